@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Tiny timing helpers shared by the benchmarks, see ./bench.
+
+typedef struct {
+   u64 ns;
+   u64 cycles;
+} BenchTime;
+
+static u64 bench_now_ns(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static u64 bench_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+   return __rdtsc();
+#else
+   return 0;
+#endif
+}
+
+static BenchTime bench_start(void) {
+   return (BenchTime){bench_now_ns(), bench_cycles()};
+}
+
+static BenchTime bench_elapsed(BenchTime start) {
+   return (BenchTime){bench_now_ns() - start.ns, bench_cycles() - start.cycles};
+}
+
+// Keeps the compiler from throwing away results that are otherwise unused.
+static void bench_use(const void* p) {
+   __asm__ volatile("" : : "r"(p) : "memory");
+}
+
+static void bench_report_ops(const char* name, BenchTime t, Size ops) {
+   printf("%-40s %10.2f ns/op %10.2f cycles/op %12.0f ops/s\n", name, (double)t.ns / (double)ops, (double)t.cycles / (double)ops, (double)ops * 1e9 / (double)t.ns);
+}
+
+static void bench_report_bytes(const char* name, BenchTime t, Size bytes) {
+   printf("%-40s %10.3f bytes/cycle %10.2f GB/s\n", name, t.cycles ? (double)bytes / (double)t.cycles : 0.0, (double)bytes / (double)t.ns);
+}
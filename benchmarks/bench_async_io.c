@@ -0,0 +1,128 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "async_io.h"
+#include "bench.h"
+
+// Reads one big file in fixed chunks at different queue depths. The page cache is dropped
+// before every run, so this measures the disk and not memcpy. Pass a path to read an existing
+// file instead of the generated one.
+
+#define FILE_SIZE MB(64)
+
+static void make_file(const char* path) {
+   int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) {
+      fprintf(stderr, "failed to create %s\n", path);
+      exit(EXIT_FAILURE);
+   }
+   u8* block = malloc(MB(1));
+   for (Size i = 0; i < MB(1); i++) block[i] = (u8)(i * 31);
+   for (Size written = 0; written < FILE_SIZE; written += MB(1)) {
+      if (write(fd, block, MB(1)) != MB(1)) {
+         fprintf(stderr, "failed to write %s\n", path);
+         exit(EXIT_FAILURE);
+      }
+   }
+   fsync(fd);
+   close(fd);
+   free(block);
+}
+
+static void drop_cache(int fd) {
+   posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+static void run(const char* path, Size file_size, Size chunk, u32 depth, bool force_threads) {
+   AsyncIo io;
+   if (!async_io_init(&io, depth, force_threads)) {
+      fprintf(stderr, "failed to start async io\n");
+      exit(EXIT_FAILURE);
+   }
+   if (!force_threads && io.backend != ASYNC_IO_BACKEND_URING) {
+      async_io_destroy(&io);
+      return;
+   }
+
+   int fd = open(path, O_RDONLY);
+   drop_cache(fd);
+   u8* dst = malloc((size_t)file_size);
+
+   BenchTime t = bench_start();
+   Size offset = 0;
+   Size bytes = 0;
+   AsyncIoCompletion done[64];
+   while (offset < file_size || io.in_flight) {
+      while (offset < file_size) {
+         Size length = file_size - offset < chunk ? file_size - offset : chunk;
+         if (!async_io_read(&io, fd, offset, dst + offset, length, 0)) break;
+         offset += length;
+      }
+      async_io_submit(&io);
+      Size count = async_io_wait(&io, done, lengthof(done));
+      for (Size i = 0; i < count; i++) bytes += done[i].bytes;
+   }
+   BenchTime elapsed = bench_elapsed(t);
+
+   char name[64];
+   snprintf(name, sizeof(name), "%s %4zdK qd %2u", async_io_backend_name(&io), chunk / KB(1), depth);
+   bench_report_bytes(name, elapsed, bytes);
+
+   bench_use(dst);
+   free(dst);
+   close(fd);
+   async_io_destroy(&io);
+}
+
+static void run_pread(const char* path, Size file_size, Size chunk) {
+   int fd = open(path, O_RDONLY);
+   drop_cache(fd);
+   u8* dst = malloc((size_t)file_size);
+
+   BenchTime t = bench_start();
+   Size bytes = 0;
+   for (Size offset = 0; offset < file_size; offset += chunk) {
+      Size length = file_size - offset < chunk ? file_size - offset : chunk;
+      ssize_t n = pread(fd, dst + offset, (size_t)length, offset);
+      if (n > 0) bytes += n;
+   }
+   BenchTime elapsed = bench_elapsed(t);
+
+   char name[64];
+   snprintf(name, sizeof(name), "pread %4zdK", chunk / KB(1));
+   bench_report_bytes(name, elapsed, bytes);
+
+   bench_use(dst);
+   free(dst);
+   close(fd);
+}
+
+int main(int argc, char** argv) {
+   const char* path = argc > 1 ? argv[1] : "benchmarks/bin/async_io.dat";
+   if (argc <= 1) make_file(path);
+
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      fprintf(stderr, "failed to open %s\n", path);
+      return EXIT_FAILURE;
+   }
+   Size file_size = lseek(fd, 0, SEEK_END);
+   close(fd);
+   printf("%zd bytes from %s\n", file_size, path);
+
+   Size chunks[] = {KB(64), MB(1)};
+   u32 depths[] = {1, 4, 16, 64};
+   for (Size c = 0; c < lengthof(chunks); c++) {
+      run_pread(path, file_size, chunks[c]);
+      for (Size d = 0; d < lengthof(depths); d++) {
+         run(path, file_size, chunks[c], depths[d], false);
+         run(path, file_size, chunks[c], depths[d], true);
+      }
+   }
+
+   if (argc <= 1) unlink(path);
+   return 0;
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "hashmap.h"
+#include "memory.h"
+
+HASHMAP_DEFINE(u64_map, u64, u64, hash_u64, hash_eq_u64)
+HASHMAP_DEFINE(string_map, String, u32, hash_string, hash_eq_string)
+
+// The chained map is the obvious thing to write otherwise, a bucket array of linked nodes from
+// a pool using the same hash so only the table layout differs.
+
+typedef struct ChainNode {
+   struct ChainNode* next;
+   u64 key;
+   u64 value;
+} ChainNode;
+
+typedef struct {
+   ChainNode** buckets;
+   Size bucket_count;
+   Size length;
+   Pool nodes;
+} ChainMap;
+
+static ChainMap chain_init(void) {
+   ChainMap m = {0};
+   m.bucket_count = 16;
+   m.buckets = calloc(m.bucket_count, sizeof(ChainNode*));
+   m.nodes = pool_init(KB(64), stdlib_allocator());
+   return m;
+}
+
+static void chain_destroy(ChainMap* m) {
+   free(m->buckets);
+   pool_destroy(&m->nodes);
+}
+
+static void chain_rehash(ChainMap* m) {
+   Size count = m->bucket_count * 2;
+   ChainNode** buckets = calloc(count, sizeof(ChainNode*));
+   for (Size i = 0; i < m->bucket_count; i++) {
+      ChainNode* n = m->buckets[i];
+      while (n) {
+         ChainNode* next = n->next;
+         Size b = (Size)(hash_u64(&n->key) & (u64)(count - 1));
+         n->next = buckets[b];
+         buckets[b] = n;
+         n = next;
+      }
+   }
+   free(m->buckets);
+   m->buckets = buckets;
+   m->bucket_count = count;
+}
+
+static void chain_put(ChainMap* m, u64 key, u64 value) {
+   Size b = (Size)(hash_u64(&key) & (u64)(m->bucket_count - 1));
+   for (ChainNode* n = m->buckets[b]; n; n = n->next) {
+      if (n->key == key) {
+         n->value = value;
+         return;
+      }
+   }
+   if (m->length + 1 > m->bucket_count) {
+      chain_rehash(m);
+      b = (Size)(hash_u64(&key) & (u64)(m->bucket_count - 1));
+   }
+   ChainNode* n = pool_alloc(&m->nodes, sizeof(ChainNode));
+   n->key = key;
+   n->value = value;
+   n->next = m->buckets[b];
+   m->buckets[b] = n;
+   m->length++;
+}
+
+static u64* chain_get(ChainMap* m, u64 key) {
+   Size b = (Size)(hash_u64(&key) & (u64)(m->bucket_count - 1));
+   for (ChainNode* n = m->buckets[b]; n; n = n->next) {
+      if (n->key == key) return &n->value;
+   }
+   return nullptr;
+}
+
+static u64 xorshift(u64* s) {
+   *s ^= *s << 13;
+   *s ^= *s >> 7;
+   *s ^= *s << 17;
+   return *s;
+}
+
+static void bench_u64(Size count) {
+   Allocator a = stdlib_allocator();
+   u64* keys = malloc((size_t)count * sizeof(u64));
+   u64 seed = 0x9e3779b97f4a7c15ull;
+   u64* lookups = malloc((size_t)count * sizeof(u64));
+   for (Size i = 0; i < count; i++) keys[i] = xorshift(&seed);
+
+   // look up in a different order than inserted, otherwise the chained nodes come out of the
+   // pool in sequence and the prefetcher hides the pointer chasing
+   memcpy(lookups, keys, (size_t)count * sizeof(u64));
+   for (Size i = count - 1; i > 0; i--) {
+      Size j = (Size)(xorshift(&seed) % (u64)(i + 1));
+      u64 tmp = lookups[i];
+      lookups[i] = lookups[j];
+      lookups[j] = tmp;
+   }
+
+   printf("u64 keys, %td entries\n", count);
+
+   HashMap m = u64_map_init(&a);
+   BenchTime t = bench_start();
+   for (Size i = 0; i < count; i++) u64_map_put(&m, keys[i], keys[i]);
+   bench_report_ops("   swiss insert", bench_elapsed(t), count);
+
+   t = bench_start();
+   u64 sum = 0;
+   for (Size i = 0; i < count; i++) sum += *u64_map_get(&m, lookups[i]);
+   bench_report_ops("   swiss lookup hit", bench_elapsed(t), count);
+
+   t = bench_start();
+   for (Size i = 0; i < count; i++) sum += u64_map_get(&m, keys[i] + 1) != nullptr;
+   bench_report_ops("   swiss lookup miss", bench_elapsed(t), count);
+
+   // same map through the type erased interface
+   t = bench_start();
+   for (Size i = 0; i < count; i++) sum += *(u64*)hashmap_get(&m, &lookups[i]);
+   bench_report_ops("   swiss lookup hit (generic)", bench_elapsed(t), count);
+   hashmap_destroy(&m);
+
+   ChainMap c = chain_init();
+   t = bench_start();
+   for (Size i = 0; i < count; i++) chain_put(&c, keys[i], keys[i]);
+   bench_report_ops("   chained insert", bench_elapsed(t), count);
+
+   t = bench_start();
+   for (Size i = 0; i < count; i++) sum += *chain_get(&c, lookups[i]);
+   bench_report_ops("   chained lookup hit", bench_elapsed(t), count);
+
+   t = bench_start();
+   for (Size i = 0; i < count; i++) sum += chain_get(&c, keys[i] + 1) != nullptr;
+   bench_report_ops("   chained lookup miss", bench_elapsed(t), count);
+   chain_destroy(&c);
+
+   bench_use(&sum);
+   free(lookups);
+   free(keys);
+}
+
+static void bench_strings(Size count) {
+   Allocator a = stdlib_allocator();
+   char* text = malloc((size_t)count * 24);
+   String* keys = malloc((size_t)count * sizeof(String));
+   for (Size i = 0; i < count; i++) {
+      int n = snprintf(text + i * 24, 24, "assets/mesh_%td.obj", i);
+      keys[i] = (String){.length = (size_t)n, .data = text + i * 24};
+   }
+
+   printf("String keys, %td entries\n", count);
+   HashMap m = string_map_init(&a);
+   BenchTime t = bench_start();
+   for (Size i = 0; i < count; i++) string_map_put(&m, keys[i], (u32)i);
+   bench_report_ops("   swiss insert", bench_elapsed(t), count);
+
+   t = bench_start();
+   u64 sum = 0;
+   for (Size i = 0; i < count; i++) sum += *string_map_get(&m, keys[i]);
+   bench_report_ops("   swiss lookup hit", bench_elapsed(t), count);
+
+   bench_use(&sum);
+   hashmap_destroy(&m);
+   free(keys);
+   free(text);
+}
+
+int main(void) {
+   bench_u64(1000);
+   bench_u64(100000);
+   bench_u64(4000000);
+   bench_strings(100000);
+   return 0;
+}
@@ -0,0 +1,107 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "pack.h"
+#include "shaders.h"
+
+// What loading the pipeline's shaders costs at startup: the embedded copies against reading the
+// .spv files or an asset pack, cold (page cache dropped) and warm.
+
+static const char* names[] = {"vert", "frag"};
+
+static void drop_cache(const char* path) {
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) return;
+   posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+   close(fd);
+}
+
+static void drop_shader_files(void) {
+   for (Size i = 0; i < lengthof(names); i++) {
+      char path[256];
+      snprintf(path, sizeof(path), SHADER_DEFAULT_DIR "/%s.spv", names[i]);
+      drop_cache(path);
+   }
+}
+
+static void load_all(ShaderSource expected) {
+   for (Size i = 0; i < lengthof(names); i++) {
+      ShaderResult shader = shader_load(names[i]);
+      if (!shader.ok || shader.value.source != expected) {
+         fprintf(stderr, "failed to load %s from %s\n", names[i], shader_source_name(expected));
+         exit(EXIT_FAILURE);
+      }
+      bench_use(shader.value.code);
+      shader_unload(&shader.value);
+   }
+}
+
+static void bench_source(const char* name, const char* override, ShaderSource expected, bool cold, Size runs) {
+   u64 total = 0;
+   u64 cycles = 0;
+   for (Size r = 0; r < runs; r++) {
+      if (cold) {
+         drop_shader_files();
+         if (override) drop_cache(override);
+      }
+      // opening the override is part of startup too
+      BenchTime t = bench_start();
+      if (override && !shaders_override(override)) {
+         fprintf(stderr, "failed to open %s\n", override);
+         exit(EXIT_FAILURE);
+      }
+      load_all(expected);
+      BenchTime elapsed = bench_elapsed(t);
+      shaders_override(nullptr);
+      total += elapsed.ns;
+      cycles += elapsed.cycles;
+   }
+   bench_report_ops(name, (BenchTime){total, cycles}, runs);
+}
+
+int main(void) {
+   // a pack of the same shaders, the way ./pack lays them out
+   const char* pack_path = "benchmarks/bin/shaders.pack";
+   PackInput inputs[lengthof(names)];
+   MappedFile files[lengthof(names)];
+   char entry_names[lengthof(names)][64];
+   for (Size i = 0; i < lengthof(names); i++) {
+      char path[256];
+      snprintf(path, sizeof(path), SHADER_DEFAULT_DIR "/%s.spv", names[i]);
+      MappedFileResult mapped = map_file(path, FILE_ADVICE_NORMAL);
+      if (!mapped.ok) {
+         fprintf(stderr, "failed to open %s, run from the repository root\n", path);
+         return EXIT_FAILURE;
+      }
+      files[i] = mapped.value;
+      snprintf(entry_names[i], sizeof(entry_names[i]), "shaders/%s.spv", names[i]);
+      inputs[i] = (PackInput){entry_names[i], files[i].data, files[i].length};
+   }
+   Allocator allocator = stdlib_allocator();
+   if (!pack_write(pack_path, inputs, lengthof(inputs), false, &allocator)) {
+      fprintf(stderr, "failed to write %s\n", pack_path);
+      return EXIT_FAILURE;
+   }
+
+   ShaderResult probe = shader_load("vert");
+   bool embedded = probe.ok && probe.value.source == SHADER_SOURCE_EMBEDDED;
+   shader_unload(&probe.value);
+   if (embedded) {
+      bench_source("embedded", nullptr, SHADER_SOURCE_EMBEDDED, false, 1000);
+   } else {
+      printf("compiler has no #embed, skipping the embedded run\n");
+   }
+   bench_source("files warm", SHADER_DEFAULT_DIR, SHADER_SOURCE_FILE, false, 1000);
+   bench_source("files cold", SHADER_DEFAULT_DIR, SHADER_SOURCE_FILE, true, 20);
+   bench_source("pack warm", pack_path, SHADER_SOURCE_PACK, false, 1000);
+   bench_source("pack cold", pack_path, SHADER_SOURCE_PACK, true, 20);
+
+   for (Size i = 0; i < lengthof(names); i++) {
+      unmap_file(&files[i]);
+   }
+   unlink(pack_path);
+   return 0;
+}
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "str.h"
+
+// The byte at a time versions str.h used to have, kept here as the baseline.
+
+static size_t scalar_find_char(String s, char c) {
+   size_t i = 0;
+   for (i = 0; (i < s.length) && (s.data[i] != c); i++) {}
+   return i;
+}
+
+static int scalar_count_char(String s, char c) {
+   int count = 0;
+   for (size_t i = 0; i < s.length; i++) {
+      if (s.data[i] == c) count++;
+   }
+   return count;
+}
+
+static bool scalar_eq(String* a, String* b) {
+   if (a->length != b->length) return false;
+   for (size_t i = 0; i < a->length; i++) {
+      if (a->data[i] != b->data[i]) return false;
+   }
+   return true;
+}
+
+static double copy_strtod(String s) {
+   char buf[s.length + 1];
+   memcpy(buf, s.data, s.length);
+   buf[s.length] = 0;
+   return strtod(buf, NULL);
+}
+
+static u64 xorshift(u64* s) {
+   *s ^= *s << 13;
+   *s ^= *s >> 7;
+   *s ^= *s << 17;
+   return *s;
+}
+
+// Something shaped like an OBJ file: short lines of floats.
+static String make_obj_text(Size lines, u64* seed) {
+   Size capacity = lines * 48;
+   char* text = malloc((size_t)capacity);
+   Size length = 0;
+   for (Size i = 0; i < lines; i++) {
+      double x = (double)(xorshift(seed) % 2000000) / 1000000.0 - 1.0;
+      double y = (double)(xorshift(seed) % 2000000) / 1000000.0 - 1.0;
+      double z = (double)(xorshift(seed) % 2000000) / 1000000.0 - 1.0;
+      length += snprintf(text + length, (size_t)(capacity - length), "v %.6f %.6f %.6f\n", x, y, z);
+   }
+   return str_make(text, (size_t)length);
+}
+
+static void bench_lines(String text, const char* name, bool simd) {
+   BenchTime t = bench_start();
+   Size lines = 0;
+   for (int r = 0; r < 10; r++) {
+      String in = text;
+      while (in.length) {
+         size_t i = simd ? str_find_char(in, '\n') : scalar_find_char(in, '\n');
+         size_t skip = i < in.length ? i + 1 : i;
+         in.data += skip;
+         in.length -= skip;
+         lines++;
+      }
+   }
+   bench_use(&lines);
+   bench_report_bytes(name, bench_elapsed(t), (Size)text.length * 10);
+}
+
+static void bench_long_search(String text, const char* name, int variant) {
+   BenchTime t = bench_start();
+   size_t found = 0;
+   for (int r = 0; r < 10; r++) {
+      if (variant == 0) found += scalar_find_char(text, '#');
+      if (variant == 1) found += str_find_char(text, '#');
+      if (variant == 2) found += memchr(text.data, '#', text.length) ? 1 : 0;
+   }
+   bench_use(&found);
+   bench_report_bytes(name, bench_elapsed(t), (Size)text.length * 10);
+}
+
+static void bench_count(String text, const char* name, bool simd) {
+   BenchTime t = bench_start();
+   int count = 0;
+   for (int r = 0; r < 10; r++) {
+      count += simd ? str_count_char(text, ' ') : scalar_count_char(text, ' ');
+   }
+   bench_use(&count);
+   bench_report_bytes(name, bench_elapsed(t), (Size)text.length * 10);
+}
+
+static void bench_eq(String text, const char* name, bool simd) {
+   char* copy = malloc(text.length);
+   memcpy(copy, text.data, text.length);
+   String other = str_make(copy, text.length);
+
+   BenchTime t = bench_start();
+   int equal = 0;
+   for (int r = 0; r < 10; r++) {
+      equal += simd ? str_eq(&text, &other) : scalar_eq(&text, &other);
+   }
+   bench_use(&equal);
+   bench_report_bytes(name, bench_elapsed(t), (Size)text.length * 10);
+   free(copy);
+}
+
+static void bench_floats(String text, const char* name, int variant) {
+   BenchTime t = bench_start();
+   double sum = 0.0;
+   Size count = 0;
+   String in = text;
+   while (in.length) {
+      String line = str_chop_delim(&in, '\n');
+      str_chop_delim(&line, ' ');
+      while (line.length) {
+         String field = str_chop_delim(&line, ' ');
+         if (variant == 0) {
+            sum += copy_strtod(field);
+         } else if (variant == 1) {
+            double v;
+            str_parse_f64(field, &v);
+            sum += v;
+         } else {
+            float v;
+            str_parse_f32(field, &v);
+            sum += (double)v;
+         }
+         count++;
+      }
+   }
+   bench_use(&sum);
+   BenchTime elapsed = bench_elapsed(t);
+   bench_report_bytes(name, elapsed, (Size)text.length);
+   bench_report_ops("", elapsed, count);
+}
+
+int main(void) {
+   u64 seed = 0x9e3779b97f4a7c15ull;
+   String text = make_obj_text(1000000, &seed);
+   printf("%zu bytes of OBJ style text\n", text.length);
+
+   bench_lines(text, "line split scalar", false);
+   bench_lines(text, "line split str_find_char", true);
+   bench_long_search(text, "long search scalar", 0);
+   bench_long_search(text, "long search str_find_char", 1);
+   bench_long_search(text, "long search memchr", 2);
+   bench_count(text, "count scalar", false);
+   bench_count(text, "count str_count_char", true);
+   bench_eq(text, "eq scalar", false);
+   bench_eq(text, "eq str_eq", true);
+   bench_floats(text, "floats copy + strtod", 0);
+   bench_floats(text, "floats str_parse_f64", 1);
+   bench_floats(text, "floats str_parse_f32", 2);
+
+   free(text.data);
+   return 0;
+}
@@ -0,0 +1,29 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+struct ObjectData {
+   mat4 model;
+   mat4 view;
+   mat4 proj;
+};
+
+// every frame's object buffer is an entry of one update-after-bind array
+layout(set = 0, binding = 0) readonly buffer ObjectBuffer {
+   ObjectData objects[];
+} objectBuffers[];
+
+layout(push_constant) uniform DrawData {
+   uint buffer;
+   uint object;
+} draw;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColour;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    ObjectData object = objectBuffers[draw.buffer].objects[draw.object];
+    gl_Position = object.proj * object.view * object.model * vec4(inPosition, 0.0, 1.0);
+    fragColor = inColour;
+}
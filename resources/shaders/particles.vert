@@ -0,0 +1,15 @@
+#version 450
+
+layout(push_constant) uniform Camera {
+   mat4 viewProj;
+} camera;
+
+layout(location = 0) in vec4 inPoint; // xyz position, w speed
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    gl_Position = camera.viewProj * vec4(inPoint.xyz, 1.0);
+    gl_PointSize = 1.0;
+    fragColor = mix(vec3(0.2, 0.3, 1.0), vec3(1.0, 0.6, 0.2), clamp(inPoint.w, 0.0, 1.0));
+}
@@ -0,0 +1,438 @@
+#include "async_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "memory.h"
+
+#define ASYNC_IO_THREAD_COUNT 4
+
+// request slots
+
+static u32 async_io_take_request(AsyncIo* io) {
+   return io->free_requests[--io->free_count];
+}
+
+static void async_io_release_request(AsyncIo* io, u32 index) {
+   AsyncIoRequest* r = &io->requests[index];
+   if (r->owns_fd) close(r->fd);
+   r->busy = false;
+   io->free_requests[io->free_count++] = index;
+   io->in_flight--;
+}
+
+static AsyncIoCompletion async_io_complete(AsyncIo* io, u32 index, int error) {
+   AsyncIoRequest* r = &io->requests[index];
+   AsyncIoCompletion c = {
+      .user_data = r->user_data,
+      .data = r->dst,
+      .bytes = r->done,
+      .error = error,
+   };
+   async_io_release_request(io, index);
+   return c;
+}
+
+// io_uring, driven with the raw syscalls so there is no liburing dependency
+
+static bool uring_init(AsyncIoUring* u, u32 entries) {
+   struct io_uring_params params = {0};
+   int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+   if (fd < 0) return false;
+
+   u->fd = fd;
+   u->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+   u->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+   bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+   if (single_mmap) {
+      if (u->cq_ring_size > u->sq_ring_size) u->sq_ring_size = u->cq_ring_size;
+      u->cq_ring_size = u->sq_ring_size;
+   }
+
+   u->sq_ring = mmap(nullptr, (size_t)u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+   if (u->sq_ring == MAP_FAILED) goto fail;
+
+   if (single_mmap) {
+      u->cq_ring = u->sq_ring;
+   } else {
+      u->cq_ring = mmap(nullptr, (size_t)u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (u->cq_ring == MAP_FAILED) goto fail_sq;
+   }
+
+   u->sqes = mmap(nullptr, (size_t)u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+   if (u->sqes == MAP_FAILED) goto fail_cq;
+
+   u8* sq = u->sq_ring;
+   u->sq_head = (u32*)(sq + params.sq_off.head);
+   u->sq_tail = (u32*)(sq + params.sq_off.tail);
+   u->sq_mask = (u32*)(sq + params.sq_off.ring_mask);
+   u->sq_array = (u32*)(sq + params.sq_off.array);
+
+   u8* cq = u->cq_ring;
+   u->cq_head = (u32*)(cq + params.cq_off.head);
+   u->cq_tail = (u32*)(cq + params.cq_off.tail);
+   u->cq_mask = (u32*)(cq + params.cq_off.ring_mask);
+   u->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+   return true;
+
+fail_cq:
+   if (!single_mmap) munmap(u->cq_ring, (size_t)u->cq_ring_size);
+fail_sq:
+   munmap(u->sq_ring, (size_t)u->sq_ring_size);
+fail:
+   close(fd);
+   return false;
+}
+
+static void uring_destroy(AsyncIoUring* u) {
+   munmap(u->sqes, (size_t)u->sqes_size);
+   if (u->cq_ring != u->sq_ring) munmap(u->cq_ring, (size_t)u->cq_ring_size);
+   munmap(u->sq_ring, (size_t)u->sq_ring_size);
+   close(u->fd);
+}
+
+static void uring_queue_read(AsyncIoUring* u, u32 index, AsyncIoRequest* r) {
+   u32 tail = *u->sq_tail;
+   u32 slot = tail & *u->sq_mask;
+
+   struct io_uring_sqe* sqe = &u->sqes[slot];
+   memset(sqe, 0, sizeof(*sqe));
+   sqe->opcode = IORING_OP_READ;
+   sqe->fd = r->fd;
+   sqe->addr = (u64)(uintptr)(r->dst + r->done);
+   // a single read is capped at 2 GiB by the kernel, the rest is resubmitted on completion
+   Size remaining = r->length - r->done;
+   sqe->len = (u32)(remaining > 0x7ffff000 ? 0x7ffff000 : remaining);
+   sqe->off = (u64)(r->offset + r->done);
+   sqe->user_data = index;
+
+   u->sq_array[slot] = slot;
+   __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+   u->sq_pending++;
+}
+
+// Returns 0 or the errno of a failure that retrying won't fix. After one the ring is left alone,
+// uring_poll fails every request still in flight with it.
+static int uring_submit(AsyncIoUring* u, u32 min_complete) {
+   if (u->error) return u->error;
+
+   u32 flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+   while (u->sq_pending || min_complete) {
+      int submitted = (int)syscall(__NR_io_uring_enter, u->fd, u->sq_pending, min_complete, flags, nullptr, 0);
+      if (submitted < 0) {
+         if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+         u->error = errno;
+         u->sq_pending = 0;
+         fprintf(stderr, "io_uring_enter failed: %s\n", strerror(u->error));
+         return u->error;
+      }
+      u->sq_pending -= (u32)submitted;
+      min_complete = 0;
+      flags = 0;
+   }
+   return 0;
+}
+
+// Completions the kernel might still post would name slots that have been reused by then, so
+// the completion queue isn't read any more either.
+static Size uring_fail(AsyncIo* io, AsyncIoCompletion* out, Size max) {
+   Size count = 0;
+   for (u32 i = 0; i < io->queue_depth && count < max; i++) {
+      AsyncIoRequest* r = &io->requests[i];
+      if (!r->busy) continue;
+      r->error = io->uring.error;
+      out[count++] = async_io_complete(io, i, r->error);
+   }
+   return count;
+}
+
+static Size uring_poll(AsyncIo* io, AsyncIoCompletion* out, Size max) {
+   AsyncIoUring* u = &io->uring;
+   if (u->error) return uring_fail(io, out, max);
+   Size count = 0;
+   bool requeued = false;
+
+   u32 head = *u->cq_head;
+   u32 tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+   while (head != tail && count < max) {
+      struct io_uring_cqe* cqe = &u->cqes[head & *u->cq_mask];
+      u32 index = (u32)cqe->user_data;
+      AsyncIoRequest* r = &io->requests[index];
+      head++;
+
+      if (cqe->res < 0) {
+         out[count++] = async_io_complete(io, index, -cqe->res);
+         continue;
+      }
+
+      r->done += cqe->res;
+      if (cqe->res == 0 || r->done == r->length) {
+         out[count++] = async_io_complete(io, index, 0);
+      } else {
+         // short read, go again for the rest
+         uring_queue_read(u, index, r);
+         requeued = true;
+      }
+   }
+   __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+   if (requeued && uring_submit(u, 0) != 0) count += uring_fail(io, out + count, max - count);
+   return count;
+}
+
+// thread pool fallback
+
+static void* async_io_worker(void* arg) {
+   AsyncIo* io = arg;
+   AsyncIoThreads* t = &io->threads;
+
+   pthread_mutex_lock(&t->lock);
+   for (;;) {
+      while (!t->quit && t->queued_count - t->unsubmitted == 0) {
+         pthread_cond_wait(&t->work, &t->lock);
+      }
+      if (t->quit) break;
+
+      u32 index = t->queued[t->queued_head];
+      t->queued_head = (t->queued_head + 1) % io->queue_depth;
+      t->queued_count--;
+      pthread_mutex_unlock(&t->lock);
+
+      AsyncIoRequest* r = &io->requests[index];
+      while (r->done < r->length) {
+         ssize_t n = pread(r->fd, r->dst + r->done, (size_t)(r->length - r->done), (off_t)(r->offset + r->done));
+         if (n < 0) {
+            if (errno == EINTR) continue;
+            r->error = errno;
+            break;
+         }
+         if (n == 0) break;
+         r->done += n;
+      }
+      pthread_mutex_lock(&t->lock);
+      t->completed[(t->completed_head + t->completed_count) % io->queue_depth] = index;
+      t->completed_count++;
+      pthread_cond_signal(&t->done);
+   }
+   pthread_mutex_unlock(&t->lock);
+   return nullptr;
+}
+
+static bool threads_init(AsyncIo* io) {
+   AsyncIoThreads* t = &io->threads;
+   t->queued = calloc(io->queue_depth, sizeof(u32));
+   t->completed = calloc(io->queue_depth, sizeof(u32));
+   t->thread_count = io->queue_depth < ASYNC_IO_THREAD_COUNT ? io->queue_depth : ASYNC_IO_THREAD_COUNT;
+   t->threads = calloc((size_t)t->thread_count, sizeof(pthread_t));
+   if (!t->queued || !t->completed || !t->threads) return false;
+
+   pthread_mutex_init(&t->lock, nullptr);
+   pthread_cond_init(&t->work, nullptr);
+   pthread_cond_init(&t->done, nullptr);
+
+   for (Size i = 0; i < t->thread_count; i++) {
+      if (pthread_create(&t->threads[i], nullptr, async_io_worker, io) != 0) {
+         t->thread_count = i;
+         return i > 0;
+      }
+   }
+   return true;
+}
+
+static void threads_destroy(AsyncIoThreads* t) {
+   pthread_mutex_lock(&t->lock);
+   t->quit = true;
+   pthread_cond_broadcast(&t->work);
+   pthread_mutex_unlock(&t->lock);
+
+   for (Size i = 0; i < t->thread_count; i++) {
+      pthread_join(t->threads[i], nullptr);
+   }
+
+   pthread_cond_destroy(&t->done);
+   pthread_cond_destroy(&t->work);
+   pthread_mutex_destroy(&t->lock);
+   free(t->threads);
+   free(t->completed);
+   free(t->queued);
+}
+
+// Must be called with the lock held.
+static Size threads_drain(AsyncIo* io, AsyncIoCompletion* out, Size max) {
+   AsyncIoThreads* t = &io->threads;
+   Size count = 0;
+   while (t->completed_count && count < max) {
+      u32 index = t->completed[t->completed_head];
+      t->completed_head = (t->completed_head + 1) % io->queue_depth;
+      t->completed_count--;
+
+      out[count++] = async_io_complete(io, index, io->requests[index].error);
+   }
+   return count;
+}
+
+// api
+
+bool async_io_init(AsyncIo* io, u32 queue_depth, bool force_threads) {
+   memset(io, 0, sizeof(*io));
+
+   // io_uring wants a power of 2
+   u32 depth = 1;
+   while (depth < queue_depth) depth <<= 1;
+   io->queue_depth = depth;
+
+   io->requests = calloc(depth, sizeof(AsyncIoRequest));
+   io->free_requests = calloc(depth, sizeof(u32));
+   if (!io->requests || !io->free_requests) return false;
+   for (u32 i = 0; i < depth; i++) {
+      io->free_requests[i] = depth - 1 - i;
+   }
+   io->free_count = depth;
+
+   if (!force_threads && uring_init(&io->uring, depth)) {
+      io->backend = ASYNC_IO_BACKEND_URING;
+      return true;
+   }
+
+   io->backend = ASYNC_IO_BACKEND_THREADS;
+   return threads_init(io);
+}
+
+void async_io_destroy(AsyncIo* io) {
+   // let everything in flight land before the memory goes away
+   AsyncIoCompletion scratch[16];
+   while (io->in_flight) {
+      async_io_submit(io);
+      async_io_wait(io, scratch, lengthof(scratch));
+   }
+
+   if (io->backend == ASYNC_IO_BACKEND_URING) {
+      uring_destroy(&io->uring);
+   } else {
+      threads_destroy(&io->threads);
+   }
+   free(io->free_requests);
+   free(io->requests);
+}
+
+const char* async_io_backend_name(AsyncIo* io) {
+   return io->backend == ASYNC_IO_BACKEND_URING ? "io_uring" : "threads";
+}
+
+static bool async_io_queue(AsyncIo* io, int fd, bool owns_fd, Size offset, void* dst, Size length, u64 user_data) {
+   if (io->free_count == 0) return false;
+
+   u32 index = async_io_take_request(io);
+   AsyncIoRequest* r = &io->requests[index];
+   *r = (AsyncIoRequest){
+      .fd = fd,
+      .owns_fd = owns_fd,
+      .dst = dst,
+      .offset = offset,
+      .length = length,
+      .user_data = user_data,
+      .busy = true,
+   };
+   io->in_flight++;
+
+   if (io->backend == ASYNC_IO_BACKEND_URING) {
+      uring_queue_read(&io->uring, index, r);
+   } else {
+      AsyncIoThreads* t = &io->threads;
+      pthread_mutex_lock(&t->lock);
+      t->queued[(t->queued_head + t->queued_count) % io->queue_depth] = index;
+      t->queued_count++;
+      t->unsubmitted++;
+      pthread_mutex_unlock(&t->lock);
+   }
+   return true;
+}
+
+bool async_io_read(AsyncIo* io, int fd, Size offset, void* dst, Size length, u64 user_data) {
+   return async_io_queue(io, fd, false, offset, dst, length, user_data);
+}
+
+bool async_io_read_file(AsyncIo* io, const char* path, Allocator* allocator, u64 user_data) {
+   if (io->free_count == 0) return false;
+
+   int fd = open(path, O_RDONLY | O_CLOEXEC);
+   if (fd < 0) return false;
+
+   struct stat st;
+   if (fstat(fd, &st) != 0) {
+      close(fd);
+      return false;
+   }
+
+   Size length = (Size)st.st_size;
+   void* dst = allocator->alloc(length, allocator->ctx);
+   if (!dst && length > 0) {
+      close(fd);
+      return false;
+   }
+
+   posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+   return async_io_queue(io, fd, true, 0, dst, length, user_data);
+}
+
+void async_io_submit(AsyncIo* io) {
+   if (io->backend == ASYNC_IO_BACKEND_URING) {
+      uring_submit(&io->uring, 0);
+   } else {
+      AsyncIoThreads* t = &io->threads;
+      pthread_mutex_lock(&t->lock);
+      if (t->unsubmitted) {
+         t->unsubmitted = 0;
+         pthread_cond_broadcast(&t->work);
+      }
+      pthread_mutex_unlock(&t->lock);
+   }
+}
+
+Size async_io_poll(AsyncIo* io, AsyncIoCompletion* out, Size max) {
+   if (io->in_flight == 0) return 0;
+
+   if (io->backend == ASYNC_IO_BACKEND_URING) {
+      return uring_poll(io, out, max);
+   }
+
+   AsyncIoThreads* t = &io->threads;
+   // someone else holding the lock is a worker, don't wait on it
+   if (pthread_mutex_trylock(&t->lock) != 0) return 0;
+   Size count = threads_drain(io, out, max);
+   pthread_mutex_unlock(&t->lock);
+   return count;
+}
+
+Size async_io_wait(AsyncIo* io, AsyncIoCompletion* out, Size max) {
+   if (io->in_flight == 0) return 0;
+
+   if (io->backend == ASYNC_IO_BACKEND_URING) {
+      // a failed submit leaves the requests to uring_poll, which fails them all
+      Size count = uring_poll(io, out, max);
+      while (count == 0 && io->in_flight) {
+         uring_submit(&io->uring, 1);
+         count = uring_poll(io, out, max);
+      }
+      return count;
+   }
+
+   AsyncIoThreads* t = &io->threads;
+   pthread_mutex_lock(&t->lock);
+   while (t->completed_count == 0) {
+      pthread_cond_wait(&t->done, &t->lock);
+   }
+   Size count = threads_drain(io, out, max);
+   pthread_mutex_unlock(&t->lock);
+   return count;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "memory.h"
+
+// Asynchronous reads.
+//
+// Reads are queued with async_io_read, handed to the kernel in one go by async_io_submit and
+// come back through async_io_poll, which never blocks so the frame loop can drain it every
+// frame. io_uring is used when the kernel allows it, otherwise a small pool of threads doing
+// pread. Data lands directly in the memory the caller passes in.
+
+typedef enum {
+   ASYNC_IO_BACKEND_URING,
+   ASYNC_IO_BACKEND_THREADS,
+} AsyncIoBackend;
+
+typedef struct {
+   u64 user_data;
+   void* data;
+   Size bytes;
+   int error; // errno value, 0 on success
+} AsyncIoCompletion;
+
+typedef struct {
+   int fd;
+   bool owns_fd;
+   u8* dst;
+   Size offset;
+   Size length;
+   Size done;
+   u64 user_data;
+   int error;
+   bool busy;
+} AsyncIoRequest;
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+typedef struct {
+   int fd;
+   u32* sq_head;
+   u32* sq_tail;
+   u32* sq_mask;
+   u32* sq_array;
+   struct io_uring_sqe* sqes;
+   u32 sq_pending;
+   int error; // io_uring_enter failed for good, every request left fails with it
+
+   u32* cq_head;
+   u32* cq_tail;
+   u32* cq_mask;
+   struct io_uring_cqe* cqes;
+
+   void* sq_ring;
+   Size sq_ring_size;
+   void* cq_ring;
+   Size cq_ring_size;
+   Size sqes_size;
+} AsyncIoUring;
+
+typedef struct {
+   pthread_t* threads;
+   Size thread_count;
+   pthread_mutex_t lock;
+   pthread_cond_t work;
+   pthread_cond_t done;
+   bool quit;
+
+   // rings of request indices, both sized to the queue depth
+   u32* queued;
+   Size queued_head;
+   Size queued_count;
+   Size unsubmitted;
+
+   u32* completed;
+   Size completed_head;
+   Size completed_count;
+} AsyncIoThreads;
+
+typedef struct {
+   AsyncIoBackend backend;
+   u32 queue_depth;
+
+   AsyncIoRequest* requests;
+   u32* free_requests;
+   u32 free_count;
+   u32 in_flight;
+
+   AsyncIoUring uring;
+   AsyncIoThreads threads;
+} AsyncIo;
+
+// Returns false if neither backend could be started. force_threads skips io_uring.
+bool async_io_init(AsyncIo* io, u32 queue_depth, bool force_threads);
+void async_io_destroy(AsyncIo* io);
+
+const char* async_io_backend_name(AsyncIo* io);
+
+// Queue a read of length bytes at offset. Returns false when queue_depth reads are already
+// in flight, poll for completions and try again.
+bool async_io_read(AsyncIo* io, int fd, Size offset, void* dst, Size length, u64 user_data);
+
+// Opens path, allocates room for the whole file from the allocator and queues reading it. The
+// file is closed when the read completes, completion.data is the buffer.
+bool async_io_read_file(AsyncIo* io, const char* path, Allocator* allocator, u64 user_data);
+
+// Hands everything queued since the last submit to the backend.
+void async_io_submit(AsyncIo* io);
+
+// Fills out with up to max finished reads without blocking, returns how many.
+Size async_io_poll(AsyncIo* io, AsyncIoCompletion* out, Size max);
+
+// Same as poll but blocks until at least one read finished, if any are in flight.
+Size async_io_wait(AsyncIo* io, AsyncIoCompletion* out, Size max);
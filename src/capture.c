@@ -0,0 +1,474 @@
+#include "capture.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CAPTURE_PNG_BLOCK 65535u // most a stored deflate block holds
+#define CAPTURE_ADLER_BASE 65521u
+#define CAPTURE_ADLER_RUN 5552 // bytes before the adler sums could overflow a u32
+
+static u32 crc_table[256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void crc_table_init(void) {
+   for (u32 i = 0; i < 256; i++) {
+      u32 c = i;
+      for (u32 k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      crc_table[i] = c;
+   }
+}
+
+static void capture_put_u32(u8* out, u32 value) {
+   out[0] = (u8)(value >> 24);
+   out[1] = (u8)(value >> 16);
+   out[2] = (u8)(value >> 8);
+   out[3] = (u8)value;
+}
+
+const char* capture_format_name(CaptureFormat format) {
+   switch (format) {
+   case CAPTURE_PPM: return "ppm";
+   case CAPTURE_PNG: return "png";
+   case CAPTURE_RAW: return "raw";
+   }
+   return "unknown";
+}
+
+// scanline of 8 bit BGRA or RGBA to RGB
+static void capture_convert_row(const Capture* c, const u8* src, u8* dst) {
+   u32 r = c->bgra ? 2 : 0;
+   u32 b = c->bgra ? 0 : 2;
+   for (u32 x = 0; x < c->extent.width; x++) {
+      dst[x * 3 + 0] = src[x * 4 + r];
+      dst[x * 3 + 1] = src[x * 4 + 1];
+      dst[x * 3 + 2] = src[x * 4 + b];
+   }
+}
+
+static bool capture_write_ppm(Capture* c, const u8* pixels, FILE* file) {
+   fprintf(file, "P6\n%u %u\n255\n", c->extent.width, c->extent.height);
+   Size pitch = (Size)c->extent.width * 4;
+   for (u32 y = 0; y < c->extent.height; y++) {
+      capture_convert_row(c, pixels + y * pitch, c->row + 1);
+      fwrite(c->row + 1, 3, c->extent.width, file);
+   }
+   return ferror(file) == 0;
+}
+
+typedef struct {
+   FILE* file;
+   u32 crc;
+   u32 adler_a;
+   u32 adler_b;
+   u32 block_left;
+   u64 remaining; // deflate payload still to come
+} CapturePng;
+
+static void png_write(CapturePng* png, const u8* data, Size length) {
+   u32 crc = png->crc;
+   for (Size i = 0; i < length; i++) crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+   png->crc = crc;
+   fwrite(data, 1, (size_t)length, png->file);
+}
+
+static void png_chunk_begin(CapturePng* png, const char* type, u32 length) {
+   u8 header[4];
+   capture_put_u32(header, length);
+   fwrite(header, 1, sizeof(header), png->file);
+   png->crc = 0xffffffffu;
+   png_write(png, (const u8*)type, 4);
+}
+
+static void png_chunk_end(CapturePng* png) {
+   u8 crc[4];
+   capture_put_u32(crc, ~png->crc);
+   fwrite(crc, 1, sizeof(crc), png->file);
+}
+
+static void png_adler(CapturePng* png, const u8* data, Size length) {
+   u32 a = png->adler_a;
+   u32 b = png->adler_b;
+   while (length > 0) {
+      Size run = length < CAPTURE_ADLER_RUN ? length : CAPTURE_ADLER_RUN;
+      for (Size i = 0; i < run; i++) {
+         a += data[i];
+         b += a;
+      }
+      a %= CAPTURE_ADLER_BASE;
+      b %= CAPTURE_ADLER_BASE;
+      data += run;
+      length -= run;
+   }
+   png->adler_a = a;
+   png->adler_b = b;
+}
+
+// Uncompressed deflate, the data goes out as is behind a 5 byte header every 64 KiB.
+static void png_deflate(CapturePng* png, const u8* data, Size length) {
+   png_adler(png, data, length);
+   while (length > 0) {
+      if (png->block_left == 0) {
+         u32 size = png->remaining < CAPTURE_PNG_BLOCK ? (u32)png->remaining : CAPTURE_PNG_BLOCK;
+         u8 header[5] = {png->remaining == size, (u8)size, (u8)(size >> 8), (u8)~size, (u8)(~size >> 8)};
+         png_write(png, header, sizeof(header));
+         png->block_left = size;
+      }
+      u32 take = length < png->block_left ? (u32)length : png->block_left;
+      png_write(png, data, take);
+      data += take;
+      length -= take;
+      png->block_left -= take;
+      png->remaining -= take;
+   }
+}
+
+// The IDAT size is known up front, so rows are encoded and written one at a time without
+// holding the compressed image anywhere.
+static bool capture_write_png(Capture* c, const u8* pixels, FILE* file) {
+   static const u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+   CapturePng png = {file, 0, 1, 0, 0, 0};
+   fwrite(signature, 1, sizeof(signature), file);
+
+   u8 ihdr[13] = {0};
+   capture_put_u32(ihdr, c->extent.width);
+   capture_put_u32(ihdr + 4, c->extent.height);
+   ihdr[8] = 8; // bits per channel
+   ihdr[9] = 2; // RGB
+   png_chunk_begin(&png, "IHDR", (u32)sizeof(ihdr));
+   png_write(&png, ihdr, sizeof(ihdr));
+   png_chunk_end(&png);
+
+   Size rowBytes = 1 + (Size)c->extent.width * 3;
+   u64 raw = (u64)rowBytes * c->extent.height;
+   u64 blocks = (raw + CAPTURE_PNG_BLOCK - 1) / CAPTURE_PNG_BLOCK;
+   u64 idat = 2 + raw + blocks * 5 + 4;
+   if (idat > UINT32_MAX >> 1) return false;
+
+   png_chunk_begin(&png, "IDAT", (u32)idat);
+   static const u8 zlibHeader[2] = {0x78, 0x01};
+   png_write(&png, zlibHeader, sizeof(zlibHeader));
+   png.remaining = raw;
+
+   Size pitch = (Size)c->extent.width * 4;
+   c->row[0] = 0; // no filter
+   for (u32 y = 0; y < c->extent.height; y++) {
+      capture_convert_row(c, pixels + y * pitch, c->row + 1);
+      png_deflate(&png, c->row, rowBytes);
+   }
+   u8 adler[4];
+   capture_put_u32(adler, png.adler_b << 16 | png.adler_a);
+   png_write(&png, adler, sizeof(adler));
+   png_chunk_end(&png);
+
+   png_chunk_begin(&png, "IEND", 0);
+   png_chunk_end(&png);
+   return ferror(file) == 0;
+}
+
+static bool capture_write(Capture* c, const CaptureSlot* slot) {
+   if (c->stream) {
+      fwrite(slot->mapped, 1, (size_t)c->size, c->stream);
+      return ferror(c->stream) == 0;
+   }
+
+   char path[CAPTURE_MAX_PATH];
+   if (c->grab_path) {
+      snprintf(path, sizeof(path), "%s", c->grab_path);
+   } else {
+      snprintf(path, sizeof(path), "%s/frame_%06llu.%s", c->directory, (unsigned long long)slot->frame, capture_format_name(c->format));
+   }
+
+   FILE* file = fopen(path, "wb");
+   if (!file) return false;
+   bool ok;
+   switch (c->format) {
+   case CAPTURE_PPM: ok = capture_write_ppm(c, slot->mapped, file); break;
+   case CAPTURE_PNG: ok = capture_write_png(c, slot->mapped, file); break;
+   default:
+      fwrite(slot->mapped, 1, (size_t)c->size, file);
+      ok = ferror(file) == 0;
+      break;
+   }
+   return fclose(file) == 0 && ok;
+}
+
+static void* capture_writer(void* arg) {
+   Capture* c = arg;
+   pthread_mutex_lock(&c->lock);
+   for (;;) {
+      while (c->job_count == 0 && !c->quit) pthread_cond_wait(&c->work, &c->lock);
+      if (c->job_count == 0) break; // quitting with nothing left to write
+
+      u32 index = c->jobs[c->job_head];
+      c->job_head = (c->job_head + 1) % CAPTURE_RING_SIZE;
+      c->job_count--;
+      pthread_mutex_unlock(&c->lock);
+
+      CaptureSlot* slot = &c->slots[index];
+      bool ok = capture_write(c, slot);
+      atomic_fetch_add_explicit(ok ? &c->written : &c->failed, 1, memory_order_relaxed);
+      // done reading the mapping, the render thread may record into it again
+      atomic_store_explicit(&slot->state, CAPTURE_SLOT_FREE, memory_order_release);
+
+      pthread_mutex_lock(&c->lock);
+      c->pending--;
+      pthread_cond_signal(&c->done);
+   }
+   pthread_mutex_unlock(&c->lock);
+   return nullptr;
+}
+
+static void capture_wait_idle(Capture* c) {
+   pthread_mutex_lock(&c->lock);
+   while (c->pending > 0) pthread_cond_wait(&c->done, &c->lock);
+   pthread_mutex_unlock(&c->lock);
+}
+
+// Cached memory keeps reading the pixels back fast, it needs an invalidate when not coherent.
+static u32 capture_memory_type(Capture* c, u32 typeBits) {
+   VkPhysicalDeviceMemoryProperties memProperties;
+   vkGetPhysicalDeviceMemoryProperties(c->physical_device, &memProperties);
+
+   VkMemoryPropertyFlags preferred[] = {
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+   };
+   for (Size p = 0; p < lengthof(preferred); p++) {
+      for (u32 i = 0; i < memProperties.memoryTypeCount; i++) {
+         VkMemoryPropertyFlags flags = memProperties.memoryTypes[i].propertyFlags;
+         if ((typeBits & (1u << i)) && (flags & preferred[p]) == preferred[p]) {
+            c->coherent = flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            return i;
+         }
+      }
+   }
+   return UINT32_MAX;
+}
+
+static void capture_destroy_slots(Capture* c) {
+   for (u32 i = 0; i < CAPTURE_RING_SIZE; i++) {
+      CaptureSlot* slot = &c->slots[i];
+      if (slot->memory) vkFreeMemory(c->device, slot->memory, c->callbacks); // unmaps it too
+      if (slot->buffer) vkDestroyBuffer(c->device, slot->buffer, c->callbacks);
+      slot->buffer = VK_NULL_HANDLE;
+      slot->memory = VK_NULL_HANDLE;
+      slot->mapped = nullptr;
+      atomic_store_explicit(&slot->state, CAPTURE_SLOT_FREE, memory_order_relaxed);
+   }
+   if (c->stream) fclose(c->stream);
+   c->stream = nullptr;
+   free(c->row);
+   c->row = nullptr;
+}
+
+static VkResult capture_create_slots(Capture* c, VkExtent2D extent) {
+   c->extent = extent;
+   c->size = (VkDeviceSize)extent.width * extent.height * 4;
+   c->row = malloc(1 + (size_t)extent.width * 3);
+   if (!c->row) return VK_ERROR_OUT_OF_HOST_MEMORY;
+
+   VkBufferCreateInfo bufferInfo = {0};
+   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+   bufferInfo.size = c->size;
+   bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+   for (u32 i = 0; i < CAPTURE_RING_SIZE; i++) {
+      CaptureSlot* slot = &c->slots[i];
+      VkResult result = vkCreateBuffer(c->device, &bufferInfo, c->callbacks, &slot->buffer);
+      if (result != VK_SUCCESS) return result;
+
+      VkMemoryRequirements requirements;
+      vkGetBufferMemoryRequirements(c->device, slot->buffer, &requirements);
+
+      VkMemoryAllocateInfo allocInfo = {0};
+      allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocInfo.allocationSize = requirements.size;
+      allocInfo.memoryTypeIndex = capture_memory_type(c, requirements.memoryTypeBits);
+      if (allocInfo.memoryTypeIndex == UINT32_MAX) return VK_ERROR_FEATURE_NOT_PRESENT;
+
+      result = vkAllocateMemory(c->device, &allocInfo, c->callbacks, &slot->memory);
+      if (result != VK_SUCCESS) return result;
+      result = vkBindBufferMemory(c->device, slot->buffer, slot->memory, 0);
+      if (result != VK_SUCCESS) return result;
+
+      void* mapped = nullptr;
+      result = vkMapMemory(c->device, slot->memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+      if (result != VK_SUCCESS) return result;
+      slot->mapped = mapped;
+   }
+
+   // a stream per size, ffmpeg can't take a change of size halfway
+   if (c->format == CAPTURE_RAW && !c->grab_path) {
+      char path[CAPTURE_MAX_PATH];
+      snprintf(path, sizeof(path), "%s/capture_%ux%u_%s.raw", c->directory, extent.width, extent.height, c->bgra ? "bgra" : "rgba");
+      c->stream = fopen(path, "wb");
+      if (!c->stream) return VK_ERROR_INITIALIZATION_FAILED;
+      printf("capture: streaming %ux%u frames to %s\n", extent.width, extent.height, path);
+   }
+   return VK_SUCCESS;
+}
+
+VkResult capture_init(Capture* c, const CaptureDesc* desc) {
+   assert((desc->grab_path || desc->directory) && "Capture expected a directory or a grab path.");
+
+   *c = (Capture){0};
+   switch (desc->image_format) {
+   case VK_FORMAT_B8G8R8A8_UNORM:
+   case VK_FORMAT_B8G8R8A8_SRGB:
+      c->bgra = true;
+      break;
+   case VK_FORMAT_R8G8B8A8_UNORM:
+   case VK_FORMAT_R8G8B8A8_SRGB:
+      c->bgra = false;
+      break;
+   default:
+      return VK_ERROR_FORMAT_NOT_SUPPORTED;
+   }
+
+   pthread_once(&crc_table_once, crc_table_init);
+   c->device = desc->device;
+   c->physical_device = desc->physical_device;
+   c->callbacks = desc->callbacks;
+   c->format = desc->format;
+   c->directory = desc->directory;
+   c->grab_path = desc->grab_path;
+   c->grab_frame = desc->grab_frame;
+   atomic_init(&c->written, 0);
+   atomic_init(&c->failed, 0);
+   for (u32 i = 0; i < CAPTURE_RING_SIZE; i++) atomic_init(&c->slots[i].state, CAPTURE_SLOT_FREE);
+
+   VkResult result = capture_create_slots(c, desc->extent);
+   if (result != VK_SUCCESS) {
+      capture_destroy_slots(c);
+      *c = (Capture){0};
+      return result;
+   }
+
+   pthread_mutex_init(&c->lock, nullptr);
+   pthread_cond_init(&c->work, nullptr);
+   pthread_cond_init(&c->done, nullptr);
+   if (pthread_create(&c->thread, nullptr, capture_writer, c) != 0) {
+      pthread_cond_destroy(&c->done);
+      pthread_cond_destroy(&c->work);
+      pthread_mutex_destroy(&c->lock);
+      capture_destroy_slots(c);
+      *c = (Capture){0};
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+   return VK_SUCCESS;
+}
+
+void capture_flush(Capture* c, FrameSync* sync) {
+   capture_collect(c, sync);
+   capture_wait_idle(c);
+}
+
+void capture_destroy(Capture* c, FrameSync* sync) {
+   if (!c->device) return;
+
+   capture_collect(c, sync);
+   pthread_mutex_lock(&c->lock);
+   c->quit = true;
+   pthread_cond_broadcast(&c->work);
+   pthread_mutex_unlock(&c->lock);
+   pthread_join(c->thread, nullptr);
+
+   pthread_cond_destroy(&c->done);
+   pthread_cond_destroy(&c->work);
+   pthread_mutex_destroy(&c->lock);
+   capture_destroy_slots(c);
+   *c = (Capture){0};
+}
+
+VkResult capture_resize(Capture* c, FrameSync* sync, VkExtent2D extent) {
+   if (extent.width == c->extent.width && extent.height == c->extent.height) return VK_SUCCESS;
+
+   // the writer is idle after this, nothing else touches the slots or the stream
+   capture_flush(c, sync);
+   capture_destroy_slots(c);
+   return capture_create_slots(c, extent);
+}
+
+void capture_record(Capture* c, VkCommandBuffer commandBuffer, VkImage image, u64 frame) {
+   if (c->grab_path && frame != c->grab_frame) return;
+   if (!c->slots[0].buffer) return;
+
+   CaptureSlot* slot = nullptr;
+   for (u32 i = 0; i < CAPTURE_RING_SIZE && !slot; i++) {
+      if (atomic_load_explicit(&c->slots[i].state, memory_order_acquire) == CAPTURE_SLOT_FREE) slot = &c->slots[i];
+   }
+   if (!slot) {
+      c->dropped++;
+      return;
+   }
+
+   VkBufferImageCopy region = {0};
+   region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+   region.imageSubresource.layerCount = 1;
+   region.imageExtent = (VkExtent3D){c->extent.width, c->extent.height, 1};
+   vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+
+   // the frame's signal doesn't make the copy visible to the host on its own
+   VkBufferMemoryBarrier barrier = {0};
+   barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+   barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+   barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+   barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   barrier.buffer = slot->buffer;
+   barrier.size = VK_WHOLE_SIZE;
+   vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+   slot->frame = frame;
+   atomic_store_explicit(&slot->state, CAPTURE_SLOT_RECORDED, memory_order_relaxed);
+   c->recorded++;
+}
+
+// Oldest first, raw streams have to stay in frame order.
+void capture_collect(Capture* c, FrameSync* sync) {
+   for (;;) {
+      CaptureSlot* oldest = nullptr;
+      u32 index = 0;
+      for (u32 i = 0; i < CAPTURE_RING_SIZE; i++) {
+         CaptureSlot* slot = &c->slots[i];
+         if (atomic_load_explicit(&slot->state, memory_order_relaxed) != CAPTURE_SLOT_RECORDED) continue;
+         if (!oldest || slot->frame < oldest->frame) {
+            oldest = slot;
+            index = i;
+         }
+      }
+      if (!oldest || !frame_sync_done(sync, oldest->frame)) return;
+
+      if (!c->coherent) {
+         VkMappedMemoryRange range = {0};
+         range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+         range.memory = oldest->memory;
+         range.size = VK_WHOLE_SIZE;
+         vkInvalidateMappedMemoryRanges(c->device, 1, &range);
+      }
+
+      pthread_mutex_lock(&c->lock);
+      atomic_store_explicit(&oldest->state, CAPTURE_SLOT_WRITING, memory_order_relaxed);
+      c->jobs[(c->job_head + c->job_count) % CAPTURE_RING_SIZE] = index;
+      c->job_count++;
+      c->pending++;
+      pthread_cond_signal(&c->work);
+      pthread_mutex_unlock(&c->lock);
+
+      if (c->grab_path) c->grab_taken = true;
+   }
+}
+
+bool capture_grab_taken(const Capture* c) {
+   return c->grab_path && c->grab_taken;
+}
+
+void capture_print_stats(Capture* c, FILE* out) {
+   fprintf(out, "capture: %llu frames recorded, %llu written, %llu failed, %llu dropped with every buffer taken\n",
+           (unsigned long long)c->recorded,
+           (unsigned long long)atomic_load_explicit(&c->written, memory_order_relaxed),
+           (unsigned long long)atomic_load_explicit(&c->failed, memory_order_relaxed),
+           (unsigned long long)c->dropped);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+#include "frame_sync.h"
+
+// Frame capture.
+//
+// The frame's swapchain image is copied into one of a ring of host visible buffers at the end
+// of its command buffer. Nothing waits for the copy, the buffer is picked up frames later once
+// frame_sync says the frame is done, and handed to a writer thread that encodes it straight out
+// of the mapped memory. Rendering never stalls on the GPU or the disk: when the writer falls so
+// far behind that every buffer is still taken, the frame is dropped and counted instead.
+//
+//    record frame N:   copy image -> slot            slot RECORDED
+//    frame N done:     invalidate, queue to writer   slot WRITING
+//    writer:           encode, write, free           slot FREE
+//
+// PPM and PNG write a file per frame, PNG with stored deflate blocks so encoding is a copy and
+// two checksums. Raw appends the pixels as they are to one stream per size, e.g.
+//    ffmpeg -f rawvideo -pixel_format bgra -video_size 800x600 -i capture_800x600_bgra.raw
+// A grab writes a single frame to a given path, for comparing images in tests.
+
+#define CAPTURE_RING_SIZE 4
+#define CAPTURE_MAX_PATH 512
+
+typedef enum {
+   CAPTURE_PPM,
+   CAPTURE_PNG,
+   CAPTURE_RAW,
+} CaptureFormat;
+
+typedef enum {
+   CAPTURE_SLOT_FREE,
+   CAPTURE_SLOT_RECORDED, // render thread only
+   CAPTURE_SLOT_WRITING,  // the writer's until it stores FREE
+} CaptureSlotState;
+
+typedef struct {
+   VkBuffer buffer;
+   VkDeviceMemory memory;
+   const u8* mapped;
+   u64 frame;
+   _Atomic(u32) state;
+} CaptureSlot;
+
+typedef struct {
+   VkDevice device;
+   VkPhysicalDevice physical_device;
+   const VkAllocationCallbacks* callbacks;
+   VkFormat image_format; // 8 bit BGRA or RGBA
+   VkExtent2D extent;
+   CaptureFormat format;
+
+   const char* directory; // every frame into directory, or
+   const char* grab_path; // only grab_frame to grab_path
+   u64 grab_frame;
+} CaptureDesc;
+
+typedef struct {
+   VkDevice device;
+   VkPhysicalDevice physical_device;
+   const VkAllocationCallbacks* callbacks;
+   CaptureFormat format;
+   bool bgra;
+   bool coherent;
+   VkExtent2D extent;
+   VkDeviceSize size;
+   const char* directory;
+   const char* grab_path;
+   u64 grab_frame;
+
+   CaptureSlot slots[CAPTURE_RING_SIZE];
+
+   // writer thread, the job ring holds slot indices
+   pthread_t thread;
+   pthread_mutex_t lock;
+   pthread_cond_t work;
+   pthread_cond_t done;
+   bool quit;
+   u32 jobs[CAPTURE_RING_SIZE];
+   u32 job_head;
+   u32 job_count;
+   u32 pending; // queued or being written
+   u8* row; // RGB scanline with the PNG filter byte in front
+   FILE* stream; // raw only
+
+   u64 recorded;
+   u64 dropped;
+   bool grab_taken;
+   _Atomic(u64) written;
+   _Atomic(u64) failed;
+} Capture;
+
+// The swapchain has to be created with VK_IMAGE_USAGE_TRANSFER_SRC_BIT.
+VkResult capture_init(Capture* c, const CaptureDesc* desc);
+// Both write out every frame that is done and wait for the writer, the device has to be idle
+// for destroy to get them all.
+void capture_flush(Capture* c, FrameSync* sync);
+void capture_destroy(Capture* c, FrameSync* sync);
+
+// After the swapchain was recreated with the device idle. Frames still in flight are written
+// at the old size first.
+VkResult capture_resize(Capture* c, FrameSync* sync, VkExtent2D extent);
+
+// Records the copy of frame's image if the frame is captured and a slot is free. The image has
+// to be in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL.
+void capture_record(Capture* c, VkCommandBuffer commandBuffer, VkImage image, u64 frame);
+
+// Hands the slots of frames that are done to the writer, never blocks.
+void capture_collect(Capture* c, FrameSync* sync);
+
+// A grab only needs the one frame, true once it went to the writer.
+bool capture_grab_taken(const Capture* c);
+
+const char* capture_format_name(CaptureFormat format);
+void capture_print_stats(Capture* c, FILE* out);
@@ -0,0 +1,265 @@
+#include "descriptors.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// allocator
+
+static VkResult descriptor_allocator_create_pool(DescriptorAllocator* d, VkDescriptorPool* pool) {
+   u32 sets = d->next_pool_sets;
+   d->next_pool_sets = sets * 2 < DESCRIPTOR_POOL_MAX_SETS ? sets * 2 : DESCRIPTOR_POOL_MAX_SETS;
+
+   VkDescriptorPoolSize sizes[DESCRIPTOR_MAX_POOL_SIZES];
+   for (u32 i = 0; i < d->ratio_count; i++) {
+      sizes[i].type = d->ratios[i].type;
+      sizes[i].descriptorCount = (u32)(d->ratios[i].per_set * (float)sets + 0.5f);
+      if (sizes[i].descriptorCount == 0) sizes[i].descriptorCount = 1;
+   }
+
+   VkDescriptorPoolCreateInfo poolInfo = {0};
+   poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+   poolInfo.flags = d->pool_flags;
+   poolInfo.maxSets = sets;
+   poolInfo.poolSizeCount = d->ratio_count;
+   poolInfo.pPoolSizes = sizes;
+   return vkCreateDescriptorPool(d->device, &poolInfo, d->callbacks, pool);
+}
+
+static void descriptor_allocator_push_pool(DescriptorAllocator* d, VkDescriptorPool pool) {
+   if (d->pool_count == d->pool_capacity) {
+      u32 capacity = d->pool_capacity ? d->pool_capacity * 2 : 4;
+      VkDescriptorPool* pools = d->allocator->alloc(capacity * sizeof(VkDescriptorPool), d->allocator->ctx);
+      if (!pools) {
+         printf("Out of memory: %s\n", __func__);
+         abort();
+      }
+      if (d->pools) {
+         memcpy(pools, d->pools, d->pool_count * sizeof(VkDescriptorPool));
+         d->allocator->free(d->pool_capacity * sizeof(VkDescriptorPool), d->pools, d->allocator->ctx);
+      }
+      d->pools = pools;
+      d->pool_capacity = capacity;
+   }
+   d->pools[d->pool_count++] = pool;
+}
+
+void descriptor_allocator_init(DescriptorAllocator* d, VkDevice device, const VkAllocationCallbacks* callbacks, Allocator* allocator,
+                               u32 initial_sets, const DescriptorPoolRatio* ratios, u32 ratio_count) {
+   assert(ratio_count > 0 && ratio_count <= DESCRIPTOR_MAX_POOL_SIZES && "Descriptor allocator expected 1 to DESCRIPTOR_MAX_POOL_SIZES ratios.");
+   *d = (DescriptorAllocator){0};
+   d->device = device;
+   d->callbacks = callbacks;
+   d->allocator = allocator;
+   memcpy(d->ratios, ratios, ratio_count * sizeof(DescriptorPoolRatio));
+   d->ratio_count = ratio_count;
+   d->next_pool_sets = initial_sets ? initial_sets : 1;
+}
+
+void descriptor_allocator_destroy(DescriptorAllocator* d) {
+   for (u32 i = 0; i < d->pool_count; i++) {
+      vkDestroyDescriptorPool(d->device, d->pools[i], d->callbacks);
+   }
+   if (d->pools) d->allocator->free(d->pool_capacity * sizeof(VkDescriptorPool), d->pools, d->allocator->ctx);
+   *d = (DescriptorAllocator){0};
+}
+
+VkResult descriptor_allocator_allocate(DescriptorAllocator* d, VkDescriptorSetLayout layout, VkDescriptorSet* set) {
+   VkDescriptorSetAllocateInfo allocInfo = {0};
+   allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+   allocInfo.descriptorSetCount = 1;
+   allocInfo.pSetLayouts = &layout;
+
+   // try the current pool, move on when it is full, a fresh pool failing is a real error
+   for (;;) {
+      bool fresh = false;
+      if (d->current == d->pool_count) {
+         VkDescriptorPool pool;
+         VkResult result = descriptor_allocator_create_pool(d, &pool);
+         if (result != VK_SUCCESS) return result;
+         descriptor_allocator_push_pool(d, pool);
+         fresh = true;
+      }
+
+      allocInfo.descriptorPool = d->pools[d->current];
+      VkResult result = vkAllocateDescriptorSets(d->device, &allocInfo, set);
+      if (result == VK_SUCCESS) {
+         d->set_count++;
+         return result;
+      }
+      if (fresh || (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)) return result;
+      d->current++;
+   }
+}
+
+void descriptor_allocator_reset(DescriptorAllocator* d) {
+   for (u32 i = 0; i < d->pool_count && i <= d->current; i++) {
+      vkResetDescriptorPool(d->device, d->pools[i], 0);
+   }
+   d->current = 0;
+   d->set_count = 0;
+}
+
+// layout cache
+
+static u64 descriptor_layout_key_hash(const void* key) {
+   return hash_bytes(key, sizeof(DescriptorLayoutKey), 0);
+}
+
+static bool descriptor_layout_key_eq(const void* a, const void* b) {
+   return memcmp(a, b, sizeof(DescriptorLayoutKey)) == 0;
+}
+
+HASHMAP_DEFINE(descriptor_layout_map, DescriptorLayoutKey, VkDescriptorSetLayout, descriptor_layout_key_hash, descriptor_layout_key_eq)
+
+typedef struct {
+   VkDescriptorSetLayoutBinding binding;
+   VkDescriptorBindingFlags flags;
+} DescriptorLayoutBinding;
+
+static int compare_bindings(const void* a, const void* b) {
+   u32 ba = ((const DescriptorLayoutBinding*)a)->binding.binding;
+   u32 bb = ((const DescriptorLayoutBinding*)b)->binding.binding;
+   return (ba > bb) - (ba < bb);
+}
+
+void descriptor_layout_cache_init(DescriptorLayoutCache* c, VkDevice device, const VkAllocationCallbacks* callbacks, Allocator* allocator) {
+   *c = (DescriptorLayoutCache){0};
+   c->device = device;
+   c->callbacks = callbacks;
+   c->layouts = descriptor_layout_map_init(allocator);
+}
+
+void descriptor_layout_cache_destroy(DescriptorLayoutCache* c) {
+   Size it = 0;
+   VkDescriptorSetLayout* layout;
+   while (hashmap_next(&c->layouts, &it, nullptr, (void**)&layout)) {
+      vkDestroyDescriptorSetLayout(c->device, *layout, c->callbacks);
+   }
+   hashmap_destroy(&c->layouts);
+}
+
+VkDescriptorSetLayout descriptor_layout_cache_get(DescriptorLayoutCache* c, const VkDescriptorSetLayoutCreateInfo* info) {
+   assert(info->bindingCount <= DESCRIPTOR_MAX_BINDINGS && "Raise DESCRIPTOR_MAX_BINDINGS.");
+   const VkDescriptorSetLayoutBindingFlagsCreateInfo* bindingFlags = info->pNext;
+   assert((!bindingFlags || (bindingFlags->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO && !bindingFlags->pNext))
+          && "Descriptor layout cache expected binding flags to be the only pNext.");
+   assert((!bindingFlags || bindingFlags->bindingCount == 0 || bindingFlags->bindingCount == info->bindingCount)
+          && "Descriptor layout cache expected flags for every binding or none.");
+
+   DescriptorLayoutBinding sorted[DESCRIPTOR_MAX_BINDINGS];
+   for (u32 i = 0; i < info->bindingCount; i++) {
+      assert(!info->pBindings[i].pImmutableSamplers && "Descriptor layout cache expected no immutable samplers.");
+      sorted[i].binding = info->pBindings[i];
+      sorted[i].flags = bindingFlags && bindingFlags->bindingCount ? bindingFlags->pBindingFlags[i] : 0;
+   }
+   qsort(sorted, info->bindingCount, sizeof(DescriptorLayoutBinding), compare_bindings);
+
+   // zeroed so the padding and unused bindings hash the same every time
+   DescriptorLayoutKey key;
+   memset(&key, 0, sizeof(key));
+   key.flags = info->flags;
+   key.binding_count = info->bindingCount;
+   for (u32 i = 0; i < info->bindingCount; i++) {
+      key.bindings[i] = sorted[i].binding;
+      key.binding_flags[i] = sorted[i].flags;
+   }
+
+   bool inserted;
+   VkDescriptorSetLayout* layout = descriptor_layout_map_get_or_insert(&c->layouts, key, &inserted);
+   if (!inserted) {
+      c->hits++;
+      return *layout;
+   }
+
+   c->misses++;
+   if (vkCreateDescriptorSetLayout(c->device, info, c->callbacks, layout) != VK_SUCCESS) {
+      descriptor_layout_map_remove(&c->layouts, key);
+      return VK_NULL_HANDLE;
+   }
+   return *layout;
+}
+
+// templates
+
+VkResult descriptor_template_create(DescriptorTemplate* t, VkDevice device, const VkAllocationCallbacks* callbacks, bool use_templates,
+                                    VkDescriptorSetLayout layout, const VkDescriptorUpdateTemplateEntry* entries, u32 entry_count) {
+   assert(entry_count <= DESCRIPTOR_MAX_TEMPLATE_ENTRIES && "Raise DESCRIPTOR_MAX_TEMPLATE_ENTRIES.");
+   *t = (DescriptorTemplate){0};
+   memcpy(t->entries, entries, entry_count * sizeof(VkDescriptorUpdateTemplateEntry));
+   t->entry_count = entry_count;
+   if (!use_templates) return VK_SUCCESS;
+
+   VkDescriptorUpdateTemplateCreateInfo createInfo = {0};
+   createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+   createInfo.descriptorUpdateEntryCount = entry_count;
+   createInfo.pDescriptorUpdateEntries = entries;
+   createInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+   createInfo.descriptorSetLayout = layout;
+   return vkCreateDescriptorUpdateTemplate(device, &createInfo, callbacks, &t->handle);
+}
+
+void descriptor_template_destroy(DescriptorTemplate* t, VkDevice device, const VkAllocationCallbacks* callbacks) {
+   if (t->handle) vkDestroyDescriptorUpdateTemplate(device, t->handle, callbacks);
+   *t = (DescriptorTemplate){0};
+}
+
+// One write per array element since the infos are strided in the caller's struct.
+static void descriptor_template_update_fallback(DescriptorTemplate* t, VkDevice device, VkDescriptorSet set, const u8* data) {
+   VkWriteDescriptorSet writes[DESCRIPTOR_MAX_TEMPLATE_ENTRIES * 4];
+   u32 writeCount = 0;
+
+   for (u32 e = 0; e < t->entry_count; e++) {
+      const VkDescriptorUpdateTemplateEntry* entry = &t->entries[e];
+      for (u32 i = 0; i < entry->descriptorCount; i++) {
+         if (writeCount == lengthof(writes)) {
+            vkUpdateDescriptorSets(device, writeCount, writes, 0, nullptr);
+            writeCount = 0;
+         }
+
+         const void* info = data + entry->offset + i * entry->stride;
+         VkWriteDescriptorSet* write = &writes[writeCount++];
+         *write = (VkWriteDescriptorSet){0};
+         write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+         write->dstSet = set;
+         write->dstBinding = entry->dstBinding;
+         write->dstArrayElement = entry->dstArrayElement + i;
+         write->descriptorCount = 1;
+         write->descriptorType = entry->descriptorType;
+
+         switch (entry->descriptorType) {
+         case VK_DESCRIPTOR_TYPE_SAMPLER:
+         case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+         case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+         case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+         case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+            write->pImageInfo = info;
+            break;
+         case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+         case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+            write->pTexelBufferView = info;
+            break;
+         default:
+            write->pBufferInfo = info;
+            break;
+         }
+      }
+   }
+
+   if (writeCount > 0) vkUpdateDescriptorSets(device, writeCount, writes, 0, nullptr);
+}
+
+void descriptor_template_update(DescriptorTemplate* t, VkDevice device, VkDescriptorSet set, const void* data) {
+   if (t->handle) {
+      vkUpdateDescriptorSetWithTemplate(device, set, t->handle, data);
+   } else {
+      descriptor_template_update_fallback(t, device, set, data);
+   }
+}
+
+void descriptor_template_update_many(DescriptorTemplate* t, VkDevice device, const VkDescriptorSet* sets, u32 count, const void* data, Size stride) {
+   const u8* bytes = data;
+   for (u32 i = 0; i < count; i++) {
+      descriptor_template_update(t, device, sets[i], bytes + i * stride);
+   }
+}
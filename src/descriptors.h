@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+#include "memory.h"
+#include "hashmap.h"
+
+// Descriptor sets.
+//
+// DescriptorAllocator hands out sets from a list of pools. A pool that runs out is left behind
+// and the next one is created twice as big, so nothing has to know up front how many sets there
+// will be. Reset puts every pool back at once, give each frame in flight its own allocator for
+// sets that are rebuilt every frame and reset it once the frame's fence has signalled.
+//
+// DescriptorLayoutCache creates each distinct set layout once, keyed by a hash of its bindings
+// and their binding flags.
+//
+// DescriptorTemplate writes a whole set from one caller struct with
+// vkUpdateDescriptorSetWithTemplate. The entries say where each binding's infos sit in the
+// struct. Without Vulkan 1.1 the same entries are turned into vkUpdateDescriptorSets writes.
+
+#define DESCRIPTOR_MAX_POOL_SIZES 8
+#define DESCRIPTOR_MAX_BINDINGS 16
+#define DESCRIPTOR_MAX_TEMPLATE_ENTRIES 16
+#define DESCRIPTOR_POOL_MAX_SETS 4096
+
+// descriptors of a type per set, pool sizes are maxSets times this
+typedef struct {
+   VkDescriptorType type;
+   float per_set;
+} DescriptorPoolRatio;
+
+typedef struct {
+   VkDevice device;
+   const VkAllocationCallbacks* callbacks;
+   Allocator* allocator;
+
+   DescriptorPoolRatio ratios[DESCRIPTOR_MAX_POOL_SIZES];
+   u32 ratio_count;
+   u32 next_pool_sets;
+   VkDescriptorPoolCreateFlags pool_flags; // UPDATE_AFTER_BIND for bindless sets, set before allocating
+
+   // pools before current are full until the next reset
+   VkDescriptorPool* pools;
+   u32 pool_count;
+   u32 pool_capacity;
+   u32 current;
+
+   u32 set_count; // since the last reset
+} DescriptorAllocator;
+
+void descriptor_allocator_init(DescriptorAllocator* d, VkDevice device, const VkAllocationCallbacks* callbacks, Allocator* allocator,
+                               u32 initial_sets, const DescriptorPoolRatio* ratios, u32 ratio_count);
+void descriptor_allocator_destroy(DescriptorAllocator* d);
+
+VkResult descriptor_allocator_allocate(DescriptorAllocator* d, VkDescriptorSetLayout layout, VkDescriptorSet* set);
+
+// Every set from this allocator becomes invalid, the pools are kept.
+void descriptor_allocator_reset(DescriptorAllocator* d);
+
+// Bindings sorted by binding number, unused bytes zeroed so the key can be hashed as bytes.
+typedef struct {
+   VkDescriptorSetLayoutCreateFlags flags;
+   u32 binding_count;
+   VkDescriptorSetLayoutBinding bindings[DESCRIPTOR_MAX_BINDINGS];
+   VkDescriptorBindingFlags binding_flags[DESCRIPTOR_MAX_BINDINGS];
+} DescriptorLayoutKey;
+
+typedef struct {
+   VkDevice device;
+   const VkAllocationCallbacks* callbacks;
+   HashMap layouts;
+   u32 hits;
+   u32 misses;
+} DescriptorLayoutCache;
+
+void descriptor_layout_cache_init(DescriptorLayoutCache* c, VkDevice device, const VkAllocationCallbacks* callbacks, Allocator* allocator);
+void descriptor_layout_cache_destroy(DescriptorLayoutCache* c);
+
+// The cache owns the layout. The only pNext allowed is VkDescriptorSetLayoutBindingFlagsCreateInfo,
+// immutable samplers aren't supported.
+VkDescriptorSetLayout descriptor_layout_cache_get(DescriptorLayoutCache* c, const VkDescriptorSetLayoutCreateInfo* info);
+
+typedef struct {
+   VkDescriptorUpdateTemplate handle; // VK_NULL_HANDLE on the fallback path
+   VkDescriptorUpdateTemplateEntry entries[DESCRIPTOR_MAX_TEMPLATE_ENTRIES];
+   u32 entry_count;
+} DescriptorTemplate;
+
+// use_templates needs Vulkan 1.1 on both the instance and the device.
+VkResult descriptor_template_create(DescriptorTemplate* t, VkDevice device, const VkAllocationCallbacks* callbacks, bool use_templates,
+                                    VkDescriptorSetLayout layout, const VkDescriptorUpdateTemplateEntry* entries, u32 entry_count);
+void descriptor_template_destroy(DescriptorTemplate* t, VkDevice device, const VkAllocationCallbacks* callbacks);
+
+void descriptor_template_update(DescriptorTemplate* t, VkDevice device, VkDescriptorSet set, const void* data);
+
+// Writes count sets, the data for set i starts at data + i * stride.
+void descriptor_template_update_many(DescriptorTemplate* t, VkDevice device, const VkDescriptorSet* sets, u32 count, const void* data, Size stride);
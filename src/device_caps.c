@@ -0,0 +1,140 @@
+#include "device_caps.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_extensions(const void* a, const void* b) {
+   return strcmp(((const VkExtensionProperties*)a)->extensionName, ((const VkExtensionProperties*)b)->extensionName);
+}
+
+static void device_caps_query_features(DeviceCaps* caps) {
+   vkGetPhysicalDeviceFeatures(caps->device, &caps->features);
+   if (caps->api_version < VK_API_VERSION_1_1) return;
+
+   bool indexing = caps->api_version >= VK_API_VERSION_1_2 || device_caps_has_extension(caps, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+   bool timeline = caps->api_version >= VK_API_VERSION_1_2 || device_caps_has_extension(caps, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+   bool vulkan13 = caps->api_version >= VK_API_VERSION_1_3;
+
+   caps->indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+   caps->timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+   caps->features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+   caps->indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+   // only what the device knows about goes in the chain
+   VkPhysicalDeviceFeatures2 features2 = {0};
+   features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+   void** next = &features2.pNext;
+   if (indexing) {
+      *next = &caps->indexing_features;
+      next = &caps->indexing_features.pNext;
+   }
+   if (timeline) {
+      *next = &caps->timeline_features;
+      next = &caps->timeline_features.pNext;
+   }
+   if (vulkan13) *next = &caps->features13;
+   vkGetPhysicalDeviceFeatures2(caps->device, &features2);
+
+   if (indexing) {
+      VkPhysicalDeviceProperties2 properties2 = {0};
+      properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+      properties2.pNext = &caps->indexing_properties;
+      vkGetPhysicalDeviceProperties2(caps->device, &properties2);
+   }
+
+   caps->indexing_features.pNext = nullptr;
+   caps->timeline_features.pNext = nullptr;
+   caps->features13.pNext = nullptr;
+   caps->indexing_properties.pNext = nullptr;
+}
+
+static void device_caps_pick_families(DeviceCaps* caps) {
+   caps->graphics_family = DEVICE_CAPS_NO_FAMILY;
+   caps->present_family = DEVICE_CAPS_NO_FAMILY;
+   caps->compute_family = DEVICE_CAPS_NO_FAMILY;
+   caps->transfer_family = DEVICE_CAPS_NO_FAMILY;
+
+   for (u32 i = 0; i < caps->queue_family_count; i++) {
+      const DeviceQueueFamily* family = &caps->queue_families[i];
+      VkQueueFlags flags = family->properties.queueFlags;
+      if (family->properties.queueCount == 0) continue;
+
+      bool graphics = flags & VK_QUEUE_GRAPHICS_BIT;
+      bool compute = flags & VK_QUEUE_COMPUTE_BIT;
+      if (graphics && family->present && (caps->graphics_family == DEVICE_CAPS_NO_FAMILY || !caps->queue_families[caps->graphics_family].present)) {
+         caps->graphics_family = i;
+         caps->present_family = i;
+      }
+      if (graphics && caps->graphics_family == DEVICE_CAPS_NO_FAMILY) caps->graphics_family = i;
+      if (family->present && caps->present_family == DEVICE_CAPS_NO_FAMILY) caps->present_family = i;
+      if (compute && !graphics && caps->compute_family == DEVICE_CAPS_NO_FAMILY) caps->compute_family = i;
+      if ((flags & VK_QUEUE_TRANSFER_BIT) && !graphics && !compute && caps->transfer_family == DEVICE_CAPS_NO_FAMILY) caps->transfer_family = i;
+   }
+}
+
+bool device_caps_query(DeviceCaps* caps, VkPhysicalDevice device, VkSurfaceKHR surface, u32 instance_version, Allocator* allocator) {
+   *caps = (DeviceCaps){0};
+   caps->device = device;
+   caps->allocator = allocator;
+
+   vkGetPhysicalDeviceProperties(device, &caps->properties);
+   caps->api_version = caps->properties.apiVersion < instance_version ? caps->properties.apiVersion : instance_version;
+   vkGetPhysicalDeviceMemoryProperties(device, &caps->memory);
+
+   u32 extensionCount = 0;
+   vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+   if (extensionCount > 0) {
+      caps->extensions = allocator->alloc(extensionCount * sizeof(VkExtensionProperties), allocator->ctx);
+      if (!caps->extensions) return false;
+      vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, caps->extensions);
+      qsort(caps->extensions, extensionCount, sizeof(VkExtensionProperties), compare_extensions);
+   }
+   caps->extension_count = extensionCount;
+
+   device_caps_query_features(caps);
+
+   VkQueueFamilyProperties families[DEVICE_CAPS_MAX_QUEUE_FAMILIES];
+   u32 familyCount = DEVICE_CAPS_MAX_QUEUE_FAMILIES;
+   vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, families);
+   caps->queue_family_count = familyCount;
+   for (u32 i = 0; i < familyCount; i++) {
+      VkBool32 present = VK_FALSE;
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present);
+      caps->queue_families[i] = (DeviceQueueFamily){families[i], present};
+   }
+   device_caps_pick_families(caps);
+
+   for (u32 i = 0; i < caps->memory.memoryHeapCount; i++) {
+      const VkMemoryHeap* heap = &caps->memory.memoryHeaps[i];
+      if ((heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && heap->size > caps->device_local_bytes) caps->device_local_bytes = heap->size;
+   }
+   return true;
+}
+
+void device_caps_destroy(DeviceCaps* caps) {
+   if (caps->extensions) caps->allocator->free(caps->extension_count * sizeof(VkExtensionProperties), caps->extensions, caps->allocator->ctx);
+   *caps = (DeviceCaps){0};
+}
+
+bool device_caps_has_extension(const DeviceCaps* caps, const char* name) {
+   VkExtensionProperties key = {0};
+   strncpy(key.extensionName, name, sizeof(key.extensionName) - 1);
+   return caps->extension_count > 0 && bsearch(&key, caps->extensions, caps->extension_count, sizeof(VkExtensionProperties), compare_extensions);
+}
+
+u32 device_caps_memory_type(const DeviceCaps* caps, u32 type_bits, VkMemoryPropertyFlags properties) {
+   for (u32 i = 0; i < caps->memory.memoryTypeCount; i++) {
+      if ((type_bits & (1u << i)) && (caps->memory.memoryTypes[i].propertyFlags & properties) == properties) return i;
+   }
+   return UINT32_MAX;
+}
+
+const char* device_caps_type_name(VkPhysicalDeviceType type) {
+   switch (type) {
+   case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+   case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+   case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+   case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+   default: return "other";
+   }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "memory.h"
+
+// Physical device capabilities.
+//
+// Everything the renderer asks a physical device about is queried once into a DeviceCaps and
+// read from there afterwards: properties, features, memory types, queue families and the
+// extension list. Feature structs are only filled in when the device and the instance both
+// have the version that defines them, otherwise they stay zero and read as unsupported.
+// Their pNext is cleared, they are copied into a create info chain as they are.
+
+#define DEVICE_CAPS_MAX_QUEUE_FAMILIES 16
+#define DEVICE_CAPS_NO_FAMILY UINT32_MAX
+
+typedef struct {
+   VkQueueFamilyProperties properties;
+   bool present; // to the surface the caps were queried for
+} DeviceQueueFamily;
+
+typedef struct {
+   VkPhysicalDevice device;
+   u32 api_version; // the lower of the device's and the instance's
+
+   VkPhysicalDeviceProperties properties;
+   VkPhysicalDeviceDescriptorIndexingProperties indexing_properties;
+   VkPhysicalDeviceMemoryProperties memory;
+   VkPhysicalDeviceFeatures features;
+   VkPhysicalDeviceDescriptorIndexingFeatures indexing_features; // 1.2 or the EXT
+   VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features; // 1.2 or the KHR
+   VkPhysicalDeviceVulkan13Features features13;
+
+   u32 queue_family_count;
+   DeviceQueueFamily queue_families[DEVICE_CAPS_MAX_QUEUE_FAMILIES];
+
+   Allocator* allocator;
+   u32 extension_count;
+   VkExtensionProperties* extensions; // sorted by name
+
+   // picked from the above, DEVICE_CAPS_NO_FAMILY if there is none
+   u32 graphics_family; // one that presents as well when there is one
+   u32 present_family;
+   u32 compute_family;  // compute without graphics
+   u32 transfer_family; // transfer without graphics or compute
+   VkDeviceSize device_local_bytes; // the largest device local heap
+} DeviceCaps;
+
+bool device_caps_query(DeviceCaps* caps, VkPhysicalDevice device, VkSurfaceKHR surface, u32 instance_version, Allocator* allocator);
+void device_caps_destroy(DeviceCaps* caps);
+
+bool device_caps_has_extension(const DeviceCaps* caps, const char* name);
+
+// First type in type_bits with all of properties, UINT32_MAX if there is none.
+u32 device_caps_memory_type(const DeviceCaps* caps, u32 type_bits, VkMemoryPropertyFlags properties);
+
+const char* device_caps_type_name(VkPhysicalDeviceType type);
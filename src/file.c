@@ -1,9 +1,13 @@
 #include "file.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "memory.h"
 #include "str.h"
@@ -58,3 +62,119 @@ String read_text_file(const char *path, Allocator *allocator) {
        .length = length,
    };
 }
+
+// mapped files
+
+#define FILE_HUGE_PAGE_SIZE MB(2)
+
+static int _madvise_flag(FileAdvice advice) {
+   switch (advice) {
+      case FILE_ADVICE_SEQUENTIAL: return MADV_SEQUENTIAL;
+      case FILE_ADVICE_WILLNEED: return MADV_WILLNEED;
+      case FILE_ADVICE_RANDOM: return MADV_RANDOM;
+      case FILE_ADVICE_NORMAL: break;
+   }
+   return MADV_NORMAL;
+}
+
+// Reserves enough address space to line the file up on a huge page and maps it over the top.
+static void* _map_huge_aligned(int fd, Size length, Size* mapping_length) {
+   Size reserve_length = length + FILE_HUGE_PAGE_SIZE;
+   u8* reserve = mmap(nullptr, (size_t)reserve_length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (reserve == MAP_FAILED) return MAP_FAILED;
+
+   u8* aligned = (u8*)(((uintptr)reserve + FILE_HUGE_PAGE_SIZE - 1) & ~(uintptr)(FILE_HUGE_PAGE_SIZE - 1));
+   void* mapped = mmap(aligned, (size_t)length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+   if (mapped == MAP_FAILED) {
+      munmap(reserve, (size_t)reserve_length);
+      return MAP_FAILED;
+   }
+
+   // hand back the reservation either side of the file
+   Size head = aligned - reserve;
+   Size page = sysconf(_SC_PAGESIZE);
+   Size tail_start = (length + page - 1) & ~(page - 1);
+   if (head > 0) munmap(reserve, (size_t)head);
+   if (reserve_length - head > tail_start) munmap(aligned + tail_start, (size_t)(reserve_length - head - tail_start));
+
+#ifdef MADV_HUGEPAGE
+   madvise(aligned, (size_t)length, MADV_HUGEPAGE);
+#endif
+
+   *mapping_length = length;
+   return aligned;
+}
+
+MappedFileResult map_file(const char* path, FileAdvice advice) {
+   MappedFileResult result = {0};
+
+   int fd = open(path, O_RDONLY | O_CLOEXEC);
+   if (fd < 0) {
+      result.error = errno;
+      return result;
+   }
+
+   struct stat st;
+   if (fstat(fd, &st) != 0) {
+      result.error = errno;
+      close(fd);
+      return result;
+   }
+
+   Size length = (Size)st.st_size;
+   if (length == 0) {
+      close(fd);
+      result.ok = true;
+      return result;
+   }
+
+   Size mapping_length = length;
+   void* mapping = MAP_FAILED;
+   if (length >= FILE_HUGE_PAGE_SIZE) {
+      mapping = _map_huge_aligned(fd, length, &mapping_length);
+   }
+   if (mapping == MAP_FAILED) {
+      mapping = mmap(nullptr, (size_t)length, PROT_READ, MAP_PRIVATE, fd, 0);
+   }
+
+   // the mapping keeps its own reference to the file
+   int map_error = errno;
+   close(fd);
+
+   if (mapping == MAP_FAILED) {
+      result.error = map_error;
+      return result;
+   }
+
+   if (advice != FILE_ADVICE_NORMAL) {
+      madvise(mapping, (size_t)mapping_length, _madvise_flag(advice));
+   }
+
+   result.value.data = mapping;
+   result.value.length = length;
+   result.value.mapping = mapping;
+   result.value.mapping_length = mapping_length;
+   result.ok = true;
+   return result;
+}
+
+void unmap_file(MappedFile* file) {
+   if (file->mapping) {
+      munmap(file->mapping, (size_t)file->mapping_length);
+   }
+   *file = (MappedFile){0};
+}
+
+void mapped_file_advise(MappedFile* file, Size offset, Size length, FileAdvice advice) {
+   if (offset >= file->length) return;
+   if (offset + length > file->length) length = file->length - offset;
+
+   // madvise wants a page aligned start
+   Size page = sysconf(_SC_PAGESIZE);
+   Size start = offset & ~(page - 1);
+   madvise(file->data + start, (size_t)(length + offset - start), _madvise_flag(advice));
+}
+
+String mapped_file_string(MappedFile* file) {
+   return str_make((char*)file->data, (size_t)file->length);
+}
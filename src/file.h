@@ -1,7 +1,40 @@
 #pragma once
 
 #include "memory.h"
+#include "result.h"
 #include "str.h"
 
 u32* read_binary_file(const char* path, Size* length, Allocator* allocator);
 String read_text_file(const char* path, Allocator* allocator);
+
+// mapped files
+//
+// Read only views of a file backed by the page cache, nothing is copied and pages are only read
+// in when touched. The data is page aligned so SPIR-V can be used as u32s straight away. Large
+// files are mapped at a huge page boundary so the kernel can back them with huge pages if it
+// supports that for the filesystem.
+
+typedef enum {
+   FILE_ADVICE_NORMAL,
+   FILE_ADVICE_SEQUENTIAL, // read front to back once, aggressive read ahead
+   FILE_ADVICE_WILLNEED,   // about to be used, start reading it all in now
+   FILE_ADVICE_RANDOM,     // lookups all over the place, no read ahead
+} FileAdvice;
+
+typedef struct {
+   u8* data;
+   Size length;
+
+   void* mapping;
+   Size mapping_length;
+} MappedFile;
+
+typedef Result(MappedFile) MappedFileResult;
+
+MappedFileResult map_file(const char* path, FileAdvice advice);
+void unmap_file(MappedFile* file);
+
+// Hint for a sub range, e.g. WILLNEED on the next chunk while parsing the current one.
+void mapped_file_advise(MappedFile* file, Size offset, Size length, FileAdvice advice);
+
+String mapped_file_string(MappedFile* file);
@@ -0,0 +1,132 @@
+#include "frame_sync.h"
+
+#include <assert.h>
+
+VkResult frame_sync_init(FrameSync* s, VkDevice device, const VkAllocationCallbacks* callbacks, bool timeline, u32 frame_count) {
+   assert(frame_count <= FRAME_SYNC_MAX_FRAMES && "Raise FRAME_SYNC_MAX_FRAMES.");
+
+   *s = (FrameSync){0};
+   s->device = device;
+   s->callbacks = callbacks;
+   s->timeline = timeline;
+   s->frame_count = frame_count;
+
+   if (timeline) {
+      VkSemaphoreTypeCreateInfo typeInfo = {0};
+      typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+      typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+      typeInfo.initialValue = 0;
+
+      VkSemaphoreCreateInfo semaphoreInfo = {0};
+      semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+      semaphoreInfo.pNext = &typeInfo;
+      return vkCreateSemaphore(device, &semaphoreInfo, callbacks, &s->semaphore);
+   }
+
+   // signalled, the first frame_count frames have nothing to wait for
+   VkFenceCreateInfo fenceInfo = {0};
+   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+   for (u32 i = 0; i < frame_count; i++) {
+      VkResult result = vkCreateFence(device, &fenceInfo, callbacks, &s->fences[i]);
+      if (result != VK_SUCCESS) {
+         frame_sync_destroy(s);
+         return result;
+      }
+   }
+   return VK_SUCCESS;
+}
+
+void frame_sync_destroy(FrameSync* s) {
+   if (!s->device) return;
+
+   if (s->semaphore) vkDestroySemaphore(s->device, s->semaphore, s->callbacks);
+   for (u32 i = 0; i < s->frame_count; i++) {
+      if (s->fences[i]) vkDestroyFence(s->device, s->fences[i], s->callbacks);
+   }
+   *s = (FrameSync){0};
+}
+
+u32 frame_sync_slot(const FrameSync* s, u64 frame) {
+   assert(frame > 0 && "Frame numbers expected to start at 1.");
+   return (u32)((frame - 1) % s->frame_count);
+}
+
+u64 frame_sync_begin(FrameSync* s) {
+   u64 next = s->submitted + 1;
+   if (next > s->frame_count) frame_sync_wait(s, next - s->frame_count, UINT64_MAX);
+   return next;
+}
+
+VkSemaphoreSubmitInfo frame_sync_signal(const FrameSync* s) {
+   VkSemaphoreSubmitInfo info = {0};
+   info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+   info.semaphore = s->semaphore;
+   info.value = s->submitted + 1;
+   info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+   return info;
+}
+
+VkFence frame_sync_fence(FrameSync* s) {
+   if (s->timeline) return VK_NULL_HANDLE;
+
+   // frame_sync_begin already waited for the frame that used the slot last
+   u32 slot = frame_sync_slot(s, s->submitted + 1);
+   vkResetFences(s->device, 1, &s->fences[slot]);
+   s->fence_frames[slot] = s->submitted + 1;
+   return s->fences[slot];
+}
+
+void frame_sync_submitted(FrameSync* s) {
+   s->submitted++;
+}
+
+// Signals on one queue complete in submission order, a frame being done means every frame
+// before it is too.
+static void frame_sync_complete(FrameSync* s, u64 frame) {
+   if (frame > s->completed) s->completed = frame;
+}
+
+bool frame_sync_done(FrameSync* s, u64 frame) {
+   if (frame <= s->completed) return true;
+   if (frame > s->submitted) return false;
+
+   s->wait_calls++;
+   if (s->timeline) {
+      u64 value = 0;
+      if (vkGetSemaphoreCounterValue(s->device, s->semaphore, &value) != VK_SUCCESS) return false;
+      frame_sync_complete(s, value);
+      return frame <= s->completed;
+   }
+
+   // a slot only moves on to a later frame once the earlier one was waited for
+   u32 slot = frame_sync_slot(s, frame);
+   if (s->fence_frames[slot] > frame) {
+      frame_sync_complete(s, frame);
+      return true;
+   }
+   if (vkGetFenceStatus(s->device, s->fences[slot]) != VK_SUCCESS) return false;
+   frame_sync_complete(s, frame);
+   return true;
+}
+
+VkResult frame_sync_wait(FrameSync* s, u64 frame, u64 timeout) {
+   assert(frame <= s->submitted && "Frame expected to be submitted before waiting for it.");
+   if (frame <= s->completed) return VK_SUCCESS;
+
+   s->wait_calls++;
+   VkResult result;
+   if (s->timeline) {
+      VkSemaphoreWaitInfo waitInfo = {0};
+      waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+      waitInfo.semaphoreCount = 1;
+      waitInfo.pSemaphores = &s->semaphore;
+      waitInfo.pValues = &frame;
+      result = vkWaitSemaphores(s->device, &waitInfo, timeout);
+   } else {
+      u32 slot = frame_sync_slot(s, frame);
+      result = s->fence_frames[slot] > frame ? VK_SUCCESS : vkWaitForFences(s->device, 1, &s->fences[slot], VK_TRUE, timeout);
+   }
+   if (result == VK_SUCCESS) frame_sync_complete(s, frame);
+   return result;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// Frame completion on the graphics queue.
+//
+// Frames are numbered from 1 and the number never wraps. With timeline semaphores the graphics
+// submit of frame N sets the timeline to N, so anything can ask whether frame N is done or wait
+// for it with the one semaphore, without a fence of its own. Without them each frame slot keeps
+// a fence and the number of the frame it was last submitted with, and the same calls work as
+// long as the frame is no more than frame_count behind.
+//
+// The last value seen complete is cached, asking about a frame older than that costs no call.
+
+#define FRAME_SYNC_MAX_FRAMES 4
+
+typedef struct {
+   VkDevice device;
+   const VkAllocationCallbacks* callbacks;
+   bool timeline;
+   u32 frame_count; // frames in flight
+
+   VkSemaphore semaphore; // timeline
+   VkFence fences[FRAME_SYNC_MAX_FRAMES]; // without, indexed by slot
+   u64 fence_frames[FRAME_SYNC_MAX_FRAMES];
+
+   u64 submitted; // last frame handed to the queue
+   u64 completed; // every frame up to here is known to be done
+
+   u64 wait_calls; // waits and polls that went to the driver
+} FrameSync;
+
+VkResult frame_sync_init(FrameSync* s, VkDevice device, const VkAllocationCallbacks* callbacks, bool timeline, u32 frame_count);
+void frame_sync_destroy(FrameSync* s);
+
+// Waits until the next frame's slot is free again and returns the next frame's number. Calling
+// it again without frame_sync_submitted returns the same frame, e.g. after a failed acquire.
+u64 frame_sync_begin(FrameSync* s);
+u32 frame_sync_slot(const FrameSync* s, u64 frame);
+
+// What the graphics submit of the next frame signals. The timeline value with timelines,
+// otherwise the slot's fence, reset and ready to pass to vkQueueSubmit.
+VkSemaphoreSubmitInfo frame_sync_signal(const FrameSync* s);
+VkFence frame_sync_fence(FrameSync* s);
+void frame_sync_submitted(FrameSync* s);
+
+bool frame_sync_done(FrameSync* s, u64 frame);
+VkResult frame_sync_wait(FrameSync* s, u64 frame, u64 timeout);
@@ -0,0 +1,60 @@
+#include "frame_times.h"
+
+#include <stdlib.h>
+
+bool frame_times_init(FrameTimes* t, Allocator* allocator, Size capacity) {
+   *t = (FrameTimes){0};
+   t->samples = allocator->alloc(capacity * sizeof(u64), allocator->ctx);
+   if (!t->samples) return false;
+   t->allocator = allocator;
+   t->capacity = capacity;
+   return true;
+}
+
+void frame_times_destroy(FrameTimes* t) {
+   if (t->samples) t->allocator->free(t->capacity * sizeof(u64), t->samples, t->allocator->ctx);
+   *t = (FrameTimes){0};
+}
+
+void frame_times_add(FrameTimes* t, u64 nanos) {
+   if (t->count == t->capacity) {
+      t->dropped++;
+      return;
+   }
+   t->samples[t->count++] = nanos;
+}
+
+static int compare_u64(const void* a, const void* b) {
+   u64 x = *(const u64*)a;
+   u64 y = *(const u64*)b;
+   return (x > y) - (x < y);
+}
+
+// nearest rank, the smallest sample with at least p percent of them at or below it
+static double frame_times_percentile(const FrameTimes* t, double p) {
+   Size rank = (Size)(p / 100.0 * (double)t->count + 0.999999);
+   if (rank < 1) rank = 1;
+   return (double)t->samples[rank - 1] / 1e6;
+}
+
+FrameTimeSummary frame_times_summarize(FrameTimes* t) {
+   FrameTimeSummary s = {0};
+   if (t->count == 0) return s;
+
+   qsort(t->samples, (size_t)t->count, sizeof(u64), compare_u64);
+   u64 total = 0;
+   for (Size i = 0; i < t->count; i++) total += t->samples[i];
+
+   s.min = (double)t->samples[0] / 1e6;
+   s.mean = (double)total / (double)t->count / 1e6;
+   s.p50 = frame_times_percentile(t, 50.0);
+   s.p90 = frame_times_percentile(t, 90.0);
+   s.p99 = frame_times_percentile(t, 99.0);
+   s.max = (double)t->samples[t->count - 1] / 1e6;
+   return s;
+}
+
+void frame_times_write_json(FILE* out, const char* name, const FrameTimeSummary* s) {
+   fprintf(out, "\"%s\": {\"min\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+           name, s->min, s->mean, s->p50, s->p90, s->p99, s->max);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "memory.h"
+
+// Frame timings for benchmarks.
+//
+// Every sample is kept, percentiles are taken once at the end by sorting them. Nothing is
+// allocated while recording, samples past the capacity are counted and dropped.
+
+typedef struct {
+   double min; // all in milliseconds
+   double mean;
+   double p50;
+   double p90;
+   double p99;
+   double max;
+} FrameTimeSummary;
+
+typedef struct {
+   Allocator* allocator;
+   u64* samples; // nanoseconds
+   Size count;
+   Size capacity;
+   Size dropped;
+} FrameTimes;
+
+bool frame_times_init(FrameTimes* t, Allocator* allocator, Size capacity);
+void frame_times_destroy(FrameTimes* t);
+
+void frame_times_add(FrameTimes* t, u64 nanos);
+
+// Sorts the samples, all zero with none.
+FrameTimeSummary frame_times_summarize(FrameTimes* t);
+
+// "name": {"min": ..., "p50": ...} without a trailing comma or newline.
+void frame_times_write_json(FILE* out, const char* name, const FrameTimeSummary* s);
@@ -0,0 +1,487 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "memory.h"
+#include "str.h"
+
+// Open addressing hash map in the style of the swiss tables.
+//
+// Every slot has a control byte, either EMPTY, DELETED or the low 7 bits of the hash when full.
+// Lookups compare 16 control bytes at once and only touch the slots whose byte matched, so a
+// miss usually costs one group load. The first group of control bytes is mirrored past the end
+// so a group can be loaded from any slot without wrapping.
+
+#define HASHMAP_GROUP_WIDTH 16
+#define HASHMAP_MIN_CAPACITY 16
+#define HASHMAP_CTRL_EMPTY ((i8)-128)
+#define HASHMAP_CTRL_DELETED ((i8)-2)
+
+typedef u64 (*HashFn)(const void* key);
+typedef bool (*HashEqFn)(const void* a, const void* b);
+
+typedef struct {
+   i8* ctrl;
+   u8* slots;
+   Size capacity;
+   Size length;
+   Size growth_left;
+
+   Size key_size;
+   Size value_size;
+   Size value_offset;
+   Size slot_size;
+   Size slot_align;
+
+   HashFn hash;
+   HashEqFn eq;
+   Allocator* allocator;
+} HashMap;
+
+/*
+ * @brief create a new hash map, no memory is allocated until the first insert
+ *
+ * @param K key type
+ * @param V value type
+ * @param hash HashFn taking a pointer to K
+ * @param eq HashEqFn taking two pointers to K
+ * @param a memory allocator
+ */
+#define hashmap(K, V, hash, eq, a) hashmap_init(sizeof(K), alignof(K), sizeof(V), alignof(V), hash, eq, a)
+
+// Typed helpers, the key and value are copied so rvalues are fine.
+#define hashmap_put_value(m, k, v) hashmap_put(m, &(typeof(k)){k}, &(typeof(v)){v})
+#define hashmap_get_value(m, V, k) ((V*)hashmap_get(m, &(typeof(k)){k}))
+
+// hashing
+
+static inline u64 hash_mix(u64 a, u64 b) {
+   __uint128_t r = (__uint128_t)a * b;
+   return (u64)r ^ (u64)(r >> 64);
+}
+
+static inline u64 hash_read64(const u8* p) {
+   u64 v;
+   memcpy(&v, p, 8);
+   return v;
+}
+
+static inline u64 hash_read32(const u8* p) {
+   u32 v;
+   memcpy(&v, p, 4);
+   return v;
+}
+
+// wyhash style, 16 bytes per round with two independent multiplies.
+static u64 hash_bytes(const void* data, Size length, u64 seed) {
+   static const u64 k0 = 0xa0761d6478bd642full;
+   static const u64 k1 = 0xe7037ed1a0b428dbull;
+   static const u64 k2 = 0x8ebc6af09c88c6e3ull;
+
+   const u8* p = data;
+   seed ^= hash_mix(seed ^ k0, k1);
+   u64 a = 0;
+   u64 b = 0;
+
+   if (length <= 16) {
+      if (length >= 4) {
+         a = (hash_read32(p) << 32) | hash_read32(p + ((length >> 3) << 2));
+         b = (hash_read32(p + length - 4) << 32) | hash_read32(p + length - 4 - ((length >> 3) << 2));
+      } else if (length > 0) {
+         a = ((u64)p[0] << 16) | ((u64)p[length >> 1] << 8) | p[length - 1];
+      }
+   } else {
+      Size i = length;
+      while (i > 16) {
+         seed = hash_mix(hash_read64(p) ^ k1, hash_read64(p + 8) ^ seed);
+         p += 16;
+         i -= 16;
+      }
+      a = hash_read64(p + i - 16);
+      b = hash_read64(p + i - 8);
+   }
+
+   return hash_mix(k1 ^ (u64)length, hash_mix(a ^ k1, b ^ seed) ^ k2);
+}
+
+static u64 hash_u32(const void* key) {
+   return hash_mix(*(const u32*)key ^ 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull);
+}
+
+static u64 hash_u64(const void* key) {
+   return hash_mix(*(const u64*)key ^ 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull);
+}
+
+static u64 hash_ptr(const void* key) {
+   return hash_mix((u64)*(const uintptr*)key ^ 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull);
+}
+
+// Key is a String*, the characters are hashed not the pointer.
+static u64 hash_string(const void* key) {
+   const String* s = key;
+   return hash_bytes(s->data, (Size)s->length, 0);
+}
+
+static bool hash_eq_u32(const void* a, const void* b) {
+   return *(const u32*)a == *(const u32*)b;
+}
+
+static bool hash_eq_u64(const void* a, const void* b) {
+   return *(const u64*)a == *(const u64*)b;
+}
+
+static bool hash_eq_ptr(const void* a, const void* b) {
+   return *(const uintptr*)a == *(const uintptr*)b;
+}
+
+static bool hash_eq_string(const void* a, const void* b) {
+   const String* sa = a;
+   const String* sb = b;
+   return sa->length == sb->length && memcmp(sa->data, sb->data, sa->length) == 0;
+}
+
+// control groups
+
+typedef u32 HashMapMask;
+
+static inline HashMapMask hashmap_group_match(const i8* ctrl, i8 h2) {
+#ifdef __SSE2__
+   __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+   return (HashMapMask)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), group));
+#else
+   HashMapMask mask = 0;
+   for (Size i = 0; i < HASHMAP_GROUP_WIDTH; i++) {
+      mask |= (HashMapMask)(ctrl[i] == h2) << i;
+   }
+   return mask;
+#endif
+}
+
+static inline HashMapMask hashmap_group_empty_or_deleted(const i8* ctrl) {
+#ifdef __SSE2__
+   // only full slots have the top bit clear
+   __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+   return (HashMapMask)_mm_movemask_epi8(group);
+#else
+   HashMapMask mask = 0;
+   for (Size i = 0; i < HASHMAP_GROUP_WIDTH; i++) {
+      mask |= (HashMapMask)(ctrl[i] < 0) << i;
+   }
+   return mask;
+#endif
+}
+
+static inline HashMapMask hashmap_group_empty(const i8* ctrl) {
+   return hashmap_group_match(ctrl, HASHMAP_CTRL_EMPTY);
+}
+
+static inline Size hashmap_h1(u64 hash) {
+   return (Size)(hash >> 7);
+}
+
+static inline i8 hashmap_h2(u64 hash) {
+   return (i8)(hash & 0x7f);
+}
+
+static inline Size hashmap_max_load(Size capacity) {
+   return capacity - capacity / 8;
+}
+
+static inline void hashmap_set_ctrl(HashMap* m, Size i, i8 h) {
+   m->ctrl[i] = h;
+   if (i < HASHMAP_GROUP_WIDTH) {
+      m->ctrl[m->capacity + i] = h;
+   }
+}
+
+static inline u8* hashmap_slot(HashMap* m, Size i) {
+   return m->slots + i * m->slot_size;
+}
+
+static Size hashmap_align_up(Size v, Size align) {
+   return (v + align - 1) & ~(align - 1);
+}
+
+static Size hashmap_ctrl_bytes(Size capacity, Size slot_align) {
+   return hashmap_align_up(capacity + HASHMAP_GROUP_WIDTH, slot_align > 16 ? slot_align : 16);
+}
+
+static Size hashmap_alloc_size(HashMap* m, Size capacity) {
+   // the allocators only promise 16 byte alignment, over aligned slots get padding
+   Size pad = m->slot_align > 16 ? m->slot_align : 0;
+   return hashmap_ctrl_bytes(capacity, m->slot_align) + capacity * m->slot_size + pad;
+}
+
+static HashMap hashmap_init(Size key_size, Size key_align, Size value_size, Size value_align, HashFn hash, HashEqFn eq, Allocator* a) {
+   HashMap m = {0};
+   m.key_size = key_size;
+   m.value_size = value_size;
+   m.value_offset = hashmap_align_up(key_size, value_align);
+   m.slot_align = key_align > value_align ? key_align : value_align;
+   m.slot_size = hashmap_align_up(m.value_offset + value_size, m.slot_align);
+   m.hash = hash;
+   m.eq = eq;
+   m.allocator = a;
+   return m;
+}
+
+static void hashmap_free_storage(HashMap* m) {
+   if (!m->ctrl) return;
+   m->allocator->free(hashmap_alloc_size(m, m->capacity), m->ctrl, m->allocator->ctx);
+}
+
+static void hashmap_destroy(HashMap* m) {
+   hashmap_free_storage(m);
+   m->ctrl = nullptr;
+   m->slots = nullptr;
+   m->capacity = 0;
+   m->length = 0;
+   m->growth_left = 0;
+}
+
+// First EMPTY or DELETED slot on the probe sequence of hash.
+static Size hashmap_find_insert_slot(HashMap* m, u64 hash) {
+   Size mask = m->capacity - 1;
+   Size pos = hashmap_h1(hash) & mask;
+   for (Size step = HASHMAP_GROUP_WIDTH;; step += HASHMAP_GROUP_WIDTH) {
+      HashMapMask free = hashmap_group_empty_or_deleted(m->ctrl + pos);
+      if (free) {
+         return (pos + (Size)__builtin_ctz(free)) & mask;
+      }
+      pos = (pos + step) & mask;
+   }
+}
+
+static void hashmap_resize(HashMap* m, Size new_capacity) {
+   HashMap old = *m;
+
+   Size size = hashmap_alloc_size(m, new_capacity);
+   u8* mem = m->allocator->alloc(size, m->allocator->ctx);
+   if (!mem) {
+      printf("Out of memory: %s\n", __func__);
+      abort();
+   }
+
+   m->ctrl = (i8*)mem;
+   m->slots = (u8*)hashmap_align_up((Size)(uintptr)(mem + hashmap_ctrl_bytes(new_capacity, m->slot_align)), m->slot_align);
+   m->capacity = new_capacity;
+   memset(m->ctrl, HASHMAP_CTRL_EMPTY, new_capacity + HASHMAP_GROUP_WIDTH);
+
+   for (Size i = 0; i < old.capacity; i++) {
+      if (old.ctrl[i] < 0) continue;
+      u8* src = old.slots + i * old.slot_size;
+      u64 hash = m->hash(src);
+      Size dst = hashmap_find_insert_slot(m, hash);
+      hashmap_set_ctrl(m, dst, hashmap_h2(hash));
+      memcpy(hashmap_slot(m, dst), src, m->slot_size);
+   }
+
+   m->growth_left = hashmap_max_load(new_capacity) - m->length;
+   hashmap_free_storage(&old);
+}
+
+static void hashmap_grow(HashMap* m) {
+   Size capacity = m->capacity ? m->capacity : HASHMAP_MIN_CAPACITY;
+   // lots of tombstones, rebuilding at the same size is enough to get them back
+   if (m->capacity && m->length * 2 > hashmap_max_load(m->capacity)) {
+      capacity *= 2;
+   }
+   hashmap_resize(m, capacity);
+}
+
+// Makes room for at least count entries without further rehashing.
+static void hashmap_reserve(HashMap* m, Size count) {
+   Size capacity = m->capacity ? m->capacity : HASHMAP_MIN_CAPACITY;
+   while (hashmap_max_load(capacity) < count) {
+      capacity *= 2;
+   }
+   if (capacity > m->capacity) {
+      hashmap_resize(m, capacity);
+   }
+}
+
+// The _with variants take the hash and eq functions as arguments and are always inlined, when
+// they are passed as constants (see HASHMAP_DEFINE) the calls are inlined too. Going through the
+// function pointers in the map stops the CPU overlapping cache misses of back to back lookups and
+// roughly halves lookup throughput on maps that don't fit in cache.
+#define HASHMAP_INLINE static inline __attribute__((always_inline))
+
+HASHMAP_INLINE Size hashmap_find_with(HashMap* m, const void* key, u64 hash, HashEqFn eq) {
+   if (!m->capacity) return -1;
+
+   Size mask = m->capacity - 1;
+   Size pos = hashmap_h1(hash) & mask;
+   i8 h2 = hashmap_h2(hash);
+
+   for (Size step = HASHMAP_GROUP_WIDTH; step <= m->capacity + HASHMAP_GROUP_WIDTH; step += HASHMAP_GROUP_WIDTH) {
+      const i8* group = m->ctrl + pos;
+      for (HashMapMask match = hashmap_group_match(group, h2); match; match &= match - 1) {
+         Size i = (pos + (Size)__builtin_ctz(match)) & mask;
+         if (eq(hashmap_slot(m, i), key)) {
+            return i;
+         }
+      }
+      if (hashmap_group_empty(group)) {
+         return -1;
+      }
+      pos = (pos + step) & mask;
+   }
+   return -1;
+}
+
+HASHMAP_INLINE void* hashmap_get_with(HashMap* m, const void* key, HashFn hash, HashEqFn eq) {
+   Size i = hashmap_find_with(m, key, hash(key), eq);
+   return i < 0 ? nullptr : hashmap_slot(m, i) + m->value_offset;
+}
+
+static void* hashmap_insert_new(HashMap* m, const void* key, u64 hash) {
+   if (m->growth_left == 0) {
+      hashmap_grow(m);
+   }
+
+   Size i = hashmap_find_insert_slot(m, hash);
+   // reusing a tombstone doesn't use up any growth
+   if (m->ctrl[i] == HASHMAP_CTRL_EMPTY) {
+      m->growth_left--;
+   }
+   hashmap_set_ctrl(m, i, hashmap_h2(hash));
+   m->length++;
+
+   u8* slot = hashmap_slot(m, i);
+   memcpy(slot, key, m->key_size);
+   memset(slot + m->value_offset, 0, m->value_size);
+   return slot + m->value_offset;
+}
+
+HASHMAP_INLINE void* hashmap_get_or_insert_with(HashMap* m, const void* key, bool* inserted, HashFn hash, HashEqFn eq) {
+   u64 h = hash(key);
+   Size i = hashmap_find_with(m, key, h, eq);
+   if (inserted) *inserted = i < 0;
+   if (i >= 0) {
+      return hashmap_slot(m, i) + m->value_offset;
+   }
+   return hashmap_insert_new(m, key, h);
+}
+
+static void hashmap_erase_slot(HashMap* m, Size i) {
+   // If the neighbourhood never filled up no probe sequence could have walked past this slot,
+   // it can go straight back to EMPTY instead of leaving a tombstone.
+   Size mask = m->capacity - 1;
+   HashMapMask before = hashmap_group_empty(m->ctrl + ((i - HASHMAP_GROUP_WIDTH) & mask));
+   HashMapMask after = hashmap_group_empty(m->ctrl + i);
+   bool was_never_full = before && after && (__builtin_ctz(after) + __builtin_clz(before << 16 | 0xffff)) < HASHMAP_GROUP_WIDTH;
+
+   hashmap_set_ctrl(m, i, was_never_full ? HASHMAP_CTRL_EMPTY : HASHMAP_CTRL_DELETED);
+   if (was_never_full) m->growth_left++;
+   m->length--;
+}
+
+HASHMAP_INLINE bool hashmap_remove_with(HashMap* m, const void* key, HashFn hash, HashEqFn eq) {
+   Size i = hashmap_find_with(m, key, hash(key), eq);
+   if (i < 0) return false;
+   hashmap_erase_slot(m, i);
+   return true;
+}
+
+/*
+ * @brief look up a key
+ *
+ * @return pointer to the stored value or nullptr, only valid until the next insert
+ */
+static void* hashmap_get(HashMap* m, const void* key) {
+   return hashmap_get_with(m, key, m->hash, m->eq);
+}
+
+/*
+ * @brief look up a key, inserting it with a zeroed value if it is missing
+ *
+ * @param inserted (optional) set to whether the key was new
+ * @return pointer to the stored value, only valid until the next insert
+ */
+static void* hashmap_get_or_insert(HashMap* m, const void* key, bool* inserted) {
+   return hashmap_get_or_insert_with(m, key, inserted, m->hash, m->eq);
+}
+
+// Inserts or overwrites, returns the stored value.
+static void* hashmap_put(HashMap* m, const void* key, const void* value) {
+   void* dst = hashmap_get_or_insert(m, key, nullptr);
+   memcpy(dst, value, m->value_size);
+   return dst;
+}
+
+static bool hashmap_remove(HashMap* m, const void* key) {
+   return hashmap_remove_with(m, key, m->hash, m->eq);
+}
+
+/*
+ * @brief define typed wrappers for one key/value pair, the hash and eq get inlined into them
+ *
+ *    HASHMAP_DEFINE(shader_map, String, VkShaderModule, hash_string, hash_eq_string)
+ *
+ *    HashMap shaders = shader_map_init(&allocator);
+ *    shader_map_put(&shaders, str("basic.vert"), module);
+ *    VkShaderModule* found = shader_map_get(&shaders, str("basic.vert"));
+ */
+#define HASHMAP_DEFINE(name, K, V, hash, eq) \
+   static HashMap name##_init(Allocator* a) { \
+      return hashmap(K, V, hash, eq, a); \
+   } \
+   static inline V* name##_get(HashMap* m, K key) { \
+      return hashmap_get_with(m, &key, hash, eq); \
+   } \
+   static inline V* name##_get_or_insert(HashMap* m, K key, bool* inserted) { \
+      return hashmap_get_or_insert_with(m, &key, inserted, hash, eq); \
+   } \
+   static inline V* name##_put(HashMap* m, K key, V value) { \
+      V* dst = hashmap_get_or_insert_with(m, &key, nullptr, hash, eq); \
+      *dst = value; \
+      return dst; \
+   } \
+   static inline bool name##_remove(HashMap* m, K key) { \
+      return hashmap_remove_with(m, &key, hash, eq); \
+   }
+
+static void hashmap_clear(HashMap* m) {
+   if (!m->capacity) return;
+   memset(m->ctrl, HASHMAP_CTRL_EMPTY, m->capacity + HASHMAP_GROUP_WIDTH);
+   m->length = 0;
+   m->growth_left = hashmap_max_load(m->capacity);
+}
+
+/*
+ * @brief iterate over all entries, start with *it = 0
+ *
+ *    Size it = 0;
+ *    String* key;
+ *    u32* value;
+ *    while (hashmap_next(&map, &it, (void**)&key, (void**)&value)) { ... }
+ */
+static bool hashmap_next(HashMap* m, Size* it, void** key, void** value) {
+   for (; *it < m->capacity; (*it)++) {
+      if (m->ctrl[*it] >= 0) {
+         u8* slot = hashmap_slot(m, (*it)++);
+         if (key) *key = slot;
+         if (value) *value = slot + m->value_offset;
+         return true;
+      }
+   }
+   return false;
+}
+
+static void hashmap_debug(char* name, HashMap* m) {
+   Size tombstones = 0;
+   for (Size i = 0; i < m->capacity; i++) {
+      tombstones += m->ctrl[i] == HASHMAP_CTRL_DELETED;
+   }
+   printf("HashMap %s:\n", name);
+   printf("  capacity: %ld\n", m->capacity);
+   printf("  length: %ld\n", m->length);
+   printf("  tombstones: %ld\n", tombstones);
+}
@@ -0,0 +1,209 @@
+#include "host_allocator.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+
+// Sits right in front of every pointer handed to the driver. pfnFree and pfnReallocation only
+// get the pointer back so everything needed to release it has to be here.
+typedef struct {
+   Size size;
+   Size raw_size;
+   u32 offset;
+   u8 scope;
+   bool scratch;
+} HostAllocationHeader;
+
+#define HOST_MIN_ALIGNMENT 16
+
+static_assert(sizeof(HostAllocationHeader) <= HOST_MIN_ALIGNMENT * 2, "Host allocation header expected to be small.");
+
+static const char* host_scope_names[HOST_ALLOCATOR_SCOPE_COUNT] = {
+   "command",
+   "object",
+   "cache",
+   "device",
+   "instance",
+};
+
+static HostAllocationHeader* host_header(void* ptr) {
+   return (HostAllocationHeader*)ptr - 1;
+}
+
+static void host_stats_add(HostScopeStats* s, Size size) {
+   s->live_bytes += size;
+   s->total_bytes += size;
+   s->alloc_count++;
+   if (s->live_bytes > s->peak_bytes) {
+      s->peak_bytes = s->live_bytes;
+   }
+}
+
+// Must be called with the lock held.
+static void* host_alloc_locked(HostAllocator* h, Size size, Size alignment, VkSystemAllocationScope scope) {
+   if (alignment < HOST_MIN_ALIGNMENT) alignment = HOST_MIN_ALIGNMENT;
+   assert((alignment & (alignment - 1)) == 0 && "Vulkan alignment expected to be a power of 2.");
+
+   Size raw_size = size + sizeof(HostAllocationHeader) + alignment - 1;
+   u8* raw = nullptr;
+   bool scratch = false;
+
+   if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+      // arena_alloc pads to its own alignment, leave room for that too
+      if (h->scratch.offset + raw_size + HOST_MIN_ALIGNMENT <= h->scratch.capacity) {
+         raw = arena_alloc(&h->scratch, raw_size);
+         scratch = raw != nullptr;
+      }
+      if (!scratch) h->scratch_fallbacks++;
+   }
+
+   if (!raw) {
+      raw = pool_alloc(&h->pool, raw_size);
+      if (!raw) return nullptr;
+   }
+
+   uintptr first = (uintptr)raw + sizeof(HostAllocationHeader);
+   u8* ptr = (u8*)((first + (uintptr)alignment - 1) & ~((uintptr)alignment - 1));
+
+   HostAllocationHeader* header = host_header(ptr);
+   header->size = size;
+   header->raw_size = raw_size;
+   header->offset = (u32)(ptr - raw);
+   header->scope = (u8)scope;
+   header->scratch = scratch;
+
+   if (scratch) h->scratch_live++;
+   host_stats_add(&h->scopes[scope], size);
+   return ptr;
+}
+
+static void host_free_locked(HostAllocator* h, void* ptr) {
+   HostAllocationHeader* header = host_header(ptr);
+   u8* raw = (u8*)ptr - header->offset;
+
+   HostScopeStats* s = &h->scopes[header->scope];
+   s->live_bytes -= header->size;
+   s->free_count++;
+
+   if (header->scratch) {
+      // command scope is over once nothing is left in the scratch arena, rewind it
+      if (--h->scratch_live == 0) {
+         arena_free_all(&h->scratch);
+      }
+   } else {
+      pool_free(&h->pool, header->raw_size, raw);
+   }
+}
+
+static void* VKAPI_CALL host_allocation(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+   HostAllocator* h = userData;
+   pthread_mutex_lock(&h->lock);
+   void* ptr = host_alloc_locked(h, (Size)size, (Size)alignment, scope);
+   pthread_mutex_unlock(&h->lock);
+   return ptr;
+}
+
+static void* VKAPI_CALL host_reallocation(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+   HostAllocator* h = userData;
+   pthread_mutex_lock(&h->lock);
+
+   void* ptr = nullptr;
+   if (!original) {
+      ptr = host_alloc_locked(h, (Size)size, (Size)alignment, scope);
+   } else if (size == 0) {
+      host_free_locked(h, original);
+   } else {
+      HostAllocationHeader* header = host_header(original);
+      ptr = host_alloc_locked(h, (Size)size, (Size)alignment, scope);
+      if (ptr) {
+         Size copy = header->size < (Size)size ? header->size : (Size)size;
+         memcpy(ptr, original, copy);
+         h->scopes[scope].realloc_count++;
+         // counted as an alloc above, don't double count it
+         h->scopes[scope].alloc_count--;
+         // the header goes with the block
+         u8 originalScope = header->scope;
+         host_free_locked(h, original);
+         h->scopes[originalScope].free_count--;
+      }
+   }
+
+   pthread_mutex_unlock(&h->lock);
+   return ptr;
+}
+
+static void VKAPI_CALL host_free(void* userData, void* memory) {
+   if (!memory) return;
+   HostAllocator* h = userData;
+   pthread_mutex_lock(&h->lock);
+   host_free_locked(h, memory);
+   pthread_mutex_unlock(&h->lock);
+}
+
+static void VKAPI_CALL host_internal_allocation(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+   HostAllocator* h = userData;
+   pthread_mutex_lock(&h->lock);
+   HostScopeStats* s = &h->scopes[scope];
+   s->internal_live_bytes += (Size)size;
+   if (s->internal_live_bytes > s->internal_peak_bytes) {
+      s->internal_peak_bytes = s->internal_live_bytes;
+   }
+   pthread_mutex_unlock(&h->lock);
+}
+
+static void VKAPI_CALL host_internal_free(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+   HostAllocator* h = userData;
+   pthread_mutex_lock(&h->lock);
+   h->scopes[scope].internal_live_bytes -= (Size)size;
+   pthread_mutex_unlock(&h->lock);
+}
+
+void host_allocator_init(HostAllocator* h, Size scratch_capacity) {
+   memset(h, 0, sizeof(*h));
+   pthread_mutex_init(&h->lock, nullptr);
+
+   h->scratch = arena_init(scratch_capacity);
+   h->pool = pool_init(KB(64), stdlib_allocator());
+
+   h->callbacks.pUserData = h;
+   h->callbacks.pfnAllocation = host_allocation;
+   h->callbacks.pfnReallocation = host_reallocation;
+   h->callbacks.pfnFree = host_free;
+   h->callbacks.pfnInternalAllocation = host_internal_allocation;
+   h->callbacks.pfnInternalFree = host_internal_free;
+}
+
+void host_allocator_destroy(HostAllocator* h) {
+   pool_destroy(&h->pool);
+   arena_destroy(&h->scratch);
+   pthread_mutex_destroy(&h->lock);
+}
+
+const VkAllocationCallbacks* host_allocator_callbacks(HostAllocator* h) {
+   return &h->callbacks;
+}
+
+void host_allocator_stats(HostAllocator* h, HostScopeStats out[HOST_ALLOCATOR_SCOPE_COUNT]) {
+   pthread_mutex_lock(&h->lock);
+   memcpy(out, h->scopes, sizeof(h->scopes));
+   pthread_mutex_unlock(&h->lock);
+}
+
+void host_allocator_dump(HostAllocator* h, FILE* out) {
+   HostScopeStats scopes[HOST_ALLOCATOR_SCOPE_COUNT];
+   host_allocator_stats(h, scopes);
+
+   fprintf(out, "Vulkan host allocations:\n");
+   fprintf(out, "   %-9s %12s %12s %12s %8s %8s %8s %12s\n", "scope", "live", "peak", "total", "allocs", "reallocs", "frees", "internal");
+   for (Size i = 0; i < HOST_ALLOCATOR_SCOPE_COUNT; i++) {
+      HostScopeStats* s = &scopes[i];
+      fprintf(out, "   %-9s %12td %12td %12td %8td %8td %8td %12td\n", host_scope_names[i], s->live_bytes, s->peak_bytes, s->total_bytes, s->alloc_count, s->realloc_count, s->free_count, s->internal_peak_bytes);
+   }
+
+   pthread_mutex_lock(&h->lock);
+   fprintf(out, "   scratch: %td / %td bytes in use, %td command allocations fell back to the pool\n", h->scratch.offset, h->scratch.capacity, h->scratch_fallbacks);
+   pthread_mutex_unlock(&h->lock);
+}
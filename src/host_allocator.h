@@ -0,0 +1,50 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+#include "memory.h"
+
+// VkAllocationCallbacks over the project allocators.
+//
+// Command scope allocations only live for the duration of a single vk* call, they come out of a
+// scratch arena that is rewound whenever the last of them is freed. Everything else goes to a
+// size class pool. The driver can call back from any thread so both sit behind a mutex.
+
+#define HOST_ALLOCATOR_SCOPE_COUNT (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+
+typedef struct {
+   Size live_bytes;
+   Size peak_bytes;
+   Size total_bytes;
+   Size alloc_count;
+   Size realloc_count;
+   Size free_count;
+
+   // allocations the driver made itself and only told us about
+   Size internal_live_bytes;
+   Size internal_peak_bytes;
+} HostScopeStats;
+
+typedef struct {
+   pthread_mutex_t lock;
+
+   Arena scratch;
+   Size scratch_live;
+   Size scratch_fallbacks;
+
+   Pool pool;
+
+   HostScopeStats scopes[HOST_ALLOCATOR_SCOPE_COUNT];
+   VkAllocationCallbacks callbacks;
+} HostAllocator;
+
+void host_allocator_init(HostAllocator* h, Size scratch_capacity);
+void host_allocator_destroy(HostAllocator* h);
+
+const VkAllocationCallbacks* host_allocator_callbacks(HostAllocator* h);
+
+void host_allocator_stats(HostAllocator* h, HostScopeStats out[HOST_ALLOCATOR_SCOPE_COUNT]);
+void host_allocator_dump(HostAllocator* h, FILE* out);
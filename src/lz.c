@@ -0,0 +1,170 @@
+#include "lz.h"
+
+#include <string.h>
+
+#include "memory.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+// matches can't start this close to the end, the tail is always sent as literals
+#define LZ_LAST_LITERALS 5
+
+static inline u32 lz_read32(const u8* p) {
+   u32 v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+static inline u32 lz_hash(u32 v) {
+   return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static u8* lz_write_length(u8* out, Size length) {
+   while (length >= 255) {
+      *out++ = 255;
+      length -= 255;
+   }
+   *out++ = (u8)length;
+   return out;
+}
+
+Size lz_compress_bound(Size n) {
+   return n + n / 255 + 16;
+}
+
+static u8* lz_write_sequence(u8* out, const u8* literals, Size literal_length, Size match_length, Size offset) {
+   u8* token = out++;
+   *token = (u8)((literal_length >= 15 ? 15 : literal_length) << 4);
+   if (literal_length >= 15) out = lz_write_length(out, literal_length - 15);
+   memcpy(out, literals, (size_t)literal_length);
+   out += literal_length;
+
+   if (match_length == 0) return out;
+
+   *out++ = (u8)offset;
+   *out++ = (u8)(offset >> 8);
+   Size extra = match_length - LZ_MIN_MATCH;
+   *token |= (u8)(extra >= 15 ? 15 : extra);
+   if (extra >= 15) out = lz_write_length(out, extra - 15);
+   return out;
+}
+
+Size lz_compress(const void* src, Size n, void* dst, Size capacity) {
+   if (capacity < lz_compress_bound(n)) return 0;
+
+   const u8* in = src;
+   const u8* end = in + n;
+   u8* out = dst;
+
+   const u8* anchor = in;
+   if (n > LZ_MIN_MATCH + LZ_LAST_LITERALS) {
+      u32 table[1 << LZ_HASH_BITS];
+      memset(table, 0, sizeof(table));
+
+      const u8* match_limit = end - LZ_LAST_LITERALS;
+      const u8* p = in + 1;
+      u32 misses = 0;
+      while (p + LZ_MIN_MATCH <= match_limit) {
+         u32 v = lz_read32(p);
+         u32 h = lz_hash(v);
+         const u8* candidate = in + table[h];
+         table[h] = (u32)(p - in);
+
+         if (candidate >= p || p - candidate > LZ_MAX_OFFSET || lz_read32(candidate) != v) {
+            // step further the longer nothing has matched, keeps incompressible data cheap
+            p += 1 + (misses++ >> 5);
+            continue;
+         }
+         misses = 0;
+
+         // extend backwards over literals that also match
+         while (p > anchor && candidate > in && p[-1] == candidate[-1]) {
+            p--;
+            candidate--;
+         }
+
+         const u8* q = p + LZ_MIN_MATCH;
+         const u8* c = candidate + LZ_MIN_MATCH;
+         while (q + 8 <= match_limit) {
+            u64 a, b;
+            memcpy(&a, q, 8);
+            memcpy(&b, c, 8);
+            u64 diff = a ^ b;
+            if (diff) {
+               q += __builtin_ctzll(diff) >> 3;
+               goto matched;
+            }
+            q += 8;
+            c += 8;
+         }
+         while (q < match_limit && *q == *c) {
+            q++;
+            c++;
+         }
+      matched:
+         out = lz_write_sequence(out, anchor, p - anchor, q - p, p - candidate);
+         anchor = q;
+
+         // seed the table inside the match so the next one can be found right away
+         table[lz_hash(lz_read32(q - 2))] = (u32)(q - 2 - in);
+         p = q;
+      }
+   }
+
+   out = lz_write_sequence(out, anchor, end - anchor, 0, 0);
+   return out - (u8*)dst;
+}
+
+static bool lz_read_length(const u8** p, const u8* end, Size* length) {
+   u8 b;
+   do {
+      if (*p >= end) return false;
+      b = *(*p)++;
+      *length += b;
+   } while (b == 255);
+   return true;
+}
+
+Size lz_decompress(const void* src, Size n, void* dst, Size capacity) {
+   const u8* p = src;
+   const u8* end = p + n;
+   u8* out = dst;
+   u8* out_end = out + capacity;
+
+   while (p < end) {
+      u8 token = *p++;
+
+      Size literal_length = token >> 4;
+      if (literal_length == 15 && !lz_read_length(&p, end, &literal_length)) return -1;
+      if (literal_length > end - p || literal_length > out_end - out) return -1;
+      memcpy(out, p, (size_t)literal_length);
+      out += literal_length;
+      p += literal_length;
+
+      // the last sequence has no match
+      if (p == end) break;
+
+      if (end - p < 2) return -1;
+      Size offset = p[0] | (p[1] << 8);
+      p += 2;
+      if (offset == 0 || offset > out - (u8*)dst) return -1;
+
+      Size match_length = token & 15;
+      if (match_length == 15 && !lz_read_length(&p, end, &match_length)) return -1;
+      match_length += LZ_MIN_MATCH;
+      if (match_length > out_end - out) return -1;
+
+      const u8* match = out - offset;
+      if (offset >= 8) {
+         // 8 bytes at a time, reads never overtake writes at this distance
+         Size i = 0;
+         for (; i + 8 <= match_length; i += 8) memcpy(out + i, match + i, 8);
+         for (; i < match_length; i++) out[i] = match[i];
+      } else {
+         for (Size i = 0; i < match_length; i++) out[i] = match[i];
+      }
+      out += match_length;
+   }
+   return out - (u8*)dst;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "memory.h"
+
+// Byte oriented LZ77 block compressor in the spirit of LZ4.
+//
+// A block is a run of sequences, each one a token byte (literal length in the high nibble, match
+// length - 4 in the low nibble, 15 means more length bytes follow), the literals, then a 16 bit
+// little endian match offset. The last sequence is literals only. Compression is a single greedy
+// pass over a hash of 4 byte prefixes, decompression is a bounds checked copy loop; both are
+// there for speed rather than ratio.
+
+#define LZ_MAX_BLOCK_SIZE MB(1)
+
+// Worst case output size for n input bytes, incompressible data grows a little.
+Size lz_compress_bound(Size n);
+
+// Returns the compressed size, or 0 if it would not fit in capacity.
+Size lz_compress(const void* src, Size n, void* dst, Size capacity);
+
+// Returns the decompressed size, or -1 if the input is corrupt or does not fit in capacity.
+Size lz_decompress(const void* src, Size n, void* dst, Size capacity);
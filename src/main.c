@@ -6,6 +6,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
 
 #include <vulkan/vulkan.h>
 #include <cglm/cglm.h>
@@ -16,8 +19,38 @@
 #include "vector.h"
 #include "memory.h"
 #include "file.h"
+#include "host_allocator.h"
+#include "shaders.h"
+#include "render_graph.h"
+#include "descriptors.h"
+#include "particles.h"
+#include "frame_sync.h"
+#include "simulation.h"
+#include "spsc_queue.h"
+#include "capture.h"
+#include "frame_times.h"
+#include "device_caps.h"
+#include "queues.h"
+#include "mesh_lod.h"
+#include "meshlets.h"
 
 static const Size g_maxFramesInFlight = 2;
+static const Size g_overdrawReportFrames = 256;
+static const Size g_bindingReportFrames = 256;
+static const u32 g_particleReportFrames = 256;
+static const Size g_syncReportFrames = 256;
+static const Size g_latencyReportFrames = 256;
+static const Size g_lodReportFrames = 256;
+static const Size g_meshletReportFrames = 256;
+static const Size g_inputQueueCapacity = 1024;
+static const u32 g_bindlessMaxBuffers = 1024;
+static const vec3 g_cameraEye = {2.0f, 2.0f, 2.0f};
+static const float g_cameraFovDegrees = 45.0f;
+static const u32 g_simulationHz = 120;
+static const u32 g_maxMeshCells = 255; // (cells + 1)^2 vertices have to fit 16 bit indices
+static const float g_lodMaxError = 0.02f; // of the mesh's extent
+static const float g_lodPixelsPerTriangle = 8.0f;
+static const float g_rotationDegreesPerSecond = 1.0f;
 
 #define Optional(T) struct Optional##T { bool ok; T* value; }
 #define get_value(o) *((o).value)
@@ -39,8 +72,71 @@ typedef struct {
 } UniformBufferObject;
 
 typedef struct {
-   time_t startTime;
+   vec3 position;
+   float scale;
+} SceneObject;
 
+typedef enum {
+   DRAW_SORT_FRONT_TO_BACK,
+   DRAW_SORT_BACK_TO_FRONT,
+   DRAW_SORT_NONE,
+} DrawSort;
+
+typedef struct {
+   float depth;
+   u32 object;
+   u32 lod; // picked every frame in update_uniform_buffer
+   // of the frame's index buffer, the level's or its visible meshlets'
+   u32 first_index;
+   u32 index_count;
+} DrawKey;
+
+// a LOD level's meshlets in app->meshlets
+typedef struct {
+   u32 first;
+   u32 count;
+} MeshletRange;
+
+// host visible, mapped for as long as it lives
+typedef struct {
+   VkBuffer buffer;
+   VkDeviceMemory memory;
+   u16* mapped;
+   Size capacity; // in indices
+} ClusterIndexBuffer;
+
+// push constants of the bindless vertex shader
+typedef struct {
+   u32 buffer;
+   u32 object;
+} BindlessDraw;
+
+typedef struct {
+   VkBuffer buffer;
+   VkDeviceMemory memory;
+} StagingBuffer;
+
+typedef enum {
+   INPUT_KEY,
+   INPUT_MOUSE_BUTTON,
+   INPUT_CURSOR,
+} InputEventType;
+
+typedef struct {
+   InputEventType type;
+   i32 code; // key or button, x for the cursor
+   i32 action; // y for the cursor
+   u64 time; // simulation_now when GLFW delivered it
+} InputEvent;
+
+// input from the oldest event a frame picked up, waiting for that frame to finish
+typedef struct {
+   u64 frame;
+   u64 time;
+   u32 events;
+} LatencySample;
+
+typedef struct {
    u32 win_width;
    u32 win_height;
    GLFWwindow *window;
@@ -48,9 +144,15 @@ typedef struct {
    VkInstance instance;
    VkDebugUtilsMessengerEXT debugMessenger;
    VkPhysicalDevice physicalDevice;
+   // everything asked of the physical device, queried once when it was picked. The highest
+   // scoring device is picked unless GPU=name|index or --gpu name|index says otherwise.
+   DeviceCaps caps;
+   const char* gpuOverride;
    VkDevice device;
-   VkQueue graphicsQueue;
-   VkQueue presentQueue;
+   // a queue and command pool per kind of work, see queues.h. Uploads go to a transfer or
+   // compute family of their own when there is one, ASYNC_TRANSFER=0 keeps them on graphics.
+   QueueSet queues;
+   bool asyncTransfer;
    
    VkSurfaceKHR surface;
    VkSwapchainKHR swapChain;
@@ -61,21 +163,120 @@ typedef struct {
    VkFormat swapChainImageFormat;
    VkExtent2D swapChainExtent;
 
+   // rebuilt with the swapchain, owns the depth buffer
+   RenderGraph frameGraph;
+   RgResource swapChainTarget;
+   RgResource depthTarget;
+   RgResource msaaColourTarget; // RG_NONE without MSAA
+   u32 imageIndex;
+   VkFormat depthFormat;
+
+   // MSAA=2|4|8, clamped to what the device can render to. The multisample targets are resolved
+   // into the swapchain image at the end of the pass and never stored.
+   VkSampleCountFlagBits msaaSamples;
+
+   // Vulkan 1.3 dynamic rendering and synchronization2 when the device has them, otherwise the
+   // render pass and framebuffers. LEGACY_RENDER_PASS=1 forces the old path.
+   bool dynamicRendering;
    VkRenderPass renderPass;
    VkDescriptorSetLayout descriptorSetLayout;
    VkPipelineLayout pipelineLayout;
    VkPipeline graphicsPipeline;
 
-   VkCommandPool commandPool;
+   // depth only subpass ahead of the colour one so every pixel is shaded once
+   bool depthPrePass;
+   VkPipeline depthPrePassPipeline;
+
    vectorT(VkCommandBuffer) commandBuffers;
 
    vectorT(VkSemaphore) imageAvailableSemaphores;
    vectorT(VkSemaphore) renderFinishedSemaphores;
-   vectorT(VkFence) inFlightFences;
 
+   // Frames are numbered and the graphics submit of each one signals its number, on a timeline
+   // semaphore when the device has them and synchronization2, otherwise on a fence per frame in
+   // flight. TIMELINE_SYNC=0 forces the fences. currentFrame is the frame's slot.
+   bool timelineSync;
+   FrameSync frameSync;
+   u64 frameNumber;
    Size currentFrame;
-   bool framebufferResized;
 
+   // Rendering runs on a thread of its own and the main thread only handles window events,
+   // RENDER_THREAD=0 does both on the main thread as before. Input goes to the render thread
+   // over an SPSC queue. A resize stores the new size, then raises the flag the render thread
+   // exchanges back to false, GLFW can only be asked for the size on the main thread.
+   bool renderThread;
+   pthread_t renderThreadHandle;
+   _Atomic(bool) quit;
+   SpscQueue inputEvents;
+   _Atomic(u64) framebufferSize; // width << 32 | height
+   _Atomic(bool) framebufferResized;
+
+   // LATENCY_STATS=1 prints the time from an input event to the end of the first frame that
+   // picked it up, observed by the render thread so up to a frame late
+   bool measureLatency;
+   LatencySample pendingLatency[8];
+   u32 pendingLatencyCount;
+   u64 latencyNanos;
+   Size latencySamples;
+   Size latencyEvents;
+   Size latencyFrames;
+
+   // copies made during init are recorded into one command buffer that goes out with the first
+   // frame, the staging buffers are freed once that frame is done. On a transfer queue of its
+   // own the copies are submitted there and release the buffers, the first frame acquires them
+   // and waits on uploadsDone.
+   VkCommandBuffer uploadCommands;
+   VkCommandBuffer uploadAcquire;
+   VkSemaphore uploadsDone;
+   bool waitUploads;
+   vectorT(VkBuffer) uploadTargets;
+   bool uploadsPending;
+   vectorT(StagingBuffer) stagingBuffers;
+   u64 stagingFrame;
+
+   // SYNC_STATS=1 prints queue submits, driver waits and the time blocked on them per frame
+   bool measureSync;
+   u64 submitCalls;
+   u64 syncWaitCalls;
+   u64 syncWaitNanos;
+   Size syncFrames;
+
+   // SCENE_TRIANGLES=n cuts the quad into a grid of at least n triangles, SCENE_INSTANCES=n
+   // draws every object n times over. The copies have nothing of their own and land on the same
+   // spot, they add vertex and rasteriser work for benchmarks and nothing to the picture.
+   u32 meshCells;
+   u32 sceneInstances;
+   u64 trianglesDrawn; // this frame's
+
+   // Every mesh gets a chain of simplified levels after the full one, all in the index buffer
+   // one after the other. Each frame every object draws the finest level with at most one
+   // triangle to g_lodPixelsPerTriangle pixels it covers on screen. MESH_LOD=0 always draws the
+   // full mesh, LOD_STATS=1 prints the triangles drawn per frame and how many objects use what.
+   bool meshLod;
+   MeshLodChain meshLods;
+   float meshRadius;
+   bool measureLod;
+   u64 lodTriangles;
+   u64 lodObjects[MESH_MAX_LODS];
+   Size lodFrames;
+
+   // MESHLETS=1 splits every level into meshlets and culls them each frame for every object,
+   // against the frustum and by their normal cones. The indices of the clusters left are copied
+   // into an index buffer of the frame's own and the draws take their range of that instead of
+   // the level's. MESHLET_STATS=1 prints how many clusters and triangles were culled.
+   bool meshletsEnabled;
+   Meshlet* meshlets;
+   Size meshletCount;
+   u16* meshletIndices; // every level's, cluster by cluster
+   Size meshletIndexCount;
+   MeshletRange meshletLevels[MESH_MAX_LODS];
+   vectorT(ClusterIndexBuffer) clusterIndices;
+   bool measureMeshlets;
+   u64 meshletsTested;
+   u64 meshletsOutside;
+   u64 meshletsBackfacing;
+   u64 meshletTriangles;
+   Size meshletFrames;
    VkBuffer vertexBuffer;
    VkDeviceMemory vertexBufferMemory;
    VkBuffer indexBuffer;
@@ -85,17 +286,89 @@ typedef struct {
    vectorT(VkDeviceMemory) uniformBuffersMemory;
    vectorT(void*) uniformBuffersMapped;
 
-   VkDescriptorPool descriptorPool;
+   // Every frame in flight has its own allocator, reset once its fence has signalled, and the
+   // frame's sets are allocated and written again from scratch.
+   DescriptorLayoutCache descriptorLayouts;
+   vectorT(DescriptorAllocator) frameDescriptors;
+   DescriptorTemplate uniformTemplate;
+   bool updateTemplates;
    vectorT(VkDescriptorSet) descriptorSets;
-} App;
-
-typedef struct {
-   u32 graphicsFamily;
-   u32 presentationFamily;
 
-   bool graphicsFound;
-   bool presentationFound;
-} QueueFamilyIndices;
+   // every object gets its own slice of the frame's uniform buffer, bound with a dynamic offset
+   vectorT(SceneObject) sceneObjects;
+   vectorT(DrawKey) drawOrder;
+   DrawSort drawSort;
+   VkDeviceSize uniformStride;
+
+   // the objects move on the simulation thread, every frame blends its two newest ticks
+   Simulation simulation;
+
+   // fragment shader invocations of the scene pass, see report_overdraw. GPU time is measured
+   // for the whole frame command buffer, for overdraw stats and benchmarks.
+   bool measureOverdraw;
+   bool measureGpuTime;
+   VkQueryPool statsQueryPool;
+   VkQueryPool timestampQueryPool;
+   u32 pendingQueries; // bit per frame in flight
+   float timestampPeriod;
+   u64 overdrawFragments;
+   u64 overdrawPixels;
+   u64 overdrawGpuTicks;
+   Size overdrawFrames;
+
+   // BINDLESS=1 with descriptor indexing: every frame's object buffer is an entry of one
+   // update-after-bind storage buffer array. The set is bound once per frame and draws pick
+   // their buffer and object with push constants instead of binding a set each.
+   bool bindless;
+   u32 bindlessCapacity;
+   DescriptorAllocator bindlessDescriptors;
+   VkDescriptorSet bindlessSet;
+
+   // BINDING_STATS=1 prints descriptor binds and CPU recording time per frame, see report_binding
+   bool measureBinding;
+   u64 bindCalls;
+   u64 pushConstantCalls;
+   u64 recordNanos;
+   Size bindingFrames;
+
+   // PARTICLES=n simulates n particles in a compute shader and draws them as points with the
+   // scene. The step runs on a compute only queue family when there is one so it overlaps the
+   // graphics work, ASYNC_COMPUTE=0 keeps it on the graphics queue to compare.
+   bool particlesEnabled;
+   bool asyncCompute;
+   u32 particleCount;
+   ParticleSystem particles;
+   VkPipelineLayout particlePipelineLayout;
+   VkPipeline particlePipeline;
+   RgResource particleTarget;
+   mat4 viewProj;
+
+   // CAPTURE=ppm|png|raw writes every frame into CAPTURE_DIR, GRAB=path writes frame GRAB_FRAME
+   // alone and quits. The copy is the last pass of the frame graph and is read back frames
+   // later, see capture.h. HEADLESS=1 keeps the window hidden.
+   bool capturing;
+   CaptureFormat captureFormat;
+   const char* captureDirectory;
+   const char* grabPath;
+   u64 grabFrame;
+   bool headless;
+   Capture capture;
+
+   // BENCH_FRAMES=n measures n frames after BENCH_WARMUP ones and quits, writing frame time
+   // percentiles and memory use as JSON to BENCH_OUT, stdout without. See ./bench-scenes.
+   bool benchmarking;
+   u32 benchFrames;
+   u32 benchWarmup;
+   const char* benchName;
+   const char* benchOut;
+   char benchDevice[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE];
+   Allocator benchAllocator; // kept out of the allocations being counted
+   FrameTimes benchFrameTimes; // start to start
+   FrameTimes benchCpuTimes; // draw_frame without waiting for the GPU
+   FrameTimes benchGpuTimes;
+   u64 benchFrameStart;
+   u64 benchTriangles;
+} App;
 
 const char* validationLayers[] = {
    "VK_LAYER_KHRONOS_validation"
@@ -105,17 +378,14 @@ const char* requiredDeviceExtensions[] = {
    "VK_KHR_swapchain"
 };
 
-constexpr Vertex vertices[] = {
+// corners of the quad, bottom left and counter clockwise
+constexpr Vertex quadCorners[] = {
    {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
    {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
    {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
    {{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}},
 };
 
-constexpr u16 indices[] = {
-   0, 1, 2, 2, 3, 0,
-};
-
 #ifdef NDEBUG
    const bool enableValidationLayers = false;
 #else
@@ -124,6 +394,9 @@ constexpr u16 indices[] = {
 
 Allocator global_allocator = {0};
 
+HostAllocator vk_host_allocator = {0};
+const VkAllocationCallbacks* vk_allocator = nullptr;
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
    VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
    VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -135,7 +408,33 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
 
 static void framebuffer_resize_callback(GLFWwindow* window, int width, int height) {
    App* app = (App*)glfwGetWindowUserPointer(window); 
-   app->framebufferResized = true;
+   atomic_store_explicit(&app->framebufferSize, (u64)(u32)width << 32 | (u32)height, memory_order_relaxed);
+   atomic_store_explicit(&app->framebufferResized, true, memory_order_release);
+}
+
+// a full queue drops the event, the render thread is too far behind for it to matter
+static void push_input(GLFWwindow* window, InputEventType type, i32 code, i32 action) {
+   App* app = (App*)glfwGetWindowUserPointer(window);
+   InputEvent event = {type, code, action, simulation_now()};
+   spsc_queue_push(&app->inputEvents, &event);
+}
+
+static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+   push_input(window, INPUT_KEY, key, action);
+}
+
+static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+   push_input(window, INPUT_MOUSE_BUTTON, button, action);
+}
+
+static void cursor_position_callback(GLFWwindow* window, double x, double y) {
+   push_input(window, INPUT_CURSOR, (i32)x, (i32)y);
+}
+
+static void framebuffer_size(App* app, u32* width, u32* height) {
+   u64 size = atomic_load_explicit(&app->framebufferSize, memory_order_relaxed);
+   *width = (u32)(size >> 32);
+   *height = (u32)size;
 }
 
 u32 clamp_u32(u32 value, u32 min, u32 max) {
@@ -197,6 +496,14 @@ bool check_validation_layers_support(void) {
    return true;
 }
 
+// vkEnumerateInstanceVersion only exists from 1.1 on, a 1.0 loader doesn't have it.
+u32 instance_api_version(void) {
+   PFN_vkEnumerateInstanceVersion enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+   u32 version = VK_API_VERSION_1_0;
+   if (enumerateInstanceVersion) enumerateInstanceVersion(&version);
+   return version;
+}
+
 void create_instance(VkInstance* instance) {
    if (enableValidationLayers && !check_validation_layers_support()) {
       fprintf(stderr, "Validation layers requested but not available.\n");
@@ -209,7 +516,9 @@ void create_instance(VkInstance* instance) {
    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
    appInfo.pEngineName = "No Engine";
    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-   appInfo.apiVersion = VK_API_VERSION_1_0;
+   // whatever the loader has up to 1.3, features are still checked per device
+   u32 loaderVersion = instance_api_version();
+   appInfo.apiVersion = loaderVersion < VK_API_VERSION_1_3 ? loaderVersion : VK_API_VERSION_1_3;
 
    VkInstanceCreateInfo createInfo = {0};
    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -232,7 +541,7 @@ void create_instance(VkInstance* instance) {
       createInfo.pNext = nullptr;
    }
 
-   if (vkCreateInstance(&createInfo, nullptr, instance) != VK_SUCCESS) {
+   if (vkCreateInstance(&createInfo, vk_allocator, instance) != VK_SUCCESS) {
       fprintf(stderr, "Error initialising vulkan instance.\n");
       exit(EXIT_FAILURE);
    }
@@ -258,70 +567,56 @@ void setup_debug_messenger(App* app) {
    VkDebugUtilsMessengerCreateInfoEXT createInfo = {0};
    populate_debug_messenger_createInfo(&createInfo);
 
-   if (create_debug_utils_messenger_ext(&app->instance, &createInfo, nullptr, &app->debugMessenger) != VK_SUCCESS) {
+   if (create_debug_utils_messenger_ext(&app->instance, &createInfo, vk_allocator, &app->debugMessenger) != VK_SUCCESS) {
        fprintf(stderr, "failed to setup debug messenger!\n");
    }
 }
 
-QueueFamilyIndices find_queue_families(App* app, VkPhysicalDevice device) {
-   QueueFamilyIndices indices = {0};
-
-   u32 queueFamilyCount = 0;
-   vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-
-   VkQueueFamilyProperties queueFamilies[queueFamilyCount] = {};
-   vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies);
-
-   for (u32 i = 0; i < lengthof(queueFamilies); i++) {
-      if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-         indices.graphicsFamily = i;
-         indices.graphicsFound = true;
-      }
-
-      VkBool32 presentationSupport = false;
-      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, app->surface, &presentationSupport);
-
-      if (presentationSupport) {
-         indices.presentationFamily = i;
-         indices.presentationFound = true;
-      }
-
-      if (indices.graphicsFamily == true || indices.presentationFound == true) {
-         break;
-      }
+bool check_device_extension_support(const DeviceCaps* caps) {
+   for (Size i = 0; i < lengthof(requiredDeviceExtensions); i++) {
+      if (!device_caps_has_extension(caps, requiredDeviceExtensions[i])) return false;
    }
-   return indices;
+   return true;
 }
 
-bool check_device_extension_support(App* app, VkPhysicalDevice device) {
-   u32 extensionCount = 0;
-   vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-   VkExtensionProperties availableExtensions[extensionCount] = {};
-   vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions);
-
-   bool extensionsSupported = false;
-   for (Size i = 0; i < extensionCount; i++) {
-      const char* extension = availableExtensions[i].extensionName;
-      for (Size j = 0; j < lengthof(requiredDeviceExtensions); j++) {
-         Size ncmp = strlen(extension) < strlen(availableExtensions[i].extensionName) ? strlen(extension) : strlen(availableExtensions[i].extensionName);
-         if (!strncmp(extension, availableExtensions[i].extensionName, ncmp)) {
-            extensionsSupported = true;
-         }
-      }
-   }
+bool is_device_suitable(App* app, const DeviceCaps* caps) {
+   if (caps->graphics_family == DEVICE_CAPS_NO_FAMILY || caps->present_family == DEVICE_CAPS_NO_FAMILY) return false;
+   if (!check_device_extension_support(caps)) return false;
 
-   return extensionsSupported;
+   u32 formatCount = 0;
+   u32 presentModeCount = 0;
+   vkGetPhysicalDeviceSurfaceFormatsKHR(caps->device, app->surface, &formatCount, nullptr);
+   vkGetPhysicalDeviceSurfacePresentModesKHR(caps->device, app->surface, &presentModeCount, nullptr);
+   return formatCount > 0 && presentModeCount > 0;
 }
 
-bool is_device_suitable(App* app, VkPhysicalDevice device) {
-   QueueFamilyIndices indicies = find_queue_families(app, device);
-
-   bool extensionsSupported = check_device_extension_support(app, device);
-
-   bool foundSuitable = indicies.graphicsFound == true && indicies.presentationFound == true && extensionsSupported;
+// Higher is better. The device type outweighs everything else, so a software renderer never
+// beats real hardware on memory or features, those only order devices of the same type.
+u32 score_device(const DeviceCaps* caps) {
+   u32 score = 0;
+   switch (caps->properties.deviceType) {
+   case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 1000; break;
+   case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 500; break;
+   case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 200; break;
+   case VK_PHYSICAL_DEVICE_TYPE_CPU: score += 50; break;
+   default: break;
+   }
 
-   return foundSuitable;
+   // 10 a GiB up to 32 GiB
+   VkDeviceSize gib = caps->device_local_bytes >> 30;
+   score += (u32)(gib < 32 ? gib : 32) * 10;
+
+   // queues that run alongside graphics, and presenting without handing images over
+   if (caps->compute_family != DEVICE_CAPS_NO_FAMILY) score += 50;
+   if (caps->transfer_family != DEVICE_CAPS_NO_FAMILY) score += 30;
+   if (caps->graphics_family == caps->present_family) score += 20;
+
+   // the faster paths the renderer takes when they are there
+   if (caps->features13.dynamicRendering && caps->features13.synchronization2) score += 25;
+   if (caps->timeline_features.timelineSemaphore) score += 25;
+   if (caps->indexing_features.runtimeDescriptorArray && caps->indexing_features.descriptorBindingStorageBufferUpdateAfterBind) score += 10;
+   if (caps->features.pipelineStatisticsQuery) score += 10;
+   return score;
 }
 
 VkSurfaceFormatKHR choose_swap_surface_format(App* app) {
@@ -350,6 +645,10 @@ VkPresentModeKHR choose_swap_present_mode(App* app) {
    VkPresentModeKHR presentModes[presentModeCount] = {};
    vkGetPhysicalDeviceSurfacePresentModesKHR(app->physicalDevice, app->surface, &presentModeCount, presentModes);
 
+   // benchmarks measure the frame, not the display
+   for (Size i = 0; i < presentModeCount && app->benchmarking; i++) {
+      if (presentModes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR) return presentModes[i];
+   }
    for (Size i = 0; i < presentModeCount; i++) {
       if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
          return presentModes[i];
@@ -362,12 +661,12 @@ VkExtent2D choose_swap_extent(App* app, VkSurfaceCapabilitiesKHR capabilities) {
    if (capabilities.currentExtent.width != UINT32_MAX) {
       return capabilities.currentExtent;
    } else {
-      i32 width, height;
-      glfwGetFramebufferSize(app->window, &width, &height);
+      u32 width, height;
+      framebuffer_size(app, &width, &height);
 
       VkExtent2D actualExtent = {
-         (u32)width,
-         (u32)height
+         width,
+         height
       };
       
       actualExtent.width = clamp_u32(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
@@ -399,11 +698,15 @@ void create_swap_chain(App* app) {
    createInfo.imageExtent = extent;
    createInfo.imageArrayLayers = 1;
    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+   if (app->capturing && !(capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+      fprintf(stderr, "the swapchain images can't be copied from, capture is off\n");
+      app->capturing = false;
+   }
+   if (app->capturing) createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
-   QueueFamilyIndices indices = find_queue_families(app, app->physicalDevice);
-   uint32_t queueFamilyIndices[] = {indices.graphicsFamily, indices.presentationFamily};
+   uint32_t queueFamilyIndices[] = {app->queues.graphics.family, app->queues.present.family};
 
-   if (indices.graphicsFamily != indices.presentationFamily) {
+   if (app->queues.graphics.family != app->queues.present.family) {
       createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
       createInfo.queueFamilyIndexCount = 2;
       createInfo.pQueueFamilyIndices = queueFamilyIndices;
@@ -417,7 +720,7 @@ void create_swap_chain(App* app) {
    createInfo.clipped = VK_TRUE;
    createInfo.oldSwapchain = VK_NULL_HANDLE;
 
-   if (vkCreateSwapchainKHR(app->device, &createInfo, nullptr, &app->swapChain)) {
+   if (vkCreateSwapchainKHR(app->device, &createInfo, vk_allocator, &app->swapChain)) {
       fprintf(stderr, "failed to create swapchain\n");
       exit(EXIT_FAILURE);
    }
@@ -431,52 +734,177 @@ void create_swap_chain(App* app) {
    app->swapChainExtent = extent;
 }
 
+// Both colour and depth are multisampled so it has to be a count both support.
+VkSampleCountFlagBits get_max_usable_sample_count(App* app) {
+   const VkPhysicalDeviceLimits* limits = &app->caps.properties.limits;
+   VkSampleCountFlags counts = limits->framebufferColorSampleCounts & limits->framebufferDepthSampleCounts;
+   VkSampleCountFlagBits candidates[] = {VK_SAMPLE_COUNT_8_BIT, VK_SAMPLE_COUNT_4_BIT, VK_SAMPLE_COUNT_2_BIT};
+   for (Size i = 0; i < lengthof(candidates); i++) {
+      if (counts & candidates[i]) return candidates[i];
+   }
+   return VK_SAMPLE_COUNT_1_BIT;
+}
+
+// A GPU override that is all digits is an index into the enumeration, otherwise a part of
+// the device name.
+static bool matches_gpu_override(const char* gpuOverride, u32 index, const DeviceCaps* caps) {
+   char* end = nullptr;
+   unsigned long wanted = strtoul(gpuOverride, &end, 10);
+   if (end != gpuOverride && *end == '\0') return wanted == index;
+   return strstr(caps->properties.deviceName, gpuOverride) != nullptr;
+}
+
 void pick_physical_device(App* app) {
    u32 deviceCount = 0;
    vkEnumeratePhysicalDevices(app->instance, &deviceCount, nullptr);
 
    if (deviceCount == 0) {
-      printf("No device found.");
+      fprintf(stderr, "No device found.\n");
+      exit(EXIT_FAILURE);
    }
 
    VkPhysicalDevice devices[deviceCount] = {};
    vkEnumeratePhysicalDevices(app->instance, &deviceCount, devices);
-   for (Size i = 0; i < lengthof(devices); i++) {
-      if (is_device_suitable(app, devices[i])) {
-         app->physicalDevice = devices[i];
-         break;
+
+   // the best so far stays in app->caps, every other device's caps are dropped again
+   u32 instanceVersion = instance_api_version();
+   u32 bestScore = 0;
+   bool overrideFound = false;
+   for (u32 i = 0; i < deviceCount; i++) {
+      DeviceCaps caps;
+      if (!device_caps_query(&caps, devices[i], app->surface, instanceVersion, &global_allocator)) {
+         fprintf(stderr, "failed to query device %u\n", i);
+         exit(EXIT_FAILURE);
       }
+
+      bool suitable = is_device_suitable(app, &caps);
+      u32 score = suitable ? score_device(&caps) : 0;
+      bool overridden = app->gpuOverride && matches_gpu_override(app->gpuOverride, i, &caps);
+      printf("gpu %u: %s (%s) score %u%s\n", i, caps.properties.deviceName, device_caps_type_name(caps.properties.deviceType),
+             score, suitable ? "" : ", not suitable");
+
+      bool better = suitable && (app->caps.device == VK_NULL_HANDLE || score > bestScore);
+      bool pick = app->gpuOverride ? overridden && !overrideFound : better;
+      if (pick && app->gpuOverride) {
+         overrideFound = true;
+         if (!suitable) {
+            fprintf(stderr, "GPU %s is not suitable\n", app->gpuOverride);
+            exit(EXIT_FAILURE);
+         }
+      }
+      if (!pick) {
+         device_caps_destroy(&caps);
+         continue;
+      }
+
+      device_caps_destroy(&app->caps);
+      app->caps = caps;
+      bestScore = score;
    }
 
-   if (app->physicalDevice == VK_NULL_HANDLE) {
+   if (app->gpuOverride && !overrideFound) {
+      fprintf(stderr, "no GPU matches %s\n", app->gpuOverride);
+      exit(EXIT_FAILURE);
+   }
+   if (app->caps.device == VK_NULL_HANDLE) {
       fprintf(stderr, "failed to find suitable GPU.\n");
       exit(EXIT_FAILURE);
    }
+   app->physicalDevice = app->caps.device;
+   printf("gpu: %s\n", app->caps.properties.deviceName);
+
+   VkSampleCountFlagBits maxSamples = get_max_usable_sample_count(app);
+   if (app->msaaSamples > maxSamples) {
+      fprintf(stderr, "%ux MSAA not supported, using %ux\n", app->msaaSamples, maxSamples);
+      app->msaaSamples = maxSamples;
+   }
+}
+
+// Sizes the bindless array, capped by what the device allows in an update-after-bind set.
+u32 bindless_capacity(App* app) {
+   const VkPhysicalDeviceDescriptorIndexingProperties* indexingProperties = &app->caps.indexing_properties;
+   u32 capacity = g_bindlessMaxBuffers;
+   if (indexingProperties->maxPerStageDescriptorUpdateAfterBindStorageBuffers < capacity) capacity = indexingProperties->maxPerStageDescriptorUpdateAfterBindStorageBuffers;
+   if (indexingProperties->maxDescriptorSetUpdateAfterBindStorageBuffers < capacity) capacity = indexingProperties->maxDescriptorSetUpdateAfterBindStorageBuffers;
+   return capacity;
 }
 
 void create_logical_device(App* app) {
-   QueueFamilyIndices indices = find_queue_families(app, app->physicalDevice);
+   queues_plan(&app->queues, &app->caps, app->asyncCompute, app->asyncTransfer);
 
-   u32 uniqueQueueFamilies[2] = {indices.graphicsFamily, indices.presentationFamily};
+   const VkPhysicalDeviceFeatures* supportedFeatures = &app->caps.features;
+   VkPhysicalDeviceFeatures deviceFeatures = {0};
+   if (app->measureOverdraw && !supportedFeatures->pipelineStatisticsQuery) {
+      fprintf(stderr, "pipeline statistics queries not supported, not measuring overdraw\n");
+      app->measureOverdraw = false;
+   }
+   deviceFeatures.pipelineStatisticsQuery = app->measureOverdraw;
 
-   float queuePriority = 1.0f;
-   VkDeviceQueueCreateInfo queueCreateInfos[2] = {0};
-   for (Size i = 0; i < lengthof(queueCreateInfos); i++) {
-      queueCreateInfos[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-      queueCreateInfos[i].queueFamilyIndex = uniqueQueueFamilies[i];
-      queueCreateInfos[i].queueCount = 1;
-      queueCreateInfos[i].pQueuePriorities = &queuePriority;
+   const char* deviceExtensions[lengthof(requiredDeviceExtensions) + 1];
+   u32 deviceExtensionCount = 0;
+   for (Size i = 0; i < lengthof(requiredDeviceExtensions); i++) {
+      deviceExtensions[deviceExtensionCount++] = requiredDeviceExtensions[i];
    }
 
-   VkPhysicalDeviceFeatures deviceFeatures = {0};
+   // descriptor update templates are core in 1.1
+   app->updateTemplates = app->caps.api_version >= VK_API_VERSION_1_1;
+
+   // descriptor indexing is core in 1.2 and VK_EXT_descriptor_indexing before that, the caps
+   // have the features of either
+   VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = app->caps.indexing_features;
+   if (app->bindless) {
+      bool core = app->caps.api_version >= VK_API_VERSION_1_2;
+      app->bindless = supportedFeatures->shaderStorageBufferArrayDynamicIndexing && indexingFeatures.runtimeDescriptorArray
+                      && indexingFeatures.descriptorBindingPartiallyBound && indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind;
+      if (!app->bindless) fprintf(stderr, "descriptor indexing not supported, binding a set per draw\n");
+      indexingFeatures = (VkPhysicalDeviceDescriptorIndexingFeatures){0};
+      indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+      indexingFeatures.runtimeDescriptorArray = app->bindless;
+      indexingFeatures.descriptorBindingPartiallyBound = app->bindless;
+      indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = app->bindless;
+      if (app->bindless && !core) deviceExtensions[deviceExtensionCount++] = VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME;
+      if (app->bindless) app->bindlessCapacity = bindless_capacity(app);
+   }
+   deviceFeatures.shaderStorageBufferArrayDynamicIndexing = app->bindless;
+
+   // timeline semaphores are core in 1.2, vkQueueSubmit2 needs synchronization2 from 1.3
+   VkPhysicalDeviceVulkan13Features features13 = app->caps.features13;
+   VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = app->caps.timeline_features;
+   if (app->dynamicRendering || app->timelineSync) {
+      bool wantDynamicRendering = app->dynamicRendering;
+      bool wantTimelineSync = app->timelineSync;
+      app->dynamicRendering = app->dynamicRendering && features13.dynamicRendering && features13.synchronization2;
+      if (wantDynamicRendering && !app->dynamicRendering) fprintf(stderr, "dynamic rendering not supported, using render passes\n");
+      app->timelineSync = app->timelineSync && timelineFeatures.timelineSemaphore && features13.synchronization2;
+      if (wantTimelineSync && !app->timelineSync) fprintf(stderr, "timeline semaphores not supported, using fences\n");
+      features13 = (VkPhysicalDeviceVulkan13Features){0};
+      features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+      features13.dynamicRendering = app->dynamicRendering;
+      features13.synchronization2 = app->dynamicRendering || app->timelineSync;
+      timelineFeatures = (VkPhysicalDeviceTimelineSemaphoreFeatures){0};
+      timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+      timelineFeatures.timelineSemaphore = app->timelineSync;
+   }
 
    VkDeviceCreateInfo createInfo = {0};
    createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-   createInfo.pQueueCreateInfos = queueCreateInfos;
-   createInfo.queueCreateInfoCount = 1;
+   createInfo.pQueueCreateInfos = app->queues.create_infos;
+   createInfo.queueCreateInfoCount = app->queues.create_info_count;
    createInfo.pEnabledFeatures = &deviceFeatures;
-   createInfo.enabledExtensionCount = lengthof(requiredDeviceExtensions);
-   createInfo.ppEnabledExtensionNames = requiredDeviceExtensions;
+   createInfo.enabledExtensionCount = deviceExtensionCount;
+   createInfo.ppEnabledExtensionNames = deviceExtensions;
+   if (app->bindless) {
+      indexingFeatures.pNext = (void*)createInfo.pNext;
+      createInfo.pNext = &indexingFeatures;
+   }
+   if (app->dynamicRendering || app->timelineSync) {
+      features13.pNext = (void*)createInfo.pNext;
+      createInfo.pNext = &features13;
+   }
+   if (app->timelineSync) {
+      timelineFeatures.pNext = (void*)createInfo.pNext;
+      createInfo.pNext = &timelineFeatures;
+   }
 
    if (enableValidationLayers) {
        createInfo.enabledLayerCount = (u32)(lengthof(validationLayers));
@@ -485,57 +913,130 @@ void create_logical_device(App* app) {
        createInfo.enabledLayerCount = 0;
    }
 
-   if (vkCreateDevice(app->physicalDevice, &createInfo, nullptr, &app->device) != VK_SUCCESS) {
+   if (vkCreateDevice(app->physicalDevice, &createInfo, vk_allocator, &app->device) != VK_SUCCESS) {
       fprintf(stderr, "failed to create logical device!\n");
       exit(EXIT_FAILURE);
    }
 
-   vkGetDeviceQueue(app->device, indices.graphicsFamily, 0, &app->graphicsQueue);
-   vkGetDeviceQueue(app->device, indices.presentationFamily, 0, &app->presentQueue);
+   if (queues_init(&app->queues, app->device, vk_allocator) != VK_SUCCESS) {
+      fprintf(stderr, "failed to create command pools.\n");
+      exit(EXIT_FAILURE);
+   }
+   printf("queues: graphics family %u, present %u, compute %u, transfer %u\n", app->queues.graphics.family,
+          app->queues.present.family, app->queues.compute.family, app->queues.transfer.family);
 }
 
 void create_surface(App* app) {
-   if (glfwCreateWindowSurface(app->instance, app->window, nullptr, &app->surface) != VK_SUCCESS) {
+   if (glfwCreateWindowSurface(app->instance, app->window, vk_allocator, &app->surface) != VK_SUCCESS) {
       fprintf(stderr, "failed to create surface\n");
       exit(EXIT_FAILURE);
    }
 }
 
+u32 find_memory_type(App* app, u32 typeFilter, VkMemoryPropertyFlags properties) {
+   u32 type = device_caps_memory_type(&app->caps, typeFilter, properties);
+   if (type != UINT32_MAX) return type;
+
+   fprintf(stderr, "failed to find suitable memory type!");
+   exit(EXIT_FAILURE);
+}
+
+void create_buffer(App* app, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* buffer, VkDeviceMemory* bufferMemory) {
+   VkBufferCreateInfo bufferInfo = {0};
+   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+   bufferInfo.size = size;
+   bufferInfo.usage = usage;
+   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+   if (vkCreateBuffer(app->device, &bufferInfo, vk_allocator, buffer) != VK_SUCCESS) {
+      fprintf(stderr, "failed to create buffer\n");
+      exit(EXIT_FAILURE);
+   }
+
+   VkMemoryRequirements memRequirements;
+   vkGetBufferMemoryRequirements(app->device, *buffer, &memRequirements);
+
+   VkMemoryAllocateInfo allocInfo = {0};
+   allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+   allocInfo.allocationSize = memRequirements.size;
+   allocInfo.memoryTypeIndex = find_memory_type(app, memRequirements.memoryTypeBits, properties);
+
+   if (vkAllocateMemory(app->device, &allocInfo, vk_allocator, bufferMemory) != VK_SUCCESS) {
+      fprintf(stderr, "failed to allocate vertex buffer memory\n");
+      exit(EXIT_FAILURE);
+   }
+
+   vkBindBufferMemory(app->device, *buffer, *bufferMemory, 0);
+}
+
+VkImageView create_image_view(App* app, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
+   VkImageViewCreateInfo createInfo = {0};
+   createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+   createInfo.image = image;
+   createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+   createInfo.format = format;
+   createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+   createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+   createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+   createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+   createInfo.subresourceRange.aspectMask = aspectFlags;
+   createInfo.subresourceRange.baseMipLevel = 0;
+   createInfo.subresourceRange.levelCount = 1;
+   createInfo.subresourceRange.baseArrayLayer = 0;
+   createInfo.subresourceRange.layerCount = 1;
+
+   VkImageView imageView;
+   if (vkCreateImageView(app->device, &createInfo, vk_allocator, &imageView) != VK_SUCCESS) {
+      fprintf(stderr, "failed to create image view\n");
+      exit(EXIT_FAILURE);
+   }
+   return imageView;
+}
+
+VkFormat find_supported_format(App* app, const VkFormat* candidates, Size candidateCount, VkImageTiling tiling, VkFormatFeatureFlags features) {
+   for (Size i = 0; i < candidateCount; i++) {
+      VkFormatProperties props;
+      vkGetPhysicalDeviceFormatProperties(app->physicalDevice, candidates[i], &props);
+
+      VkFormatFeatureFlags supported = tiling == VK_IMAGE_TILING_LINEAR ? props.linearTilingFeatures : props.optimalTilingFeatures;
+      if ((supported & features) == features) {
+         return candidates[i];
+      }
+   }
+
+   fprintf(stderr, "failed to find supported format\n");
+   exit(EXIT_FAILURE);
+}
+
+VkFormat find_depth_format(App* app) {
+   // nothing uses stencil, so the depth only formats go first. D32 is the most precise, D24 is
+   // the fallback on hardware without it and is smaller where it exists.
+   const VkFormat candidates[] = {
+      VK_FORMAT_D32_SFLOAT,
+      VK_FORMAT_X8_D24_UNORM_PACK32,
+      VK_FORMAT_D24_UNORM_S8_UINT,
+      VK_FORMAT_D32_SFLOAT_S8_UINT,
+   };
+   return find_supported_format(app, candidates, lengthof(candidates), VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+}
+
 void create_image_views(App* app) {
    app->swapChainImageViews = vector(VkImage, vector_length(app->swapChainImages), &global_allocator);
 
    for (Size i = 0; i < vector_length(app->swapChainImages); i++) {
-      VkImageViewCreateInfo createInfo = {};
-      createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-      createInfo.image = app->swapChainImages[i];
-      createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-      createInfo.format = app->swapChainImageFormat;
-      createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-      createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-      createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-      createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-      createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      createInfo.subresourceRange.baseMipLevel = 0;
-      createInfo.subresourceRange.levelCount = 1;
-      createInfo.subresourceRange.baseArrayLayer = 0;
-      createInfo.subresourceRange.layerCount = 1;
-
-      if (vkCreateImageView(app->device, &createInfo, nullptr, &app->swapChainImageViews[i]) != VK_SUCCESS) {
-         fprintf(stderr, "failed to create image views\n");
-         exit(EXIT_FAILURE);
-      }
+      app->swapChainImageViews[i] = create_image_view(app, app->swapChainImages[i], app->swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
    }
    vector_update_length(vector_length(app->swapChainImages), app->swapChainImageViews);
 }
 
-VkShaderModule create_shader_module(App* app, u32* code, Size codeLength) {
+VkShaderModule create_shader_module(App* app, const u32* code, Size codeLength) {
    VkShaderModuleCreateInfo createInfo = {0};
    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
    createInfo.codeSize = codeLength;
    createInfo.pCode = code;
 
    VkShaderModule shaderModule;
-   if (vkCreateShaderModule(app->device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+   if (vkCreateShaderModule(app->device, &createInfo, vk_allocator, &shaderModule) != VK_SUCCESS) {
       fprintf(stderr, "failed to create shader module.\n");
       exit(EXIT_FAILURE);
    }
@@ -575,14 +1076,19 @@ vectorT(VkVertexInputAttributeDescription) get_vertex_attribute_descriptions() {
 }
 
 void create_graphics_pipeline(App* app) {
-   Size vertLength = 0;
-   Size fragLength = 0;
+   ShaderResult vertShaderCode = shader_load(app->bindless ? "vert_bindless" : "vert");
+   ShaderResult fragShaderCode = shader_load("frag");
+   if (!vertShaderCode.ok || !fragShaderCode.ok) {
+      fprintf(stderr, "failed to load shaders: %s\n", strerror(vertShaderCode.ok ? fragShaderCode.error : vertShaderCode.error));
+      exit(EXIT_FAILURE);
+   }
 
-   u32* fragShaderCode = read_binary_file("resources/shaders/frag.spv", &fragLength, &global_allocator);
-   u32* vertShaderCode = read_binary_file("resources/shaders/vert.spv", &vertLength, &global_allocator);
+   VkShaderModule vertShaderModule = create_shader_module(app, vertShaderCode.value.code, vertShaderCode.value.size);
+   VkShaderModule fragShaderModule = create_shader_module(app, fragShaderCode.value.code, fragShaderCode.value.size);
 
-   VkShaderModule vertShaderModule = create_shader_module(app, vertShaderCode, vertLength);
-   VkShaderModule fragShaderModule = create_shader_module(app, fragShaderCode, fragLength);
+   // the driver has its own copy once the module exists
+   shader_unload(&vertShaderCode.value);
+   shader_unload(&fragShaderCode.value);
 
    VkPipelineShaderStageCreateInfo vertShaderStageInfo = {0};
    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -631,7 +1137,7 @@ void create_graphics_pipeline(App* app) {
    VkPipelineMultisampleStateCreateInfo multisampling = {0};
    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
    multisampling.sampleShadingEnable = VK_FALSE;
-   multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+   multisampling.rasterizationSamples = app->msaaSamples;
 
    VkPipelineColorBlendAttachmentState colorBlendAttachment = {0};
    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -648,6 +1154,16 @@ void create_graphics_pipeline(App* app) {
    colorBlending.blendConstants[2] = 0.0f;
    colorBlending.blendConstants[3] = 0.0f;
 
+   // with the pre-pass the depth buffer is complete before the colour subpass, which only shades
+   // the fragment that won
+   VkPipelineDepthStencilStateCreateInfo depthStencil = {0};
+   depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+   depthStencil.depthTestEnable = VK_TRUE;
+   depthStencil.depthWriteEnable = app->depthPrePass ? VK_FALSE : VK_TRUE;
+   depthStencil.depthCompareOp = app->depthPrePass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
+   depthStencil.depthBoundsTestEnable = VK_FALSE;
+   depthStencil.stencilTestEnable = VK_FALSE;
+
    VkDynamicState dynamicStates[] = {
       VK_DYNAMIC_STATE_VIEWPORT,
       VK_DYNAMIC_STATE_SCISSOR,
@@ -663,7 +1179,16 @@ void create_graphics_pipeline(App* app) {
    pipelineLayoutInfo.setLayoutCount = 1;
    pipelineLayoutInfo.pSetLayouts = &app->descriptorSetLayout;
 
-   if (vkCreatePipelineLayout(app->device, &pipelineLayoutInfo, nullptr, &app->pipelineLayout) != VK_SUCCESS) {
+   VkPushConstantRange bindlessRange = {0};
+   bindlessRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+   bindlessRange.offset = 0;
+   bindlessRange.size = sizeof(BindlessDraw);
+   if (app->bindless) {
+      pipelineLayoutInfo.pushConstantRangeCount = 1;
+      pipelineLayoutInfo.pPushConstantRanges = &bindlessRange;
+   }
+
+   if (vkCreatePipelineLayout(app->device, &pipelineLayoutInfo, vk_allocator, &app->pipelineLayout) != VK_SUCCESS) {
       fprintf(stderr, "failed to create pipeline layout.\n");
       exit(EXIT_FAILURE);
    }
@@ -677,60 +1202,289 @@ void create_graphics_pipeline(App* app) {
    pipelineInfo.pViewportState = &viewportState;
    pipelineInfo.pRasterizationState = &rasterizer;
    pipelineInfo.pMultisampleState = &multisampling;
-   pipelineInfo.pDepthStencilState = nullptr; // Optional
+   pipelineInfo.pDepthStencilState = &depthStencil;
    pipelineInfo.pColorBlendState = &colorBlending;
    pipelineInfo.pDynamicState = &dynamicState;
    pipelineInfo.layout = app->pipelineLayout;
-   pipelineInfo.renderPass = app->renderPass;
-   pipelineInfo.subpass = 0;
 
-   if (vkCreateGraphicsPipelines(app->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &app->graphicsPipeline) != VK_SUCCESS) {
+   // with dynamic rendering the pipeline only has to know the attachment formats
+   VkPipelineRenderingCreateInfo renderingInfo = {0};
+   renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+   renderingInfo.colorAttachmentCount = 1;
+   renderingInfo.pColorAttachmentFormats = &app->swapChainImageFormat;
+   renderingInfo.depthAttachmentFormat = app->depthFormat;
+
+   if (app->dynamicRendering) {
+      pipelineInfo.pNext = &renderingInfo;
+      pipelineInfo.renderPass = VK_NULL_HANDLE;
+      pipelineInfo.subpass = 0;
+   } else {
+      pipelineInfo.renderPass = app->renderPass;
+      pipelineInfo.subpass = app->depthPrePass ? 1 : 0;
+   }
+
+   if (vkCreateGraphicsPipelines(app->device, VK_NULL_HANDLE, 1, &pipelineInfo, vk_allocator, &app->graphicsPipeline) != VK_SUCCESS) {
       fprintf(stderr, "failed to create graphics pipeline.\n");
       exit(EXIT_FAILURE);
    }
 
-   vkDestroyShaderModule(app->device, vertShaderModule, nullptr);
-   vkDestroyShaderModule(app->device, fragShaderModule, nullptr);
+   if (app->depthPrePass) {
+      // same vertex shader and state so the depth values match exactly, no fragment shader and
+      // no colour output
+      VkPipelineDepthStencilStateCreateInfo prePassDepthStencil = depthStencil;
+      prePassDepthStencil.depthWriteEnable = VK_TRUE;
+      prePassDepthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+      VkPipelineColorBlendStateCreateInfo prePassColorBlending = colorBlending;
+      prePassColorBlending.attachmentCount = 0;
+      prePassColorBlending.pAttachments = nullptr;
+
+      VkPipelineRenderingCreateInfo prePassRenderingInfo = renderingInfo;
+      prePassRenderingInfo.colorAttachmentCount = 0;
+      prePassRenderingInfo.pColorAttachmentFormats = nullptr;
+
+      VkGraphicsPipelineCreateInfo prePassInfo = pipelineInfo;
+      if (app->dynamicRendering) prePassInfo.pNext = &prePassRenderingInfo;
+      prePassInfo.stageCount = 1;
+      prePassInfo.pDepthStencilState = &prePassDepthStencil;
+      prePassInfo.pColorBlendState = &prePassColorBlending;
+      prePassInfo.subpass = 0;
+
+      if (vkCreateGraphicsPipelines(app->device, VK_NULL_HANDLE, 1, &prePassInfo, vk_allocator, &app->depthPrePassPipeline) != VK_SUCCESS) {
+         fprintf(stderr, "failed to create depth pre-pass pipeline.\n");
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   vkDestroyShaderModule(app->device, vertShaderModule, vk_allocator);
+   vkDestroyShaderModule(app->device, fragShaderModule, vk_allocator);
+}
+
+// Points in the scene pass, after the scene's own draws. They are tested against the scene's
+// depth but don't write it, the vertex buffer is the compute step's output for the frame.
+void create_particle_pipeline(App* app) {
+   ShaderResult vertShaderCode = shader_load("particles_vert");
+   ShaderResult fragShaderCode = shader_load("particles_frag");
+   if (!vertShaderCode.ok || !fragShaderCode.ok) {
+      fprintf(stderr, "failed to load particle shaders: %s\n", strerror(vertShaderCode.ok ? fragShaderCode.error : vertShaderCode.error));
+      exit(EXIT_FAILURE);
+   }
+
+   VkShaderModule vertShaderModule = create_shader_module(app, vertShaderCode.value.code, vertShaderCode.value.size);
+   VkShaderModule fragShaderModule = create_shader_module(app, fragShaderCode.value.code, fragShaderCode.value.size);
+   shader_unload(&vertShaderCode.value);
+   shader_unload(&fragShaderCode.value);
+
+   VkPipelineShaderStageCreateInfo shaderStages[2] = {0};
+   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+   shaderStages[0].module = vertShaderModule;
+   shaderStages[0].pName = "main";
+   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+   shaderStages[1].module = fragShaderModule;
+   shaderStages[1].pName = "main";
+
+   VkVertexInputBindingDescription bindingDescription = {0};
+   bindingDescription.binding = 0;
+   bindingDescription.stride = 4 * sizeof(float);
+   bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+   VkVertexInputAttributeDescription attributeDescription = {0};
+   attributeDescription.binding = 0;
+   attributeDescription.location = 0;
+   attributeDescription.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+   attributeDescription.offset = 0;
+
+   VkPipelineVertexInputStateCreateInfo vertexInputInfo = {0};
+   vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+   vertexInputInfo.vertexBindingDescriptionCount = 1;
+   vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+   vertexInputInfo.vertexAttributeDescriptionCount = 1;
+   vertexInputInfo.pVertexAttributeDescriptions = &attributeDescription;
+
+   VkPipelineInputAssemblyStateCreateInfo inputAssembly = {0};
+   inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+   inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+
+   VkPipelineViewportStateCreateInfo viewportState = {0};
+   viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+   viewportState.viewportCount = 1;
+   viewportState.scissorCount = 1;
+
+   VkPipelineRasterizationStateCreateInfo rasterizer = {0};
+   rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+   rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+   rasterizer.lineWidth = 1.0f;
+   rasterizer.cullMode = VK_CULL_MODE_NONE;
+   rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+   VkPipelineMultisampleStateCreateInfo multisampling = {0};
+   multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+   multisampling.rasterizationSamples = app->msaaSamples;
+
+   VkPipelineColorBlendAttachmentState colorBlendAttachment = {0};
+   colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+   colorBlendAttachment.blendEnable = VK_FALSE;
+
+   VkPipelineColorBlendStateCreateInfo colorBlending = {0};
+   colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+   colorBlending.attachmentCount = 1;
+   colorBlending.pAttachments = &colorBlendAttachment;
+
+   VkPipelineDepthStencilStateCreateInfo depthStencil = {0};
+   depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+   depthStencil.depthTestEnable = VK_TRUE;
+   depthStencil.depthWriteEnable = VK_FALSE;
+   depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+   VkDynamicState dynamicStates[] = {
+      VK_DYNAMIC_STATE_VIEWPORT,
+      VK_DYNAMIC_STATE_SCISSOR,
+   };
+
+   VkPipelineDynamicStateCreateInfo dynamicState = {0};
+   dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+   dynamicState.dynamicStateCount = lengthof(dynamicStates);
+   dynamicState.pDynamicStates = dynamicStates;
+
+   VkPushConstantRange cameraRange = {0};
+   cameraRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+   cameraRange.offset = 0;
+   cameraRange.size = sizeof(mat4);
+
+   VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
+   pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+   pipelineLayoutInfo.pushConstantRangeCount = 1;
+   pipelineLayoutInfo.pPushConstantRanges = &cameraRange;
+
+   if (vkCreatePipelineLayout(app->device, &pipelineLayoutInfo, vk_allocator, &app->particlePipelineLayout) != VK_SUCCESS) {
+      fprintf(stderr, "failed to create particle pipeline layout.\n");
+      exit(EXIT_FAILURE);
+   }
+
+   VkGraphicsPipelineCreateInfo pipelineInfo = {0};
+   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+   pipelineInfo.stageCount = lengthof(shaderStages);
+   pipelineInfo.pStages = shaderStages;
+   pipelineInfo.pVertexInputState = &vertexInputInfo;
+   pipelineInfo.pInputAssemblyState = &inputAssembly;
+   pipelineInfo.pViewportState = &viewportState;
+   pipelineInfo.pRasterizationState = &rasterizer;
+   pipelineInfo.pMultisampleState = &multisampling;
+   pipelineInfo.pDepthStencilState = &depthStencil;
+   pipelineInfo.pColorBlendState = &colorBlending;
+   pipelineInfo.pDynamicState = &dynamicState;
+   pipelineInfo.layout = app->particlePipelineLayout;
+
+   VkPipelineRenderingCreateInfo renderingInfo = {0};
+   renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+   renderingInfo.colorAttachmentCount = 1;
+   renderingInfo.pColorAttachmentFormats = &app->swapChainImageFormat;
+   renderingInfo.depthAttachmentFormat = app->depthFormat;
+
+   if (app->dynamicRendering) {
+      pipelineInfo.pNext = &renderingInfo;
+   } else {
+      pipelineInfo.renderPass = app->renderPass;
+      pipelineInfo.subpass = app->depthPrePass ? 1 : 0;
+   }
+
+   if (vkCreateGraphicsPipelines(app->device, VK_NULL_HANDLE, 1, &pipelineInfo, vk_allocator, &app->particlePipeline) != VK_SUCCESS) {
+      fprintf(stderr, "failed to create particle pipeline.\n");
+      exit(EXIT_FAILURE);
+   }
+
+   vkDestroyShaderModule(app->device, vertShaderModule, vk_allocator);
+   vkDestroyShaderModule(app->device, fragShaderModule, vk_allocator);
 }
 
+// The frame graph moves the attachments in and out of these layouts around the pass, so the
+// render pass neither transitions them nor needs external dependencies.
 void create_render_pass(App* app) {
+   bool msaa = app->msaaSamples > VK_SAMPLE_COUNT_1_BIT;
+
+   // with MSAA this is the multisample target, only the resolve gets written out
    VkAttachmentDescription colourAttachment = {0};
    colourAttachment.format = app->swapChainImageFormat;
-   colourAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+   colourAttachment.samples = app->msaaSamples;
    colourAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-   colourAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+   colourAttachment.storeOp = msaa ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
    colourAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
    colourAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-   colourAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-   colourAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+   colourAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+   colourAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+   VkAttachmentDescription depthAttachment = {0};
+   depthAttachment.format = app->depthFormat;
+   depthAttachment.samples = app->msaaSamples;
+   depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+   depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+   depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+   depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+   depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+   depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+   // the swapchain image, fully overwritten by the resolve
+   VkAttachmentDescription resolveAttachment = {0};
+   resolveAttachment.format = app->swapChainImageFormat;
+   resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+   resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+   resolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+   resolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+   resolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+   resolveAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+   resolveAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
    VkAttachmentReference colourAttachmentRef = {0};
    colourAttachmentRef.attachment = 0;
    colourAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-   VkSubpassDescription subpass = {0};
-   subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-   subpass.colorAttachmentCount = 1;
-   subpass.pColorAttachments = &colourAttachmentRef;
-
-   VkSubpassDependency dependency = {0};
-   dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-   dependency.dstSubpass = 0;
-   dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-   dependency.srcAccessMask = 0;
-   dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-   dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+   VkAttachmentReference depthAttachmentRef = {0};
+   depthAttachmentRef.attachment = 1;
+   depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+   VkAttachmentReference resolveAttachmentRef = {0};
+   resolveAttachmentRef.attachment = 2;
+   resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+   // with the pre-pass subpass 0 only writes depth and subpass 1 is the usual colour pass
+   VkSubpassDescription subpasses[2] = {0};
+   u32 subpassCount = 0;
+   if (app->depthPrePass) {
+      subpasses[subpassCount].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+      subpasses[subpassCount].pDepthStencilAttachment = &depthAttachmentRef;
+      subpassCount++;
+   }
+   subpasses[subpassCount].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+   subpasses[subpassCount].colorAttachmentCount = 1;
+   subpasses[subpassCount].pColorAttachments = &colourAttachmentRef;
+   subpasses[subpassCount].pResolveAttachments = msaa ? &resolveAttachmentRef : nullptr;
+   subpasses[subpassCount].pDepthStencilAttachment = &depthAttachmentRef;
+   subpassCount++;
+
+   // the colour subpass tests against the depth the pre-pass wrote
+   VkSubpassDependency prePassDependency = {0};
+   prePassDependency.srcSubpass = 0;
+   prePassDependency.dstSubpass = 1;
+   prePassDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+   prePassDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+   prePassDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+   prePassDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+   prePassDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+   VkAttachmentDescription attachments[] = {colourAttachment, depthAttachment, resolveAttachment};
 
    VkRenderPassCreateInfo renderPassInfo = {0};
    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-   renderPassInfo.attachmentCount = 1;
-   renderPassInfo.pAttachments = &colourAttachment;
-   renderPassInfo.subpassCount = 1;
-   renderPassInfo.pSubpasses = &subpass;
-   renderPassInfo.pDependencies = &dependency;
-   renderPassInfo.dependencyCount = 1;
-
-   if (vkCreateRenderPass(app->device, &renderPassInfo, nullptr, &app->renderPass) != VK_SUCCESS) {
+   renderPassInfo.attachmentCount = msaa ? 3 : 2;
+   renderPassInfo.pAttachments = attachments;
+   renderPassInfo.subpassCount = subpassCount;
+   renderPassInfo.pSubpasses = subpasses;
+   renderPassInfo.pDependencies = &prePassDependency;
+   renderPassInfo.dependencyCount = app->depthPrePass ? 1 : 0;
+
+   if (vkCreateRenderPass(app->device, &renderPassInfo, vk_allocator, &app->renderPass) != VK_SUCCESS) {
       fprintf(stderr, "failed to create render pass.\n");
       exit(EXIT_FAILURE);
    }
@@ -739,21 +1493,26 @@ void create_render_pass(App* app) {
 void create_framebuffers(App* app) {
    app->swapChainFramebuffers = vector(VkFramebuffer, vector_length(app->swapChainImageViews), &global_allocator);
 
+   bool msaa = app->msaaSamples > VK_SAMPLE_COUNT_1_BIT;
    for (Size i = 0; i < vector_length(app->swapChainImageViews); i++) {
-      VkImageView attachments[] = {
-         app->swapChainImageViews[i],
-      };
+      // same order as the render pass attachments, the swapchain image is the resolve target
+      // with MSAA
+      VkImageView attachments[3] = {0};
+      u32 attachmentCount = 0;
+      attachments[attachmentCount++] = msaa ? rg_image_view(&app->frameGraph, app->msaaColourTarget) : app->swapChainImageViews[i];
+      attachments[attachmentCount++] = rg_image_view(&app->frameGraph, app->depthTarget);
+      if (msaa) attachments[attachmentCount++] = app->swapChainImageViews[i];
 
       VkFramebufferCreateInfo framebufferCreateInfo = {0};
       framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
       framebufferCreateInfo.renderPass = app->renderPass;
-      framebufferCreateInfo.attachmentCount = 1;
+      framebufferCreateInfo.attachmentCount = attachmentCount;
       framebufferCreateInfo.pAttachments = attachments;
       framebufferCreateInfo.width = app->swapChainExtent.width;
       framebufferCreateInfo.height = app->swapChainExtent.height;
       framebufferCreateInfo.layers = 1;
 
-      if (vkCreateFramebuffer(app->device, &framebufferCreateInfo, nullptr, &app->swapChainFramebuffers[i]) != VK_SUCCESS) {
+      if (vkCreateFramebuffer(app->device, &framebufferCreateInfo, vk_allocator, &app->swapChainFramebuffers[i]) != VK_SUCCESS) {
          fprintf(stderr, "failed to create framebuffer.\n");
          exit(EXIT_FAILURE);
       }
@@ -761,27 +1520,13 @@ void create_framebuffers(App* app) {
    vector_update_length(vector_length(app->swapChainImageViews), app->swapChainFramebuffers);
 }
 
-void create_command_pool(App* app) {
-   QueueFamilyIndices queueFamilyIndices = find_queue_families(app, app->physicalDevice);
-
-   VkCommandPoolCreateInfo poolInfo = {0};
-   poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-   poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-   poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-
-   if (vkCreateCommandPool(app->device, &poolInfo, nullptr, &app->commandPool) != VK_SUCCESS) {
-      fprintf(stderr, "failed to create command pool.\n");
-      exit(EXIT_FAILURE);
-   }
-}
-
 void create_command_buffers(App* app) {
    app->commandBuffers = vector(VkCommandBuffer, g_maxFramesInFlight, &global_allocator);
    vector_update_length(g_maxFramesInFlight, app->commandBuffers);
 
    VkCommandBufferAllocateInfo allocInfo = {0};
    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-   allocInfo.commandPool = app->commandPool;
+   allocInfo.commandPool = app->queues.graphics.pool;
    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
    allocInfo.commandBufferCount = (u32)vector_length(app->commandBuffers);
 
@@ -791,29 +1536,69 @@ void create_command_buffers(App* app) {
    }
 }
 
-void record_command_buffer(App* app, VkCommandBuffer commandBuffer, u32 imageIndex) {
-   VkCommandBufferBeginInfo beginInfo = {0};
-   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+u32 mesh_vertex_count(App* app) {
+   return (app->meshCells + 1) * (app->meshCells + 1);
+}
 
-   if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-      fprintf(stderr, "failed to begin recording command buffer.\n");
-      exit(EXIT_FAILURE);
-   }
+u32 mesh_index_count(App* app) {
+   return app->meshCells * app->meshCells * 6;
+}
 
-   VkRenderPassBeginInfo renderPassInfo = {0};
-   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-   renderPassInfo.renderPass = app->renderPass;
-   renderPassInfo.framebuffer = app->swapChainFramebuffers[imageIndex];
-   renderPassInfo.renderArea.offset = (VkOffset2D){0, 0};
-   renderPassInfo.renderArea.extent = app->swapChainExtent;
+// Row by row from the bottom left, the colours blend between the quad's corners. One cell is
+// the original quad.
+void write_mesh_vertices(App* app, Vertex* out) {
+   u32 cells = app->meshCells;
+   for (u32 y = 0; y <= cells; y++) {
+      for (u32 x = 0; x <= cells; x++) {
+         float u = (float)x / (float)cells;
+         float v = (float)y / (float)cells;
+         float weights[4] = {(1.0f - u) * (1.0f - v), u * (1.0f - v), u * v, (1.0f - u) * v};
+
+         Vertex* vertex = &out[y * (cells + 1) + x];
+         vertex->pos[0] = u - 0.5f;
+         vertex->pos[1] = v - 0.5f;
+         glm_vec3_zero(vertex->colour);
+         for (u32 i = 0; i < lengthof(quadCorners); i++) {
+            glm_vec3_muladds((float*)quadCorners[i].colour, weights[i], vertex->colour);
+         }
+      }
+   }
+}
 
-   VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-   renderPassInfo.clearValueCount = 1;
-   renderPassInfo.pClearValues = &clearColor;
+void write_mesh_indices(App* app, u32* out) {
+   u32 cells = app->meshCells;
+   u32 n = 0;
+   for (u32 y = 0; y < cells; y++) {
+      for (u32 x = 0; x < cells; x++) {
+         u32 a = y * (cells + 1) + x;
+         u32 b = a + 1;
+         u32 c = a + cells + 1;
+         u32 d = c + 1;
+         u32 cell[6] = {a, b, d, d, c, a};
+         for (u32 i = 0; i < lengthof(cell); i++) out[n++] = cell[i];
+      }
+   }
+}
 
-   vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->graphicsPipeline);
+// Draws every object in app->drawOrder, the uniform slices are written in the same order.
+void draw_scene(App* app, VkCommandBuffer commandBuffer) {
+   for (Size i = 0; i < vector_length(app->drawOrder); i++) {
+      if (app->bindless) {
+         BindlessDraw draw = {(u32)app->currentFrame, (u32)i};
+         vkCmdPushConstants(commandBuffer, app->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(draw), &draw);
+         app->pushConstantCalls++;
+      } else {
+         u32 dynamicOffset = (u32)((VkDeviceSize)i * app->uniformStride);
+         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->pipelineLayout, 0, 1, &app->descriptorSets[app->currentFrame], 1, &dynamicOffset);
+         app->bindCalls++;
+      }
+      const DrawKey* draw = &app->drawOrder[i];
+      if (draw->index_count == 0) continue;
+      vkCmdDrawIndexed(commandBuffer, draw->index_count, app->sceneInstances, draw->first_index, 0, 0);
+   }
+}
 
+void bind_scene_state(App* app, VkCommandBuffer commandBuffer) {
    VkViewport viewport = {0};
    viewport.x = 0.0f;
    viewport.y = 0.0f;
@@ -832,12 +1617,261 @@ void record_command_buffer(App* app, VkCommandBuffer commandBuffer, u32 imageInd
    VkDeviceSize offsets[] = {0};
 
    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-   vkCmdBindIndexBuffer(commandBuffer, app->indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+   VkBuffer indexBuffer = app->meshletsEnabled ? app->clusterIndices[app->currentFrame].buffer : app->indexBuffer;
+   vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+}
+
+// Draws the scene with the current pipeline, counting fragments if overdraw is measured. The
+// colour pass, triangles are counted here so a depth pre-pass doesn't count them twice.
+void draw_scene_measured(App* app, VkCommandBuffer commandBuffer) {
+   u32 frame = (u32)app->currentFrame;
+   if (app->measureOverdraw) vkCmdBeginQuery(commandBuffer, app->statsQueryPool, frame, 0);
+   draw_scene(app, commandBuffer);
+   if (app->measureOverdraw) vkCmdEndQuery(commandBuffer, app->statsQueryPool, frame);
+
+   for (Size i = 0; i < vector_length(app->drawOrder); i++) {
+      app->trianglesDrawn += (u64)app->drawOrder[i].index_count / 3 * app->sceneInstances;
+   }
+}
 
-   vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->pipelineLayout, 0, 1, &app->descriptorSets[app->currentFrame], 0, nullptr);
-   vkCmdDrawIndexed(commandBuffer, lengthof(indices), 1, 0, 0, 0);
+// after the scene so the points are depth tested against it without writing depth
+void draw_particles(App* app, VkCommandBuffer commandBuffer) {
+   if (!app->particlesEnabled) return;
+
+   VkBuffer points = particles_points(&app->particles, (u32)app->currentFrame);
+   VkDeviceSize offset = 0;
+   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->particlePipeline);
+   vkCmdBindVertexBuffers(commandBuffer, 0, 1, &points, &offset);
+   vkCmdPushConstants(commandBuffer, app->particlePipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat4), app->viewProj);
+   vkCmdDraw(commandBuffer, app->particleCount, 1, 0, 0);
+}
+
+// Render pass path, the only pass in the frame graph. The depth pre-pass is a subpass of the
+// same render pass.
+static void record_scene_pass(VkCommandBuffer commandBuffer, void* user) {
+   App* app = user;
+
+   VkRenderPassBeginInfo renderPassInfo = {0};
+   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+   renderPassInfo.renderPass = app->renderPass;
+   renderPassInfo.framebuffer = app->swapChainFramebuffers[app->imageIndex];
+   renderPassInfo.renderArea.offset = (VkOffset2D){0, 0};
+   renderPassInfo.renderArea.extent = app->swapChainExtent;
+
+   VkClearValue clearValues[2] = {0};
+   clearValues[0].color = (VkClearColorValue){{0.0f, 0.0f, 0.0f, 1.0f}};
+   clearValues[1].depthStencil = (VkClearDepthStencilValue){1.0f, 0};
+   renderPassInfo.clearValueCount = lengthof(clearValues);
+   renderPassInfo.pClearValues = clearValues;
+
+   vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+   bind_scene_state(app, commandBuffer);
+
+   if (app->depthPrePass) {
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->depthPrePassPipeline);
+      draw_scene(app, commandBuffer);
+      vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+   }
+
+   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->graphicsPipeline);
+   draw_scene_measured(app, commandBuffer);
+   draw_particles(app, commandBuffer);
 
    vkCmdEndRenderPass(commandBuffer);
+}
+
+// Dynamic rendering path. Without subpasses the pre-pass is a graph pass of its own and the
+// scene pass only reads the depth it left behind.
+static void record_depth_prepass_rendering(VkCommandBuffer commandBuffer, void* user) {
+   App* app = user;
+
+   VkRenderingAttachmentInfo depthAttachment = {0};
+   depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+   depthAttachment.imageView = rg_image_view(&app->frameGraph, app->depthTarget);
+   depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+   depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+   depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+   depthAttachment.clearValue.depthStencil = (VkClearDepthStencilValue){1.0f, 0};
+
+   VkRenderingInfo renderingInfo = {0};
+   renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+   renderingInfo.renderArea.extent = app->swapChainExtent;
+   renderingInfo.layerCount = 1;
+   renderingInfo.pDepthAttachment = &depthAttachment;
+
+   vkCmdBeginRendering(commandBuffer, &renderingInfo);
+   bind_scene_state(app, commandBuffer);
+   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->depthPrePassPipeline);
+   draw_scene(app, commandBuffer);
+   vkCmdEndRendering(commandBuffer);
+}
+
+static void record_scene_rendering(VkCommandBuffer commandBuffer, void* user) {
+   App* app = user;
+
+   VkRenderingAttachmentInfo colourAttachment = {0};
+   colourAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+   colourAttachment.imageView = rg_image_view(&app->frameGraph, app->swapChainTarget);
+   colourAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+   colourAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+   colourAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+   colourAttachment.clearValue.color = (VkClearColorValue){{0.0f, 0.0f, 0.0f, 1.0f}};
+   if (app->msaaSamples > VK_SAMPLE_COUNT_1_BIT) {
+      colourAttachment.imageView = rg_image_view(&app->frameGraph, app->msaaColourTarget);
+      colourAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      colourAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+      colourAttachment.resolveImageView = rg_image_view(&app->frameGraph, app->swapChainTarget);
+      colourAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+   }
+
+   VkRenderingAttachmentInfo depthAttachment = {0};
+   depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+   depthAttachment.imageView = rg_image_view(&app->frameGraph, app->depthTarget);
+   depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+   if (app->depthPrePass) {
+      depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+      depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+   } else {
+      depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+      depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+      depthAttachment.clearValue.depthStencil = (VkClearDepthStencilValue){1.0f, 0};
+   }
+
+   VkRenderingInfo renderingInfo = {0};
+   renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+   renderingInfo.renderArea.extent = app->swapChainExtent;
+   renderingInfo.layerCount = 1;
+   renderingInfo.colorAttachmentCount = 1;
+   renderingInfo.pColorAttachments = &colourAttachment;
+   renderingInfo.pDepthAttachment = &depthAttachment;
+
+   vkCmdBeginRendering(commandBuffer, &renderingInfo);
+   bind_scene_state(app, commandBuffer);
+   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->graphicsPipeline);
+   draw_scene_measured(app, commandBuffer);
+   draw_particles(app, commandBuffer);
+   vkCmdEndRendering(commandBuffer);
+}
+
+static void record_capture_pass(VkCommandBuffer commandBuffer, void* user) {
+   App* app = user;
+   capture_record(&app->capture, commandBuffer, app->swapChainImages[app->imageIndex], app->frameNumber);
+}
+
+// Everything but the swapchain image is known up front, the graph is compiled once per
+// swapchain and this only has to point it at the image that was acquired.
+void build_frame_graph(App* app) {
+   RenderGraph* graph = &app->frameGraph;
+   rg_init(graph, app->device, app->physicalDevice, vk_allocator, app->dynamicRendering);
+
+   // the acquire semaphore is waited on at colour attachment output, the first barrier chains
+   // onto that
+   RgState acquired = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED};
+   RgState present = {VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+   app->swapChainTarget = rg_import_image(graph, "swapchain", VK_IMAGE_ASPECT_COLOR_BIT, acquired, present);
+
+   // depth has to be stored between the two dynamic rendering passes, otherwise it lives and
+   // dies inside one pass
+   RgImageDesc depthDesc = {0};
+   depthDesc.format = app->depthFormat;
+   depthDesc.extent = app->swapChainExtent;
+   depthDesc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+   depthDesc.samples = app->msaaSamples;
+   depthDesc.flags = app->dynamicRendering && app->depthPrePass ? 0 : RG_IMAGE_LAZY;
+   app->depthTarget = rg_create_image(graph, "depth", &depthDesc);
+
+   app->msaaColourTarget = RG_NONE;
+   if (app->msaaSamples > VK_SAMPLE_COUNT_1_BIT) {
+      RgImageDesc colourDesc = {0};
+      colourDesc.format = app->swapChainImageFormat;
+      colourDesc.extent = app->swapChainExtent;
+      colourDesc.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+      colourDesc.samples = app->msaaSamples;
+      colourDesc.flags = RG_IMAGE_LAZY;
+      app->msaaColourTarget = rg_create_image(graph, "msaa colour", &colourDesc);
+   }
+
+   RgPass scene;
+   if (!app->dynamicRendering) {
+      scene = rg_add_pass(graph, "scene", record_scene_pass, app);
+      rg_write(graph, scene, app->depthTarget, RG_ACCESS_DEPTH_ATTACHMENT);
+   } else if (app->depthPrePass) {
+      RgPass prePass = rg_add_pass(graph, "depth pre-pass", record_depth_prepass_rendering, app);
+      rg_write(graph, prePass, app->depthTarget, RG_ACCESS_DEPTH_ATTACHMENT);
+
+      scene = rg_add_pass(graph, "scene", record_scene_rendering, app);
+      rg_read(graph, scene, app->depthTarget, RG_ACCESS_DEPTH_READ);
+   } else {
+      scene = rg_add_pass(graph, "scene", record_scene_rendering, app);
+      rg_write(graph, scene, app->depthTarget, RG_ACCESS_DEPTH_ATTACHMENT);
+   }
+   // the resolve writes the swapchain image as a colour attachment too
+   if (app->msaaColourTarget != RG_NONE) rg_write(graph, scene, app->msaaColourTarget, RG_ACCESS_COLOR_ATTACHMENT);
+   rg_write(graph, scene, app->swapChainTarget, RG_ACCESS_COLOR_ATTACHMENT);
+
+   // the frame's point buffer is acquired from the compute queue before the graph runs and
+   // released after, inside the graph it is only ever read as vertices. It comes in and goes
+   // out with no state so the graph puts no barriers around the read.
+   app->particleTarget = RG_NONE;
+   if (app->particlesEnabled) {
+      app->particleTarget = rg_import_buffer(graph, "particles", (RgState){0}, (RgState){0});
+      rg_read(graph, scene, app->particleTarget, RG_ACCESS_VERTEX_BUFFER);
+   }
+
+   // nothing reads what the copy writes as far as the graph knows, it has to be kept
+   if (app->capturing) {
+      RgPass capture = rg_add_pass(graph, "capture", record_capture_pass, app);
+      rg_read(graph, capture, app->swapChainTarget, RG_ACCESS_TRANSFER_READ);
+      rg_keep(graph, capture);
+   }
+
+   if (rg_compile(graph) != VK_SUCCESS) {
+      fprintf(stderr, "failed to compile frame graph\n");
+      exit(EXIT_FAILURE);
+   }
+#ifndef NDEBUG
+   rg_print_stats(graph, stdout);
+#endif
+   printf("msaa %ux: %.2f MiB of attachments, %.2f MiB lazily allocated\n", app->msaaSamples,
+          (double)graph->stats.allocated_bytes / MB(1.0), (double)graph->stats.lazy_bytes / MB(1.0));
+}
+
+void record_command_buffer(App* app, VkCommandBuffer commandBuffer, u32 imageIndex) {
+   VkCommandBufferBeginInfo beginInfo = {0};
+   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+   if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+      fprintf(stderr, "failed to begin recording command buffer.\n");
+      exit(EXIT_FAILURE);
+   }
+
+   u32 frame = (u32)app->currentFrame;
+   app->trianglesDrawn = 0;
+   if (app->measureOverdraw) vkCmdResetQueryPool(commandBuffer, app->statsQueryPool, frame, 1);
+   if (app->measureGpuTime) {
+      vkCmdResetQueryPool(commandBuffer, app->timestampQueryPool, frame * 2, 2);
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, app->timestampQueryPool, frame * 2);
+   }
+
+   // the one bind of the frame, it stays bound across the passes and pipelines
+   if (app->bindless) {
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->pipelineLayout, 0, 1, &app->bindlessSet, 0, nullptr);
+      app->bindCalls++;
+   }
+
+   app->imageIndex = imageIndex;
+   rg_set_image(&app->frameGraph, app->swapChainTarget, app->swapChainImages[imageIndex], app->swapChainImageViews[imageIndex]);
+   if (app->particlesEnabled) {
+      rg_set_buffer(&app->frameGraph, app->particleTarget, particles_points(&app->particles, frame));
+      particles_acquire(&app->particles, commandBuffer, frame);
+   }
+   rg_execute(&app->frameGraph, commandBuffer);
+   if (app->particlesEnabled) particles_release(&app->particles, commandBuffer, frame);
+
+   if (app->measureGpuTime) {
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, app->timestampQueryPool, frame * 2 + 1);
+      app->pendingQueries |= 1u << frame;
+   }
 
    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
       fprintf(stderr, "failed to record command buffer.\n");
@@ -848,54 +1882,70 @@ void record_command_buffer(App* app, VkCommandBuffer commandBuffer, u32 imageInd
 void create_sync_objects(App* app) {
    app->renderFinishedSemaphores = vector(VkSemaphore, vector_length(app->swapChainImages), &global_allocator);
    app->imageAvailableSemaphores = vector(VkSemaphore, g_maxFramesInFlight, &global_allocator);
-   app->inFlightFences = vector(VkFence, g_maxFramesInFlight, &global_allocator);
 
    vector_update_length(vector_length(app->swapChainImages), app->renderFinishedSemaphores);
    vector_update_length(g_maxFramesInFlight, app->imageAvailableSemaphores);
-   vector_update_length(g_maxFramesInFlight, app->inFlightFences);
 
    VkSemaphoreCreateInfo semaphoreInfo = {0};
    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-   VkFenceCreateInfo fenceInfo = {0};
-   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
    for (Size i = 0; i < vector_length(app->swapChainImages); i++) {
-      if (vkCreateSemaphore(app->device, &semaphoreInfo, nullptr, &app->renderFinishedSemaphores[i]) != VK_SUCCESS) {
+      if (vkCreateSemaphore(app->device, &semaphoreInfo, vk_allocator, &app->renderFinishedSemaphores[i]) != VK_SUCCESS) {
          fprintf(stderr, "failed to create semaphores.\n");
          exit(EXIT_FAILURE);
       }
    }
 
+   // the swapchain only takes binary semaphores
    for (Size i = 0; i < g_maxFramesInFlight; i++) {
-      if (vkCreateSemaphore(app->device, &semaphoreInfo, nullptr, &app->imageAvailableSemaphores[i]) != VK_SUCCESS
-            || vkCreateFence(app->device, &fenceInfo, nullptr, &app->inFlightFences[i]) != VK_SUCCESS) {
+      if (vkCreateSemaphore(app->device, &semaphoreInfo, vk_allocator, &app->imageAvailableSemaphores[i]) != VK_SUCCESS) {
          fprintf(stderr, "failed to create semaphores.\n");
          exit(EXIT_FAILURE);
       }
    }
+
+   if (frame_sync_init(&app->frameSync, app->device, vk_allocator, app->timelineSync, (u32)g_maxFramesInFlight) != VK_SUCCESS) {
+      fprintf(stderr, "failed to create frame sync objects.\n");
+      exit(EXIT_FAILURE);
+   }
 }
 
 void cleanup_swap_chain(App* app) {
-   for (Size i = 0; i < vector_length(app->swapChainFramebuffers); i++) {
-      vkDestroyFramebuffer(app->device, app->swapChainFramebuffers[i], nullptr);
+   if (!app->dynamicRendering) {
+      for (Size i = 0; i < vector_length(app->swapChainFramebuffers); i++) {
+         vkDestroyFramebuffer(app->device, app->swapChainFramebuffers[i], vk_allocator);
+      }
    }
 
    for (Size i = 0; i < vector_length(app->swapChainImageViews); i++) {
-      vkDestroyImageView(app->device, app->swapChainImageViews[i], nullptr);
+      vkDestroyImageView(app->device, app->swapChainImageViews[i], vk_allocator);
+   }
+
+   // lazily allocated attachments only get real memory if the driver had to spill them
+   if (app->frameGraph.stats.lazy_bytes > 0) {
+      printf("msaa %ux: %.2f MiB of lazily allocated attachments committed\n", app->msaaSamples,
+             (double)rg_committed_bytes(&app->frameGraph) / MB(1.0));
    }
+   rg_destroy(&app->frameGraph);
 
-   vkDestroySwapchainKHR(app->device, app->swapChain, nullptr);
+   vkDestroySwapchainKHR(app->device, app->swapChain, vk_allocator);
 }
 
+// Minimised there is nothing to render to, wait for a size. The render thread can't wait on
+// GLFW events and checks back every few milliseconds, leaving the old swapchain in place if the
+// app quits meanwhile.
 void recreate_swap_chain(App* app) {
-   int width = 0;
-   int height = 0;
-   glfwGetFramebufferSize(app->window, &width, &height);
+   u32 width = 0;
+   u32 height = 0;
+   framebuffer_size(app, &width, &height);
    while (width == 0 || height == 0) {
-      glfwGetFramebufferSize(app->window, &width, &height);
-      glfwWaitEvents();
+      if (app->renderThread) {
+         if (atomic_load_explicit(&app->quit, memory_order_acquire)) return;
+         nanosleep(&(struct timespec){0, 5000000}, nullptr);
+      } else {
+         glfwWaitEvents();
+      }
+      framebuffer_size(app, &width, &height);
    }
 
    vkDeviceWaitIdle(app->device);
@@ -903,207 +1953,816 @@ void recreate_swap_chain(App* app) {
 
    create_swap_chain(app);
    create_image_views(app);
-   create_framebuffers(app);
+   build_frame_graph(app);
+   if (!app->dynamicRendering) create_framebuffers(app);
+   if (app->capturing && capture_resize(&app->capture, &app->frameSync, app->swapChainExtent) != VK_SUCCESS) {
+      fprintf(stderr, "failed to resize the capture buffers\n");
+      exit(EXIT_FAILURE);
+   }
+}
+
+static int compare_draw_keys(const void* a, const void* b) {
+   float da = ((const DrawKey*)a)->depth;
+   float db = ((const DrawKey*)b)->depth;
+   return (da > db) - (da < db);
+}
+
+// Sorts the objects by distance along the view direction. Front to back lets early depth
+// testing throw away hidden fragments before they are shaded.
+void sort_draws(App* app) {
+   vec3 eye, forward;
+   glm_vec3_copy((float*)g_cameraEye, eye);
+   glm_vec3_negate_to(eye, forward);
+   glm_vec3_normalize(forward);
+
+   Size count = vector_length(app->sceneObjects);
+   for (Size i = 0; i < count; i++) {
+      vec3 toObject;
+      glm_vec3_sub(app->sceneObjects[i].position, eye, toObject);
+      float depth = glm_vec3_dot(toObject, forward);
+      app->drawOrder[i] = (DrawKey){app->drawSort == DRAW_SORT_BACK_TO_FRONT ? -depth : depth, (u32)i, 0, 0, 0};
+   }
+   vector_update_length(count, app->drawOrder);
+
+   if (app->drawSort != DRAW_SORT_NONE) {
+      qsort(app->drawOrder, (size_t)count, sizeof(DrawKey), compare_draw_keys);
+   }
+}
+
+// The finest level with no more triangles than the pixels the object's bounding circle covers
+// over g_lodPixelsPerTriangle, the coarsest if none is that small.
+u32 select_lod(App* app, const vec3 position, float scale) {
+   if (app->meshLods.count == 1) return 0;
+
+   vec3 eye;
+   glm_vec3_copy((float*)g_cameraEye, eye);
+   float distance = glm_vec3_distance(eye, (float*)position);
+   float radius = app->meshRadius * scale;
+   if (distance <= radius) return 0;
+
+   float pixelsPerUnit = (float)app->swapChainExtent.height * 0.5f / tanf(glm_rad(g_cameraFovDegrees) * 0.5f);
+   float screenRadius = radius / distance * pixelsPerUnit;
+   float budget = GLM_PIf * screenRadius * screenRadius / g_lodPixelsPerTriangle;
+
+   for (u32 i = 0; i < app->meshLods.count; i++) {
+      if ((float)(app->meshLods.levels[i].index_count / 3) <= budget) return i;
+   }
+   return app->meshLods.count - 1;
+}
+
+// Room for count more indices after the used ones. A buffer too small is replaced by one twice
+// the size it needs, keeping what was written. Only called for the current frame, its fence
+// has signalled so the GPU is done with the old one.
+u16* reserve_cluster_indices(App* app, ClusterIndexBuffer* indices, Size used, Size count) {
+   if (used + count <= indices->capacity) return indices->mapped;
+
+   ClusterIndexBuffer grown = {0};
+   grown.capacity = (used + count) * 2;
+   VkDeviceSize size = (VkDeviceSize)grown.capacity * sizeof(u16);
+   create_buffer(app, size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &grown.buffer, &grown.memory);
+   vkMapMemory(app->device, grown.memory, 0, size, 0, (void**)&grown.mapped);
+
+   if (indices->buffer) {
+      memcpy(grown.mapped, indices->mapped, (size_t)used * sizeof(u16));
+      vkDestroyBuffer(app->device, indices->buffer, vk_allocator);
+      vkFreeMemory(app->device, indices->memory, vk_allocator);
+   }
+   *indices = grown;
+   return indices->mapped;
+}
+
+// Copies the indices of the draw's meshlets that can be seen after the used ones in the
+// frame's cluster indices, the draw gets their range. Returns the indices used. The planes come
+// out of the object's model view projection and the eye goes through the inverse model, so
+// both are in the mesh's space like the meshlets.
+Size cull_meshlets(App* app, DrawKey* draw, mat4 model, Size used) {
+   mat4 modelViewProj, inverseModel;
+   vec4 planes[6];
+   vec3 eye;
+   glm_mat4_mul(app->viewProj, model, modelViewProj);
+   glm_frustum_planes(modelViewProj, planes);
+   glm_mat4_inv(model, inverseModel);
+   glm_mat4_mulv3(inverseModel, (float*)g_cameraEye, 1.0f, eye);
+
+   const MeshLod* lod = &app->meshLods.levels[draw->lod];
+   MeshletRange range = app->meshletLevels[draw->lod];
+   u16* out = reserve_cluster_indices(app, &app->clusterIndices[app->currentFrame], used, lod->index_count);
+
+   Size count = 0;
+   for (u32 i = range.first; i < range.first + range.count; i++) {
+      const Meshlet* meshlet = &app->meshlets[i];
+      if (meshlet_outside(meshlet, (const float(*)[4])planes)) {
+         app->meshletsOutside++;
+         continue;
+      }
+      if (meshlet_backfacing(meshlet, eye)) {
+         app->meshletsBackfacing++;
+         continue;
+      }
+      Size indexCount = meshlet->triangle_count * 3;
+      memcpy(&out[used + count], &app->meshletIndices[meshlet->first_index], (size_t)indexCount * sizeof(u16));
+      count += indexCount;
+   }
+   app->meshletsTested += range.count;
+
+   draw->first_index = (u32)used;
+   draw->index_count = (u32)count;
+   return used + count;
 }
 
 void update_uniform_buffer(App* app) {
-   time_t now = time(nullptr) - app->startTime;
-   
+   const SimSnapshot* snapshot = simulation_read(&app->simulation);
+   float alpha = simulation_alpha(&app->simulation, snapshot, simulation_now());
+
    UniformBufferObject ubo = {0};
-   glm_rotate_make(ubo.model, glm_rad(1.0f) * (float)now, (vec3){0.0f, 0.0f, 1.0f});
-   glm_lookat((vec3){2.0f, 2.0f, 2.0f}, (vec3){0.0f, 0.0f, 0.0f}, (vec3){0.0f, 0.0f, 1.0f}, ubo.view);
-   glm_perspective(glm_rad(45.0f), (float)app->swapChainExtent.width / (float)app->swapChainExtent.height, 0.1f, 10.0f, ubo.proj);
+   vec3 eye;
+   glm_vec3_copy((float*)g_cameraEye, eye);
+   glm_lookat(eye, (vec3){0.0f, 0.0f, 0.0f}, (vec3){0.0f, 0.0f, 1.0f}, ubo.view);
+   glm_perspective(glm_rad(g_cameraFovDegrees), (float)app->swapChainExtent.width / (float)app->swapChainExtent.height, 0.1f, 10.0f, ubo.proj);
 
    // flip upside down
    ubo.proj[1][1] *= -1;
+   glm_mat4_mul(ubo.proj, ubo.view, app->viewProj);
+
+   sort_draws(app);
+
+   u8* mapped = app->uniformBuffersMapped[app->currentFrame];
+   Size clusterIndices = 0;
+   for (Size i = 0; i < vector_length(app->drawOrder); i++) {
+      u32 object = app->drawOrder[i].object;
+      const SimTransform* previous = &snapshot->previous[object];
+      const SimTransform* current = &snapshot->current[object];
+      vec3 position;
+      glm_vec3_lerp((float*)previous->position, (float*)current->position, alpha, position);
+      float scale = glm_lerp(previous->scale, current->scale, alpha);
+      glm_translate_make(ubo.model, position);
+      glm_rotate(ubo.model, glm_lerp(previous->angle, current->angle, alpha), (vec3){0.0f, 0.0f, 1.0f});
+      glm_scale_uni(ubo.model, scale);
+
+      DrawKey* draw = &app->drawOrder[i];
+      draw->lod = select_lod(app, position, scale);
+      if (app->meshletsEnabled) {
+         clusterIndices = cull_meshlets(app, draw, ubo.model, clusterIndices);
+      } else {
+         draw->first_index = app->meshLods.levels[draw->lod].first_index;
+         draw->index_count = app->meshLods.levels[draw->lod].index_count;
+      }
+      memcpy(mapped + (VkDeviceSize)i * app->uniformStride, &ubo, sizeof(ubo));
+   }
+}
 
-   memcpy(app->uniformBuffersMapped[app->currentFrame], &ubo, sizeof(ubo));
+// Only safe once the frame's fence has signalled, the previous sets from this allocator may
+// still be in use until then.
+void update_frame_descriptors(App* app) {
+   if (app->bindless) return;
+
+   DescriptorAllocator* descriptors = &app->frameDescriptors[app->currentFrame];
+   descriptor_allocator_reset(descriptors);
+
+   VkDescriptorSet* set = &app->descriptorSets[app->currentFrame];
+   if (descriptor_allocator_allocate(descriptors, app->descriptorSetLayout, set) != VK_SUCCESS) {
+      fprintf(stderr, "failed to allocate descriptor set\n");
+      exit(EXIT_FAILURE);
+   }
+
+   VkDescriptorBufferInfo bufferInfo = {0};
+   bufferInfo.buffer = app->uniformBuffers[app->currentFrame];
+   bufferInfo.offset = 0;
+   bufferInfo.range = sizeof(UniformBufferObject);
+   descriptor_template_update(&app->uniformTemplate, app->device, *set, &bufferInfo);
 }
 
-void draw_frame(App* app) {
-   vkWaitForFences(app->device, 1, &app->inFlightFences[app->currentFrame], VK_TRUE, UINT64_MAX);
+// Called once the frame's fence has signalled so the results are there without waiting. Every
+// g_overdrawReportFrames frames prints the average fragments shaded per pixel, 1.0 means no
+// overdraw at all, and the GPU time of the scene pass.
+void report_overdraw(App* app, u64 fragments, u64 gpuTicks) {
+   app->overdrawFragments += fragments;
+   app->overdrawPixels += (u64)app->swapChainExtent.width * app->swapChainExtent.height;
+   app->overdrawGpuTicks += gpuTicks;
+   app->overdrawFrames++;
+
+   if (app->overdrawFrames == g_overdrawReportFrames) {
+      const char* sortNames[] = {"front to back", "back to front", "unsorted"};
+      printf("overdraw: %.3f fragments/pixel, %.3f ms gpu, %zd objects, %s, pre-pass %s\n",
+             (double)app->overdrawFragments / (double)app->overdrawPixels,
+             (double)app->overdrawGpuTicks * (double)app->timestampPeriod / 1e6 / (double)app->overdrawFrames,
+             vector_length(app->sceneObjects), sortNames[app->drawSort], app->depthPrePass ? "on" : "off");
+      app->overdrawFragments = 0;
+      app->overdrawPixels = 0;
+      app->overdrawGpuTicks = 0;
+      app->overdrawFrames = 0;
+   }
+}
 
-   u32 imageIndex = 0;
-   VkResult result = vkAcquireNextImageKHR(app->device, app->swapChain, UINT64_MAX, app->imageAvailableSemaphores[app->currentFrame], VK_NULL_HANDLE, &imageIndex);
-   if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-      recreate_swap_chain(app);
+// The slot's last frame is done by the time it comes round again, its results are ready.
+void read_frame_queries(App* app) {
+   u32 frame = (u32)app->currentFrame;
+   if (!(app->pendingQueries & (1u << frame))) return;
+   app->pendingQueries &= ~(1u << frame);
+
+   u64 fragments = 0;
+   u64 timestamps[2] = {0};
+   if (app->measureOverdraw && vkGetQueryPoolResults(app->device, app->statsQueryPool, frame, 1, sizeof(fragments), &fragments, sizeof(fragments), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
       return;
-   } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-      fprintf(stderr, "failed to acquire swapchain image.\n");
+   }
+   if (vkGetQueryPoolResults(app->device, app->timestampQueryPool, frame * 2, 2, sizeof(timestamps), timestamps, sizeof(u64), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
       return;
    }
 
-   vkResetFences(app->device, 1, &app->inFlightFences[app->currentFrame]);
-
-   update_uniform_buffer(app);
+   u64 gpuTicks = timestamps[1] - timestamps[0];
+   if (app->benchmarking && app->benchFrameTimes.count > 0) {
+      frame_times_add(&app->benchGpuTimes, (u64)((double)gpuTicks * (double)app->timestampPeriod));
+   }
+   if (app->measureOverdraw) report_overdraw(app, fragments, gpuTicks);
+}
 
-   vkResetCommandBuffer(app->commandBuffers[app->currentFrame], 0);
-   record_command_buffer(app, app->commandBuffers[app->currentFrame], imageIndex);
+void report_lod(App* app) {
+   app->lodTriangles += app->trianglesDrawn;
+   for (Size i = 0; i < vector_length(app->drawOrder); i++) app->lodObjects[app->drawOrder[i].lod]++;
+   app->lodFrames++;
+   if (app->lodFrames < g_lodReportFrames) return;
+
+   double frames = (double)app->lodFrames;
+   printf("lod: %.0f triangles per frame, objects per level", (double)app->lodTriangles / frames);
+   for (u32 i = 0; i < app->meshLods.count; i++) {
+      printf(" %u:%.1f", app->meshLods.levels[i].index_count / 3, (double)app->lodObjects[i] / frames);
+      app->lodObjects[i] = 0;
+   }
+   printf("\n");
+   app->lodTriangles = 0;
+   app->lodFrames = 0;
+}
 
-   VkSubmitInfo submitInfo = {0};
-   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+void report_meshlets(App* app) {
+   app->meshletTriangles += app->trianglesDrawn;
+   app->meshletFrames++;
+   if (app->meshletFrames < g_meshletReportFrames) return;
+
+   double frames = (double)app->meshletFrames;
+   u64 drawn = app->meshletsTested - app->meshletsOutside - app->meshletsBackfacing;
+   printf("meshlets: %.1f of %.1f clusters drawn per frame, %.1f outside the frustum, %.1f facing away, %.0f triangles\n",
+          (double)drawn / frames, (double)app->meshletsTested / frames, (double)app->meshletsOutside / frames,
+          (double)app->meshletsBackfacing / frames, (double)app->meshletTriangles / frames);
+   app->meshletsTested = 0;
+   app->meshletsOutside = 0;
+   app->meshletsBackfacing = 0;
+   app->meshletTriangles = 0;
+   app->meshletFrames = 0;
+}
 
-   VkSemaphore waitSemaphores[] = {app->imageAvailableSemaphores[app->currentFrame]};
-   VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-   submitInfo.waitSemaphoreCount = 1;
-   submitInfo.pWaitSemaphores = waitSemaphores;
-   submitInfo.pWaitDstStageMask = waitStages;
+void report_binding(App* app) {
+   app->bindingFrames++;
+   if (app->bindingFrames < g_bindingReportFrames) return;
+
+   double frames = (double)app->bindingFrames;
+   printf("binding: %.1f descriptor binds, %.1f push constants, %.3f ms recording per frame, %zd objects, bindless %s\n",
+          (double)app->bindCalls / frames, (double)app->pushConstantCalls / frames, (double)app->recordNanos / 1e6 / frames,
+          vector_length(app->sceneObjects), app->bindless ? "on" : "off");
+   app->bindCalls = 0;
+   app->pushConstantCalls = 0;
+   app->recordNanos = 0;
+   app->bindingFrames = 0;
+}
 
-   submitInfo.commandBufferCount = 1;
-   submitInfo.pCommandBuffers = &app->commandBuffers[app->currentFrame];
+// Everything the graphics queue runs this frame goes out in one submit: pending uploads, the
+// particle step when it has no queue of its own, and the frame itself, in that order.
+void begin_uploads(App* app) {
+   VkCommandBufferAllocateInfo allocInfo = {0};
+   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+   allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+   allocInfo.commandPool = app->queues.transfer.pool;
+   allocInfo.commandBufferCount = 1;
 
-   VkSemaphore signalSemaphores[] = {app->renderFinishedSemaphores[imageIndex]};
-   submitInfo.signalSemaphoreCount = 1;
-   submitInfo.pSignalSemaphores = signalSemaphores;
+   VkCommandBufferBeginInfo beginInfo = {0};
+   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+   beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-   if (vkQueueSubmit(app->graphicsQueue, 1, &submitInfo, app->inFlightFences[app->currentFrame]) != VK_SUCCESS) {
-      fprintf(stderr, "failed to submit draw command buffer.\n");
+   if (vkAllocateCommandBuffers(app->device, &allocInfo, &app->uploadCommands) != VK_SUCCESS
+         || vkBeginCommandBuffer(app->uploadCommands, &beginInfo) != VK_SUCCESS) {
+      fprintf(stderr, "failed to begin upload command buffer.\n");
       exit(EXIT_FAILURE);
    }
+   app->stagingBuffers = vector(StagingBuffer, &global_allocator);
+   app->uploadTargets = vector(VkBuffer, &global_allocator);
+   app->uploadsPending = true;
+}
 
-   VkPresentInfoKHR presentInfo = {0};
-   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+// The copies go out on the transfer queue right away when it is a family of its own, the
+// buffers change owner on the way. Either way the returned command buffer goes first in the
+// frame's submit.
+VkCommandBuffer end_uploads(App* app) {
+   const VkAccessFlags vertexInput = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+   u32 transferFamily = app->queues.transfer.family;
+   u32 graphicsFamily = app->queues.graphics.family;
+   app->uploadsPending = false;
+
+   if (transferFamily == graphicsFamily) {
+      VkMemoryBarrier barrier = {0};
+      barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = vertexInput;
+      vkCmdPipelineBarrier(app->uploadCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+      if (vkEndCommandBuffer(app->uploadCommands) != VK_SUCCESS) {
+         fprintf(stderr, "failed to record upload command buffer.\n");
+         exit(EXIT_FAILURE);
+      }
+      return app->uploadCommands;
+   }
 
-   presentInfo.waitSemaphoreCount = 1;
-   presentInfo.pWaitSemaphores = signalSemaphores;
+   for (Size i = 0; i < vector_length(app->uploadTargets); i++) {
+      queues_release_buffer(app->uploadCommands, app->uploadTargets[i], transferFamily, graphicsFamily, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+   }
 
-   VkSwapchainKHR swapChains[] = {app->swapChain};
-   presentInfo.swapchainCount = 1;
-   presentInfo.pSwapchains = swapChains;
-   presentInfo.pImageIndices = &imageIndex;
-   presentInfo.pResults = nullptr;
+   VkCommandBufferAllocateInfo allocInfo = {0};
+   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+   allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+   allocInfo.commandPool = app->queues.graphics.pool;
+   allocInfo.commandBufferCount = 1;
 
-   result = vkQueuePresentKHR(app->presentQueue, &presentInfo);
-   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || app->framebufferResized) {
-      app->framebufferResized = false;
-      recreate_swap_chain(app);
-   } else if (result != VK_SUCCESS) {
-      fprintf(stderr, "failed to present swap chain image!");
+   VkCommandBufferBeginInfo beginInfo = {0};
+   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+   beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+   VkSemaphoreCreateInfo semaphoreInfo = {0};
+   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+   if (vkEndCommandBuffer(app->uploadCommands) != VK_SUCCESS
+         || vkCreateSemaphore(app->device, &semaphoreInfo, vk_allocator, &app->uploadsDone) != VK_SUCCESS
+         || vkAllocateCommandBuffers(app->device, &allocInfo, &app->uploadAcquire) != VK_SUCCESS
+         || vkBeginCommandBuffer(app->uploadAcquire, &beginInfo) != VK_SUCCESS) {
+      fprintf(stderr, "failed to record upload command buffer.\n");
+      exit(EXIT_FAILURE);
+   }
+   for (Size i = 0; i < vector_length(app->uploadTargets); i++) {
+      queues_acquire_buffer(app->uploadAcquire, app->uploadTargets[i], transferFamily, graphicsFamily, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, vertexInput);
+   }
+   if (vkEndCommandBuffer(app->uploadAcquire) != VK_SUCCESS) {
+      fprintf(stderr, "failed to record upload command buffer.\n");
       exit(EXIT_FAILURE);
    }
 
-   app->currentFrame = (app->currentFrame + 1) % g_maxFramesInFlight;
+   VkSubmitInfo submitInfo = {0};
+   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+   submitInfo.commandBufferCount = 1;
+   submitInfo.pCommandBuffers = &app->uploadCommands;
+   submitInfo.signalSemaphoreCount = 1;
+   submitInfo.pSignalSemaphores = &app->uploadsDone;
+   if (vkQueueSubmit(app->queues.transfer.queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+      fprintf(stderr, "failed to submit upload command buffer.\n");
+      exit(EXIT_FAILURE);
+   }
+   app->submitCalls++;
+   app->waitUploads = true;
+   return app->uploadAcquire;
 }
 
-u32 find_memory_type(App* app, u32 typeFilter, VkMemoryPropertyFlags properties) {
-   VkPhysicalDeviceMemoryProperties memProperties;
-   vkGetPhysicalDeviceMemoryProperties(app->physicalDevice, &memProperties);
+// the frame that waited on the uploads is done, so are the copies
+void release_staging_buffers(App* app) {
+   for (Size i = 0; i < vector_length(app->stagingBuffers); i++) {
+      vkDestroyBuffer(app->device, app->stagingBuffers[i].buffer, vk_allocator);
+      vkFreeMemory(app->device, app->stagingBuffers[i].memory, vk_allocator);
+   }
+   vector_update_length(0, app->stagingBuffers);
+   vector_update_length(0, app->uploadTargets);
+   app->stagingFrame = 0;
+
+   if (app->uploadCommands) vkFreeCommandBuffers(app->device, app->queues.transfer.pool, 1, &app->uploadCommands);
+   if (app->uploadAcquire) vkFreeCommandBuffers(app->device, app->queues.graphics.pool, 1, &app->uploadAcquire);
+   if (app->uploadsDone) vkDestroySemaphore(app->device, app->uploadsDone, vk_allocator);
+   app->uploadCommands = VK_NULL_HANDLE;
+   app->uploadAcquire = VK_NULL_HANDLE;
+   app->uploadsDone = VK_NULL_HANDLE;
+}
+
+void report_sync(App* app) {
+   app->syncFrames++;
+   if (app->syncFrames < g_syncReportFrames) return;
+
+   double frames = (double)app->syncFrames;
+   printf("sync: %.2f submits, %.2f driver waits, %.3f ms waiting per frame, %s\n",
+          (double)app->submitCalls / frames, (double)app->syncWaitCalls / frames, (double)app->syncWaitNanos / 1e6 / frames,
+          app->timelineSync ? "timeline semaphore" : "fences");
+   app->submitCalls = 0;
+   app->syncWaitCalls = 0;
+   app->syncWaitNanos = 0;
+   app->syncFrames = 0;
+}
 
+void submit_frame(App* app, u32 imageIndex, const VkCommandBuffer* commandBuffers, u32 commandBufferCount) {
+   u32 frame = (u32)app->currentFrame;
+   bool asyncParticles = app->particlesEnabled && app->particles.async;
+
+   if (app->timelineSync) {
+      // the particle points and uploads are first read as vertices, the rest of the frame
+      // doesn't wait for them
+      VkSemaphoreSubmitInfo waitInfos[3] = {0};
+      waitInfos[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+      waitInfos[0].semaphore = app->imageAvailableSemaphores[frame];
+      waitInfos[0].stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+      u32 waitCount = 1;
+      if (asyncParticles) waitInfos[waitCount++] = particles_timeline_wait(&app->particles, app->frameNumber);
+      if (app->waitUploads) {
+         waitInfos[waitCount].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+         waitInfos[waitCount].semaphore = app->uploadsDone;
+         waitInfos[waitCount].stageMask = VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT;
+         waitCount++;
+      }
+
+      VkCommandBufferSubmitInfo commandBufferInfos[4] = {0};
+      assert(commandBufferCount <= lengthof(commandBufferInfos) && "Frame expected to have at most 4 command buffers.");
+      for (u32 i = 0; i < commandBufferCount; i++) {
+         commandBufferInfos[i].sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+         commandBufferInfos[i].commandBuffer = commandBuffers[i];
+      }
 
-   for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-      if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-         return i;
+      // present waits on the binary one, anything waiting for the frame on the timeline
+      VkSemaphoreSubmitInfo signalInfos[2] = {0};
+      signalInfos[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+      signalInfos[0].semaphore = app->renderFinishedSemaphores[imageIndex];
+      signalInfos[0].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+      signalInfos[1] = frame_sync_signal(&app->frameSync);
+
+      VkSubmitInfo2 submitInfo = {0};
+      submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+      submitInfo.waitSemaphoreInfoCount = waitCount;
+      submitInfo.pWaitSemaphoreInfos = waitInfos;
+      submitInfo.commandBufferInfoCount = commandBufferCount;
+      submitInfo.pCommandBufferInfos = commandBufferInfos;
+      submitInfo.signalSemaphoreInfoCount = lengthof(signalInfos);
+      submitInfo.pSignalSemaphoreInfos = signalInfos;
+
+      if (vkQueueSubmit2(app->queues.graphics.queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+         fprintf(stderr, "failed to submit draw command buffer.\n");
+         exit(EXIT_FAILURE);
+      }
+   } else {
+      VkSubmitInfo submitInfo = {0};
+      submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+      VkSemaphore waitSemaphores[3] = {app->imageAvailableSemaphores[frame]};
+      VkPipelineStageFlags waitStages[3] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+      submitInfo.waitSemaphoreCount = 1;
+      if (asyncParticles) {
+         waitSemaphores[submitInfo.waitSemaphoreCount] = particles_compute_done(&app->particles, frame);
+         waitStages[submitInfo.waitSemaphoreCount++] = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+      }
+      if (app->waitUploads) {
+         waitSemaphores[submitInfo.waitSemaphoreCount] = app->uploadsDone;
+         waitStages[submitInfo.waitSemaphoreCount++] = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+      }
+      submitInfo.pWaitSemaphores = waitSemaphores;
+      submitInfo.pWaitDstStageMask = waitStages;
+
+      submitInfo.commandBufferCount = commandBufferCount;
+      submitInfo.pCommandBuffers = commandBuffers;
+
+      // present only waits on the first, the next step in this slot waits on the second
+      VkSemaphore signalSemaphores[2] = {app->renderFinishedSemaphores[imageIndex]};
+      submitInfo.signalSemaphoreCount = 1;
+      if (asyncParticles) {
+         signalSemaphores[1] = particles_graphics_done(&app->particles, frame);
+         submitInfo.signalSemaphoreCount = 2;
+      }
+      submitInfo.pSignalSemaphores = signalSemaphores;
+
+      if (vkQueueSubmit(app->queues.graphics.queue, 1, &submitInfo, frame_sync_fence(&app->frameSync)) != VK_SUCCESS) {
+         fprintf(stderr, "failed to submit draw command buffer.\n");
+         exit(EXIT_FAILURE);
       }
    }
 
-   fprintf(stderr, "failed to find suitable memory type!");
-   exit(EXIT_FAILURE);
+   frame_sync_submitted(&app->frameSync);
+   app->submitCalls++;
+   app->waitUploads = false;
 }
 
-void create_buffer(App* app, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* buffer, VkDeviceMemory* bufferMemory) {
-   VkBufferCreateInfo bufferInfo = {0};
-   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-   bufferInfo.size = size;
-   bufferInfo.usage = usage;
-   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+// Nothing reacts to input yet, the events are drained every frame and timed. The time of the
+// oldest one goes with the frame so its latency can be measured once the frame is done.
+void process_input(App* app) {
+   InputEvent event;
+   LatencySample sample = {app->frameNumber, 0, 0};
+   while (spsc_queue_pop(&app->inputEvents, &event)) {
+      if (sample.events == 0) sample.time = event.time;
+      sample.events++;
+   }
 
-   if (vkCreateBuffer(app->device, &bufferInfo, nullptr, buffer) != VK_SUCCESS) {
-      fprintf(stderr, "failed to create buffer\n");
-      exit(EXIT_FAILURE);
+   if (!app->measureLatency || sample.events == 0) return;
+   if (app->pendingLatencyCount == lengthof(app->pendingLatency)) return;
+   app->pendingLatency[app->pendingLatencyCount++] = sample;
+}
+
+void report_latency(App* app) {
+   u64 now = simulation_now();
+   u32 kept = 0;
+   for (u32 i = 0; i < app->pendingLatencyCount; i++) {
+      LatencySample sample = app->pendingLatency[i];
+      if (!frame_sync_done(&app->frameSync, sample.frame)) {
+         app->pendingLatency[kept++] = sample;
+         continue;
+      }
+      app->latencyNanos += now - sample.time;
+      app->latencySamples++;
+      app->latencyEvents += sample.events;
    }
+   app->pendingLatencyCount = kept;
 
-   VkMemoryRequirements memRequirements;
-   vkGetBufferMemoryRequirements(app->device, *buffer, &memRequirements);
+   app->latencyFrames++;
+   if (app->latencyFrames < g_latencyReportFrames) return;
 
-   VkMemoryAllocateInfo allocInfo = {0};
-   allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-   allocInfo.allocationSize = memRequirements.size;
-   allocInfo.memoryTypeIndex = find_memory_type(app, memRequirements.memoryTypeBits, properties);
+   if (app->latencySamples > 0) {
+      printf("latency: %.3f ms input to frame done, %zd events over %zd frames, %zd dropped, render thread %s\n",
+             (double)app->latencyNanos / 1e6 / (double)app->latencySamples, app->latencyEvents, app->latencyFrames,
+             atomic_load_explicit(&app->inputEvents.dropped, memory_order_relaxed), app->renderThread ? "on" : "off");
+   }
+   app->latencyNanos = 0;
+   app->latencySamples = 0;
+   app->latencyEvents = 0;
+   app->latencyFrames = 0;
+}
 
-   if (vkAllocateMemory(app->device, &allocInfo, nullptr, bufferMemory) != VK_SUCCESS) {
-      fprintf(stderr, "failed to allocate vertex buffer memory\n");
-      exit(EXIT_FAILURE);
+// The grab is with the writer, which gets to finish in cleanup. Either loop stops at the end of
+// this frame, the empty event wakes the main thread up to see it.
+void request_quit(App* app) {
+   glfwSetWindowShouldClose(app->window, GLFW_TRUE);
+   if (app->renderThread) {
+      atomic_store_explicit(&app->quit, true, memory_order_release);
+      glfwPostEmptyEvent();
    }
+}
 
-   vkBindBufferMemory(app->device, *buffer, *bufferMemory, 0);
+// Warm up frames only set the start, the first measured frame needs the one before it.
+void sample_benchmark(App* app, u64 frameStart, u64 waitNanos) {
+   u64 previousStart = app->benchFrameStart;
+   app->benchFrameStart = frameStart;
+   if (app->frameNumber <= app->benchWarmup || !previousStart) return;
+
+   frame_times_add(&app->benchFrameTimes, frameStart - previousStart);
+   frame_times_add(&app->benchCpuTimes, simulation_now() - frameStart - waitNanos);
+   app->benchTriangles = app->trianglesDrawn;
+   if (app->benchFrameTimes.count == app->benchFrames) request_quit(app);
 }
 
-void copy_buffer(App* app, VkBuffer src, VkBuffer dest, VkDeviceSize size) {
-   VkCommandBufferAllocateInfo allocInfo = {0};
-   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-   allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-   allocInfo.commandPool = app->commandPool;
-   allocInfo.commandBufferCount = 1;
+void draw_frame(App* app) {
+   u64 frameStart = simulation_now();
+
+   // the only CPU wait of the frame, and only when the GPU is frame_count frames behind
+   struct timespec waitStart, waitEnd;
+   u64 waitCalls = app->frameSync.wait_calls;
+   clock_gettime(CLOCK_MONOTONIC, &waitStart);
+   app->frameNumber = frame_sync_begin(&app->frameSync);
+   clock_gettime(CLOCK_MONOTONIC, &waitEnd);
+   app->syncWaitCalls += app->frameSync.wait_calls - waitCalls;
+   u64 waitNanos = (u64)((waitEnd.tv_sec - waitStart.tv_sec) * 1000000000 + (waitEnd.tv_nsec - waitStart.tv_nsec));
+   app->syncWaitNanos += waitNanos;
+   app->currentFrame = frame_sync_slot(&app->frameSync, app->frameNumber);
+
+   if (app->measureGpuTime) read_frame_queries(app);
+   if (app->particlesEnabled) particles_report(&app->particles, (u32)app->currentFrame, g_particleReportFrames, stdout);
+   if (app->stagingFrame && frame_sync_done(&app->frameSync, app->stagingFrame)) release_staging_buffers(app);
+   if (app->measureLatency) report_latency(app);
+   if (app->capturing) {
+      capture_collect(&app->capture, &app->frameSync);
+      if (capture_grab_taken(&app->capture)) request_quit(app);
+   }
+
+   u32 imageIndex = 0;
+   VkResult result = vkAcquireNextImageKHR(app->device, app->swapChain, UINT64_MAX, app->imageAvailableSemaphores[app->currentFrame], VK_NULL_HANDLE, &imageIndex);
+   if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+      recreate_swap_chain(app);
+      return;
+   } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+      fprintf(stderr, "failed to acquire swapchain image.\n");
+      return;
+   }
 
-   VkCommandBuffer commandBuffer;
-   vkAllocateCommandBuffers(app->device, &allocInfo, &commandBuffer);
+   process_input(app);
+   update_uniform_buffer(app);
+   update_frame_descriptors(app);
 
-   VkCommandBufferBeginInfo beginInfo = {0};
-   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-   beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+   VkCommandBuffer commandBuffers[3];
+   u32 commandBufferCount = 0;
+
+   if (app->uploadsPending) {
+      commandBuffers[commandBufferCount++] = end_uploads(app);
+      app->stagingFrame = app->frameNumber;
+   }
+
+   // only once the image is acquired, a step that was submitted has to be drawn so the
+   // semaphores pair up
+   if (app->particlesEnabled) {
+      VkCommandBuffer step;
+      result = particles_record(&app->particles, (u32)app->currentFrame, 1.0f / 60.0f, &step);
+      if (result == VK_SUCCESS && app->particles.async) {
+         result = particles_submit(&app->particles, (u32)app->currentFrame, app->frameNumber, app->frameSync.semaphore);
+         app->submitCalls++;
+      } else if (result == VK_SUCCESS) {
+         commandBuffers[commandBufferCount++] = step;
+      }
+      if (result != VK_SUCCESS) {
+         fprintf(stderr, "failed to submit particle step.\n");
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   struct timespec recordStart, recordEnd;
+   clock_gettime(CLOCK_MONOTONIC, &recordStart);
+   vkResetCommandBuffer(app->commandBuffers[app->currentFrame], 0);
+   record_command_buffer(app, app->commandBuffers[app->currentFrame], imageIndex);
+   clock_gettime(CLOCK_MONOTONIC, &recordEnd);
+   app->recordNanos += (u64)((recordEnd.tv_sec - recordStart.tv_sec) * 1000000000 + (recordEnd.tv_nsec - recordStart.tv_nsec));
+   if (app->measureBinding) report_binding(app);
+   if (app->measureLod) report_lod(app);
+   if (app->measureMeshlets) report_meshlets(app);
+   commandBuffers[commandBufferCount++] = app->commandBuffers[app->currentFrame];
+
+   submit_frame(app, imageIndex, commandBuffers, commandBufferCount);
+   if (app->measureSync) report_sync(app);
+
+   VkSemaphore presentWait = app->renderFinishedSemaphores[imageIndex];
+   VkPresentInfoKHR presentInfo = {0};
+   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+   presentInfo.waitSemaphoreCount = 1;
+   presentInfo.pWaitSemaphores = &presentWait;
+
+   VkSwapchainKHR swapChains[] = {app->swapChain};
+   presentInfo.swapchainCount = 1;
+   presentInfo.pSwapchains = swapChains;
+   presentInfo.pImageIndices = &imageIndex;
+   presentInfo.pResults = nullptr;
+
+   result = vkQueuePresentKHR(app->queues.present.queue, &presentInfo);
+   bool resized = atomic_exchange_explicit(&app->framebufferResized, false, memory_order_acquire);
+   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || resized) {
+      recreate_swap_chain(app);
+   } else if (result != VK_SUCCESS) {
+      fprintf(stderr, "failed to present swap chain image!");
+      exit(EXIT_FAILURE);
+   }
+   if (app->benchmarking) sample_benchmark(app, frameStart, waitNanos);
+}
 
-   vkBeginCommandBuffer(commandBuffer, &beginInfo);
+// Recorded with the other init time copies, src has to stay alive until the first frame is done.
+void copy_buffer(App* app, VkBuffer src, VkBuffer dest, VkDeviceSize size) {
+   assert(app->uploadsPending && "Copies expected between begin_uploads and the first frame.");
 
    VkBufferCopy copyRegion = {0};
    copyRegion.srcOffset = 0; // Optional
    copyRegion.dstOffset = 0; // Optional
    copyRegion.size = size;
-   vkCmdCopyBuffer(commandBuffer, src, dest, 1, &copyRegion);
-   vkEndCommandBuffer(commandBuffer);
-
-   VkSubmitInfo submitInfo = {0};
-   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-   submitInfo.commandBufferCount = 1;
-   submitInfo.pCommandBuffers = &commandBuffer;
-
-   vkQueueSubmit(app->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-   vkQueueWaitIdle(app->graphicsQueue);
-
-   vkFreeCommandBuffers(app->device, app->commandPool, 1, &commandBuffer);
+   vkCmdCopyBuffer(app->uploadCommands, src, dest, 1, &copyRegion);
+   vector_push_back(app->uploadTargets, dest);
 }
 
+// the mesh is generated straight into the staging memory
 void create_vertex_buffer(App* app) {
+   VkDeviceSize bufferSize = (VkDeviceSize)mesh_vertex_count(app) * sizeof(Vertex);
+
    VkBuffer staginBuffer;
    VkDeviceMemory stagingBufferMemory;
 
-   create_buffer(app, sizeof(vertices), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staginBuffer, &stagingBufferMemory);
+   create_buffer(app, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staginBuffer, &stagingBufferMemory);
 
    void* data;
-   vkMapMemory(app->device, stagingBufferMemory, 0, sizeof(vertices), 0, &data);
-   memcpy(data, vertices, sizeof(vertices));
+   vkMapMemory(app->device, stagingBufferMemory, 0, bufferSize, 0, &data);
+   write_mesh_vertices(app, data);
    vkUnmapMemory(app->device, stagingBufferMemory);
 
-   create_buffer(app, sizeof(vertices), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT, &app->vertexBuffer, &app->vertexBufferMemory);
-   copy_buffer(app, staginBuffer, app->vertexBuffer, sizeof(vertices));
+   create_buffer(app, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT, &app->vertexBuffer, &app->vertexBufferMemory);
+   copy_buffer(app, staginBuffer, app->vertexBuffer, bufferSize);
+
+   StagingBuffer staging = {staginBuffer, stagingBufferMemory};
+   vector_push_back(app->stagingBuffers, staging);
+}
+
+// Every level of the chain gets meshlets of its own. They and their indices stay on the CPU for
+// the culling, the indices as the 16 bit ones the draws take, out of the arena like the chain.
+void build_meshlets(App* app, const u32* chain, const float* positions, Size vertexCount) {
+   Allocator heap = stdlib_allocator();
+   Size indexCount = app->meshLods.index_count;
+   Size boundSize = meshlets_bound(indexCount) * sizeof(Meshlet);
+   Size clusteredSize = indexCount * sizeof(u32);
+   Meshlet* bound = heap.alloc(boundSize, heap.ctx);
+   u32* clustered = heap.alloc(clusteredSize, heap.ctx);
+   app->meshletIndices = heap.alloc(indexCount * sizeof(u16), heap.ctx);
+   if (!bound || !clustered || !app->meshletIndices) {
+      fprintf(stderr, "failed to allocate meshlets\n");
+      exit(EXIT_FAILURE);
+   }
+
+   Size count = 0;
+   for (u32 i = 0; i < app->meshLods.count; i++) {
+      const MeshLod* lod = &app->meshLods.levels[i];
+      Size built = meshlets_build(&bound[count], &clustered[lod->first_index], &chain[lod->first_index], lod->index_count, positions, vertexCount, &heap);
+      if (built == 0) {
+         fprintf(stderr, "failed to build meshlets\n");
+         exit(EXIT_FAILURE);
+      }
+      for (Size j = count; j < count + built; j++) bound[j].first_index += lod->first_index;
+      app->meshletLevels[i] = (MeshletRange){(u32)count, (u32)built};
+      count += built;
+   }
+
+   app->meshletCount = count;
+   app->meshlets = heap.alloc(count * sizeof(Meshlet), heap.ctx);
+   if (!app->meshlets) {
+      fprintf(stderr, "failed to allocate meshlets\n");
+      exit(EXIT_FAILURE);
+   }
+   memcpy(app->meshlets, bound, (size_t)count * sizeof(Meshlet));
+   app->meshletIndexCount = indexCount;
+   for (Size i = 0; i < indexCount; i++) app->meshletIndices[i] = (u16)clustered[i];
+   heap.free(boundSize, bound, heap.ctx);
+   heap.free(clusteredSize, clustered, heap.ctx);
+
+   // every frame starts with room for one object's full mesh
+   app->clusterIndices = vector(ClusterIndexBuffer, g_maxFramesInFlight, &global_allocator);
+   for (Size i = 0; i < g_maxFramesInFlight; i++) {
+      ClusterIndexBuffer indices = {0};
+      reserve_cluster_indices(app, &indices, 0, app->meshLods.levels[0].index_count);
+      vector_push_back(app->clusterIndices, indices);
+   }
 
-   vkDestroyBuffer(app->device, staginBuffer, nullptr);
-   vkFreeMemory(app->device, stagingBufferMemory, nullptr);
+   const MeshletRange* full = &app->meshletLevels[0];
+   printf("meshlets: %zd over %u levels, %.1f triangles each at level 0\n", count, app->meshLods.count,
+          (double)app->meshLods.levels[0].index_count / 3.0 / (double)full->count);
 }
 
+// The full mesh and its LOD chain share the buffer, see meshLods. Simplification works on 32 bit
+// indices and positions of its own, kept out of the arena and freed once the chain is written.
 void create_index_buffer(App* app) {
-   VkDeviceSize bufferSize = sizeof(indices);
+   Allocator scratch = stdlib_allocator();
+   Size vertexCount = mesh_vertex_count(app);
+   Size indexCount = mesh_index_count(app);
+   Size verticesSize = vertexCount * sizeof(Vertex);
+   Size positionsSize = vertexCount * 3 * sizeof(float);
+   Size indicesSize = indexCount * sizeof(u32);
+   Size chainSize = (app->meshLod ? mesh_lod_capacity(indexCount) : indexCount) * sizeof(u32);
+   Vertex* vertices = scratch.alloc(verticesSize, scratch.ctx);
+   float* positions = scratch.alloc(positionsSize, scratch.ctx);
+   u32* indices = scratch.alloc(indicesSize, scratch.ctx);
+   u32* chain = scratch.alloc(chainSize, scratch.ctx);
+   if (!vertices || !positions || !indices || !chain) {
+      fprintf(stderr, "failed to allocate the mesh\n");
+      exit(EXIT_FAILURE);
+   }
+
+   write_mesh_vertices(app, vertices);
+   write_mesh_indices(app, indices);
+   app->meshRadius = 0.0f;
+   for (Size i = 0; i < vertexCount; i++) {
+      positions[i * 3] = vertices[i].pos[0];
+      positions[i * 3 + 1] = vertices[i].pos[1];
+      positions[i * 3 + 2] = 0.0f;
+      app->meshRadius = glm_max(app->meshRadius, glm_vec2_norm(vertices[i].pos));
+   }
+
+   if (app->meshLod) {
+      mesh_lod_build(&app->meshLods, chain, indices, indexCount, positions, vertexCount, g_lodMaxError, &scratch);
+   } else {
+      memcpy(chain, indices, (size_t)indicesSize);
+      app->meshLods = (MeshLodChain){0};
+      app->meshLods.levels[0] = (MeshLod){0, (u32)indexCount, 0.0f};
+      app->meshLods.count = 1;
+      app->meshLods.index_count = (u32)indexCount;
+   }
 
+   if (app->meshletsEnabled) build_meshlets(app, chain, positions, vertexCount);
+
+   VkDeviceSize bufferSize = (VkDeviceSize)app->meshLods.index_count * sizeof(u16);
    VkBuffer stagingBuffer;
    VkDeviceMemory stagingBufferMemory;
    create_buffer(app, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
 
-   void* data;
-   vkMapMemory(app->device, stagingBufferMemory, 0, bufferSize, 0, &data);
-   memcpy(data, indices, (size_t) bufferSize);
+   u16* data;
+   vkMapMemory(app->device, stagingBufferMemory, 0, bufferSize, 0, (void**)&data);
+   for (u32 i = 0; i < app->meshLods.index_count; i++) data[i] = (u16)chain[i];
    vkUnmapMemory(app->device, stagingBufferMemory);
 
    create_buffer(app, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &app->indexBuffer, &app->indexBufferMemory);
 
    copy_buffer(app, stagingBuffer, app->indexBuffer, bufferSize);
 
-   vkDestroyBuffer(app->device, stagingBuffer, nullptr);
-   vkFreeMemory(app->device, stagingBufferMemory, nullptr);
+   StagingBuffer staging = {stagingBuffer, stagingBufferMemory};
+   vector_push_back(app->stagingBuffers, staging);
+
+   scratch.free(verticesSize, vertices, scratch.ctx);
+   scratch.free(positionsSize, positions, scratch.ctx);
+   scratch.free(indicesSize, indices, scratch.ctx);
+   scratch.free(chainSize, chain, scratch.ctx);
+
+   if (app->meshLods.count > 1) {
+      const MeshLod* coarsest = &app->meshLods.levels[app->meshLods.count - 1];
+      printf("mesh: %u triangles, %u levels down to %u triangles, %.4f error\n", (u32)indexCount / 3,
+             app->meshLods.count, coarsest->index_count / 3, (double)coarsest->error);
+   }
 }
 
 void create_descriptor_set_layout(App* app) {
    VkDescriptorSetLayoutBinding uboLayoutBinding = {0};
    uboLayoutBinding.binding = 0;
-   uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+   uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
    uboLayoutBinding.descriptorCount = 1;
    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -1112,21 +2771,52 @@ void create_descriptor_set_layout(App* app) {
    layoutInfo.bindingCount = 1;
    layoutInfo.pBindings = &uboLayoutBinding;
 
-   if (vkCreateDescriptorSetLayout(app->device, &layoutInfo, nullptr, &app->descriptorSetLayout) != VK_SUCCESS) {
+   // bindless: a partially bound array of storage buffers that can be written while bound
+   VkDescriptorSetLayoutBinding bindlessBinding = {0};
+   bindlessBinding.binding = 0;
+   bindlessBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+   bindlessBinding.descriptorCount = app->bindlessCapacity;
+   bindlessBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+   VkDescriptorBindingFlags bindlessFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+   VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlags = {0};
+   bindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+   bindingFlags.bindingCount = 1;
+   bindingFlags.pBindingFlags = &bindlessFlags;
+
+   if (app->bindless) {
+      layoutInfo.pNext = &bindingFlags;
+      layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+      layoutInfo.pBindings = &bindlessBinding;
+   }
+
+   descriptor_layout_cache_init(&app->descriptorLayouts, app->device, vk_allocator, &global_allocator);
+   app->descriptorSetLayout = descriptor_layout_cache_get(&app->descriptorLayouts, &layoutInfo);
+   if (app->descriptorSetLayout == VK_NULL_HANDLE) {
       fprintf(stderr, "failed to create descriptor set layout\n");
       exit(EXIT_FAILURE);
    }
 }
 
 void create_uniform_buffer(App* app) {
-   VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+   // dynamic offsets have to be multiples of the alignment, which is a power of 2
+   VkDeviceSize alignment = app->caps.properties.limits.minUniformBufferOffsetAlignment;
+   app->uniformStride = (sizeof(UniformBufferObject) + alignment - 1) & ~(alignment - 1);
+   VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+
+   // bindless reads the buffer as an array of objects so the objects are packed
+   if (app->bindless) {
+      app->uniformStride = sizeof(UniformBufferObject);
+      usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+   }
+   VkDeviceSize bufferSize = app->uniformStride * (VkDeviceSize)vector_length(app->sceneObjects);
 
     app->uniformBuffers = vector(VkBuffer, g_maxFramesInFlight, &global_allocator);
     app->uniformBuffersMemory = vector(VkDeviceMemory, g_maxFramesInFlight, &global_allocator);
     app->uniformBuffersMapped = vector(void*, g_maxFramesInFlight, &global_allocator);
 
     for (Size i = 0; i < g_maxFramesInFlight; i++) {
-        create_buffer(app, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &app->uniformBuffers[i], &app->uniformBuffersMemory[i]);
+        create_buffer(app, bufferSize, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &app->uniformBuffers[i], &app->uniformBuffersMemory[i]);
 
         vkMapMemory(app->device, app->uniformBuffersMemory[i], 0, bufferSize, 0, &app->uniformBuffersMapped[i]);
 
@@ -1136,58 +2826,256 @@ void create_uniform_buffer(App* app) {
     }
 }
 
-void create_descriptor_pool(App* app) {
-   VkDescriptorPoolSize poolSize = {0};
-   poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-   poolSize.descriptorCount = (u32)g_maxFramesInFlight;
+void create_descriptor_allocators(App* app) {
+   // one dynamic uniform buffer per set, the pools double from 16 sets when they run out
+   DescriptorPoolRatio ratios[] = {
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+   };
 
-   VkDescriptorPoolCreateInfo poolInfo = {0};
-   poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-   poolInfo.poolSizeCount = 1;
-   poolInfo.pPoolSizes = &poolSize;
-   poolInfo.maxSets = (u32)g_maxFramesInFlight;
+   app->frameDescriptors = vector(DescriptorAllocator, g_maxFramesInFlight, &global_allocator);
+   for (Size i = 0; i < g_maxFramesInFlight; i++) {
+      descriptor_allocator_init(&app->frameDescriptors[i], app->device, vk_allocator, &global_allocator, 16, ratios, lengthof(ratios));
+   }
+   vector_update_length(g_maxFramesInFlight, app->frameDescriptors);
 
-   if (vkCreateDescriptorPool(app->device, &poolInfo, nullptr, &app->descriptorPool) != VK_SUCCESS) {
-      fprintf(stderr, "failed to create descriptor pool\n");
-      exit(EXIT_FAILURE);
+   // the one bindless set, update-after-bind sets need a pool created for them
+   DescriptorPoolRatio bindlessRatios[] = {
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, (float)app->bindlessCapacity},
+   };
+   if (app->bindless) {
+      descriptor_allocator_init(&app->bindlessDescriptors, app->device, vk_allocator, &global_allocator, 1, bindlessRatios, lengthof(bindlessRatios));
+      app->bindlessDescriptors.pool_flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
    }
 }
 
-void create_descriptor_sets(App* app) {
-   vectorT(VkDescriptorSetLayout) layouts = vector(VkDescriptorSetLayout, g_maxFramesInFlight, &global_allocator);
-   for (Size i = 0; i < g_maxFramesInFlight; i++) {
-      vector_push_back(layouts, app->descriptorSetLayout);
+void create_descriptor_templates(App* app) {
+   VkDescriptorUpdateTemplateEntry entry = {0};
+   entry.dstBinding = 0;
+   entry.dstArrayElement = 0;
+   entry.descriptorCount = 1;
+   entry.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+   entry.offset = 0;
+   entry.stride = sizeof(VkDescriptorBufferInfo);
+
+   // bindless writes every frame's buffer in one go, array element n is frame n
+   if (app->bindless) {
+      entry.descriptorCount = (u32)g_maxFramesInFlight;
+      entry.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
    }
-   VkDescriptorSetAllocateInfo allocInfo = {0};
-   allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-   allocInfo.descriptorPool = app->descriptorPool;
-   allocInfo.descriptorSetCount = (u32)g_maxFramesInFlight;
-   allocInfo.pSetLayouts = layouts;
-   
-   app->descriptorSets = vector(VkDescriptorSet, g_maxFramesInFlight, &global_allocator);
-   if (vkAllocateDescriptorSets(app->device, &allocInfo, app->descriptorSets) != VK_SUCCESS) {
-      fprintf(stderr, "failed to allocate descriptor sets\n");
+
+   if (descriptor_template_create(&app->uniformTemplate, app->device, vk_allocator, app->updateTemplates, app->descriptorSetLayout, &entry, 1) != VK_SUCCESS) {
+      fprintf(stderr, "failed to create descriptor update template\n");
       exit(EXIT_FAILURE);
    }
+
+   app->descriptorSets = vector(VkDescriptorSet, g_maxFramesInFlight, &global_allocator);
    vector_update_length(g_maxFramesInFlight, app->descriptorSets);
+}
+
+// Written once, the buffers never change. More buffers or textures would go in the free array
+// elements, update-after-bind allows that while the set is in use.
+void create_bindless_set(App* app) {
+   if (descriptor_allocator_allocate(&app->bindlessDescriptors, app->descriptorSetLayout, &app->bindlessSet) != VK_SUCCESS) {
+      fprintf(stderr, "failed to allocate bindless descriptor set\n");
+      exit(EXIT_FAILURE);
+   }
 
+   vectorT(VkDescriptorBufferInfo) bufferInfos = vector(VkDescriptorBufferInfo, g_maxFramesInFlight, &global_allocator);
    for (Size i = 0; i < g_maxFramesInFlight; i++) {
       VkDescriptorBufferInfo bufferInfo = {0};
       bufferInfo.buffer = app->uniformBuffers[i];
       bufferInfo.offset = 0;
-      bufferInfo.range = sizeof(UniformBufferObject);
+      bufferInfo.range = VK_WHOLE_SIZE;
+      vector_push_back(bufferInfos, bufferInfo);
+   }
+   descriptor_template_update(&app->uniformTemplate, app->device, app->bindlessSet, bufferInfos);
+}
+
+static void step_scene(SimTransform* transforms, u32 count, double dt, void* user) {
+   float step = glm_rad(g_rotationDegreesPerSecond) * (float)dt;
+   for (u32 i = 0; i < count; i++) {
+      transforms[i].angle += step;
+   }
+}
+
+void start_simulation(App* app) {
+   Size count = vector_length(app->sceneObjects);
+   vectorT(SimTransform) initial = vector(SimTransform, count, &global_allocator);
+   for (Size i = 0; i < count; i++) {
+      SimTransform transform = {0};
+      glm_vec3_copy(app->sceneObjects[i].position, transform.position);
+      transform.scale = app->sceneObjects[i].scale;
+      vector_push_back(initial, transform);
+   }
+
+   if (!simulation_start(&app->simulation, &global_allocator, initial, (u32)count, g_simulationHz, step_scene, app)) {
+      fprintf(stderr, "failed to start the simulation thread\n");
+      exit(EXIT_FAILURE);
+   }
+}
+
+void create_particle_system(App* app) {
+   ParticleSystemDesc desc = {0};
+   desc.device = app->device;
+   desc.caps = &app->caps;
+   desc.callbacks = vk_allocator;
+   desc.allocator = &global_allocator;
+   desc.layouts = &app->descriptorLayouts;
+   desc.count = app->particleCount;
+   desc.frame_count = (u32)g_maxFramesInFlight;
+   desc.graphics_family = app->queues.graphics.family;
+   desc.compute_family = app->queues.compute.family;
+   desc.compute_queue = app->queues.compute.queue;
+   desc.command_pool = app->queues.compute.pool;
+   desc.timeline_sync = app->timelineSync;
+
+   if (particles_init(&app->particles, &desc) != VK_SUCCESS) {
+      fprintf(stderr, "failed to create particle system\n");
+      exit(EXIT_FAILURE);
+   }
+   printf("particles: %u simulated on the %s queue\n", app->particleCount, app->particles.async ? "compute" : "graphics");
+}
+
+// One quad by default. SCENE_OBJECTS=n stacks n quads along the view direction, overlapping on
+// screen, which is the case the depth buffer and draw order are there for.
+void create_scene(App* app) {
+   const char* objectsEnv = getenv("SCENE_OBJECTS");
+   Size objectCount = objectsEnv ? strtol(objectsEnv, nullptr, 10) : 1;
+   if (objectCount < 1) objectCount = 1;
+
+   app->sceneObjects = vector(SceneObject, objectCount, &global_allocator);
+   app->drawOrder = vector(DrawKey, objectCount, &global_allocator);
+   vector_update_length(objectCount, app->sceneObjects);
+
+   if (objectCount == 1) {
+      app->sceneObjects[0] = (SceneObject){{0.0f, 0.0f, 0.0f}, 1.0f};
+      return;
+   }
+
+   u32 seed = 0x9e3779b9u;
+   for (Size i = 0; i < objectCount; i++) {
+      seed = seed * 1664525u + 1013904223u;
+      float x = (float)(seed >> 8) / (float)(1u << 24) - 0.5f;
+      seed = seed * 1664525u + 1013904223u;
+      float y = (float)(seed >> 8) / (float)(1u << 24) - 0.5f;
+      float z = 1.0f - 2.0f * (float)i / (float)(objectCount - 1);
+      app->sceneObjects[i] = (SceneObject){{x * 0.5f, y * 0.5f, z}, 0.75f};
+   }
+}
+
+void create_query_pools(App* app) {
+   if (!app->measureGpuTime) return;
+
+   app->timestampPeriod = app->caps.properties.limits.timestampPeriod;
+
+   VkQueryPoolCreateInfo statsInfo = {0};
+   statsInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+   statsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+   statsInfo.queryCount = (u32)g_maxFramesInFlight;
+   statsInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+   VkQueryPoolCreateInfo timestampInfo = {0};
+   timestampInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+   timestampInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+   timestampInfo.queryCount = (u32)g_maxFramesInFlight * 2;
+
+   if ((app->measureOverdraw && vkCreateQueryPool(app->device, &statsInfo, vk_allocator, &app->statsQueryPool) != VK_SUCCESS)
+         || vkCreateQueryPool(app->device, &timestampInfo, vk_allocator, &app->timestampQueryPool) != VK_SUCCESS) {
+      fprintf(stderr, "failed to create query pools\n");
+      exit(EXIT_FAILURE);
+   }
+}
+
+void create_capture(App* app) {
+   CaptureDesc desc = {0};
+   desc.device = app->device;
+   desc.physical_device = app->physicalDevice;
+   desc.callbacks = vk_allocator;
+   desc.image_format = app->swapChainImageFormat;
+   desc.extent = app->swapChainExtent;
+   desc.format = app->captureFormat;
+   desc.directory = app->captureDirectory;
+   desc.grab_path = app->grabPath;
+   desc.grab_frame = app->grabFrame;
+
+   VkResult result = capture_init(&app->capture, &desc);
+   if (result == VK_ERROR_FORMAT_NOT_SUPPORTED) {
+      fprintf(stderr, "capture only reads 8 bit RGBA or BGRA swapchains\n");
+      exit(EXIT_FAILURE);
+   } else if (result != VK_SUCCESS) {
+      fprintf(stderr, "failed to create the capture buffers\n");
+      exit(EXIT_FAILURE);
+   }
+   if (app->grabPath) {
+      printf("capture: grabbing frame %llu to %s\n", (unsigned long long)app->grabFrame, app->grabPath);
+   } else {
+      printf("capture: %s frames into %s\n", capture_format_name(app->captureFormat), app->captureDirectory);
+   }
+}
+
+void init_benchmark(App* app) {
+   snprintf(app->benchDevice, sizeof(app->benchDevice), "%s", app->caps.properties.deviceName);
+
+   app->benchAllocator = stdlib_allocator();
+   if (!frame_times_init(&app->benchFrameTimes, &app->benchAllocator, app->benchFrames)
+         || !frame_times_init(&app->benchCpuTimes, &app->benchAllocator, app->benchFrames)
+         || !frame_times_init(&app->benchGpuTimes, &app->benchAllocator, app->benchFrames)) {
+      fprintf(stderr, "failed to allocate the benchmark samples\n");
+      exit(EXIT_FAILURE);
+   }
+}
 
-      VkWriteDescriptorSet descriptorWrite = {0};
-      descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      descriptorWrite.dstSet = app->descriptorSets[i];
-      descriptorWrite.dstBinding = 0;
-      descriptorWrite.dstArrayElement = 0;
-      descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      descriptorWrite.descriptorCount = 1;
-      descriptorWrite.pBufferInfo = &bufferInfo;
+// After cleanup, so the peaks cover the whole run. Vulkan host memory is the sum of the peaks
+// of every allocation scope, they need not have been at the same time.
+void write_benchmark(App* app, const AllocStatsSnapshot* allocations) {
+   FILE* out = app->benchOut ? fopen(app->benchOut, "w") : stdout;
+   if (!out) {
+      fprintf(stderr, "could not open %s for the benchmark results\n", app->benchOut);
+      return;
+   }
 
-      vkUpdateDescriptorSets(app->device, 1, &descriptorWrite, 0, nullptr);
+   HostScopeStats scopes[HOST_ALLOCATOR_SCOPE_COUNT];
+   host_allocator_stats(&vk_host_allocator, scopes);
+   Size hostAllocations = 0;
+   Size hostPeakBytes = 0;
+   for (Size i = 0; i < HOST_ALLOCATOR_SCOPE_COUNT; i++) {
+      hostAllocations += scopes[i].alloc_count + scopes[i].realloc_count;
+      hostPeakBytes += scopes[i].peak_bytes + scopes[i].internal_peak_bytes;
+   }
+   struct rusage usage = {0};
+   getrusage(RUSAGE_SELF, &usage);
+
+   Size frames = app->benchFrameTimes.count;
+   FrameTimeSummary frameTimes = frame_times_summarize(&app->benchFrameTimes);
+   FrameTimeSummary cpuTimes = frame_times_summarize(&app->benchCpuTimes);
+   FrameTimeSummary gpuTimes = frame_times_summarize(&app->benchGpuTimes);
+
+   fprintf(out, "{\n");
+   fprintf(out, "  \"scene\": \"%s\",\n", app->benchName);
+   fprintf(out, "  \"device\": \"%s\",\n", app->benchDevice);
+   fprintf(out, "  \"params\": {\"objects\": %zd, \"triangles\": %u, \"instances\": %u, \"width\": %u, \"height\": %u, \"msaa\": %u, \"lod_levels\": %u, \"meshlets\": %zd},\n",
+           vector_length(app->sceneObjects), mesh_index_count(app) / 3, app->sceneInstances,
+           app->swapChainExtent.width, app->swapChainExtent.height, app->msaaSamples, app->meshLods.count, app->meshletCount);
+   fprintf(out, "  \"frames\": %zd,\n", frames);
+   fprintf(out, "  \"triangles_per_frame\": %llu,\n", (unsigned long long)app->benchTriangles);
+   fprintf(out, "  ");
+   frame_times_write_json(out, "frame_ms", &frameTimes);
+   fprintf(out, ",\n  ");
+   frame_times_write_json(out, "cpu_ms", &cpuTimes);
+   fprintf(out, ",\n  ");
+   frame_times_write_json(out, "gpu_ms", &gpuTimes);
+   fprintf(out, ",\n");
+   fprintf(out, "  \"memory\": {\"allocations\": %zd, \"peak_bytes\": %zd, \"vulkan_host_allocations\": %zd, \"vulkan_host_peak_bytes\": %zd, \"peak_rss_kib\": %ld}\n",
+           allocations->alloc_count, allocations->peak_bytes, hostAllocations, hostPeakBytes, usage.ru_maxrss);
+   fprintf(out, "}\n");
+   if (out != stdout) fclose(out);
+
+   if (app->benchFrameTimes.dropped > 0 || frames < app->benchFrames) {
+      fprintf(stderr, "benchmark %s: %zd of %u frames measured\n", app->benchName, frames, app->benchFrames);
    }
+   frame_times_destroy(&app->benchFrameTimes);
+   frame_times_destroy(&app->benchCpuTimes);
+   frame_times_destroy(&app->benchGpuTimes);
 }
 
 void init_vulkan(App* app) {
@@ -1199,102 +3087,321 @@ void init_vulkan(App* app) {
    create_logical_device(app);
    create_swap_chain(app);
    create_image_views(app);
-   create_render_pass(app);
+   app->depthFormat = find_depth_format(app);
+   if (!app->dynamicRendering) create_render_pass(app);
    create_descriptor_set_layout(app);
    create_graphics_pipeline(app);
-   create_framebuffers(app);
-   create_command_pool(app);
+   if (app->particlesEnabled) create_particle_pipeline(app);
+   build_frame_graph(app);
+   if (!app->dynamicRendering) create_framebuffers(app);
+   begin_uploads(app);
    create_vertex_buffer(app);
    create_index_buffer(app);
+   create_scene(app);
+   start_simulation(app);
    create_uniform_buffer(app);
-   create_descriptor_pool(app);
-   create_descriptor_sets(app);
+   create_descriptor_allocators(app);
+   create_descriptor_templates(app);
+   if (app->bindless) create_bindless_set(app);
+   if (app->particlesEnabled) create_particle_system(app);
    create_command_buffers(app);
    create_sync_objects(app);
+   create_query_pools(app);
+   if (app->capturing) create_capture(app);
+   if (app->benchmarking) init_benchmark(app);
 }
 
 void init_window(App* app) {
    glfwInit();
    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+   if (app->headless) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 // makes the window auto float for me but I want it to be resizable in release
 #ifndef NDEBUG
    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 #endif
 
    app->window = glfwCreateWindow(app->win_width, app->win_height, "Vulkan", nullptr, nullptr);
-   glfwSetFramebufferSizeCallback(app->window, framebuffer_resize_callback);
    glfwSetWindowUserPointer(app->window, app);
+
+   int width = 0;
+   int height = 0;
+   glfwGetFramebufferSize(app->window, &width, &height);
+   atomic_init(&app->framebufferSize, (u64)(u32)width << 32 | (u32)height);
+   atomic_init(&app->framebufferResized, false);
+   atomic_init(&app->quit, false);
+   if (!spsc_queue_init(&app->inputEvents, &global_allocator, sizeof(InputEvent), g_inputQueueCapacity)) {
+      fprintf(stderr, "failed to create the input queue\n");
+      exit(EXIT_FAILURE);
+   }
+
+   glfwSetFramebufferSizeCallback(app->window, framebuffer_resize_callback);
+   glfwSetKeyCallback(app->window, key_callback);
+   glfwSetMouseButtonCallback(app->window, mouse_button_callback);
+   glfwSetCursorPosCallback(app->window, cursor_position_callback);
 }
 
-App init_app(void) {
-   App app = {0};
-   app.startTime = time(nullptr);
-   app.win_width = 800;
-   app.win_height = 600;
-   init_window(&app);
-   init_vulkan(&app);
-   return app;
+// Initialised in place, the window and the frame graph keep pointers to the App.
+void init_app(App* app, int argc, char** argv) {
+   *app = (App){0};
+   app->win_width = 800;
+   app->win_height = 600;
+
+   // DEPTH_PREPASS=1, DRAW_SORT=front|back|none and OVERDRAW_STATS=1 for comparing draw orders
+   const char* prePass = getenv("DEPTH_PREPASS");
+   app->depthPrePass = prePass && strcmp(prePass, "0") != 0;
+   const char* drawSort = getenv("DRAW_SORT");
+   app->drawSort = DRAW_SORT_FRONT_TO_BACK;
+   if (drawSort && strcmp(drawSort, "back") == 0) app->drawSort = DRAW_SORT_BACK_TO_FRONT;
+   if (drawSort && strcmp(drawSort, "none") == 0) app->drawSort = DRAW_SORT_NONE;
+   const char* overdraw = getenv("OVERDRAW_STATS");
+   app->measureOverdraw = overdraw && strcmp(overdraw, "0") != 0;
+
+   // SCENE_TRIANGLES=n and SCENE_INSTANCES=n, WINDOW_SIZE=1920x1080
+   const char* triangles = getenv("SCENE_TRIANGLES");
+   u32 triangleCount = triangles ? (u32)strtoul(triangles, nullptr, 10) : 2;
+   app->meshCells = 1;
+   while (app->meshCells < g_maxMeshCells && app->meshCells * app->meshCells * 2 < triangleCount) app->meshCells++;
+   const char* instances = getenv("SCENE_INSTANCES");
+   app->sceneInstances = instances ? (u32)strtoul(instances, nullptr, 10) : 1;
+   if (app->sceneInstances < 1) app->sceneInstances = 1;
+   const char* windowSize = getenv("WINDOW_SIZE");
+   u32 width = 0;
+   u32 height = 0;
+   if (windowSize && sscanf(windowSize, "%ux%u", &width, &height) == 2 && width > 0 && height > 0) {
+      app->win_width = width;
+      app->win_height = height;
+   }
+
+   // BENCH_FRAMES=n with BENCH_WARMUP=n, BENCH_NAME and BENCH_OUT=path
+   const char* benchFrames = getenv("BENCH_FRAMES");
+   const char* benchWarmup = getenv("BENCH_WARMUP");
+   const char* benchName = getenv("BENCH_NAME");
+   app->benchFrames = benchFrames ? (u32)strtoul(benchFrames, nullptr, 10) : 0;
+   app->benchmarking = app->benchFrames > 0;
+   app->benchWarmup = benchWarmup ? (u32)strtoul(benchWarmup, nullptr, 10) : 60;
+   app->benchName = benchName ? benchName : "unnamed";
+   app->benchOut = getenv("BENCH_OUT");
+   app->measureGpuTime = app->measureOverdraw || app->benchmarking;
+   const char* meshLod = getenv("MESH_LOD");
+   app->meshLod = !meshLod || strcmp(meshLod, "0") != 0;
+   const char* lodStats = getenv("LOD_STATS");
+   app->measureLod = lodStats && strcmp(lodStats, "0") != 0;
+   const char* meshlets = getenv("MESHLETS");
+   app->meshletsEnabled = meshlets && strcmp(meshlets, "0") != 0;
+   const char* meshletStats = getenv("MESHLET_STATS");
+   app->measureMeshlets = app->meshletsEnabled && meshletStats && strcmp(meshletStats, "0") != 0;
+   const char* legacy = getenv("LEGACY_RENDER_PASS");
+   app->dynamicRendering = !legacy || strcmp(legacy, "0") == 0;
+   const char* msaa = getenv("MSAA");
+   app->msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+   if (msaa && strcmp(msaa, "2") == 0) app->msaaSamples = VK_SAMPLE_COUNT_2_BIT;
+   if (msaa && strcmp(msaa, "4") == 0) app->msaaSamples = VK_SAMPLE_COUNT_4_BIT;
+   if (msaa && strcmp(msaa, "8") == 0) app->msaaSamples = VK_SAMPLE_COUNT_8_BIT;
+   const char* bindless = getenv("BINDLESS");
+   app->bindless = bindless && strcmp(bindless, "0") != 0;
+   const char* bindingStats = getenv("BINDING_STATS");
+   app->measureBinding = bindingStats && strcmp(bindingStats, "0") != 0;
+   const char* renderThread = getenv("RENDER_THREAD");
+   app->renderThread = !renderThread || strcmp(renderThread, "0") != 0;
+   const char* latencyStats = getenv("LATENCY_STATS");
+   app->measureLatency = latencyStats && strcmp(latencyStats, "0") != 0;
+   const char* timelineSync = getenv("TIMELINE_SYNC");
+   app->timelineSync = !timelineSync || strcmp(timelineSync, "0") != 0;
+   const char* syncStats = getenv("SYNC_STATS");
+   app->measureSync = syncStats && strcmp(syncStats, "0") != 0;
+   const char* particles = getenv("PARTICLES");
+   app->particleCount = particles ? (u32)strtoul(particles, nullptr, 10) : 0;
+   app->particlesEnabled = app->particleCount > 0;
+   const char* asyncCompute = getenv("ASYNC_COMPUTE");
+   app->asyncCompute = !asyncCompute || strcmp(asyncCompute, "0") != 0;
+   const char* asyncTransfer = getenv("ASYNC_TRANSFER");
+   app->asyncTransfer = !asyncTransfer || strcmp(asyncTransfer, "0") != 0;
+
+   // the format is CAPTURE's, for a grab without it the path's extension, png by default
+   const char* capture = getenv("CAPTURE");
+   const char* captureDirectory = getenv("CAPTURE_DIR");
+   const char* grabFrame = getenv("GRAB_FRAME");
+   const char* headless = getenv("HEADLESS");
+   app->grabPath = getenv("GRAB");
+   app->capturing = app->grabPath || (capture && strcmp(capture, "0") != 0);
+   const char* format = capture ? capture : app->grabPath ? strrchr(app->grabPath, '.') : nullptr;
+   if (format && *format == '.') format++;
+   app->captureFormat = CAPTURE_PNG;
+   if (format && strcmp(format, "ppm") == 0) app->captureFormat = CAPTURE_PPM;
+   if (format && strcmp(format, "raw") == 0) app->captureFormat = CAPTURE_RAW;
+   app->captureDirectory = captureDirectory ? captureDirectory : ".";
+   app->grabFrame = grabFrame ? strtoull(grabFrame, nullptr, 10) : 1;
+   if (app->grabFrame == 0) app->grabFrame = 1;
+   app->headless = headless && strcmp(headless, "0") != 0;
+
+   // GPU=name|index, --gpu on the command line wins
+   app->gpuOverride = getenv("GPU");
+   for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--gpu") == 0 && i + 1 < argc) {
+         app->gpuOverride = argv[++i];
+      } else if (strncmp(argv[i], "--gpu=", 6) == 0) {
+         app->gpuOverride = argv[i] + 6;
+      } else {
+         fprintf(stderr, "usage: %s [--gpu name|index]\n", argv[0]);
+         exit(EXIT_FAILURE);
+      }
+   }
+   if (app->gpuOverride && *app->gpuOverride == '\0') app->gpuOverride = nullptr;
+
+   init_window(app);
+   init_vulkan(app);
 }
 
 void cleanup(App* app) {
+   simulation_stop(&app->simulation);
+   if (app->capturing) {
+      capture_flush(&app->capture, &app->frameSync);
+      capture_print_stats(&app->capture, stdout);
+      capture_destroy(&app->capture, &app->frameSync);
+   }
    cleanup_swap_chain(app);
 
    for (Size i = 0; i < g_maxFramesInFlight; i++) {
-      vkDestroyBuffer(app->device, app->uniformBuffers[i], nullptr);
-      vkFreeMemory(app->device, app->uniformBuffersMemory[i], nullptr);
+      vkDestroyBuffer(app->device, app->uniformBuffers[i], vk_allocator);
+      vkFreeMemory(app->device, app->uniformBuffersMemory[i], vk_allocator);
    }
 
-   vkDestroyDescriptorPool(app->device, app->descriptorPool, nullptr);
-   vkDestroyDescriptorSetLayout(app->device, app->descriptorSetLayout, nullptr);
-
-   vkDestroyBuffer(app->device, app->vertexBuffer, nullptr);
-   vkFreeMemory(app->device, app->vertexBufferMemory, nullptr);
-   vkDestroyBuffer(app->device, app->indexBuffer, nullptr);
-   vkFreeMemory(app->device, app->indexBufferMemory, nullptr);
+   for (Size i = 0; i < vector_length(app->frameDescriptors); i++) {
+      descriptor_allocator_destroy(&app->frameDescriptors[i]);
+   }
+   if (app->bindless) descriptor_allocator_destroy(&app->bindlessDescriptors);
+   if (app->particlesEnabled) particles_destroy(&app->particles);
+   descriptor_template_destroy(&app->uniformTemplate, app->device, vk_allocator);
+   descriptor_layout_cache_destroy(&app->descriptorLayouts);
+
+   vkDestroyBuffer(app->device, app->vertexBuffer, vk_allocator);
+   vkFreeMemory(app->device, app->vertexBufferMemory, vk_allocator);
+   vkDestroyBuffer(app->device, app->indexBuffer, vk_allocator);
+   vkFreeMemory(app->device, app->indexBufferMemory, vk_allocator);
+   if (app->meshletsEnabled) {
+      for (Size i = 0; i < vector_length(app->clusterIndices); i++) {
+         vkDestroyBuffer(app->device, app->clusterIndices[i].buffer, vk_allocator);
+         vkFreeMemory(app->device, app->clusterIndices[i].memory, vk_allocator);
+      }
+      Allocator heap = stdlib_allocator();
+      heap.free(app->meshletCount * sizeof(Meshlet), app->meshlets, heap.ctx);
+      heap.free(app->meshletIndexCount * sizeof(u16), app->meshletIndices, heap.ctx);
+   }
 
    for (Size i = 0; i < vector_length(app->renderFinishedSemaphores); i++) {
-      vkDestroySemaphore(app->device, app->renderFinishedSemaphores[i], nullptr);
+      vkDestroySemaphore(app->device, app->renderFinishedSemaphores[i], vk_allocator);
    }
 
    for (Size i = 0; i < g_maxFramesInFlight; i++) {
-      vkDestroySemaphore(app->device, app->imageAvailableSemaphores[i], nullptr);
-      vkDestroyFence(app->device, app->inFlightFences[i], nullptr);
+      vkDestroySemaphore(app->device, app->imageAvailableSemaphores[i], vk_allocator);
    }
+   frame_sync_destroy(&app->frameSync);
+   release_staging_buffers(app);
 
-   vkDestroyCommandPool(app->device, app->commandPool, nullptr);
+   queues_destroy(&app->queues);
 
-   vkDestroyPipeline(app->device, app->graphicsPipeline, nullptr);
-   vkDestroyPipelineLayout(app->device, app->pipelineLayout, nullptr);
-   vkDestroyRenderPass(app->device, app->renderPass, nullptr);
+   if (app->measureOverdraw) vkDestroyQueryPool(app->device, app->statsQueryPool, vk_allocator);
+   if (app->measureGpuTime) vkDestroyQueryPool(app->device, app->timestampQueryPool, vk_allocator);
+
+   if (app->depthPrePass) {
+      vkDestroyPipeline(app->device, app->depthPrePassPipeline, vk_allocator);
+   }
+   if (app->particlesEnabled) {
+      vkDestroyPipeline(app->device, app->particlePipeline, vk_allocator);
+      vkDestroyPipelineLayout(app->device, app->particlePipelineLayout, vk_allocator);
+   }
+   vkDestroyPipeline(app->device, app->graphicsPipeline, vk_allocator);
+   vkDestroyPipelineLayout(app->device, app->pipelineLayout, vk_allocator);
+   if (!app->dynamicRendering) vkDestroyRenderPass(app->device, app->renderPass, vk_allocator);
 
-   vkDestroyDevice(app->device, nullptr);
+   vkDestroyDevice(app->device, vk_allocator);
+   device_caps_destroy(&app->caps);
 
    if (enableValidationLayers) {
-      destroy_debug_utils_messenger_ext(app->instance, app->debugMessenger, nullptr);
+      destroy_debug_utils_messenger_ext(app->instance, app->debugMessenger, vk_allocator);
    }
 
-   vkDestroySurfaceKHR(app->instance, app->surface, nullptr);
-   vkDestroyInstance(app->instance, nullptr);
+   vkDestroySurfaceKHR(app->instance, app->surface, vk_allocator);
+   vkDestroyInstance(app->instance, vk_allocator);
+   spsc_queue_destroy(&app->inputEvents);
    glfwDestroyWindow(app->window);
    glfwTerminate();
 }
 
-void main_loop(App* app) {
-   while (!glfwWindowShouldClose(app->window)) {
-      glfwPollEvents();
+static void* render_loop(void* user) {
+   App* app = user;
+   while (!atomic_load_explicit(&app->quit, memory_order_acquire)) {
       draw_frame(app);
    }
 
    vkDeviceWaitIdle(app->device);
+   return nullptr;
 }
 
-int main(void) {
+void main_loop(App* app) {
+   if (!app->renderThread) {
+      while (!glfwWindowShouldClose(app->window)) {
+         glfwPollEvents();
+         draw_frame(app);
+      }
+
+      vkDeviceWaitIdle(app->device);
+      return;
+   }
+
+   if (pthread_create(&app->renderThreadHandle, nullptr, render_loop, app) != 0) {
+      fprintf(stderr, "failed to start the render thread\n");
+      exit(EXIT_FAILURE);
+   }
+
+   // sleeps until there are events, a stalled frame no longer holds up input or the other way round
+   while (!glfwWindowShouldClose(app->window)) {
+      glfwWaitEvents();
+   }
+
+   atomic_store_explicit(&app->quit, true, memory_order_release);
+   pthread_join(app->renderThreadHandle, nullptr);
+}
+
+int main(int argc, char** argv) {
    Arena global_arena = arena_init(KB(500));
+   // benchmarks count allocations in release builds as well
+   AllocStats global_stats;
+#ifdef NDEBUG
+   bool trackAllocations = getenv("BENCH_FRAMES") != nullptr;
+#else
+   bool trackAllocations = true;
+#endif
    global_allocator = arena_allocator(&global_arena);
+   if (trackAllocations) {
+      alloc_stats_init(&global_stats, "global", arena_allocator(&global_arena));
+      global_allocator = tracking_allocator(&global_stats);
+   }
 
-   App app = init_app();
+   host_allocator_init(&vk_host_allocator, KB(256));
+   vk_allocator = host_allocator_callbacks(&vk_host_allocator);
+
+   // e.g. SHADER_OVERRIDE=resources/shaders to pick up recompiled shaders without a rebuild
+   const char* shaderOverride = getenv("SHADER_OVERRIDE");
+   if (shaderOverride && !shaders_override(shaderOverride)) {
+      fprintf(stderr, "could not open shader override %s, using the built in shaders\n", shaderOverride);
+   }
+
+   App app;
+   init_app(&app, argc, argv);
    main_loop(&app);
    cleanup(&app);
+
+   AllocStatsSnapshot snapshot = {0};
+   if (trackAllocations) alloc_stats_snapshot(&global_stats, &snapshot);
+#ifndef NDEBUG
+   host_allocator_dump(&vk_host_allocator, stdout);
+   alloc_stats_dump(&snapshot, stdout);
+#endif
+   if (app.benchmarking) write_benchmark(&app, &snapshot);
+   if (trackAllocations) alloc_stats_destroy(&global_stats);
+   shaders_override(nullptr);
+   host_allocator_destroy(&vk_host_allocator);
    arena_destroy(&global_arena);
    return 0;
 }
@@ -1,6 +1,8 @@
 #include "memory.h"
 
 #include <assert.h>
+#include <dlfcn.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -116,3 +118,326 @@ Allocator stdlib_allocator() {
    allocator.ctx = nullptr;
    return allocator;
 }
+
+// pool
+
+struct PoolBlock {
+   PoolBlock* next;
+};
+
+static_assert(POOL_MAX_BLOCK == POOL_MIN_BLOCK << (POOL_CLASS_COUNT - 1), "Pool classes expected to span POOL_MIN_BLOCK to POOL_MAX_BLOCK.");
+
+static Size pool_class(Size size) {
+   Size c = 0;
+   Size block = POOL_MIN_BLOCK;
+   while (block < size) {
+      block <<= 1;
+      c++;
+   }
+   return c;
+}
+
+Pool pool_init(Size page_size, Allocator parent) {
+   assert(page_size >= POOL_MAX_BLOCK + POOL_MIN_BLOCK && "Pool pages expected to hold at least one of the largest block.");
+   Pool pool = {0};
+   pool.parent = parent;
+   pool.page_size = page_size;
+   return pool;
+}
+
+void pool_destroy(Pool* p) {
+   PoolBlock* page = p->pages;
+   while (page) {
+      PoolBlock* next = page->next;
+      p->parent.free(p->page_size, page, p->parent.ctx);
+      page = next;
+   }
+   memset(p->free_lists, 0, sizeof(p->free_lists));
+   p->pages = nullptr;
+}
+
+// Splits a fresh page into blocks of one class. The first POOL_MIN_BLOCK bytes link the page
+// into the page list so it can be handed back on destroy.
+static bool pool_grow(Pool* p, Size c) {
+   u8* page = p->parent.alloc(p->page_size, p->parent.ctx);
+   if (!page) return false;
+
+   ((PoolBlock*)page)->next = p->pages;
+   p->pages = (PoolBlock*)page;
+
+   Size block_size = POOL_MIN_BLOCK << c;
+   for (Size offset = POOL_MIN_BLOCK; offset + block_size <= p->page_size; offset += block_size) {
+      PoolBlock* block = (PoolBlock*)(page + offset);
+      block->next = p->free_lists[c];
+      p->free_lists[c] = block;
+   }
+   return true;
+}
+
+void* pool_alloc(Pool* p, Size size) {
+   if (size > POOL_MAX_BLOCK) {
+      return p->parent.alloc(size, p->parent.ctx);
+   }
+
+   Size c = pool_class(size);
+   if (!p->free_lists[c] && !pool_grow(p, c)) {
+      return nullptr;
+   }
+
+   PoolBlock* block = p->free_lists[c];
+   p->free_lists[c] = block->next;
+   return block;
+}
+
+void pool_free(Pool* p, Size size, void* ptr) {
+   if (!ptr) return;
+   if (size > POOL_MAX_BLOCK) {
+      p->parent.free(size, ptr, p->parent.ctx);
+      return;
+   }
+
+   Size c = pool_class(size);
+   PoolBlock* block = ptr;
+   block->next = p->free_lists[c];
+   p->free_lists[c] = block;
+}
+
+static void* pool_allocator_alloc(Size size, void* ctx) {
+   return pool_alloc(ctx, size);
+}
+
+static void pool_allocator_free(Size size, void* ptr, void* ctx) {
+   pool_free(ctx, size, ptr);
+}
+
+Allocator pool_allocator(Pool* p) {
+   Allocator allocator = {0};
+   allocator.alloc = pool_allocator_alloc;
+   allocator.free = pool_allocator_free;
+   allocator.ctx = p;
+   return allocator;
+}
+
+// tracking allocator
+
+// Per thread, per AllocStats counters. Only the owning thread writes these, snapshots read them
+// relaxed from whatever thread asks so the totals can be a few allocations behind.
+struct AllocStatsThread {
+   AllocStats* owner;
+   AllocStatsThread* next;        // owner's list
+   AllocStatsThread* next_local;  // this thread's list
+
+   _Atomic(Size) total_bytes;
+   _Atomic(Size) alloc_count;
+   _Atomic(Size) free_count;
+   _Atomic(Size) failed_count;
+
+   // open addressed on the site address. Once the table is full, new sites are dropped: they
+   // still count in the totals but get no entry of their own.
+   struct {
+      _Atomic(void*) site;
+      _Atomic(Size) count;
+      _Atomic(Size) bytes;
+   } sites[ALLOC_STATS_MAX_SITES];
+};
+
+static thread_local AllocStatsThread* t_stats_threads = nullptr;
+
+static void counter_add(_Atomic(Size)* counter, Size value) {
+   atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static AllocStatsThread* alloc_stats_thread(AllocStats* stats) {
+   AllocStatsThread* t = t_stats_threads;
+   if (t && t->owner == stats) return t;
+
+   for (t = t_stats_threads; t; t = t->next_local) {
+      if (t->owner == stats) return t;
+   }
+
+   t = calloc(1, sizeof(AllocStatsThread));
+   if (!t) return nullptr;
+   t->owner = stats;
+   t->next_local = t_stats_threads;
+   t_stats_threads = t;
+
+   AllocStatsThread* head = atomic_load(&stats->threads);
+   do {
+      t->next = head;
+   } while (!atomic_compare_exchange_weak(&stats->threads, &head, t));
+
+   return t;
+}
+
+static void alloc_stats_record_site(AllocStatsThread* t, void* site, Size size) {
+   Size mask = ALLOC_STATS_MAX_SITES - 1;
+   Size i = (Size)(((uintptr)site >> 4) * 0x9E3779B97F4A7C15ull >> 57) & mask;
+
+   for (Size probe = 0; probe < ALLOC_STATS_MAX_SITES; probe++, i = (i + 1) & mask) {
+      void* current = atomic_load_explicit(&t->sites[i].site, memory_order_relaxed);
+      if (current == nullptr) {
+         atomic_store_explicit(&t->sites[i].site, site, memory_order_relaxed);
+      } else if (current != site) {
+         continue;
+      }
+      counter_add(&t->sites[i].count, 1);
+      counter_add(&t->sites[i].bytes, size);
+      return;
+   }
+}
+
+static_assert((ALLOC_STATS_MAX_SITES & (ALLOC_STATS_MAX_SITES - 1)) == 0, "ALLOC_STATS_MAX_SITES expected to be a power of 2.");
+
+static void* tracking_allocator_alloc(Size size, void* ctx) {
+   AllocStats* stats = ctx;
+   void* site = __builtin_return_address(0);
+   void* ptr = stats->parent.alloc(size, stats->parent.ctx);
+
+   AllocStatsThread* t = alloc_stats_thread(stats);
+   if (!t) return ptr;
+
+   if (!ptr) {
+      counter_add(&t->failed_count, 1);
+      return ptr;
+   }
+
+   counter_add(&t->alloc_count, 1);
+   counter_add(&t->total_bytes, size);
+   alloc_stats_record_site(t, site, size);
+
+   Size live = atomic_fetch_add_explicit(&stats->live_bytes, size, memory_order_relaxed) + size;
+   Size peak = atomic_load_explicit(&stats->peak_bytes, memory_order_relaxed);
+   while (live > peak && !atomic_compare_exchange_weak_explicit(&stats->peak_bytes, &peak, live, memory_order_relaxed, memory_order_relaxed)) {}
+
+   return ptr;
+}
+
+static void tracking_allocator_free(Size size, void* ptr, void* ctx) {
+   AllocStats* stats = ctx;
+   stats->parent.free(size, ptr, stats->parent.ctx);
+   if (!ptr) return;
+
+   AllocStatsThread* t = alloc_stats_thread(stats);
+   if (t) counter_add(&t->free_count, 1);
+   atomic_fetch_sub_explicit(&stats->live_bytes, size, memory_order_relaxed);
+}
+
+void alloc_stats_init(AllocStats* stats, const char* name, Allocator parent) {
+   stats->parent = parent;
+   stats->name = name;
+   atomic_init(&stats->live_bytes, 0);
+   atomic_init(&stats->peak_bytes, 0);
+   atomic_init(&stats->threads, nullptr);
+}
+
+// Only safe once no other thread is still allocating through the stats.
+void alloc_stats_destroy(AllocStats* stats) {
+   AllocStatsThread* t = atomic_exchange(&stats->threads, nullptr);
+
+   // unlink from the calling thread's list, other threads' lists are gone with them
+   AllocStatsThread** link = &t_stats_threads;
+   while (*link) {
+      if ((*link)->owner == stats) {
+         *link = (*link)->next_local;
+      } else {
+         link = &(*link)->next_local;
+      }
+   }
+
+   while (t) {
+      AllocStatsThread* next = t->next;
+      free(t);
+      t = next;
+   }
+}
+
+Allocator tracking_allocator(AllocStats* stats) {
+   Allocator allocator = {0};
+   allocator.alloc = tracking_allocator_alloc;
+   allocator.free = tracking_allocator_free;
+   allocator.ctx = stats;
+   return allocator;
+}
+
+static int alloc_site_compare(const void* a, const void* b) {
+   const AllocSite* sa = a;
+   const AllocSite* sb = b;
+   return (sa->bytes < sb->bytes) - (sa->bytes > sb->bytes);
+}
+
+void alloc_stats_snapshot(AllocStats* stats, AllocStatsSnapshot* out) {
+   memset(out, 0, sizeof(*out));
+   out->name = stats->name;
+   out->live_bytes = atomic_load_explicit(&stats->live_bytes, memory_order_relaxed);
+   out->peak_bytes = atomic_load_explicit(&stats->peak_bytes, memory_order_relaxed);
+
+   for (AllocStatsThread* t = atomic_load(&stats->threads); t; t = t->next) {
+      out->total_bytes += atomic_load_explicit(&t->total_bytes, memory_order_relaxed);
+      out->alloc_count += atomic_load_explicit(&t->alloc_count, memory_order_relaxed);
+      out->free_count += atomic_load_explicit(&t->free_count, memory_order_relaxed);
+      out->failed_count += atomic_load_explicit(&t->failed_count, memory_order_relaxed);
+
+      for (Size i = 0; i < ALLOC_STATS_MAX_SITES; i++) {
+         void* site = atomic_load_explicit(&t->sites[i].site, memory_order_relaxed);
+         if (!site) continue;
+
+         Size j = 0;
+         for (; j < out->site_count && out->sites[j].site != site; j++) {}
+         if (j == out->site_count) {
+            if (out->site_count == ALLOC_STATS_MAX_SITES) continue;
+            out->sites[out->site_count++].site = site;
+         }
+         out->sites[j].count += atomic_load_explicit(&t->sites[i].count, memory_order_relaxed);
+         out->sites[j].bytes += atomic_load_explicit(&t->sites[i].bytes, memory_order_relaxed);
+      }
+   }
+
+   qsort(out->sites, out->site_count, sizeof(AllocSite), alloc_site_compare);
+}
+
+// Writes "module+0xoffset" which is what addr2line -e module wants for PIE binaries.
+static void alloc_site_format(void* site, char* buf, Size length) {
+   Dl_info info = {0};
+   if (dladdr(site, &info) && info.dli_fname) {
+      const char* module = strrchr(info.dli_fname, '/');
+      module = module ? module + 1 : info.dli_fname;
+      if (info.dli_sname) {
+         snprintf(buf, length, "%s(%s+0x%tx)", module, info.dli_sname, (char*)site - (char*)info.dli_saddr);
+      } else {
+         snprintf(buf, length, "%s+0x%tx", module, (char*)site - (char*)info.dli_fbase);
+      }
+   } else {
+      snprintf(buf, length, "%p", site);
+   }
+}
+
+void alloc_stats_dump(const AllocStatsSnapshot* snapshot, FILE* out) {
+   fprintf(out, "Allocation stats %s:\n", snapshot->name ? snapshot->name : "");
+   fprintf(out, "   live:    %td bytes\n", snapshot->live_bytes);
+   fprintf(out, "   peak:    %td bytes\n", snapshot->peak_bytes);
+   fprintf(out, "   total:   %td bytes\n", snapshot->total_bytes);
+   fprintf(out, "   allocs:  %td\n", snapshot->alloc_count);
+   fprintf(out, "   frees:   %td\n", snapshot->free_count);
+   fprintf(out, "   failed:  %td\n", snapshot->failed_count);
+   fprintf(out, "   call sites:\n");
+
+   char site[256];
+   for (Size i = 0; i < snapshot->site_count; i++) {
+      const AllocSite* s = &snapshot->sites[i];
+      alloc_site_format(s->site, site, sizeof(site));
+      fprintf(out, "      %10td bytes %6td allocs  %s\n", s->bytes, s->count, site);
+   }
+}
+
+void alloc_stats_write_csv(const AllocStatsSnapshot* snapshot, FILE* out) {
+   fprintf(out, "name,site,count,bytes\n");
+   fprintf(out, "%s,total,%td,%td\n", snapshot->name ? snapshot->name : "", snapshot->alloc_count, snapshot->total_bytes);
+   fprintf(out, "%s,peak,0,%td\n", snapshot->name ? snapshot->name : "", snapshot->peak_bytes);
+
+   char site[256];
+   for (Size i = 0; i < snapshot->site_count; i++) {
+      const AllocSite* s = &snapshot->sites[i];
+      alloc_site_format(s->site, site, sizeof(site));
+      fprintf(out, "%s,%s,%td,%td\n", snapshot->name ? snapshot->name : "", site, s->count, s->bytes);
+   }
+}
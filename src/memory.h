@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdio.h>
+
 #define KB(s) ((s) * 1024)
 #define MB(s) (KB(s) * 1024)
 #define GB(s) (MB(s) * 1024)
@@ -24,3 +26,76 @@ typedef struct {
 Allocator arena_allocator(Arena* a);
 Allocator debug_arena_allocator(Arena* a);
 Allocator stdlib_allocator();
+
+// pool
+//
+// Power of 2 size classes from POOL_MIN_BLOCK to POOL_MAX_BLOCK carved out of pages taken from the
+// parent allocator, anything bigger goes straight to the parent. Unlike the arena blocks can be
+// freed individually, the size passed to free picks the class so there is no per block header.
+
+#define POOL_MIN_BLOCK 16
+#define POOL_MAX_BLOCK KB(4)
+#define POOL_CLASS_COUNT 9
+
+typedef struct PoolBlock PoolBlock;
+
+typedef struct {
+   Allocator parent;
+   Size page_size;
+   PoolBlock* free_lists[POOL_CLASS_COUNT];
+   PoolBlock* pages;
+} Pool;
+
+Pool pool_init(Size page_size, Allocator parent);
+void pool_destroy(Pool* p);
+void* pool_alloc(Pool* p, Size size);
+void pool_free(Pool* p, Size size, void* ptr);
+Allocator pool_allocator(Pool* p);
+
+// tracking allocator
+//
+// Wraps any Allocator and records how it is used. Counters are kept per thread so recording is
+// a couple of plain stores, the only shared state is the live byte count used for the high-water
+// mark. Call sites are the return address of the alloc call, run them through addr2line with the
+// printed module offset to get a file:line.
+
+#define ALLOC_STATS_MAX_SITES 128
+
+typedef struct {
+   void* site;
+   Size count;
+   Size bytes;
+} AllocSite;
+
+typedef struct AllocStatsThread AllocStatsThread;
+
+typedef struct {
+   Allocator parent;
+   const char* name;
+
+   _Atomic(Size) live_bytes;
+   _Atomic(Size) peak_bytes;
+   _Atomic(AllocStatsThread*) threads;
+} AllocStats;
+
+typedef struct {
+   const char* name;
+   Size live_bytes;
+   Size peak_bytes;
+   Size total_bytes;
+   Size alloc_count;
+   Size free_count;
+   Size failed_count;
+
+   // sorted by bytes, largest first
+   Size site_count;
+   AllocSite sites[ALLOC_STATS_MAX_SITES];
+} AllocStatsSnapshot;
+
+void alloc_stats_init(AllocStats* stats, const char* name, Allocator parent);
+void alloc_stats_destroy(AllocStats* stats);
+Allocator tracking_allocator(AllocStats* stats);
+
+void alloc_stats_snapshot(AllocStats* stats, AllocStatsSnapshot* out);
+void alloc_stats_dump(const AllocStatsSnapshot* snapshot, FILE* out);
+void alloc_stats_write_csv(const AllocStatsSnapshot* snapshot, FILE* out);
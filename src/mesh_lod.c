@@ -0,0 +1,301 @@
+#include "mesh_lod.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a border edge's plane counts this much more than the triangle next to it
+static const double g_borderWeight = 10.0;
+
+// Sum of squared distances to planes ax + by + cz + d = 0, the upper half of the symmetric 4x4
+// matrix, and the sum of the plane weights to turn it into a mean.
+typedef struct {
+   double a2, b2, c2, d2;
+   double ab, ac, ad, bc, bd, cd;
+   double w;
+} Quadric;
+
+typedef struct {
+   u32 from;
+   u32 to;
+   float cost;
+} Collapse;
+
+static void quadric_add_plane(Quadric* q, const double n[3], const double p[3], double w) {
+   double a = n[0], b = n[1], c = n[2];
+   double d = -(a * p[0] + b * p[1] + c * p[2]);
+   q->a2 += w * a * a;
+   q->b2 += w * b * b;
+   q->c2 += w * c * c;
+   q->d2 += w * d * d;
+   q->ab += w * a * b;
+   q->ac += w * a * c;
+   q->ad += w * a * d;
+   q->bc += w * b * c;
+   q->bd += w * b * d;
+   q->cd += w * c * d;
+   q->w += w;
+}
+
+static void quadric_add(Quadric* q, const Quadric* other) {
+   q->a2 += other->a2;
+   q->b2 += other->b2;
+   q->c2 += other->c2;
+   q->d2 += other->d2;
+   q->ab += other->ab;
+   q->ac += other->ac;
+   q->ad += other->ad;
+   q->bc += other->bc;
+   q->bd += other->bd;
+   q->cd += other->cd;
+   q->w += other->w;
+}
+
+// mean squared distance of p to the planes
+static double quadric_error(const Quadric* q, const float* p) {
+   double x = p[0], y = p[1], z = p[2];
+   double e = q->a2 * x * x + q->b2 * y * y + q->c2 * z * z + q->d2
+            + 2.0 * (q->ab * x * y + q->ac * x * z + q->bc * y * z + q->ad * x + q->bd * y + q->cd * z);
+   return q->w > 0.0 ? fabs(e) / q->w : 0.0;
+}
+
+static void triangle_normal(const float* a, const float* b, const float* c, double n[3]) {
+   double u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+   double v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+   n[0] = u[1] * v[2] - u[2] * v[1];
+   n[1] = u[2] * v[0] - u[0] * v[2];
+   n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+static int compare_collapses(const void* a, const void* b) {
+   float x = ((const Collapse*)a)->cost;
+   float y = ((const Collapse*)b)->cost;
+   return (x > y) - (x < y);
+}
+
+// Triangles around every vertex, offsets[v] to offsets[v + 1] in triangles.
+static void build_adjacency(u32* offsets, u32* triangles, const u32* indices, Size index_count, Size vertex_count) {
+   memset(offsets, 0, (size_t)(vertex_count + 1) * sizeof(u32));
+   for (Size i = 0; i < index_count; i++) offsets[indices[i] + 1]++;
+   for (Size v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+
+   // every vertex's offset moves up to the next one's start while filling, then back down
+   for (Size i = 0; i < index_count; i++) triangles[offsets[indices[i]]++] = (u32)(i / 3);
+   for (Size v = vertex_count; v > 0; v--) offsets[v] = offsets[v - 1];
+   offsets[0] = 0;
+}
+
+static bool triangle_has_edge(const u32* triangle, u32 a, u32 b) {
+   for (u32 k = 0; k < 3; k++) {
+      if (triangle[k] == a && triangle[(k + 1) % 3] == b) return true;
+   }
+   return false;
+}
+
+static void build_quadrics(Quadric* quadrics, const u32* indices, Size index_count, const float* positions, Size vertex_count,
+                           const u32* offsets, const u32* triangles) {
+   memset(quadrics, 0, (size_t)vertex_count * sizeof(Quadric));
+   for (Size t = 0; t < index_count / 3; t++) {
+      const u32* tri = &indices[t * 3];
+      double n[3];
+      triangle_normal(&positions[tri[0] * 3], &positions[tri[1] * 3], &positions[tri[2] * 3], n);
+      double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (length == 0.0) continue;
+      n[0] /= length;
+      n[1] /= length;
+      n[2] /= length;
+
+      // weighted by area
+      double p[3] = {positions[tri[0] * 3], positions[tri[0] * 3 + 1], positions[tri[0] * 3 + 2]};
+      Quadric q = {0};
+      quadric_add_plane(&q, n, p, length * 0.5);
+      for (u32 k = 0; k < 3; k++) quadric_add(&quadrics[tri[k]], &q);
+
+      // an edge no other triangle runs back along is on the border
+      for (u32 k = 0; k < 3; k++) {
+         u32 a = tri[k];
+         u32 b = tri[(k + 1) % 3];
+         bool shared = false;
+         for (u32 j = offsets[b]; j < offsets[b + 1] && !shared; j++) shared = triangle_has_edge(&indices[triangles[j] * 3], b, a);
+         if (shared) continue;
+
+         const float* pa = &positions[a * 3];
+         const float* pb = &positions[b * 3];
+         double e[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+         double side[3] = {e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0]};
+         double sideLength = sqrt(side[0] * side[0] + side[1] * side[1] + side[2] * side[2]);
+         if (sideLength == 0.0) continue;
+         side[0] /= sideLength;
+         side[1] /= sideLength;
+         side[2] /= sideLength;
+
+         double pp[3] = {pa[0], pa[1], pa[2]};
+         Quadric border = {0};
+         quadric_add_plane(&border, side, pp, (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]) * g_borderWeight);
+         quadric_add(&quadrics[a], &border);
+         quadric_add(&quadrics[b], &border);
+      }
+   }
+}
+
+// Moving from onto to keeps every triangle around from that doesn't also have to facing the
+// same way and with some area left.
+static bool collapse_flips(const u32* indices, const float* positions, const u32* offsets, const u32* triangles, u32 from, u32 to) {
+   for (u32 j = offsets[from]; j < offsets[from + 1]; j++) {
+      const u32* tri = &indices[triangles[j] * 3];
+      if (tri[0] == to || tri[1] == to || tri[2] == to) continue;
+
+      const float* p[3];
+      const float* moved[3];
+      for (u32 k = 0; k < 3; k++) {
+         p[k] = &positions[tri[k] * 3];
+         moved[k] = tri[k] == from ? &positions[to * 3] : p[k];
+      }
+      double before[3], after[3];
+      triangle_normal(p[0], p[1], p[2], before);
+      triangle_normal(moved[0], moved[1], moved[2], after);
+      double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+      if (dot <= 0.0) return true;
+   }
+   return false;
+}
+
+Size mesh_simplify(u32* out, const u32* indices, Size index_count, const float* positions, Size vertex_count,
+                   Size target_index_count, float target_error, float* result_error, Allocator* allocator) {
+   assert(index_count % 3 == 0 && "Indices expected to be a triangle list.");
+   memcpy(out, indices, (size_t)index_count * sizeof(u32));
+   if (result_error) *result_error = 0.0f;
+   if (index_count <= target_index_count || index_count == 0) return index_count;
+
+   float lower[3] = {INFINITY, INFINITY, INFINITY};
+   float upper[3] = {-INFINITY, -INFINITY, -INFINITY};
+   for (Size v = 0; v < vertex_count; v++) {
+      for (u32 k = 0; k < 3; k++) {
+         lower[k] = fminf(lower[k], positions[v * 3 + k]);
+         upper[k] = fmaxf(upper[k], positions[v * 3 + k]);
+      }
+   }
+   double extent = sqrt((double)((upper[0] - lower[0]) * (upper[0] - lower[0]) + (upper[1] - lower[1]) * (upper[1] - lower[1])
+                                 + (upper[2] - lower[2]) * (upper[2] - lower[2])));
+   if (extent == 0.0) extent = 1.0;
+   double maxCost = (double)target_error * extent * (double)target_error * extent;
+
+   Size quadricsSize = vertex_count * sizeof(Quadric);
+   Size offsetsSize = (vertex_count + 1) * sizeof(u32);
+   Size trianglesSize = index_count * sizeof(u32);
+   Size remapSize = vertex_count * sizeof(u32);
+   Size lockedSize = vertex_count * sizeof(u8);
+   Size collapsesSize = index_count * 2 * sizeof(Collapse);
+   Quadric* quadrics = allocator->alloc(quadricsSize, allocator->ctx);
+   u32* offsets = allocator->alloc(offsetsSize, allocator->ctx);
+   u32* triangles = allocator->alloc(trianglesSize, allocator->ctx);
+   u32* remap = allocator->alloc(remapSize, allocator->ctx);
+   u8* locked = allocator->alloc(lockedSize, allocator->ctx);
+   Collapse* collapses = allocator->alloc(collapsesSize, allocator->ctx);
+
+   Size count = index_count;
+   double worst = 0.0;
+   if (quadrics && offsets && triangles && remap && locked && collapses) {
+      build_adjacency(offsets, triangles, out, count, vertex_count);
+      build_quadrics(quadrics, out, count, positions, vertex_count, offsets, triangles);
+   }
+
+   // Every pass collapses the cheapest edges it can without two touching the same triangles,
+   // then drops the triangles that collapsed and starts over on what is left.
+   while (quadrics && offsets && triangles && remap && locked && collapses && count > target_index_count) {
+      build_adjacency(offsets, triangles, out, count, vertex_count);
+
+      Size collapseCount = 0;
+      for (Size i = 0; i < count; i += 3) {
+         for (u32 k = 0; k < 3; k++) {
+            u32 a = out[i + k];
+            u32 b = out[i + (k + 1) % 3];
+            Quadric q = quadrics[a];
+            quadric_add(&q, &quadrics[b]);
+            collapses[collapseCount++] = (Collapse){a, b, (float)quadric_error(&q, &positions[b * 3])};
+            collapses[collapseCount++] = (Collapse){b, a, (float)quadric_error(&q, &positions[a * 3])};
+         }
+      }
+      qsort(collapses, (size_t)collapseCount, sizeof(Collapse), compare_collapses);
+
+      memset(locked, 0, (size_t)lockedSize);
+      for (Size v = 0; v < vertex_count; v++) remap[v] = (u32)v;
+
+      Size trianglesLeft = count / 3;
+      Size collapsed = 0;
+      for (Size i = 0; i < collapseCount && trianglesLeft > target_index_count / 3; i++) {
+         Collapse c = collapses[i];
+         if ((double)c.cost > maxCost) break;
+         if (locked[c.from] || locked[c.to]) continue;
+         if (collapse_flips(out, positions, offsets, triangles, c.from, c.to)) continue;
+
+         // the triangles around from are about to change, nothing else may touch them this pass
+         for (u32 j = offsets[c.from]; j < offsets[c.from + 1]; j++) {
+            const u32* tri = &out[triangles[j] * 3];
+            bool removed = tri[0] == c.to || tri[1] == c.to || tri[2] == c.to;
+            trianglesLeft -= removed;
+            for (u32 k = 0; k < 3; k++) locked[tri[k]] = 1;
+         }
+         remap[c.from] = c.to;
+         quadric_add(&quadrics[c.to], &quadrics[c.from]);
+         if ((double)c.cost > worst) worst = (double)c.cost;
+         collapsed++;
+      }
+      if (collapsed == 0) break;
+
+      Size kept = 0;
+      for (Size i = 0; i < count; i += 3) {
+         u32 a = remap[out[i]];
+         u32 b = remap[out[i + 1]];
+         u32 c = remap[out[i + 2]];
+         if (a == b || b == c || c == a) continue;
+         out[kept++] = a;
+         out[kept++] = b;
+         out[kept++] = c;
+      }
+      count = kept;
+   }
+
+   if (quadrics) allocator->free(quadricsSize, quadrics, allocator->ctx);
+   if (offsets) allocator->free(offsetsSize, offsets, allocator->ctx);
+   if (triangles) allocator->free(trianglesSize, triangles, allocator->ctx);
+   if (remap) allocator->free(remapSize, remap, allocator->ctx);
+   if (locked) allocator->free(lockedSize, locked, allocator->ctx);
+   if (collapses) allocator->free(collapsesSize, collapses, allocator->ctx);
+
+   if (result_error) *result_error = (float)(sqrt(worst) / extent);
+   return count;
+}
+
+Size mesh_lod_capacity(Size index_count) {
+   return index_count * 4;
+}
+
+void mesh_lod_build(MeshLodChain* chain, u32* out, const u32* indices, Size index_count, const float* positions, Size vertex_count,
+                    float max_error, Allocator* allocator) {
+   *chain = (MeshLodChain){0};
+   memcpy(out, indices, (size_t)index_count * sizeof(u32));
+   chain->levels[0] = (MeshLod){0, (u32)index_count, 0.0f};
+   chain->count = 1;
+   chain->index_count = (u32)index_count;
+
+   // Every level is made from the one before, far cheaper than from level 0 each time. Their
+   // errors add up to a bound on the distance to level 0.
+   while (chain->count < MESH_MAX_LODS) {
+      const MeshLod* previous = &chain->levels[chain->count - 1];
+      const u32* source = &out[previous->first_index];
+      u32* level = &out[chain->index_count];
+      Size target = previous->index_count / 6 * 3;
+      if (target < 3) break;
+
+      float error = 0.0f;
+      float remaining = max_error - previous->error;
+      Size count = mesh_simplify(level, source, previous->index_count, positions, vertex_count, target, remaining, &error, allocator);
+      // less than a quarter gone isn't worth a level, and keeps the chain in mesh_lod_capacity
+      if (count == 0 || count > previous->index_count / 12 * 9) break;
+
+      chain->levels[chain->count++] = (MeshLod){chain->index_count, (u32)count, previous->error + error};
+      chain->index_count += (u32)count;
+   }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "memory.h"
+
+// Mesh simplification and LOD chains.
+//
+// Simplification collapses edges in order of their quadric error (Garland and Heckbert), a
+// vertex always moves onto one of its neighbours so the vertex buffer stays as it is and only
+// the indices change. Every edge on the mesh's border adds a plane at right angles to its
+// triangle, so the outline and corners of open meshes cost as much to move as the surface.
+// Collapses that would turn a triangle over are skipped.
+//
+// Errors are distances relative to the mesh's extent, the diagonal of its bounding box.
+//
+// A chain keeps every level in one index array one after the other, level 0 the mesh as it is:
+//    [ level 0 | level 1 | level 2 | ... ]
+// so they can share an index buffer and a level is a first index and a count.
+
+#define MESH_MAX_LODS 8
+
+typedef struct {
+   u32 first_index;
+   u32 index_count;
+   float error; // to level 0, relative to the extent
+} MeshLod;
+
+typedef struct {
+   MeshLod levels[MESH_MAX_LODS];
+   u32 count;
+   u32 index_count; // of every level together
+} MeshLodChain;
+
+// Simplifies indices into out, down to target_index_count indices or fewer, or until the next
+// collapse would be more than target_error off. out has to have room for index_count. positions
+// are 3 floats per vertex. Returns the index count written, result_error the largest error.
+Size mesh_simplify(u32* out, const u32* indices, Size index_count, const float* positions, Size vertex_count,
+                   Size target_index_count, float target_error, float* result_error, Allocator* allocator);
+
+// Room out needs for a chain of a mesh with index_count indices.
+Size mesh_lod_capacity(Size index_count);
+
+// Every level aims for half the triangles of the one before. The chain ends at MESH_MAX_LODS,
+// once a level would be more than max_error off or keeps more than 3/4 of the one before.
+void mesh_lod_build(MeshLodChain* chain, u32* out, const u32* indices, Size index_count, const float* positions, Size vertex_count,
+                    float max_error, Allocator* allocator);
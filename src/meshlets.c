@@ -0,0 +1,231 @@
+#include "meshlets.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#define MESHLET_NO_SLOT 0xff
+#define MESHLET_NO_TRIANGLE UINT32_MAX
+
+// normals spreading further than this off the axis make a cone that culls next to nothing
+static const float g_minConeDot = 0.1f;
+
+typedef struct {
+   u32 vertices[MESHLET_MAX_VERTICES];
+   u32 vertex_count;
+   u32 triangle_count;
+   u32 first_index;
+   float centroid_sum[3]; // of the triangles' centroids
+} Cluster;
+
+// Triangles around every vertex, offsets[v] to offsets[v + 1] in triangles.
+static void build_adjacency(u32* offsets, u32* triangles, const u32* indices, Size index_count, Size vertex_count) {
+   memset(offsets, 0, (size_t)(vertex_count + 1) * sizeof(u32));
+   for (Size i = 0; i < index_count; i++) offsets[indices[i] + 1]++;
+   for (Size v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+
+   // every vertex's offset moves up to the next one's start while filling, then back down
+   for (Size i = 0; i < index_count; i++) triangles[offsets[indices[i]]++] = (u32)(i / 3);
+   for (Size v = vertex_count; v > 0; v--) offsets[v] = offsets[v - 1];
+   offsets[0] = 0;
+}
+
+static void triangle_centroid(const u32* triangle, const float* positions, float c[3]) {
+   for (u32 k = 0; k < 3; k++) {
+      c[k] = (positions[triangle[0] * 3 + k] + positions[triangle[1] * 3 + k] + positions[triangle[2] * 3 + k]) / 3.0f;
+   }
+}
+
+static bool triangle_unit_normal(const u32* triangle, const float* positions, float n[3]) {
+   const float* a = &positions[triangle[0] * 3];
+   const float* b = &positions[triangle[1] * 3];
+   const float* c = &positions[triangle[2] * 3];
+   float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+   float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+   n[0] = u[1] * v[2] - u[2] * v[1];
+   n[1] = u[2] * v[0] - u[0] * v[2];
+   n[2] = u[0] * v[1] - u[1] * v[0];
+   float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+   if (length == 0.0f) return false;
+   n[0] /= length;
+   n[1] /= length;
+   n[2] /= length;
+   return true;
+}
+
+// The sphere is around the middle of the vertices' bounding box. The cone's axis is the mean of
+// the triangles' normals, its cutoff is how far the furthest one leans off it.
+static void meshlet_bounds(Meshlet* meshlet, const Cluster* cluster, const u32* indices, const float* positions) {
+   float lower[3] = {INFINITY, INFINITY, INFINITY};
+   float upper[3] = {-INFINITY, -INFINITY, -INFINITY};
+   for (u32 i = 0; i < cluster->vertex_count; i++) {
+      const float* p = &positions[cluster->vertices[i] * 3];
+      for (u32 k = 0; k < 3; k++) {
+         lower[k] = fminf(lower[k], p[k]);
+         upper[k] = fmaxf(upper[k], p[k]);
+      }
+   }
+   float radius2 = 0.0f;
+   for (u32 k = 0; k < 3; k++) meshlet->center[k] = (lower[k] + upper[k]) * 0.5f;
+   for (u32 i = 0; i < cluster->vertex_count; i++) {
+      const float* p = &positions[cluster->vertices[i] * 3];
+      float d[3] = {p[0] - meshlet->center[0], p[1] - meshlet->center[1], p[2] - meshlet->center[2]};
+      radius2 = fmaxf(radius2, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+   }
+   meshlet->radius = sqrtf(radius2);
+
+   float axis[3] = {0.0f, 0.0f, 0.0f};
+   for (u32 t = 0; t < cluster->triangle_count; t++) {
+      float n[3];
+      if (!triangle_unit_normal(&indices[t * 3], positions, n)) continue;
+      for (u32 k = 0; k < 3; k++) axis[k] += n[k];
+   }
+   float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+   meshlet->cone_cutoff = 1.0f;
+   memset(meshlet->cone_axis, 0, sizeof(meshlet->cone_axis));
+   if (length == 0.0f) return;
+
+   float minDot = 1.0f;
+   for (u32 k = 0; k < 3; k++) axis[k] /= length;
+   for (u32 t = 0; t < cluster->triangle_count; t++) {
+      float n[3];
+      if (!triangle_unit_normal(&indices[t * 3], positions, n)) continue;
+      minDot = fminf(minDot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+   }
+   if (minDot < g_minConeDot) return;
+
+   memcpy(meshlet->cone_axis, axis, sizeof(axis));
+   meshlet->cone_cutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+static void cluster_add(Cluster* cluster, u8* slots, u32* out, const u32* indices, u32 triangle, const float* positions) {
+   const u32* tri = &indices[triangle * 3];
+   u32* written = &out[cluster->first_index + cluster->triangle_count * 3];
+   for (u32 k = 0; k < 3; k++) {
+      if (slots[tri[k]] == MESHLET_NO_SLOT) {
+         slots[tri[k]] = (u8)cluster->vertex_count;
+         cluster->vertices[cluster->vertex_count++] = tri[k];
+      }
+      written[k] = tri[k];
+   }
+   float c[3];
+   triangle_centroid(tri, positions, c);
+   for (u32 k = 0; k < 3; k++) cluster->centroid_sum[k] += c[k];
+   cluster->triangle_count++;
+}
+
+// The unused triangle next to the cluster that adds the fewest vertices and still fits, the one
+// closest to the cluster's middle of those.
+static u32 cluster_next(const Cluster* cluster, const u8* slots, const u8* used, const u32* indices, const float* positions,
+                        const u32* offsets, const u32* triangles) {
+   float middle[3];
+   for (u32 k = 0; k < 3; k++) middle[k] = cluster->centroid_sum[k] / (float)cluster->triangle_count;
+
+   u32 best = MESHLET_NO_TRIANGLE;
+   u32 bestAdded = 4;
+   float bestDistance = INFINITY;
+   for (u32 i = 0; i < cluster->vertex_count; i++) {
+      u32 v = cluster->vertices[i];
+      for (u32 j = offsets[v]; j < offsets[v + 1]; j++) {
+         u32 t = triangles[j];
+         if (used[t]) continue;
+
+         const u32* tri = &indices[t * 3];
+         u32 added = 0;
+         for (u32 k = 0; k < 3; k++) added += slots[tri[k]] == MESHLET_NO_SLOT;
+         if (cluster->vertex_count + added > MESHLET_MAX_VERTICES || added > bestAdded) continue;
+
+         float c[3];
+         triangle_centroid(tri, positions, c);
+         float d[3] = {c[0] - middle[0], c[1] - middle[1], c[2] - middle[2]};
+         float distance = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+         if (added < bestAdded || distance < bestDistance) {
+            best = t;
+            bestAdded = added;
+            bestDistance = distance;
+         }
+      }
+   }
+   return best;
+}
+
+Size meshlets_bound(Size index_count) {
+   return index_count / 3;
+}
+
+Size meshlets_build(Meshlet* meshlets, u32* out, const u32* indices, Size index_count, const float* positions, Size vertex_count,
+                    Allocator* allocator) {
+   assert(index_count % 3 == 0 && "Indices expected to be a triangle list.");
+   Size triangleCount = index_count / 3;
+   if (triangleCount == 0) return 0;
+
+   Size offsetsSize = (vertex_count + 1) * sizeof(u32);
+   Size trianglesSize = index_count * sizeof(u32);
+   Size slotsSize = vertex_count * sizeof(u8);
+   Size usedSize = triangleCount * sizeof(u8);
+   u32* offsets = allocator->alloc(offsetsSize, allocator->ctx);
+   u32* triangles = allocator->alloc(trianglesSize, allocator->ctx);
+   u8* slots = allocator->alloc(slotsSize, allocator->ctx);
+   u8* used = allocator->alloc(usedSize, allocator->ctx);
+
+   Size count = 0;
+   if (offsets && triangles && slots && used) {
+      build_adjacency(offsets, triangles, indices, index_count, vertex_count);
+      memset(slots, MESHLET_NO_SLOT, (size_t)slotsSize);
+      memset(used, 0, (size_t)usedSize);
+
+      Cluster cluster = {0};
+      u32 seed = 0;
+      for (;;) {
+         u32 next = MESHLET_NO_TRIANGLE;
+         if (cluster.triangle_count > 0) next = cluster_next(&cluster, slots, used, indices, positions, offsets, triangles);
+
+         // out of neighbours or full, the cluster is done
+         if (cluster.triangle_count > 0 && (next == MESHLET_NO_TRIANGLE || cluster.triangle_count == MESHLET_MAX_TRIANGLES)) {
+            Meshlet* meshlet = &meshlets[count++];
+            meshlet->first_index = cluster.first_index;
+            meshlet->triangle_count = cluster.triangle_count;
+            meshlet->vertex_count = cluster.vertex_count;
+            meshlet_bounds(meshlet, &cluster, &out[cluster.first_index], positions);
+            for (u32 i = 0; i < cluster.vertex_count; i++) slots[cluster.vertices[i]] = MESHLET_NO_SLOT;
+            cluster = (Cluster){.first_index = cluster.first_index + cluster.triangle_count * 3};
+            next = MESHLET_NO_TRIANGLE;
+         }
+
+         // a new cluster starts from the first triangle left, the mesh's order keeps it close
+         // to where the last one ended
+         if (cluster.triangle_count == 0) {
+            while (seed < triangleCount && used[seed]) seed++;
+            if (seed == triangleCount) break;
+            next = seed;
+         }
+
+         used[next] = 1;
+         cluster_add(&cluster, slots, out, indices, next, positions);
+      }
+   }
+
+   if (offsets) allocator->free(offsetsSize, offsets, allocator->ctx);
+   if (triangles) allocator->free(trianglesSize, triangles, allocator->ctx);
+   if (slots) allocator->free(slotsSize, slots, allocator->ctx);
+   if (used) allocator->free(usedSize, used, allocator->ctx);
+   return count;
+}
+
+bool meshlet_outside(const Meshlet* meshlet, const float planes[6][4]) {
+   const float* c = meshlet->center;
+   for (u32 i = 0; i < 6; i++) {
+      const float* p = planes[i];
+      if (p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3] < -meshlet->radius) return true;
+   }
+   return false;
+}
+
+// Every triangle faces away when the direction to any point of the sphere is within the cone's
+// cutoff of the axis.
+bool meshlet_backfacing(const Meshlet* meshlet, const float eye[3]) {
+   float d[3] = {meshlet->center[0] - eye[0], meshlet->center[1] - eye[1], meshlet->center[2] - eye[2]};
+   float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+   return d[0] * meshlet->cone_axis[0] + d[1] * meshlet->cone_axis[1] + d[2] * meshlet->cone_axis[2]
+          >= meshlet->cone_cutoff * distance + meshlet->radius;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "memory.h"
+
+// Meshlets, small clusters of a mesh's triangles that are culled on their own.
+//
+// The builder grows every cluster from a seed triangle, always taking the neighbouring
+// triangle that adds the fewest vertices and lies closest to the cluster's middle, so clusters
+// come out round and share few vertices. A cluster ends at MESHLET_MAX_VERTICES vertices,
+// MESHLET_MAX_TRIANGLES triangles or when it runs out of neighbours. The limits are the ones
+// mesh shaders like, a cluster keeps its triangles as plain indices into the mesh's vertices so
+// it draws through the vertex pipeline as well.
+//
+// Every cluster gets a bounding sphere and the cone its triangles' normals fall in, both in the
+// mesh's space. A cluster outside the frustum or seen only from behind has nothing to draw:
+//    if (meshlet_outside(m, planes) || meshlet_backfacing(m, eye)) continue;
+// The cone test assumes back faces are culled with counter clockwise triangles in front.
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+typedef struct {
+   u32 first_index; // into the indices the meshlets were built into
+   u32 triangle_count;
+   u32 vertex_count;
+   float center[3];
+   float radius;
+   float cone_axis[3];
+   float cone_cutoff; // sine of the normals' spread off the axis, 1 when they point every way
+} Meshlet;
+
+// Most meshlets a mesh with index_count indices can turn into.
+Size meshlets_bound(Size index_count);
+
+// Splits indices into meshlets, their triangles written to out cluster by cluster. out has to
+// have room for index_count and meshlets for meshlets_bound. positions are 3 floats per vertex.
+// Returns the meshlet count, 0 if the scratch memory couldn't be allocated.
+Size meshlets_build(Meshlet* meshlets, u32* out, const u32* indices, Size index_count, const float* positions, Size vertex_count,
+                    Allocator* allocator);
+
+// planes are ax + by + cz + d with unit normals pointing inwards, as glm_frustum_planes makes them.
+bool meshlet_outside(const Meshlet* meshlet, const float planes[6][4]);
+bool meshlet_backfacing(const Meshlet* meshlet, const float eye[3]);
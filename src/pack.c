@@ -0,0 +1,338 @@
+#include "pack.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashmap.h"
+#include "lz.h"
+#include "memory.h"
+
+static u64 _pack_hash(String name) {
+   u64 hash = hash_bytes(name.data, (Size)name.length, PACK_HASH_SEED);
+   return hash ? hash : 1;
+}
+
+static Size _pack_align(Size offset) {
+   return (offset + PACK_ALIGNMENT - 1) & ~(Size)(PACK_ALIGNMENT - 1);
+}
+
+// reading
+
+PackResult pack_open(const char* path) {
+   PackResult result = {0};
+
+   MappedFileResult mapped = map_file(path, FILE_ADVICE_RANDOM);
+   if (!mapped.ok) {
+      result.error = mapped.error;
+      return result;
+   }
+   MappedFile file = mapped.value;
+
+   const PackHeader* header = (const PackHeader*)file.data;
+   bool valid = file.length >= sizeof(PackHeader) && header->magic == PACK_MAGIC && header->version == PACK_VERSION;
+   if (valid) {
+      Size index_end = sizeof(PackHeader) + (Size)header->index_capacity * sizeof(PackEntry);
+      valid = header->index_capacity > 0 && (header->index_capacity & (header->index_capacity - 1)) == 0 &&
+              header->file_size == (u64)file.length && index_end <= file.length &&
+              header->names_offset >= (u64)index_end && header->names_offset + header->names_length <= (u64)file.length;
+   }
+   if (!valid) {
+      unmap_file(&file);
+      result.error = EINVAL;
+      return result;
+   }
+
+   result.value = (Pack){
+      .file = file,
+      .header = header,
+      .index = (const PackEntry*)(file.data + sizeof(PackHeader)),
+      .names = (const char*)file.data + header->names_offset,
+   };
+   result.ok = true;
+   return result;
+}
+
+void pack_close(Pack* pack) {
+   unmap_file(&pack->file);
+   *pack = (Pack){0};
+}
+
+static bool _pack_name_in_bounds(Pack* pack, const PackEntry* entry) {
+   return (u64)entry->name_offset + entry->name_length <= pack->header->names_length;
+}
+
+// empty if the entry's name lies outside the names
+String pack_entry_name(Pack* pack, const PackEntry* entry) {
+   if (!_pack_name_in_bounds(pack, entry)) return str_make((char*)pack->names, 0);
+   return str_make((char*)pack->names + entry->name_offset, entry->name_length);
+}
+
+// A full index has no empty slot to end on, the probe gives up after visiting every slot once.
+const PackEntry* pack_find(Pack* pack, String name) {
+   u64 hash = _pack_hash(name);
+   u32 mask = pack->header->index_capacity - 1;
+   u32 i = (u32)hash & mask;
+   for (u32 probes = 0; probes < pack->header->index_capacity; probes++, i = (i + 1) & mask) {
+      const PackEntry* entry = &pack->index[i];
+      if (entry->hash == 0) return nullptr;
+      if (entry->hash == hash && entry->name_length == name.length && _pack_name_in_bounds(pack, entry) &&
+          memcmp(pack->names + entry->name_offset, name.data, name.length) == 0) {
+         return entry;
+      }
+   }
+   return nullptr;
+}
+
+const PackEntry* pack_next(Pack* pack, u32* cursor) {
+   while (*cursor < pack->header->index_capacity) {
+      const PackEntry* entry = &pack->index[(*cursor)++];
+      if (entry->hash != 0) return entry;
+   }
+   return nullptr;
+}
+
+static bool _pack_entry_in_bounds(Pack* pack, const PackEntry* entry) {
+   return entry->offset <= (u64)pack->file.length && entry->stored_size <= (u64)pack->file.length - entry->offset;
+}
+
+const u8* pack_entry_view(Pack* pack, const PackEntry* entry) {
+   if (entry->flags & PACK_ENTRY_COMPRESSED || !_pack_entry_in_bounds(pack, entry)) return nullptr;
+   return pack->file.data + entry->offset;
+}
+
+Size pack_read_block(Pack* pack, const PackEntry* entry, u32 block, void* dst) {
+   if (!(entry->flags & PACK_ENTRY_COMPRESSED) || block >= entry->block_count) return -1;
+   if (!_pack_entry_in_bounds(pack, entry)) return -1;
+
+   // the table has to fit the entry before anything is read from it
+   Size table_size = ((Size)entry->block_count + 1) * sizeof(u32);
+   if ((u64)table_size > entry->stored_size) return -1;
+
+   const u8* data = pack->file.data + entry->offset;
+   u32 start, end;
+   memcpy(&start, data + block * sizeof(u32), sizeof(u32));
+   memcpy(&end, data + (block + 1) * sizeof(u32), sizeof(u32));
+   if (start > end || (u64)(table_size + end) > entry->stored_size) return -1;
+
+   Size raw_size = (Size)entry->size - (Size)block * PACK_BLOCK_SIZE;
+   if (raw_size > PACK_BLOCK_SIZE) raw_size = PACK_BLOCK_SIZE;
+
+   const u8* src = data + table_size + start;
+   Size stored = end - start;
+   if (stored == raw_size) {
+      memcpy(dst, src, (size_t)raw_size);
+      return raw_size;
+   }
+   Size written = lz_decompress(src, stored, dst, raw_size);
+   return written == raw_size ? written : -1;
+}
+
+typedef struct {
+   Pack* pack;
+   const PackEntry* entry;
+   u8* dst;
+   u32 first;
+   u32 last;
+   bool ok;
+} PackReadJob;
+
+static void* _pack_read_blocks(void* arg) {
+   PackReadJob* job = arg;
+   job->ok = true;
+   for (u32 b = job->first; b < job->last; b++) {
+      if (pack_read_block(job->pack, job->entry, b, job->dst + (Size)b * PACK_BLOCK_SIZE) < 0) {
+         job->ok = false;
+         break;
+      }
+   }
+   return nullptr;
+}
+
+bool pack_read(Pack* pack, const PackEntry* entry, void* dst, Size thread_count) {
+   if (!(entry->flags & PACK_ENTRY_COMPRESSED)) {
+      const u8* view = pack_entry_view(pack, entry);
+      if (!view || entry->stored_size != entry->size) return false;
+      memcpy(dst, view, (size_t)entry->size);
+      return true;
+   }
+
+   if (thread_count > (Size)entry->block_count) thread_count = entry->block_count;
+   if (thread_count < 1) thread_count = 1;
+
+   PackReadJob jobs[thread_count];
+   pthread_t threads[thread_count];
+   u32 per_thread = (u32)((entry->block_count + thread_count - 1) / thread_count);
+   for (Size t = 0; t < thread_count; t++) {
+      u32 first = (u32)t * per_thread;
+      u32 last = first + per_thread < entry->block_count ? first + per_thread : entry->block_count;
+      jobs[t] = (PackReadJob){pack, entry, dst, first, last, false};
+   }
+
+   // the calling thread takes the first share itself
+   Size started = 1;
+   for (; started < thread_count; started++) {
+      if (pthread_create(&threads[started], nullptr, _pack_read_blocks, &jobs[started]) != 0) break;
+   }
+   _pack_read_blocks(&jobs[0]);
+   for (Size t = started; t < thread_count; t++) {
+      _pack_read_blocks(&jobs[t]);
+   }
+
+   bool ok = jobs[0].ok;
+   for (Size t = 1; t < thread_count; t++) {
+      if (t < started) pthread_join(threads[t], nullptr);
+      ok = ok && jobs[t].ok;
+   }
+   return ok;
+}
+
+// writing
+
+typedef struct {
+   u8* data;
+   Size size;
+   Size capacity;
+} PackBlob;
+
+// Compresses input into blocks, returns false if that doesn't save enough to be worth it.
+static bool _pack_compress(const PackInput* input, PackBlob* out, Allocator* allocator) {
+   u32 block_count = (u32)((input->size + PACK_BLOCK_SIZE - 1) / PACK_BLOCK_SIZE);
+   Size table_size = (Size)(block_count + 1) * sizeof(u32);
+   out->capacity = table_size + (Size)block_count * lz_compress_bound(PACK_BLOCK_SIZE);
+   out->data = allocator->alloc(out->capacity, allocator->ctx);
+   if (!out->data) return false;
+
+   const u8* src = input->data;
+   u32* table = (u32*)out->data;
+   Size offset = 0;
+   for (u32 b = 0; b < block_count; b++) {
+      Size raw_size = input->size - (Size)b * PACK_BLOCK_SIZE;
+      if (raw_size > PACK_BLOCK_SIZE) raw_size = PACK_BLOCK_SIZE;
+
+      table[b] = (u32)offset;
+      u8* dst = out->data + table_size + offset;
+      Size compressed = lz_compress(src + (Size)b * PACK_BLOCK_SIZE, raw_size, dst, out->capacity - table_size - offset);
+      if (compressed == 0 || compressed >= raw_size) {
+         memcpy(dst, src + (Size)b * PACK_BLOCK_SIZE, (size_t)raw_size);
+         compressed = raw_size;
+      }
+      offset += compressed;
+   }
+   table[block_count] = (u32)offset;
+   out->size = table_size + offset;
+
+   return out->size <= input->size - input->size / 8;
+}
+
+static bool _pack_pad(FILE* f, Size to) {
+   static const u8 zeros[PACK_ALIGNMENT];
+   Size at = ftell(f);
+   return at <= to && fwrite(zeros, 1, (size_t)(to - at), f) == (size_t)(to - at);
+}
+
+bool pack_write(const char* path, const PackInput* inputs, Size count, bool compress, Allocator* allocator) {
+   u32 capacity = 16;
+   while (capacity < count * 2) capacity <<= 1;
+
+   Size names_length = 0;
+   for (Size i = 0; i < count; i++) {
+      names_length += (Size)strlen(inputs[i].name);
+   }
+
+   Size index_size = (Size)capacity * sizeof(PackEntry);
+   PackEntry* index = allocator->alloc(index_size, allocator->ctx);
+   PackBlob* blobs = allocator->alloc(count * sizeof(PackBlob), allocator->ctx);
+   u32* slots = allocator->alloc(count * sizeof(u32), allocator->ctx);
+   char* names = allocator->alloc(names_length, allocator->ctx);
+   if (!index || !blobs || !slots || (!names && names_length > 0)) {
+      errno = ENOMEM;
+      return false;
+   }
+   memset(index, 0, (size_t)index_size);
+   memset(blobs, 0, (size_t)(count * sizeof(PackBlob)));
+
+   Size names_offset = sizeof(PackHeader) + index_size;
+   Size data_offset = _pack_align(names_offset + names_length);
+   u32 name_offset = 0;
+
+   bool ok = true;
+   for (Size i = 0; i < count && ok; i++) {
+      const PackInput* input = &inputs[i];
+      String name = str_from_cstr((char*)input->name);
+      u64 hash = _pack_hash(name);
+
+      u32 slot = (u32)hash & (capacity - 1);
+      for (; index[slot].hash != 0; slot = (slot + 1) & (capacity - 1)) {
+         if (index[slot].hash == hash && index[slot].name_length == name.length &&
+             memcmp(names + index[slot].name_offset, name.data, name.length) == 0) {
+            errno = EEXIST;
+            ok = false;
+            break;
+         }
+      }
+      if (!ok) break;
+
+      memcpy(names + name_offset, name.data, name.length);
+      slots[i] = slot;
+
+      PackEntry* entry = &index[slot];
+      *entry = (PackEntry){
+         .hash = hash,
+         .offset = (u64)data_offset,
+         .size = (u64)input->size,
+         .stored_size = (u64)input->size,
+         .name_offset = name_offset,
+         .name_length = (u32)name.length,
+      };
+      name_offset += (u32)name.length;
+
+      PackBlob* blob = &blobs[i];
+      if (compress && input->size > 0 && _pack_compress(input, blob, allocator)) {
+         entry->flags |= PACK_ENTRY_COMPRESSED;
+         entry->stored_size = (u64)blob->size;
+         entry->block_count = (u32)((input->size + PACK_BLOCK_SIZE - 1) / PACK_BLOCK_SIZE);
+      } else if (blob->data) {
+         allocator->free(blob->capacity, blob->data, allocator->ctx);
+         *blob = (PackBlob){0};
+      }
+      data_offset = _pack_align(data_offset + (Size)entry->stored_size);
+   }
+
+   FILE* f = ok ? fopen(path, "wb") : nullptr;
+   if (f) {
+      PackHeader header = {
+         .magic = PACK_MAGIC,
+         .version = PACK_VERSION,
+         .entry_count = (u32)count,
+         .index_capacity = capacity,
+         .names_offset = (u64)names_offset,
+         .names_length = (u64)names_length,
+         .file_size = (u64)data_offset,
+      };
+      ok = fwrite(&header, sizeof(header), 1, f) == 1;
+      ok = ok && fwrite(index, (size_t)index_size, 1, f) == 1;
+      ok = ok && fwrite(names, 1, (size_t)names_length, f) == (size_t)names_length;
+      for (Size i = 0; i < count && ok; i++) {
+         PackEntry* entry = &index[slots[i]];
+         const void* data = blobs[i].data ? blobs[i].data : inputs[i].data;
+         ok = _pack_pad(f, (Size)entry->offset);
+         ok = ok && (entry->stored_size == 0 || fwrite(data, (size_t)entry->stored_size, 1, f) == 1);
+      }
+      ok = ok && _pack_pad(f, data_offset);
+      if (fclose(f) != 0) ok = false;
+   } else {
+      ok = false;
+   }
+
+   for (Size i = 0; i < count; i++) {
+      if (blobs[i].data) allocator->free(blobs[i].capacity, blobs[i].data, allocator->ctx);
+   }
+   if (names) allocator->free(names_length, names, allocator->ctx);
+   allocator->free(count * sizeof(u32), slots, allocator->ctx);
+   allocator->free(count * sizeof(PackBlob), blobs, allocator->ctx);
+   allocator->free(index_size, index, allocator->ctx);
+   return ok;
+}
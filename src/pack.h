@@ -0,0 +1,97 @@
+#pragma once
+
+#include "file.h"
+#include "memory.h"
+#include "result.h"
+#include "str.h"
+
+// asset packs
+//
+// One file holding many assets so a cold start is one open and one mmap instead of thousands.
+//
+//    PackHeader
+//    PackEntry index[index_capacity]   open addressed on the name hash, linear probing
+//    names                             not terminated, entries point in with offset + length
+//    entry data                        every entry starts on a PACK_ALIGNMENT boundary
+//
+// Finding an asset is one hash and usually one probe into the mapped index, nothing is read or
+// built at open time so opening and lookups cost the same no matter how many files are packed.
+//
+// Compressed entries are cut into PACK_BLOCK_SIZE blocks compressed on their own (see lz.h) so
+// they can be decompressed on demand or spread over threads. Their data starts with a table of
+// block_count + 1 u32 offsets relative to the end of the table. A block whose compressed size
+// equals its raw size is stored as is.
+
+#define PACK_MAGIC 0x4b50564bu // "KVPK"
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT KB(4)
+#define PACK_BLOCK_SIZE KB(64)
+#define PACK_HASH_SEED 0x7061636b7061636bull
+
+typedef enum {
+   PACK_ENTRY_COMPRESSED = 1 << 0,
+} PackEntryFlags;
+
+typedef struct {
+   u32 magic;
+   u32 version;
+   u32 entry_count;
+   u32 index_capacity; // power of 2
+   u64 names_offset;
+   u64 names_length;
+   u64 file_size;
+} PackHeader;
+
+typedef struct {
+   u64 hash; // 0 marks an empty slot
+   u64 offset;
+   u64 size;        // uncompressed
+   u64 stored_size; // bytes in the pack, including the block table
+   u32 name_offset;
+   u32 name_length;
+   u32 block_count;
+   u32 flags;
+} PackEntry;
+
+typedef struct {
+   MappedFile file;
+   const PackHeader* header;
+   const PackEntry* index;
+   const char* names;
+} Pack;
+
+typedef Result(Pack) PackResult;
+
+// Fails with EINVAL if the file is not a pack or is truncated.
+PackResult pack_open(const char* path);
+void pack_close(Pack* pack);
+
+// nullptr if there is no entry with that name.
+const PackEntry* pack_find(Pack* pack, String name);
+String pack_entry_name(Pack* pack, const PackEntry* entry);
+
+// Points straight into the mapping for uncompressed entries, nullptr for compressed ones.
+const u8* pack_entry_view(Pack* pack, const PackEntry* entry);
+
+// Decompresses (or copies) the entry into dst, which needs room for entry->size bytes. With
+// thread_count > 1 the blocks are split between that many threads.
+bool pack_read(Pack* pack, const PackEntry* entry, void* dst, Size thread_count);
+
+// One block of a compressed entry, dst needs room for PACK_BLOCK_SIZE bytes. Returns the number
+// of bytes written, -1 if the block is corrupt.
+Size pack_read_block(Pack* pack, const PackEntry* entry, u32 block, void* dst);
+
+// For reading every entry, returns nullptr past the end. Start with *cursor = 0.
+const PackEntry* pack_next(Pack* pack, u32* cursor);
+
+// writing
+
+typedef struct {
+   const char* name;
+   const void* data;
+   Size size;
+} PackInput;
+
+// Writes inputs to path. With compress set each entry is compressed and kept that way if it
+// saves at least an eighth. Returns false and leaves errno set on failure.
+bool pack_write(const char* path, const PackInput* inputs, Size count, bool compress, Allocator* allocator);
@@ -0,0 +1,411 @@
+#include "particles.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "shaders.h"
+#include "queues.h"
+
+typedef struct {
+   float dt;
+   u32 count;
+   u32 seed;
+} ParticleParams;
+
+#define PARTICLE_STATE_SIZE 32 // position and velocity, both vec4
+#define PARTICLE_POINT_SIZE 16
+
+static VkResult particles_create_buffers(ParticleSystem* ps, const DeviceCaps* caps) {
+   VkBufferCreateInfo bufferInfo = {0};
+   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+   bufferInfo.size = (VkDeviceSize)ps->count * PARTICLE_STATE_SIZE;
+   bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+   VkResult result = vkCreateBuffer(ps->device, &bufferInfo, ps->callbacks, &ps->state);
+   if (result != VK_SUCCESS) return result;
+
+   bufferInfo.size = (VkDeviceSize)ps->count * PARTICLE_POINT_SIZE;
+   bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+   for (u32 i = 0; i < ps->frame_count; i++) {
+      result = vkCreateBuffer(ps->device, &bufferInfo, ps->callbacks, &ps->points[i]);
+      if (result != VK_SUCCESS) return result;
+   }
+
+   // one allocation for all of them
+   VkBuffer buffers[PARTICLES_MAX_FRAMES + 1];
+   VkDeviceSize offsets[PARTICLES_MAX_FRAMES + 1];
+   u32 bufferCount = 0;
+   buffers[bufferCount++] = ps->state;
+   for (u32 i = 0; i < ps->frame_count; i++) buffers[bufferCount++] = ps->points[i];
+
+   VkDeviceSize size = 0;
+   u32 typeBits = UINT32_MAX;
+   for (u32 i = 0; i < bufferCount; i++) {
+      VkMemoryRequirements requirements;
+      vkGetBufferMemoryRequirements(ps->device, buffers[i], &requirements);
+      offsets[i] = (size + requirements.alignment - 1) & ~(requirements.alignment - 1);
+      size = offsets[i] + requirements.size;
+      typeBits &= requirements.memoryTypeBits;
+   }
+
+   VkMemoryAllocateInfo allocInfo = {0};
+   allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+   allocInfo.allocationSize = size;
+   allocInfo.memoryTypeIndex = device_caps_memory_type(caps, typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+   if (allocInfo.memoryTypeIndex == UINT32_MAX) return VK_ERROR_FEATURE_NOT_PRESENT;
+
+   result = vkAllocateMemory(ps->device, &allocInfo, ps->callbacks, &ps->memory);
+   if (result != VK_SUCCESS) return result;
+   for (u32 i = 0; i < bufferCount; i++) {
+      result = vkBindBufferMemory(ps->device, buffers[i], ps->memory, offsets[i]);
+      if (result != VK_SUCCESS) return result;
+   }
+   return VK_SUCCESS;
+}
+
+static VkResult particles_create_pipeline(ParticleSystem* ps, DescriptorLayoutCache* layouts) {
+   VkDescriptorSetLayoutBinding bindings[2] = {0};
+   for (u32 i = 0; i < lengthof(bindings); i++) {
+      bindings[i].binding = i;
+      bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+   }
+
+   VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
+   layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+   layoutInfo.bindingCount = lengthof(bindings);
+   layoutInfo.pBindings = bindings;
+   ps->set_layout = descriptor_layout_cache_get(layouts, &layoutInfo);
+   if (ps->set_layout == VK_NULL_HANDLE) return VK_ERROR_INITIALIZATION_FAILED;
+
+   VkPushConstantRange pushRange = {0};
+   pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+   pushRange.size = sizeof(ParticleParams);
+
+   VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
+   pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+   pipelineLayoutInfo.setLayoutCount = 1;
+   pipelineLayoutInfo.pSetLayouts = &ps->set_layout;
+   pipelineLayoutInfo.pushConstantRangeCount = 1;
+   pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+   VkResult result = vkCreatePipelineLayout(ps->device, &pipelineLayoutInfo, ps->callbacks, &ps->pipeline_layout);
+   if (result != VK_SUCCESS) return result;
+
+   ShaderResult code = shader_load("particles_comp");
+   if (!code.ok) return VK_ERROR_INITIALIZATION_FAILED;
+
+   VkShaderModuleCreateInfo moduleInfo = {0};
+   moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+   moduleInfo.codeSize = code.value.size;
+   moduleInfo.pCode = code.value.code;
+   VkShaderModule module;
+   result = vkCreateShaderModule(ps->device, &moduleInfo, ps->callbacks, &module);
+   shader_unload(&code.value);
+   if (result != VK_SUCCESS) return result;
+
+   VkComputePipelineCreateInfo pipelineInfo = {0};
+   pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+   pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+   pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+   pipelineInfo.stage.module = module;
+   pipelineInfo.stage.pName = "main";
+   pipelineInfo.layout = ps->pipeline_layout;
+   result = vkCreateComputePipelines(ps->device, VK_NULL_HANDLE, 1, &pipelineInfo, ps->callbacks, &ps->pipeline);
+   vkDestroyShaderModule(ps->device, module, ps->callbacks);
+   return result;
+}
+
+static VkResult particles_create_sets(ParticleSystem* ps, Allocator* allocator) {
+   DescriptorPoolRatio ratios[] = {
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f},
+   };
+   descriptor_allocator_init(&ps->descriptors, ps->device, ps->callbacks, allocator, ps->frame_count, ratios, lengthof(ratios));
+
+   for (u32 i = 0; i < ps->frame_count; i++) {
+      VkResult result = descriptor_allocator_allocate(&ps->descriptors, ps->set_layout, &ps->sets[i]);
+      if (result != VK_SUCCESS) return result;
+
+      VkDescriptorBufferInfo bufferInfos[2] = {
+         {ps->state, 0, VK_WHOLE_SIZE},
+         {ps->points[i], 0, VK_WHOLE_SIZE},
+      };
+      VkWriteDescriptorSet write = {0};
+      write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write.dstSet = ps->sets[i];
+      write.dstBinding = 0;
+      write.descriptorCount = lengthof(bufferInfos);
+      write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      write.pBufferInfo = bufferInfos;
+      vkUpdateDescriptorSets(ps->device, 1, &write, 0, nullptr);
+   }
+   return VK_SUCCESS;
+}
+
+static VkResult particles_create_commands(ParticleSystem* ps, const DeviceCaps* caps, VkCommandPool commandPool) {
+   VkCommandBufferAllocateInfo allocInfo = {0};
+   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+   allocInfo.commandPool = commandPool;
+   allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+   allocInfo.commandBufferCount = ps->frame_count;
+   VkResult result = vkAllocateCommandBuffers(ps->device, &allocInfo, ps->command_buffers);
+   if (result != VK_SUCCESS) return result;
+   ps->command_pool = commandPool;
+
+   // on the graphics queue the step goes out in the frame's own submit and needs neither
+   VkSemaphoreCreateInfo semaphoreInfo = {0};
+   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+   if (ps->async && ps->timeline_sync) {
+      VkSemaphoreTypeCreateInfo typeInfo = {0};
+      typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+      typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+      semaphoreInfo.pNext = &typeInfo;
+      result = vkCreateSemaphore(ps->device, &semaphoreInfo, ps->callbacks, &ps->timeline);
+      if (result != VK_SUCCESS) return result;
+   } else if (ps->async) {
+      for (u32 i = 0; i < ps->frame_count; i++) {
+         result = vkCreateSemaphore(ps->device, &semaphoreInfo, ps->callbacks, &ps->compute_done[i]);
+         if (result != VK_SUCCESS) return result;
+         result = vkCreateSemaphore(ps->device, &semaphoreInfo, ps->callbacks, &ps->graphics_done[i]);
+         if (result != VK_SUCCESS) return result;
+      }
+   }
+
+   // timestamps have to work on both queues for the overlap to mean anything
+   const DeviceQueueFamily* families = caps->queue_families;
+   ps->timed = families[ps->compute_family].properties.timestampValidBits > 0 && families[ps->graphics_family].properties.timestampValidBits > 0;
+   if (!ps->timed) return VK_SUCCESS;
+   ps->timestamp_period = caps->properties.limits.timestampPeriod;
+
+   VkQueryPoolCreateInfo queryInfo = {0};
+   queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+   queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+   queryInfo.queryCount = ps->frame_count * 4;
+   return vkCreateQueryPool(ps->device, &queryInfo, ps->callbacks, &ps->queries);
+}
+
+VkResult particles_init(ParticleSystem* ps, const ParticleSystemDesc* desc) {
+   assert(desc->frame_count <= PARTICLES_MAX_FRAMES && "Raise PARTICLES_MAX_FRAMES.");
+   assert(desc->count > 0 && "Particle system expected at least one particle.");
+
+   *ps = (ParticleSystem){0};
+   ps->device = desc->device;
+   ps->callbacks = desc->callbacks;
+   ps->count = desc->count;
+   ps->frame_count = desc->frame_count;
+   ps->graphics_family = desc->graphics_family;
+   ps->compute_family = desc->compute_family;
+   ps->compute_queue = desc->compute_queue;
+   ps->async = desc->compute_family != desc->graphics_family;
+   ps->timeline_sync = desc->timeline_sync;
+
+   u32 maxCount = desc->caps->properties.limits.maxComputeWorkGroupCount[0] * PARTICLES_GROUP_SIZE;
+   if (ps->count > maxCount) ps->count = maxCount;
+
+   VkResult result = particles_create_buffers(ps, desc->caps);
+   if (result == VK_SUCCESS) result = particles_create_pipeline(ps, desc->layouts);
+   if (result == VK_SUCCESS) result = particles_create_sets(ps, desc->allocator);
+   if (result == VK_SUCCESS) result = particles_create_commands(ps, desc->caps, desc->command_pool);
+   if (result != VK_SUCCESS) particles_destroy(ps);
+   return result;
+}
+
+// Everything is VK_NULL_HANDLE until created so a half initialised system can go through here.
+void particles_destroy(ParticleSystem* ps) {
+   if (!ps->device) return;
+
+   if (ps->queries) vkDestroyQueryPool(ps->device, ps->queries, ps->callbacks);
+   if (ps->timeline) vkDestroySemaphore(ps->device, ps->timeline, ps->callbacks);
+   for (u32 i = 0; i < ps->frame_count; i++) {
+      if (ps->compute_done[i]) vkDestroySemaphore(ps->device, ps->compute_done[i], ps->callbacks);
+      if (ps->graphics_done[i]) vkDestroySemaphore(ps->device, ps->graphics_done[i], ps->callbacks);
+   }
+   if (ps->command_pool) vkFreeCommandBuffers(ps->device, ps->command_pool, ps->frame_count, ps->command_buffers);
+
+   if (ps->pipeline) vkDestroyPipeline(ps->device, ps->pipeline, ps->callbacks);
+   if (ps->pipeline_layout) vkDestroyPipelineLayout(ps->device, ps->pipeline_layout, ps->callbacks);
+   if (ps->descriptors.device) descriptor_allocator_destroy(&ps->descriptors);
+
+   if (ps->state) vkDestroyBuffer(ps->device, ps->state, ps->callbacks);
+   for (u32 i = 0; i < ps->frame_count; i++) {
+      if (ps->points[i]) vkDestroyBuffer(ps->device, ps->points[i], ps->callbacks);
+   }
+   if (ps->memory) vkFreeMemory(ps->device, ps->memory, ps->callbacks);
+
+   *ps = (ParticleSystem){0};
+}
+
+static void particles_transfer(ParticleSystem* ps, VkCommandBuffer commandBuffer, u32 frame, bool toGraphics, bool release,
+                               VkPipelineStageFlags stage, VkAccessFlags access) {
+   u32 srcFamily = toGraphics ? ps->compute_family : ps->graphics_family;
+   u32 dstFamily = toGraphics ? ps->graphics_family : ps->compute_family;
+   if (release) {
+      queues_release_buffer(commandBuffer, ps->points[frame], srcFamily, dstFamily, stage, access);
+   } else {
+      queues_acquire_buffer(commandBuffer, ps->points[frame], srcFamily, dstFamily, stage, access);
+   }
+}
+
+VkResult particles_record(ParticleSystem* ps, u32 frame, float dt, VkCommandBuffer* commandBuffer) {
+   VkCommandBuffer cmd = ps->command_buffers[frame];
+   vkResetCommandBuffer(cmd, 0);
+
+   VkCommandBufferBeginInfo beginInfo = {0};
+   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+   beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+   VkResult result = vkBeginCommandBuffer(cmd, &beginInfo);
+   if (result != VK_SUCCESS) return result;
+
+   // the graphics half of this frame's queries is written after this submission on the other
+   // queue, so all four are reset here
+   if (ps->timed) {
+      vkCmdResetQueryPool(cmd, ps->queries, frame * 4, 4);
+      vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, ps->queries, frame * 4);
+   }
+
+   ps->wait_graphics = ps->async && ps->graphics_pending[frame];
+   ps->graphics_pending[frame] = false;
+   if (ps->wait_graphics) {
+      particles_transfer(ps, cmd, frame, false, false, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+   }
+
+   ParticleParams params = {dt, ps->count, ps->seeded ? 0 : 0x9e3779b9u};
+   ps->seeded = true;
+   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ps->pipeline);
+   vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ps->pipeline_layout, 0, 1, &ps->sets[frame], 0, nullptr);
+   vkCmdPushConstants(cmd, ps->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+   vkCmdDispatch(cmd, (ps->count + PARTICLES_GROUP_SIZE - 1) / PARTICLES_GROUP_SIZE, 1, 1);
+
+   // the state is only ever touched here, the next step has to see this one's writes. On the
+   // graphics queue nothing sits between the step and the draw, the points are covered here too.
+   VkMemoryBarrier stateBarrier = {0};
+   stateBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+   stateBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+   stateBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+   VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+   if (!ps->async) {
+      stateBarrier.dstAccessMask |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+      dstStage |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+   }
+   vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStage, 0, 1, &stateBarrier, 0, nullptr, 0, nullptr);
+
+   if (ps->async) {
+      particles_transfer(ps, cmd, frame, true, true, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+   }
+
+   if (ps->timed) vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, ps->queries, frame * 4 + 1);
+
+   *commandBuffer = cmd;
+   return vkEndCommandBuffer(cmd);
+}
+
+VkResult particles_submit(ParticleSystem* ps, u32 frame, u64 frame_number, VkSemaphore frame_timeline) {
+   assert(ps->async && "Particle steps on the graphics queue expected to go out with the frame.");
+   VkCommandBuffer commandBuffer = ps->command_buffers[frame];
+
+   if (ps->timeline_sync) {
+      // the frame that used this slot before
+      VkSemaphoreSubmitInfo waitInfo = {0};
+      waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+      waitInfo.semaphore = frame_timeline;
+      waitInfo.value = frame_number - ps->frame_count;
+      waitInfo.stageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+
+      VkSemaphoreSubmitInfo signalInfo = {0};
+      signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+      signalInfo.semaphore = ps->timeline;
+      signalInfo.value = frame_number;
+      signalInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+      VkCommandBufferSubmitInfo commandBufferInfo = {0};
+      commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+      commandBufferInfo.commandBuffer = commandBuffer;
+
+      VkSubmitInfo2 submitInfo = {0};
+      submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+      submitInfo.waitSemaphoreInfoCount = ps->wait_graphics ? 1 : 0;
+      submitInfo.pWaitSemaphoreInfos = &waitInfo;
+      submitInfo.commandBufferInfoCount = 1;
+      submitInfo.pCommandBufferInfos = &commandBufferInfo;
+      submitInfo.signalSemaphoreInfoCount = 1;
+      submitInfo.pSignalSemaphoreInfos = &signalInfo;
+      return vkQueueSubmit2(ps->compute_queue, 1, &submitInfo, VK_NULL_HANDLE);
+   }
+
+   VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+   VkSubmitInfo submitInfo = {0};
+   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+   if (ps->wait_graphics) {
+      submitInfo.waitSemaphoreCount = 1;
+      submitInfo.pWaitSemaphores = &ps->graphics_done[frame];
+      submitInfo.pWaitDstStageMask = &waitStage;
+   }
+   submitInfo.commandBufferCount = 1;
+   submitInfo.pCommandBuffers = &commandBuffer;
+   submitInfo.signalSemaphoreCount = 1;
+   submitInfo.pSignalSemaphores = &ps->compute_done[frame];
+   return vkQueueSubmit(ps->compute_queue, 1, &submitInfo, VK_NULL_HANDLE);
+}
+
+VkSemaphoreSubmitInfo particles_timeline_wait(ParticleSystem* ps, u64 frame_number) {
+   VkSemaphoreSubmitInfo info = {0};
+   info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+   info.semaphore = ps->timeline;
+   info.value = frame_number;
+   info.stageMask = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT;
+   return info;
+}
+
+VkSemaphore particles_compute_done(ParticleSystem* ps, u32 frame) {
+   return ps->compute_done[frame];
+}
+
+VkSemaphore particles_graphics_done(ParticleSystem* ps, u32 frame) {
+   return ps->graphics_done[frame];
+}
+
+VkBuffer particles_points(ParticleSystem* ps, u32 frame) {
+   return ps->points[frame];
+}
+
+void particles_acquire(ParticleSystem* ps, VkCommandBuffer commandBuffer, u32 frame) {
+   if (ps->timed) vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, ps->queries, frame * 4 + 2);
+   if (ps->async) {
+      particles_transfer(ps, commandBuffer, frame, true, false, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+   }
+}
+
+void particles_release(ParticleSystem* ps, VkCommandBuffer commandBuffer, u32 frame) {
+   // only read, there is nothing to make available
+   if (ps->async) particles_transfer(ps, commandBuffer, frame, false, true, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0);
+   if (ps->timed) {
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, ps->queries, frame * 4 + 3);
+      ps->pending_queries |= 1u << frame;
+   }
+   ps->graphics_pending[frame] = true;
+}
+
+void particles_report(ParticleSystem* ps, u32 frame, u32 report_frames, FILE* out) {
+   if (!(ps->pending_queries & (1u << frame))) return;
+   ps->pending_queries &= ~(1u << frame);
+
+   u64 t[4];
+   if (vkGetQueryPoolResults(ps->device, ps->queries, frame * 4, 4, sizeof(t), t, sizeof(u64), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) return;
+
+   ParticleTimings* timings = &ps->timings;
+   timings->compute_ticks += t[1] - t[0];
+   timings->graphics_ticks += t[3] - t[2];
+   timings->span_ticks += (t[1] > t[3] ? t[1] : t[3]) - (t[0] < t[2] ? t[0] : t[2]);
+   timings->frames++;
+   if (timings->frames < report_frames) return;
+
+   double scale = (double)ps->timestamp_period / 1e6 / (double)timings->frames;
+   double compute = (double)timings->compute_ticks * scale;
+   double graphics = (double)timings->graphics_ticks * scale;
+   double span = (double)timings->span_ticks * scale;
+   double overlap = compute + graphics - span;
+   fprintf(out, "particles: %u on the %s queue, compute %.3f ms, graphics %.3f ms, both %.3f ms, %.3f ms overlapped\n",
+           ps->count, ps->async ? "async compute" : "graphics", compute, graphics, span, overlap > 0.0 ? overlap : 0.0);
+   *timings = (ParticleTimings){0};
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+#include "descriptors.h"
+#include "device_caps.h"
+
+// GPU particle simulation.
+//
+// The state buffer lives on the compute queue for good. Every step writes the particle
+// positions into the frame's point buffer, which the graphics queue draws as a vertex buffer.
+// When the compute queue is a family of its own the point buffer changes owner twice a frame,
+// released by compute and acquired by graphics, then handed back after drawing. The semaphores
+// order the two queues, so the next frame's step can run while this frame is still rasterised.
+// Without a separate family everything goes to the graphics queue and runs in order.
+//
+// Per frame slot:
+//    compute:  [acquire points]  dispatch  release points   -> signals compute_done
+//    graphics: acquire points  ... draw ...  release points  -> signals graphics_done
+// particles_submit waits on graphics_done from the last time the slot was used. With timeline
+// semaphores the step of frame N sets the particle timeline to N instead, and waits for the
+// frame timeline to reach the frame that used the slot before.
+//
+// On the graphics queue the step is one more command buffer in the frame's own submit, ahead of
+// the frame's, and a barrier takes the place of the semaphores.
+
+#define PARTICLES_MAX_FRAMES 4
+#define PARTICLES_GROUP_SIZE 256
+
+typedef struct {
+   VkDevice device;
+   const DeviceCaps* caps; // of the device's physical device, only read during particles_init
+   const VkAllocationCallbacks* callbacks;
+   Allocator* allocator;
+   DescriptorLayoutCache* layouts;
+
+   u32 count;
+   u32 frame_count; // frames in flight
+
+   u32 graphics_family;
+   u32 compute_family;
+   VkQueue compute_queue; // the graphics queue if compute_family == graphics_family
+   VkCommandPool command_pool; // of compute_family, the step's command buffers come from it
+   bool timeline_sync; // timeline semaphores and vkQueueSubmit2
+} ParticleSystemDesc;
+
+typedef struct {
+   u64 compute_ticks;
+   u64 graphics_ticks;
+   u64 span_ticks; // first start to last end over both queues
+   u32 frames;
+} ParticleTimings;
+
+typedef struct {
+   VkDevice device;
+   const VkAllocationCallbacks* callbacks;
+   u32 count;
+   u32 frame_count;
+   u32 graphics_family;
+   u32 compute_family;
+   VkQueue compute_queue;
+   bool async; // separate queue family, ownership is transferred
+   bool timeline_sync;
+
+   VkBuffer state;
+   VkBuffer points[PARTICLES_MAX_FRAMES];
+   VkDeviceMemory memory;
+
+   VkDescriptorSetLayout set_layout;
+   DescriptorAllocator descriptors;
+   VkDescriptorSet sets[PARTICLES_MAX_FRAMES];
+   VkPipelineLayout pipeline_layout;
+   VkPipeline pipeline;
+
+   VkCommandPool command_pool; // not ours
+   VkCommandBuffer command_buffers[PARTICLES_MAX_FRAMES];
+   VkSemaphore compute_done[PARTICLES_MAX_FRAMES];
+   VkSemaphore graphics_done[PARTICLES_MAX_FRAMES];
+   VkSemaphore timeline; // replaces both with timeline_sync
+   bool graphics_pending[PARTICLES_MAX_FRAMES]; // graphics released the points
+   bool wait_graphics; // the step just recorded acquired them back
+   bool seeded;
+
+   // compute start/end then graphics start/end per frame, off if either family has no timestamps
+   bool timed;
+   VkQueryPool queries;
+   u32 pending_queries; // bit per frame
+   float timestamp_period;
+   ParticleTimings timings;
+} ParticleSystem;
+
+VkResult particles_init(ParticleSystem* ps, const ParticleSystemDesc* desc);
+void particles_destroy(ParticleSystem* ps);
+
+// Records the step for this frame slot. Only call once the slot's previous graphics submission
+// has been waited for. Without async the command buffer goes ahead of the frame's in its submit.
+VkResult particles_record(ParticleSystem* ps, u32 frame, float dt, VkCommandBuffer* commandBuffer);
+
+// Async only, submits the recorded step to the compute queue. With timelines the frame's graphics
+// submit waits on particles_timeline_wait, otherwise on particles_compute_done, and signals
+// particles_graphics_done.
+VkResult particles_submit(ParticleSystem* ps, u32 frame, u64 frame_number, VkSemaphore frame_timeline);
+
+VkSemaphoreSubmitInfo particles_timeline_wait(ParticleSystem* ps, u64 frame_number);
+VkSemaphore particles_compute_done(ParticleSystem* ps, u32 frame);
+VkSemaphore particles_graphics_done(ParticleSystem* ps, u32 frame);
+VkBuffer particles_points(ParticleSystem* ps, u32 frame);
+
+// Recorded into the frame's graphics command buffer around the passes that draw the points.
+// The timing queries go with them.
+void particles_acquire(ParticleSystem* ps, VkCommandBuffer commandBuffer, u32 frame);
+void particles_release(ParticleSystem* ps, VkCommandBuffer commandBuffer, u32 frame);
+
+// Reads back the frame's queries once its graphics submission finished, prints the averages
+// every report_frames frames.
+void particles_report(ParticleSystem* ps, u32 frame, u32 report_frames, FILE* out);
@@ -0,0 +1,116 @@
+#include "queues.h"
+
+// uploads are never in a hurry and the frame always is, the particle step sits in between
+static const float g_graphicsPriority = 1.0f;
+static const float g_computePriority = 0.5f;
+static const float g_transferPriority = 0.25f;
+
+// one queue per family, at the highest priority any role on it asked for
+static void queues_assign(QueueSet* q, DeviceQueue* role, u32 family, float priority) {
+   role->family = family;
+   for (u32 i = 0; i < q->create_info_count; i++) {
+      if (q->create_infos[i].queueFamilyIndex != family) continue;
+      if (priority > q->priorities[i]) q->priorities[i] = priority;
+      return;
+   }
+
+   u32 i = q->create_info_count++;
+   q->priorities[i] = priority;
+   VkDeviceQueueCreateInfo* createInfo = &q->create_infos[i];
+   createInfo->sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+   createInfo->queueFamilyIndex = family;
+   createInfo->queueCount = 1;
+   createInfo->pQueuePriorities = &q->priorities[i];
+}
+
+void queues_plan(QueueSet* q, const DeviceCaps* caps, bool async_compute, bool async_transfer) {
+   *q = (QueueSet){0};
+
+   u32 compute = caps->graphics_family;
+   if (async_compute && caps->compute_family != DEVICE_CAPS_NO_FAMILY) compute = caps->compute_family;
+
+   // compute families can always copy as well
+   u32 transfer = caps->graphics_family;
+   if (async_transfer && caps->transfer_family != DEVICE_CAPS_NO_FAMILY) {
+      transfer = caps->transfer_family;
+   } else if (async_transfer && caps->compute_family != DEVICE_CAPS_NO_FAMILY) {
+      transfer = caps->compute_family;
+   }
+
+   queues_assign(q, &q->graphics, caps->graphics_family, g_graphicsPriority);
+   queues_assign(q, &q->present, caps->present_family, g_graphicsPriority);
+   queues_assign(q, &q->compute, compute, g_computePriority);
+   queues_assign(q, &q->transfer, transfer, g_transferPriority);
+}
+
+VkResult queues_init(QueueSet* q, VkDevice device, const VkAllocationCallbacks* callbacks) {
+   q->device = device;
+   q->callbacks = callbacks;
+
+   DeviceQueue* roles[] = {&q->graphics, &q->present, &q->compute, &q->transfer};
+   for (Size i = 0; i < lengthof(roles); i++) {
+      vkGetDeviceQueue(device, roles[i]->family, 0, &roles[i]->queue);
+   }
+
+   // present only ever calls vkQueuePresentKHR
+   DeviceQueue* recording[] = {&q->graphics, &q->compute, &q->transfer};
+   for (Size i = 0; i < lengthof(recording); i++) {
+      for (Size j = 0; j < i && !recording[i]->pool; j++) {
+         if (recording[j]->family == recording[i]->family) recording[i]->pool = recording[j]->pool;
+      }
+      if (recording[i]->pool) continue;
+
+      VkCommandPoolCreateInfo poolInfo = {0};
+      poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+      poolInfo.queueFamilyIndex = recording[i]->family;
+      VkResult result = vkCreateCommandPool(device, &poolInfo, callbacks, &recording[i]->pool);
+      if (result != VK_SUCCESS) return result;
+   }
+   return VK_SUCCESS;
+}
+
+void queues_destroy(QueueSet* q) {
+   DeviceQueue* recording[] = {&q->graphics, &q->compute, &q->transfer};
+   for (Size i = 0; i < lengthof(recording); i++) {
+      bool shared = false;
+      for (Size j = 0; j < i; j++) shared |= recording[j]->pool == recording[i]->pool;
+      if (recording[i]->pool && !shared) vkDestroyCommandPool(q->device, recording[i]->pool, q->callbacks);
+   }
+   *q = (QueueSet){0};
+}
+
+static void queues_transfer_buffer(VkCommandBuffer commandBuffer, VkBuffer buffer, u32 src_family, u32 dst_family, bool release,
+                                   VkPipelineStageFlags stage, VkAccessFlags access) {
+   VkBufferMemoryBarrier barrier = {0};
+   barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+   barrier.srcQueueFamilyIndex = src_family;
+   barrier.dstQueueFamilyIndex = dst_family;
+   barrier.buffer = buffer;
+   barrier.offset = 0;
+   barrier.size = VK_WHOLE_SIZE;
+
+   // the release only makes the writes available, the acquire makes them visible, the
+   // semaphore in between carries the execution dependency
+   VkPipelineStageFlags srcStage, dstStage;
+   if (release) {
+      barrier.srcAccessMask = access;
+      srcStage = stage;
+      dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+   } else {
+      barrier.dstAccessMask = access;
+      srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+      dstStage = stage;
+   }
+   vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void queues_release_buffer(VkCommandBuffer commandBuffer, VkBuffer buffer, u32 src_family, u32 dst_family,
+                           VkPipelineStageFlags stage, VkAccessFlags access) {
+   queues_transfer_buffer(commandBuffer, buffer, src_family, dst_family, true, stage, access);
+}
+
+void queues_acquire_buffer(VkCommandBuffer commandBuffer, VkBuffer buffer, u32 src_family, u32 dst_family,
+                           VkPipelineStageFlags stage, VkAccessFlags access) {
+   queues_transfer_buffer(commandBuffer, buffer, src_family, dst_family, false, stage, access);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "device_caps.h"
+
+// Device queues.
+//
+// Every kind of work the renderer submits gets a queue of the family best suited to it:
+//    graphics  the graphics family, presenting as well when it can
+//    present   the graphics queue, or one of a present only family
+//    compute   a compute family without graphics, otherwise the graphics queue
+//    transfer  a transfer only family, then a compute one, otherwise the graphics queue
+// Work on a family of its own runs alongside the graphics queue. Roles that end up on the same
+// family share its one queue and its command pool, nothing is created twice.
+//
+// The queues are planned before the device exists, the plan's create infos go into
+// VkDeviceCreateInfo, then queues_init fetches them and makes the pools:
+//    queues_plan(&q, &caps, ...);
+//    createInfo.queueCreateInfoCount = q.create_info_count;
+//    createInfo.pQueueCreateInfos = q.create_infos;
+//    vkCreateDevice(...);
+//    queues_init(&q, device, callbacks);
+//
+// Exclusive resources that move between families have to be released by the old one and
+// acquired by the new one, see queues_release_buffer.
+
+typedef struct {
+   u32 family;
+   VkQueue queue;
+   VkCommandPool pool; // resettable command buffers, none for present
+} DeviceQueue;
+
+typedef struct {
+   VkDevice device;
+   const VkAllocationCallbacks* callbacks;
+
+   DeviceQueue graphics;
+   DeviceQueue present;
+   DeviceQueue compute;
+   DeviceQueue transfer;
+
+   u32 create_info_count;
+   VkDeviceQueueCreateInfo create_infos[4];
+   float priorities[4];
+} QueueSet;
+
+// async_compute and async_transfer false keep that work on the graphics queue.
+void queues_plan(QueueSet* q, const DeviceCaps* caps, bool async_compute, bool async_transfer);
+VkResult queues_init(QueueSet* q, VkDevice device, const VkAllocationCallbacks* callbacks);
+void queues_destroy(QueueSet* q);
+
+// The release is recorded on the family giving the buffer up after its last use there, the
+// acquire on the family taking it before its first use, with a semaphore between the two
+// submits. The release makes the writes in stage with access available, the acquire makes them
+// visible to stage with access.
+void queues_release_buffer(VkCommandBuffer commandBuffer, VkBuffer buffer, u32 src_family, u32 dst_family,
+                           VkPipelineStageFlags stage, VkAccessFlags access);
+void queues_acquire_buffer(VkCommandBuffer commandBuffer, VkBuffer buffer, u32 src_family, u32 dst_family,
+                           VkPipelineStageFlags stage, VkAccessFlags access);
@@ -0,0 +1,704 @@
+#include "render_graph.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+
+typedef struct {
+   VkPipelineStageFlags stages;
+   VkAccessFlags access;
+   VkImageLayout layout;
+   bool write;
+   VkImageUsageFlags image_usage;
+   VkBufferUsageFlags buffer_usage;
+} RgAccessInfo;
+
+static const RgAccessInfo rg_access_info[RG_ACCESS_COUNT] = {
+   [RG_ACCESS_COLOR_ATTACHMENT] = {
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0,
+   },
+   [RG_ACCESS_DEPTH_ATTACHMENT] = {
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0,
+   },
+   [RG_ACCESS_DEPTH_READ] = {
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0,
+   },
+   [RG_ACCESS_FRAGMENT_SAMPLED] = {
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, VK_IMAGE_USAGE_SAMPLED_BIT, 0,
+   },
+   [RG_ACCESS_COMPUTE_SAMPLED] = {
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, VK_IMAGE_USAGE_SAMPLED_BIT, 0,
+   },
+   [RG_ACCESS_COMPUTE_READ] = {
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+      VK_IMAGE_LAYOUT_GENERAL, false, VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+   },
+   [RG_ACCESS_COMPUTE_WRITE] = {
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+      VK_IMAGE_LAYOUT_GENERAL, true, VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+   },
+   [RG_ACCESS_TRANSFER_READ] = {
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+   },
+   [RG_ACCESS_TRANSFER_WRITE] = {
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true, VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+   },
+   [RG_ACCESS_VERTEX_BUFFER] = {
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, false, 0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+   },
+   [RG_ACCESS_INDEX_BUFFER] = {
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, false, 0, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+   },
+   [RG_ACCESS_INDIRECT_BUFFER] = {
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, false, 0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+   },
+   [RG_ACCESS_UNIFORM_READ] = {
+      VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false, 0, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+   },
+};
+
+void rg_init(RenderGraph* g, VkDevice device, VkPhysicalDevice physicalDevice, const VkAllocationCallbacks* callbacks, bool synchronization2) {
+   memset(g, 0, sizeof(*g));
+   g->device = device;
+   g->physical_device = physicalDevice;
+   g->callbacks = callbacks;
+   g->synchronization2 = synchronization2;
+}
+
+void rg_destroy(RenderGraph* g) {
+   for (u32 i = 0; i < g->resource_count; i++) {
+      RgResourceNode* r = &g->resources[i];
+      if (r->imported) continue;
+      if (r->view) vkDestroyImageView(g->device, r->view, g->callbacks);
+      if (r->vk_image) vkDestroyImage(g->device, r->vk_image, g->callbacks);
+      if (r->vk_buffer) vkDestroyBuffer(g->device, r->vk_buffer, g->callbacks);
+   }
+   for (u32 i = 0; i < g->block_count; i++) {
+      vkFreeMemory(g->device, g->blocks[i].memory, g->callbacks);
+   }
+   rg_init(g, g->device, g->physical_device, g->callbacks, g->synchronization2);
+}
+
+// building
+
+static RgResource rg_add_resource(RenderGraph* g, const char* name, bool image, bool imported) {
+   assert(!g->compiled && "Render graph expected to be rebuilt instead of changed after compiling.");
+   assert(g->resource_count < RG_MAX_RESOURCES && "Raise RG_MAX_RESOURCES.");
+   RgResource index = g->resource_count++;
+   RgResourceNode* r = &g->resources[index];
+   r->name = name;
+   r->image = image;
+   r->imported = imported;
+   r->first_pass = RG_NONE;
+   r->last_pass = RG_NONE;
+   r->block = RG_NONE;
+   r->alias_prev = RG_NONE;
+   return index;
+}
+
+RgResource rg_create_image(RenderGraph* g, const char* name, const RgImageDesc* desc) {
+   RgResource index = rg_add_resource(g, name, true, false);
+   RgResourceNode* r = &g->resources[index];
+   r->desc = *desc;
+   if (r->desc.samples == 0) r->desc.samples = VK_SAMPLE_COUNT_1_BIT;
+   r->aspect = desc->aspect;
+   return index;
+}
+
+RgResource rg_create_buffer(RenderGraph* g, const char* name, VkDeviceSize size) {
+   RgResource index = rg_add_resource(g, name, false, false);
+   g->resources[index].size = size;
+   return index;
+}
+
+RgResource rg_import_image(RenderGraph* g, const char* name, VkImageAspectFlags aspect, RgState initial, RgState final) {
+   RgResource index = rg_add_resource(g, name, true, true);
+   RgResourceNode* r = &g->resources[index];
+   r->aspect = aspect;
+   r->initial = initial;
+   r->final = final;
+   return index;
+}
+
+RgResource rg_import_buffer(RenderGraph* g, const char* name, RgState initial, RgState final) {
+   RgResource index = rg_add_resource(g, name, false, true);
+   g->resources[index].initial = initial;
+   g->resources[index].final = final;
+   return index;
+}
+
+void rg_set_image(RenderGraph* g, RgResource r, VkImage image, VkImageView view) {
+   assert(g->resources[r].imported && g->resources[r].image);
+   g->resources[r].vk_image = image;
+   g->resources[r].view = view;
+}
+
+void rg_set_buffer(RenderGraph* g, RgResource r, VkBuffer buffer) {
+   assert(g->resources[r].imported && !g->resources[r].image);
+   g->resources[r].vk_buffer = buffer;
+}
+
+RgPass rg_add_pass(RenderGraph* g, const char* name, RgRecordFn record, void* user) {
+   assert(!g->compiled && "Render graph expected to be rebuilt instead of changed after compiling.");
+   assert(g->pass_count < RG_MAX_PASSES && "Raise RG_MAX_PASSES.");
+   RgPass index = g->pass_count++;
+   RgPassNode* p = &g->passes[index];
+   p->name = name;
+   p->record = record;
+   p->user = user;
+   return index;
+}
+
+static void rg_use(RenderGraph* g, RgPass pass, RgResource r, RgAccess access) {
+   RgPassNode* p = &g->passes[pass];
+   assert(p->use_count < RG_MAX_PASS_USES && "Raise RG_MAX_PASS_USES.");
+   assert(r < g->resource_count);
+   p->uses[p->use_count++] = (RgUse){r, access};
+}
+
+void rg_read(RenderGraph* g, RgPass pass, RgResource r, RgAccess access) {
+   assert(!rg_access_info[access].write && "Write access passed to rg_read.");
+   rg_use(g, pass, r, access);
+}
+
+void rg_write(RenderGraph* g, RgPass pass, RgResource r, RgAccess access) {
+   assert(rg_access_info[access].write && "Read access passed to rg_write.");
+   rg_use(g, pass, r, access);
+}
+
+void rg_keep(RenderGraph* g, RgPass pass) {
+   g->passes[pass].side_effects = true;
+}
+
+// culling
+//
+// Every pass is referenced by the resources it writes and every resource by the passes reading
+// it. Resources nobody reads release their writers, a pass with no references left is culled
+// and releases what it read in turn. Writing an imported resource counts as a side effect.
+
+static void rg_cull(RenderGraph* g) {
+   for (u32 i = 0; i < g->pass_count; i++) {
+      RgPassNode* p = &g->passes[i];
+      for (u32 u = 0; u < p->use_count; u++) {
+         RgResourceNode* r = &g->resources[p->uses[u].resource];
+         if (!rg_access_info[p->uses[u].access].write) {
+            r->reader_count++;
+         } else {
+            p->ref_count++;
+            if (r->imported) p->side_effects = true;
+         }
+      }
+   }
+
+   RgResource stack[RG_MAX_RESOURCES];
+   u32 top = 0;
+   for (u32 i = 0; i < g->resource_count; i++) {
+      if (g->resources[i].reader_count == 0) stack[top++] = i;
+   }
+
+   while (top > 0) {
+      RgResource unread = stack[--top];
+      for (u32 i = 0; i < g->pass_count; i++) {
+         RgPassNode* p = &g->passes[i];
+         if (p->culled || p->side_effects) continue;
+
+         for (u32 u = 0; u < p->use_count; u++) {
+            if (p->uses[u].resource != unread || !rg_access_info[p->uses[u].access].write) continue;
+            if (--p->ref_count > 0) continue;
+
+            p->culled = true;
+            for (u32 v = 0; v < p->use_count; v++) {
+               if (rg_access_info[p->uses[v].access].write) continue;
+               RgResourceNode* read = &g->resources[p->uses[v].resource];
+               if (--read->reader_count == 0) stack[top++] = p->uses[v].resource;
+            }
+            break;
+         }
+      }
+   }
+}
+
+// transients
+
+static u32 rg_memory_type(RenderGraph* g, u32 typeBits, VkMemoryPropertyFlags properties) {
+   VkPhysicalDeviceMemoryProperties memProperties;
+   vkGetPhysicalDeviceMemoryProperties(g->physical_device, &memProperties);
+
+   for (u32 i = 0; i < memProperties.memoryTypeCount; i++) {
+      if ((typeBits & (1u << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+         return i;
+      }
+   }
+   return RG_NONE;
+}
+
+static bool rg_lifetimes_overlap(const RgResourceNode* a, const RgResourceNode* b) {
+   return a->first_pass <= b->last_pass && b->first_pass <= a->last_pass;
+}
+
+static VkResult rg_create_transient(RenderGraph* g, RgResourceNode* r, VkMemoryRequirements* requirements) {
+   VkResult result;
+   if (r->image) {
+      VkImageCreateInfo imageInfo = {0};
+      imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+      imageInfo.imageType = VK_IMAGE_TYPE_2D;
+      imageInfo.format = r->desc.format;
+      imageInfo.extent = (VkExtent3D){r->desc.extent.width, r->desc.extent.height, 1};
+      imageInfo.mipLevels = 1;
+      imageInfo.arrayLayers = 1;
+      imageInfo.samples = r->desc.samples;
+      imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+      imageInfo.usage = r->image_usage;
+      if (r->desc.flags & RG_IMAGE_LAZY) {
+         const VkImageUsageFlags attachments = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+         assert((r->image_usage & ~attachments) == 0 && "Lazy images expected to only be used as attachments.");
+         imageInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+      }
+      imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+      result = vkCreateImage(g->device, &imageInfo, g->callbacks, &r->vk_image);
+      if (result != VK_SUCCESS) return result;
+      vkGetImageMemoryRequirements(g->device, r->vk_image, requirements);
+   } else {
+      VkBufferCreateInfo bufferInfo = {0};
+      bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      bufferInfo.size = r->size;
+      bufferInfo.usage = r->buffer_usage;
+      bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+      result = vkCreateBuffer(g->device, &bufferInfo, g->callbacks, &r->vk_buffer);
+      if (result != VK_SUCCESS) return result;
+      vkGetBufferMemoryRequirements(g->device, r->vk_buffer, requirements);
+   }
+   r->memory_size = requirements->size;
+   return VK_SUCCESS;
+}
+
+static int rg_compare_size(const void* a, const void* b, void* ctx) {
+   const RgResourceNode* resources = ctx;
+   VkDeviceSize sa = resources[*(const RgResource*)a].memory_size;
+   VkDeviceSize sb = resources[*(const RgResource*)b].memory_size;
+   return (sa < sb) - (sa > sb);
+}
+
+// Biggest first, each transient goes into the first block of the right memory type whose other
+// residents are all dead by the time it is first used, or a new block. Everything is bound at
+// offset 0 so alignment never comes into it, a block is as big as its biggest resident.
+static VkResult rg_allocate_transients(RenderGraph* g) {
+   RgResource order[RG_MAX_RESOURCES];
+   u32 types[RG_MAX_RESOURCES];
+   u32 count = 0;
+
+   for (u32 i = 0; i < g->resource_count; i++) {
+      RgResourceNode* r = &g->resources[i];
+      if (r->imported || r->first_pass == RG_NONE) continue;
+
+      VkMemoryRequirements requirements;
+      VkResult result = rg_create_transient(g, r, &requirements);
+      if (result != VK_SUCCESS) return result;
+
+      types[i] = RG_NONE;
+      if (r->image && (r->desc.flags & RG_IMAGE_LAZY)) {
+         types[i] = rg_memory_type(g, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+      }
+      if (types[i] == RG_NONE) types[i] = rg_memory_type(g, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      if (types[i] == RG_NONE) return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+      order[count++] = i;
+      g->stats.transient_count++;
+      g->stats.transient_bytes += r->memory_size;
+   }
+
+   qsort_r(order, count, sizeof(order[0]), rg_compare_size, g->resources);
+
+   for (u32 i = 0; i < count; i++) {
+      RgResourceNode* r = &g->resources[order[i]];
+
+      for (u32 b = 0; b < g->block_count && r->block == RG_NONE; b++) {
+         if (g->blocks[b].memory_type != types[order[i]]) continue;
+
+         bool free = true;
+         for (u32 j = 0; j < i && free; j++) {
+            RgResourceNode* other = &g->resources[order[j]];
+            free = other->block != b || !rg_lifetimes_overlap(r, other);
+         }
+         if (free) r->block = b;
+      }
+
+      if (r->block == RG_NONE) {
+         r->block = g->block_count++;
+         g->blocks[r->block].memory_type = types[order[i]];
+         g->blocks[r->block].lazy = rg_memory_type(g, 1u << types[order[i]], VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != RG_NONE;
+      }
+      if (r->memory_size > g->blocks[r->block].size) g->blocks[r->block].size = r->memory_size;
+   }
+
+   for (u32 b = 0; b < g->block_count; b++) {
+      VkMemoryAllocateInfo allocInfo = {0};
+      allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocInfo.allocationSize = g->blocks[b].size;
+      allocInfo.memoryTypeIndex = g->blocks[b].memory_type;
+
+      VkResult result = vkAllocateMemory(g->device, &allocInfo, g->callbacks, &g->blocks[b].memory);
+      if (result != VK_SUCCESS) return result;
+      g->stats.allocated_bytes += g->blocks[b].size;
+      if (g->blocks[b].lazy) g->stats.lazy_bytes += g->blocks[b].size;
+   }
+   g->stats.block_count = g->block_count;
+
+   for (u32 i = 0; i < count; i++) {
+      RgResourceNode* r = &g->resources[order[i]];
+      VkDeviceMemory memory = g->blocks[r->block].memory;
+
+      // whoever used the memory last, earlier in this frame or else at the end of the previous
+      RgResource latest = RG_NONE;
+      RgResource wrapped = RG_NONE;
+      for (u32 j = 0; j < count; j++) {
+         RgResourceNode* other = &g->resources[order[j]];
+         if (other->block != r->block) continue;
+         if (other->last_pass < r->first_pass && (latest == RG_NONE || other->last_pass > g->resources[latest].last_pass)) {
+            latest = order[j];
+         }
+         if (wrapped == RG_NONE || other->last_pass > g->resources[wrapped].last_pass) wrapped = order[j];
+      }
+      r->alias_prev = latest != RG_NONE ? latest : wrapped;
+
+      VkResult result;
+      if (r->image) {
+         result = vkBindImageMemory(g->device, r->vk_image, memory, 0);
+         if (result != VK_SUCCESS) return result;
+
+         VkImageViewCreateInfo viewInfo = {0};
+         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+         viewInfo.image = r->vk_image;
+         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+         viewInfo.format = r->desc.format;
+         viewInfo.subresourceRange.aspectMask = r->aspect;
+         viewInfo.subresourceRange.levelCount = 1;
+         viewInfo.subresourceRange.layerCount = 1;
+
+         result = vkCreateImageView(g->device, &viewInfo, g->callbacks, &r->view);
+      } else {
+         result = vkBindBufferMemory(g->device, r->vk_buffer, memory, 0);
+      }
+      if (result != VK_SUCCESS) return result;
+   }
+   return VK_SUCCESS;
+}
+
+// barriers
+//
+// Per resource the planner remembers the last write, or layout transition, and which stages
+// have read since. A read only needs a barrier if the write isn't visible to it yet, a write or
+// a layout change has to wait for the previous write and every read since.
+
+typedef struct {
+   VkPipelineStageFlags write_stages;
+   VkAccessFlags write_access;
+   VkPipelineStageFlags read_stages;
+   VkPipelineStageFlags visible_stages;
+   VkAccessFlags visible_access;
+   VkImageLayout layout;
+} RgTrack;
+
+static RgTrack rg_track_start(RgState state) {
+   return (RgTrack){
+      .write_stages = state.stages,
+      .write_access = state.access,
+      .layout = state.layout,
+   };
+}
+
+static RgState rg_track_end(const RgTrack* t) {
+   return (RgState){t->write_stages | t->read_stages, t->write_access, t->layout};
+}
+
+// Returns true and fills out if a barrier is needed in front of the access.
+static bool rg_track(RgTrack* t, bool image, RgState dst, bool write, RgBarrier* out) {
+   bool layoutChange = image && dst.layout != t->layout;
+   out->src = (RgState){t->write_stages, t->write_access, t->layout};
+   out->dst = dst;
+
+   if (write || layoutChange) {
+      out->src.stages |= t->read_stages;
+      bool needed = layoutChange || out->src.stages != 0;
+
+      t->write_stages = dst.stages;
+      t->write_access = write ? dst.access : 0;
+      t->read_stages = 0;
+      t->visible_stages = dst.stages;
+      t->visible_access = dst.access;
+      t->layout = dst.layout;
+      return needed;
+   }
+
+   t->read_stages |= dst.stages;
+   if (t->write_stages == 0) return false;
+   if ((dst.stages & ~t->visible_stages) == 0 && (dst.access & ~t->visible_access) == 0) return false;
+
+   t->visible_stages |= dst.stages;
+   t->visible_access |= dst.access;
+   return true;
+}
+
+static RgState rg_access_state(RgAccess access, bool image) {
+   const RgAccessInfo* info = &rg_access_info[access];
+   return (RgState){info->stages, info->access, image ? info->layout : VK_IMAGE_LAYOUT_UNDEFINED};
+}
+
+static void rg_plan(RenderGraph* g, RgState end[RG_MAX_RESOURCES], bool emit) {
+   RgTrack tracks[RG_MAX_RESOURCES];
+   for (u32 i = 0; i < g->resource_count; i++) {
+      RgResourceNode* r = &g->resources[i];
+      if (r->imported) {
+         tracks[i] = rg_track_start(r->initial);
+      } else {
+         // the memory was last used by alias_prev, the contents are thrown away
+         RgState prev = r->alias_prev != RG_NONE ? end[r->alias_prev] : (RgState){0};
+         prev.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+         tracks[i] = rg_track_start(prev);
+      }
+   }
+
+   g->barrier_count = 0;
+   for (u32 i = 0; i < g->pass_count; i++) {
+      RgPassNode* p = &g->passes[i];
+      p->first_barrier = g->barrier_count;
+      p->barrier_count = 0;
+      if (p->culled) continue;
+
+      for (u32 u = 0; u < p->use_count; u++) {
+         RgResource index = p->uses[u].resource;
+         RgResourceNode* r = &g->resources[index];
+         RgBarrier barrier = {.resource = index};
+         bool write = rg_access_info[p->uses[u].access].write;
+         if (rg_track(&tracks[index], r->image, rg_access_state(p->uses[u].access, r->image), write, &barrier) && emit) {
+            g->barriers[g->barrier_count++] = barrier;
+            p->barrier_count++;
+         }
+      }
+   }
+
+   g->final_barrier = g->barrier_count;
+   for (u32 i = 0; i < g->resource_count; i++) {
+      RgResourceNode* r = &g->resources[i];
+      end[i] = rg_track_end(&tracks[i]);
+      if (!r->imported || !emit) continue;
+
+      bool layoutChange = r->image && r->final.layout != end[i].layout;
+      if (layoutChange || (r->final.access != 0 && tracks[i].write_stages != 0)) {
+         g->barriers[g->barrier_count++] = (RgBarrier){i, end[i], r->final};
+      }
+   }
+}
+
+VkResult rg_compile(RenderGraph* g) {
+   assert(!g->compiled);
+   rg_cull(g);
+
+   for (u32 i = 0; i < g->pass_count; i++) {
+      RgPassNode* p = &g->passes[i];
+      g->stats.pass_count++;
+      if (p->culled) {
+         g->stats.culled_count++;
+         continue;
+      }
+
+      for (u32 u = 0; u < p->use_count; u++) {
+         RgResourceNode* r = &g->resources[p->uses[u].resource];
+         const RgAccessInfo* info = &rg_access_info[p->uses[u].access];
+         if (r->first_pass == RG_NONE) {
+            r->first_pass = i;
+            assert((r->imported || info->write) && "Transient read before anything wrote it.");
+         }
+         r->last_pass = i;
+         r->image_usage |= info->image_usage;
+         r->buffer_usage |= info->buffer_usage;
+      }
+   }
+
+   VkResult result = rg_allocate_transients(g);
+   if (result != VK_SUCCESS) return result;
+
+   // the first run only finds out the state every resource ends the frame in, which is where
+   // the first use of the next one in the same memory has to wait
+   RgState end[RG_MAX_RESOURCES] = {0};
+   rg_plan(g, end, false);
+   rg_plan(g, end, true);
+
+   g->stats.barrier_count = g->barrier_count;
+   g->compiled = true;
+   return VK_SUCCESS;
+}
+
+// execution
+
+static void rg_emit_barriers2(RenderGraph* g, VkCommandBuffer commandBuffer, u32 first, u32 count) {
+   VkImageMemoryBarrier2 imageBarriers[RG_MAX_RESOURCES];
+   VkBufferMemoryBarrier2 bufferBarriers[RG_MAX_RESOURCES];
+   u32 imageCount = 0;
+   u32 bufferCount = 0;
+
+   for (u32 i = first; i < first + count; i++) {
+      RgBarrier* b = &g->barriers[i];
+      RgResourceNode* r = &g->resources[b->resource];
+
+      if (r->image) {
+         VkImageMemoryBarrier2* barrier = &imageBarriers[imageCount++];
+         *barrier = (VkImageMemoryBarrier2){0};
+         barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+         barrier->srcStageMask = b->src.stages;
+         barrier->srcAccessMask = b->src.access;
+         barrier->dstStageMask = b->dst.stages;
+         barrier->dstAccessMask = b->dst.access;
+         barrier->oldLayout = b->src.layout;
+         barrier->newLayout = b->dst.layout;
+         barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+         barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+         barrier->image = r->vk_image;
+         barrier->subresourceRange.aspectMask = r->aspect;
+         barrier->subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+         barrier->subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+      } else {
+         VkBufferMemoryBarrier2* barrier = &bufferBarriers[bufferCount++];
+         *barrier = (VkBufferMemoryBarrier2){0};
+         barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+         barrier->srcStageMask = b->src.stages;
+         barrier->srcAccessMask = b->src.access;
+         barrier->dstStageMask = b->dst.stages;
+         barrier->dstAccessMask = b->dst.access;
+         barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+         barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+         barrier->buffer = r->vk_buffer;
+         barrier->size = VK_WHOLE_SIZE;
+      }
+   }
+
+   VkDependencyInfo dependencyInfo = {0};
+   dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+   dependencyInfo.bufferMemoryBarrierCount = bufferCount;
+   dependencyInfo.pBufferMemoryBarriers = bufferBarriers;
+   dependencyInfo.imageMemoryBarrierCount = imageCount;
+   dependencyInfo.pImageMemoryBarriers = imageBarriers;
+   vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
+
+static void rg_emit_barriers(RenderGraph* g, VkCommandBuffer commandBuffer, u32 first, u32 count) {
+   if (count == 0) return;
+   if (g->synchronization2) {
+      rg_emit_barriers2(g, commandBuffer, first, count);
+      return;
+   }
+
+   VkImageMemoryBarrier imageBarriers[RG_MAX_RESOURCES];
+   VkBufferMemoryBarrier bufferBarriers[RG_MAX_RESOURCES];
+   u32 imageCount = 0;
+   u32 bufferCount = 0;
+   VkPipelineStageFlags srcStages = 0;
+   VkPipelineStageFlags dstStages = 0;
+
+   for (u32 i = first; i < first + count; i++) {
+      RgBarrier* b = &g->barriers[i];
+      RgResourceNode* r = &g->resources[b->resource];
+      srcStages |= b->src.stages;
+      dstStages |= b->dst.stages;
+
+      if (r->image) {
+         VkImageMemoryBarrier* barrier = &imageBarriers[imageCount++];
+         *barrier = (VkImageMemoryBarrier){0};
+         barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+         barrier->srcAccessMask = b->src.access;
+         barrier->dstAccessMask = b->dst.access;
+         barrier->oldLayout = b->src.layout;
+         barrier->newLayout = b->dst.layout;
+         barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+         barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+         barrier->image = r->vk_image;
+         barrier->subresourceRange.aspectMask = r->aspect;
+         barrier->subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+         barrier->subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+      } else {
+         VkBufferMemoryBarrier* barrier = &bufferBarriers[bufferCount++];
+         *barrier = (VkBufferMemoryBarrier){0};
+         barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+         barrier->srcAccessMask = b->src.access;
+         barrier->dstAccessMask = b->dst.access;
+         barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+         barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+         barrier->buffer = r->vk_buffer;
+         barrier->size = VK_WHOLE_SIZE;
+      }
+   }
+
+   if (srcStages == 0) srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+   if (dstStages == 0) dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+   vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, bufferCount, bufferBarriers, imageCount, imageBarriers);
+}
+
+void rg_execute(RenderGraph* g, VkCommandBuffer commandBuffer) {
+   assert(g->compiled);
+   for (u32 i = 0; i < g->pass_count; i++) {
+      RgPassNode* p = &g->passes[i];
+      if (p->culled) continue;
+
+      rg_emit_barriers(g, commandBuffer, p->first_barrier, p->barrier_count);
+      p->record(commandBuffer, p->user);
+   }
+   rg_emit_barriers(g, commandBuffer, g->final_barrier, g->barrier_count - g->final_barrier);
+}
+
+VkImage rg_image(RenderGraph* g, RgResource r) {
+   return g->resources[r].vk_image;
+}
+
+VkImageView rg_image_view(RenderGraph* g, RgResource r) {
+   return g->resources[r].view;
+}
+
+VkBuffer rg_buffer(RenderGraph* g, RgResource r) {
+   return g->resources[r].vk_buffer;
+}
+
+VkDeviceSize rg_committed_bytes(RenderGraph* g) {
+   VkDeviceSize committed = 0;
+   for (u32 b = 0; b < g->block_count; b++) {
+      if (!g->blocks[b].lazy) {
+         committed += g->blocks[b].size;
+         continue;
+      }
+      VkDeviceSize bytes = 0;
+      vkGetDeviceMemoryCommitment(g->device, g->blocks[b].memory, &bytes);
+      committed += bytes;
+   }
+   return committed;
+}
+
+void rg_print_stats(RenderGraph* g, FILE* out) {
+   RgStats* s = &g->stats;
+   fprintf(out, "render graph: %u passes, %u culled, %u barriers per frame\n", s->pass_count, s->culled_count, s->barrier_count);
+   fprintf(out, "   %u transients in %u blocks, %.2f MiB allocated, %.2f MiB saved by aliasing\n",
+           s->transient_count, s->block_count, (double)s->allocated_bytes / MB(1.0),
+           (double)(s->transient_bytes - s->allocated_bytes) / MB(1.0));
+   if (s->lazy_bytes > 0) fprintf(out, "   %.2f MiB of it lazily allocated\n", (double)s->lazy_bytes / MB(1.0));
+   for (u32 i = 0; i < g->pass_count; i++) {
+      RgPassNode* p = &g->passes[i];
+      fprintf(out, "   %-16s %s, %u barriers\n", p->name, p->culled ? "culled" : "live", p->barrier_count);
+   }
+}
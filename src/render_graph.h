@@ -0,0 +1,193 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+// Frame graph.
+//
+// Passes are added in execution order and say which resources they read and write, and how.
+// rg_compile drops passes nothing depends on, works out the smallest set of pipeline barriers
+// between the passes that are left and creates the transient resources, letting ones whose
+// lifetimes don't overlap share memory. The plan only depends on the graph so it is built
+// once, rg_execute replays it every frame. Rebuild the graph when the swapchain changes.
+// With synchronization2 every barrier keeps its own stages, otherwise the barriers in front of
+// a pass share one vkCmdPipelineBarrier.
+//
+// Imported resources live outside the graph, the swapchain image for example. They start every
+// frame in their initial state and are left in their final one. Transient resources only exist
+// inside the frame and their contents are discarded in between.
+
+#define RG_MAX_PASSES 32
+#define RG_MAX_RESOURCES 32
+#define RG_MAX_PASS_USES 8
+
+#define RG_NONE UINT32_MAX
+
+typedef u32 RgPass;
+typedef u32 RgResource;
+
+typedef enum {
+   RG_ACCESS_COLOR_ATTACHMENT,
+   RG_ACCESS_DEPTH_ATTACHMENT,
+   RG_ACCESS_DEPTH_READ,
+   RG_ACCESS_FRAGMENT_SAMPLED,
+   RG_ACCESS_COMPUTE_SAMPLED,
+   RG_ACCESS_COMPUTE_READ,
+   RG_ACCESS_COMPUTE_WRITE,
+   RG_ACCESS_TRANSFER_READ,
+   RG_ACCESS_TRANSFER_WRITE,
+   RG_ACCESS_VERTEX_BUFFER,
+   RG_ACCESS_INDEX_BUFFER,
+   RG_ACCESS_INDIRECT_BUFFER,
+   RG_ACCESS_UNIFORM_READ,
+   RG_ACCESS_COUNT,
+} RgAccess;
+
+typedef struct {
+   VkPipelineStageFlags stages;
+   VkAccessFlags access;
+   VkImageLayout layout;
+} RgState;
+
+typedef enum {
+   // Contents never leave the pass that uses the image, multisample targets that get resolved
+   // and depth nobody reads later. They get TRANSIENT_ATTACHMENT usage and lazily allocated
+   // memory where the device has it, so on tilers they only ever live in tile memory.
+   RG_IMAGE_LAZY = 1 << 0,
+} RgImageFlags;
+
+typedef struct {
+   VkFormat format;
+   VkExtent2D extent;
+   VkImageAspectFlags aspect;
+   VkSampleCountFlagBits samples; // 0 is the same as 1
+   RgImageFlags flags;
+} RgImageDesc;
+
+typedef void (*RgRecordFn)(VkCommandBuffer commandBuffer, void* user);
+
+typedef struct {
+   RgResource resource;
+   RgAccess access;
+} RgUse;
+
+typedef struct {
+   const char* name;
+   RgRecordFn record;
+   void* user;
+   RgUse uses[RG_MAX_PASS_USES];
+   u32 use_count;
+   bool side_effects;
+
+   bool culled;
+   u32 ref_count;
+   u32 first_barrier;
+   u32 barrier_count;
+} RgPassNode;
+
+typedef struct {
+   const char* name;
+   bool image;
+   bool imported;
+
+   // transients, usage is collected from the passes
+   RgImageDesc desc;
+   VkImageUsageFlags image_usage;
+   VkDeviceSize size;
+   VkBufferUsageFlags buffer_usage;
+
+   RgState initial;
+   RgState final;
+   VkImageAspectFlags aspect;
+
+   VkImage vk_image;
+   VkImageView view;
+   VkBuffer vk_buffer;
+
+   u32 first_pass;
+   u32 last_pass;
+   u32 reader_count;
+   u32 block;
+   RgResource alias_prev;
+   VkDeviceSize memory_size;
+} RgResourceNode;
+
+typedef struct {
+   RgResource resource;
+   RgState src;
+   RgState dst;
+} RgBarrier;
+
+typedef struct {
+   VkDeviceMemory memory;
+   VkDeviceSize size;
+   u32 memory_type;
+   bool lazy;
+} RgMemoryBlock;
+
+typedef struct {
+   u32 pass_count;
+   u32 culled_count;
+   u32 transient_count;
+   u32 barrier_count; // per frame
+   u32 block_count;
+   VkDeviceSize transient_bytes; // what the transients would take on their own
+   VkDeviceSize allocated_bytes;
+   VkDeviceSize lazy_bytes; // part of allocated_bytes that is lazily allocated
+} RgStats;
+
+typedef struct {
+   VkDevice device;
+   VkPhysicalDevice physical_device;
+   const VkAllocationCallbacks* callbacks;
+   bool synchronization2;
+
+   RgPassNode passes[RG_MAX_PASSES];
+   u32 pass_count;
+   RgResourceNode resources[RG_MAX_RESOURCES];
+   u32 resource_count;
+
+   RgBarrier barriers[RG_MAX_PASSES * RG_MAX_PASS_USES + RG_MAX_RESOURCES];
+   u32 barrier_count;
+   u32 final_barrier;
+
+   RgMemoryBlock blocks[RG_MAX_RESOURCES];
+   u32 block_count;
+
+   RgStats stats;
+   bool compiled;
+} RenderGraph;
+
+void rg_init(RenderGraph* g, VkDevice device, VkPhysicalDevice physicalDevice, const VkAllocationCallbacks* callbacks, bool synchronization2);
+void rg_destroy(RenderGraph* g);
+
+RgResource rg_create_image(RenderGraph* g, const char* name, const RgImageDesc* desc);
+RgResource rg_create_buffer(RenderGraph* g, const char* name, VkDeviceSize size);
+
+// The handles of imported resources can change every frame, set them before rg_execute.
+RgResource rg_import_image(RenderGraph* g, const char* name, VkImageAspectFlags aspect, RgState initial, RgState final);
+RgResource rg_import_buffer(RenderGraph* g, const char* name, RgState initial, RgState final);
+void rg_set_image(RenderGraph* g, RgResource r, VkImage image, VkImageView view);
+void rg_set_buffer(RenderGraph* g, RgResource r, VkBuffer buffer);
+
+RgPass rg_add_pass(RenderGraph* g, const char* name, RgRecordFn record, void* user);
+void rg_read(RenderGraph* g, RgPass pass, RgResource r, RgAccess access);
+void rg_write(RenderGraph* g, RgPass pass, RgResource r, RgAccess access);
+
+// Keeps a pass even if nothing reads what it writes, for passes that only matter for what they
+// do outside the graph, queries or readbacks.
+void rg_keep(RenderGraph* g, RgPass pass);
+
+VkResult rg_compile(RenderGraph* g);
+void rg_execute(RenderGraph* g, VkCommandBuffer commandBuffer);
+
+VkImage rg_image(RenderGraph* g, RgResource r);
+VkImageView rg_image_view(RenderGraph* g, RgResource r);
+VkBuffer rg_buffer(RenderGraph* g, RgResource r);
+
+// How much of the lazily allocated memory the driver actually backed, only meaningful after
+// the graph has run a few frames.
+VkDeviceSize rg_committed_bytes(RenderGraph* g);
+
+void rg_print_stats(RenderGraph* g, FILE* out);
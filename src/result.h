@@ -1,3 +1,5 @@
 #pragma once
 
-#define Result(T) (struct {T value; bool ok})
+// error is an errno value when ok is false. T names the struct, so it has to be one token: a
+// typedef name, not const char* or unsigned int. Typedef those first.
+#define Result(T) struct Result##T { T value; bool ok; int error; }
@@ -0,0 +1,211 @@
+#include "shaders.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "pack.h"
+
+#define SPIRV_MAGIC 0x07230203u
+
+// embedded shaders, the paths are relative to this file
+
+#if defined(__has_embed)
+#if __has_embed("../resources/shaders/vert.spv") && __has_embed("../resources/shaders/frag.spv")
+#define SHADERS_EMBEDDED
+#endif
+// only there once compile-shaders has run, the checked in .spv files predate it
+#if __has_embed("../resources/shaders/vert_bindless.spv")
+#define SHADERS_EMBEDDED_BINDLESS
+#endif
+#if __has_embed("../resources/shaders/particles_comp.spv") && __has_embed("../resources/shaders/particles_vert.spv") \
+      && __has_embed("../resources/shaders/particles_frag.spv")
+#define SHADERS_EMBEDDED_PARTICLES
+#endif
+#endif
+
+#ifdef SHADERS_EMBEDDED
+alignas(u32) static const u8 vert_spv[] = {
+#embed "../resources/shaders/vert.spv"
+};
+
+alignas(u32) static const u8 frag_spv[] = {
+#embed "../resources/shaders/frag.spv"
+};
+
+#ifdef SHADERS_EMBEDDED_BINDLESS
+alignas(u32) static const u8 vert_bindless_spv[] = {
+#embed "../resources/shaders/vert_bindless.spv"
+};
+#endif
+
+#ifdef SHADERS_EMBEDDED_PARTICLES
+alignas(u32) static const u8 particles_comp_spv[] = {
+#embed "../resources/shaders/particles_comp.spv"
+};
+
+alignas(u32) static const u8 particles_vert_spv[] = {
+#embed "../resources/shaders/particles_vert.spv"
+};
+
+alignas(u32) static const u8 particles_frag_spv[] = {
+#embed "../resources/shaders/particles_frag.spv"
+};
+#endif
+
+static const struct {
+   const char* name;
+   const u8* code;
+   Size size;
+} embedded_shaders[] = {
+   {"vert", vert_spv, sizeof(vert_spv)},
+   {"frag", frag_spv, sizeof(frag_spv)},
+#ifdef SHADERS_EMBEDDED_BINDLESS
+   {"vert_bindless", vert_bindless_spv, sizeof(vert_bindless_spv)},
+#endif
+#ifdef SHADERS_EMBEDDED_PARTICLES
+   {"particles_comp", particles_comp_spv, sizeof(particles_comp_spv)},
+   {"particles_vert", particles_vert_spv, sizeof(particles_vert_spv)},
+   {"particles_frag", particles_frag_spv, sizeof(particles_frag_spv)},
+#endif
+};
+#endif
+
+// overrides
+
+static struct {
+   char dir[256];
+   Pack pack;
+   bool has_dir;
+   bool has_pack;
+} shader_override;
+
+bool shaders_override(const char* path) {
+   if (shader_override.has_pack) pack_close(&shader_override.pack);
+   shader_override.has_pack = false;
+   shader_override.has_dir = false;
+   if (!path) return true;
+
+   struct stat st;
+   if (stat(path, &st) != 0) return false;
+
+   if (S_ISDIR(st.st_mode)) {
+      if (strlen(path) >= sizeof(shader_override.dir)) return false;
+      strcpy(shader_override.dir, path);
+      shader_override.has_dir = true;
+      return true;
+   }
+
+   PackResult pack = pack_open(path);
+   if (!pack.ok) return false;
+   shader_override.pack = pack.value;
+   shader_override.has_pack = true;
+   return true;
+}
+
+static bool _shader_check(Shader* shader) {
+   if (shader->size < 4 || shader->size % 4 != 0 || shader->code[0] != SPIRV_MAGIC) {
+      shader_unload(shader);
+      return false;
+   }
+   return true;
+}
+
+static ShaderResult _shader_from_file(const char* dir, const char* name) {
+   ShaderResult result = {0};
+
+   char path[512];
+   snprintf(path, sizeof(path), "%s/%s.spv", dir, name);
+   MappedFileResult mapped = map_file(path, FILE_ADVICE_WILLNEED);
+   if (!mapped.ok) {
+      result.error = mapped.error;
+      return result;
+   }
+
+   result.value = (Shader){
+      .code = (const u32*)mapped.value.data,
+      .size = mapped.value.length,
+      .source = SHADER_SOURCE_FILE,
+      .file = mapped.value,
+   };
+   result.ok = _shader_check(&result.value);
+   result.error = result.ok ? 0 : EINVAL;
+   return result;
+}
+
+static ShaderResult _shader_from_pack(Pack* pack, const char* name) {
+   ShaderResult result = {0};
+
+   char entry_name[256];
+   snprintf(entry_name, sizeof(entry_name), "shaders/%s.spv", name);
+   const PackEntry* entry = pack_find(pack, str(entry_name));
+   if (!entry) {
+      result.error = ENOENT;
+      return result;
+   }
+
+   result.value = (Shader){
+      .size = (Size)entry->size,
+      .source = SHADER_SOURCE_PACK,
+   };
+   const u8* view = pack_entry_view(pack, entry);
+   if (view) {
+      result.value.code = (const u32*)view;
+   } else {
+      result.value.owned = malloc((size_t)entry->size);
+      if (!result.value.owned || !pack_read(pack, entry, result.value.owned, 1)) {
+         free(result.value.owned);
+         result.error = EINVAL;
+         return result;
+      }
+      result.value.code = result.value.owned;
+   }
+   result.ok = _shader_check(&result.value);
+   result.error = result.ok ? 0 : EINVAL;
+   return result;
+}
+
+ShaderResult shader_load(const char* name) {
+   ShaderResult result = {.error = ENOENT};
+
+   if (shader_override.has_pack) {
+      result = _shader_from_pack(&shader_override.pack, name);
+   } else if (shader_override.has_dir) {
+      result = _shader_from_file(shader_override.dir, name);
+   }
+   // broken shaders in the override are reported, missing ones fall through to the built in ones
+   if (result.ok || result.error != ENOENT) return result;
+
+#ifdef SHADERS_EMBEDDED
+   for (Size i = 0; i < lengthof(embedded_shaders); i++) {
+      if (strcmp(embedded_shaders[i].name, name) != 0) continue;
+      result.value = (Shader){
+         .code = (const u32*)embedded_shaders[i].code,
+         .size = embedded_shaders[i].size,
+         .source = SHADER_SOURCE_EMBEDDED,
+      };
+      result.ok = _shader_check(&result.value);
+      result.error = result.ok ? 0 : EINVAL;
+      return result;
+   }
+#endif
+   // not embedded, either no #embed or built before the shader existed
+   return _shader_from_file(SHADER_DEFAULT_DIR, name);
+}
+
+void shader_unload(Shader* shader) {
+   if (shader->source == SHADER_SOURCE_FILE) unmap_file(&shader->file);
+   free(shader->owned);
+   *shader = (Shader){0};
+}
+
+const char* shader_source_name(ShaderSource source) {
+   switch (source) {
+      case SHADER_SOURCE_EMBEDDED: return "embedded";
+      case SHADER_SOURCE_FILE: return "file";
+      case SHADER_SOURCE_PACK: return "pack";
+   }
+   return "unknown";
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "file.h"
+#include "result.h"
+
+// shader registry
+//
+// The compiled SPIR-V is baked into the binary with #embed so starting up needs no file IO and
+// works from any directory. While working on shaders an override can point the registry at a
+// directory of .spv files or an asset pack instead, anything not found there still comes from
+// the embedded copy. Shaders are named after their file without the extension: "vert", "frag",
+// "vert_bindless", "particles_comp".
+//
+// Compilers without #embed get no embedded shaders and load from resources/shaders, so does any
+// shader that wasn't compiled yet when the binary was built.
+
+#define SHADER_DEFAULT_DIR "resources/shaders"
+
+typedef enum {
+   SHADER_SOURCE_EMBEDDED,
+   SHADER_SOURCE_FILE,
+   SHADER_SOURCE_PACK,
+} ShaderSource;
+
+typedef struct {
+   const u32* code;
+   Size size; // in bytes
+   ShaderSource source;
+
+   MappedFile file;
+   void* owned; // decompressed out of a pack
+} Shader;
+
+typedef Result(Shader) ShaderResult;
+
+// A directory of .spv files or a .pack file, nullptr drops the override. Returns false and keeps
+// the embedded shaders if path can't be opened.
+bool shaders_override(const char* path);
+
+// Fails with ENOENT for unknown names and EINVAL for data that isn't SPIR-V.
+ShaderResult shader_load(const char* name);
+void shader_unload(Shader* shader);
+
+const char* shader_source_name(ShaderSource source);
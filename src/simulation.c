@@ -0,0 +1,122 @@
+#include "simulation.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#define SIMULATION_FRESH 4u // or'd onto the latest slot index until the reader takes it
+
+u64 simulation_now(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (u64)ts.tv_sec * 1000000000u + (u64)ts.tv_nsec;
+}
+
+static void simulation_sleep_until(u64 deadline) {
+   struct timespec ts = {(time_t)(deadline / 1000000000u), (long)(deadline % 1000000000u)};
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+}
+
+// every slot holds a previous and a current snapshot, plus the live state the thread steps:
+// 3 slots * 2 + 1 transforms per object
+static Size simulation_bytes(u32 count) {
+   return (Size)count * sizeof(SimTransform) * 7;
+}
+
+static void* simulation_thread(void* arg) {
+   Simulation* s = arg;
+   Size bytes = (Size)s->count * sizeof(SimTransform);
+   double dt = (double)s->step_nanos / 1e9;
+   u64 tick = 0;
+   u64 next = simulation_now() + s->step_nanos;
+
+   while (atomic_load_explicit(&s->running, memory_order_acquire)) {
+      simulation_sleep_until(next);
+      u64 now = simulation_now();
+
+      for (u32 steps = 0; next <= now && steps < SIMULATION_MAX_CATCH_UP; steps++) {
+         SimSnapshot* snapshot = &s->slots[s->back];
+         memcpy(snapshot->previous, s->state, (size_t)bytes);
+         s->step(s->state, s->count, dt, s->user);
+         memcpy(snapshot->current, s->state, (size_t)bytes);
+         snapshot->tick = ++tick;
+         snapshot->time = next;
+
+         // the release half makes the copies visible to the reader, what comes back is the
+         // slot it let go of or the one it never took
+         u32 previous = atomic_exchange_explicit(&s->latest, s->back | SIMULATION_FRESH, memory_order_acq_rel);
+         s->back = previous & ~SIMULATION_FRESH;
+         next += s->step_nanos;
+      }
+
+      // after a long stall the simulation falls behind the clock rather than running a burst
+      if (next <= now) {
+         atomic_fetch_add_explicit(&s->dropped_ticks, (now - next) / s->step_nanos + 1, memory_order_relaxed);
+         next = now + s->step_nanos;
+      }
+   }
+   return nullptr;
+}
+
+bool simulation_start(Simulation* s, Allocator* allocator, const SimTransform* initial, u32 count, u32 hz, SimStepFn step, void* user) {
+   assert(hz > 0 && "Simulation expected a tick rate.");
+
+   *s = (Simulation){0};
+   s->allocator = allocator;
+   s->count = count;
+   s->step_nanos = 1000000000u / hz;
+   s->step = step;
+   s->user = user;
+
+   SimTransform* transforms = allocator->alloc(simulation_bytes(count), allocator->ctx);
+   if (!transforms) return false;
+
+   Size bytes = (Size)count * sizeof(SimTransform);
+   for (u32 i = 0; i < lengthof(s->slots); i++) {
+      s->slots[i].previous = transforms + (Size)count * (i * 2);
+      s->slots[i].current = transforms + (Size)count * (i * 2 + 1);
+      memcpy(s->slots[i].previous, initial, (size_t)bytes);
+      memcpy(s->slots[i].current, initial, (size_t)bytes);
+   }
+   s->state = transforms + (Size)count * 6;
+   memcpy(s->state, initial, (size_t)bytes);
+
+   s->front = 0;
+   atomic_init(&s->latest, 1);
+   s->back = 2;
+   atomic_init(&s->dropped_ticks, 0);
+   atomic_init(&s->running, true);
+
+   if (pthread_create(&s->thread, nullptr, simulation_thread, s) != 0) {
+      allocator->free(simulation_bytes(count), transforms, allocator->ctx);
+      *s = (Simulation){0};
+      return false;
+   }
+   return true;
+}
+
+void simulation_stop(Simulation* s) {
+   if (!s->allocator) return;
+
+   atomic_store_explicit(&s->running, false, memory_order_release);
+   pthread_join(s->thread, nullptr);
+
+   // the slots never move, only which one is whose
+   s->allocator->free(simulation_bytes(s->count), s->slots[0].previous, s->allocator->ctx);
+   *s = (Simulation){0};
+}
+
+const SimSnapshot* simulation_read(Simulation* s) {
+   if (atomic_load_explicit(&s->latest, memory_order_relaxed) & SIMULATION_FRESH) {
+      u32 latest = atomic_exchange_explicit(&s->latest, s->front, memory_order_acq_rel);
+      s->front = latest & ~SIMULATION_FRESH;
+   }
+   return &s->slots[s->front];
+}
+
+float simulation_alpha(const Simulation* s, const SimSnapshot* snapshot, u64 now) {
+   if (now <= snapshot->time) return 0.0f;
+   double alpha = (double)(now - snapshot->time) / (double)s->step_nanos;
+   return alpha < 1.0 ? (float)alpha : 1.0f;
+}
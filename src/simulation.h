@@ -0,0 +1,64 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "memory.h"
+
+// Fixed timestep simulation on a thread of its own.
+//
+// The thread steps the transforms at a fixed rate on the monotonic clock, however fast or slow
+// frames are, and publishes every tick through a triple buffer. The writer always has a slot of
+// its own to fill, the reader always has one to read, and the third is the latest complete tick.
+// Publishing and picking up swap that slot with one atomic exchange, neither side ever waits.
+//
+// A snapshot holds the tick before and the tick itself, the render thread blends the two with
+// simulation_alpha. What is drawn is up to one tick behind the simulation, in exchange motion is
+// smooth at any frame rate and the results never depend on it.
+
+#define SIMULATION_MAX_CATCH_UP 8 // ticks per wake before the clock is reset instead
+
+typedef struct {
+   float position[3];
+   float angle; // radians about z
+   float scale;
+} SimTransform;
+
+typedef struct {
+   u64 tick;
+   u64 time; // simulation_now when the tick was due
+   SimTransform* previous;
+   SimTransform* current;
+} SimSnapshot;
+
+typedef void (*SimStepFn)(SimTransform* transforms, u32 count, double dt, void* user);
+
+typedef struct {
+   Allocator* allocator;
+   u32 count;
+   u64 step_nanos;
+   SimStepFn step;
+   void* user;
+
+   SimSnapshot slots[3];
+   _Atomic(u32) latest; // slot index, SIMULATION_FRESH when not read yet
+   u32 back; // simulation thread only
+   u32 front; // render thread only
+
+   SimTransform* state;
+   pthread_t thread;
+   _Atomic(bool) running;
+   _Atomic(u64) dropped_ticks; // lost to catching up after a stall
+} Simulation;
+
+u64 simulation_now(void); // nanoseconds, CLOCK_MONOTONIC
+
+// Copies initial, which also stands as tick 0 until the first tick is published.
+bool simulation_start(Simulation* s, Allocator* allocator, const SimTransform* initial, u32 count, u32 hz, SimStepFn step, void* user);
+void simulation_stop(Simulation* s);
+
+// The newest published tick, stays valid until the next call.
+const SimSnapshot* simulation_read(Simulation* s);
+
+// How far now is past the snapshot's tick, 0 to 1, for blending previous into current.
+float simulation_alpha(const Simulation* s, const SimSnapshot* snapshot, u64 now);
@@ -0,0 +1,49 @@
+#include "spsc_queue.h"
+
+#include <assert.h>
+#include <string.h>
+
+bool spsc_queue_init(SpscQueue* q, Allocator* allocator, Size item_size, Size capacity) {
+   assert(capacity > 0 && (capacity & (capacity - 1)) == 0 && "SPSC queue capacity expected to be a power of two.");
+
+   *q = (SpscQueue){0};
+   q->items = allocator->alloc(item_size * capacity, allocator->ctx);
+   if (!q->items) return false;
+   q->allocator = allocator;
+   q->item_size = item_size;
+   q->capacity = capacity;
+   atomic_init(&q->head, 0);
+   atomic_init(&q->tail, 0);
+   atomic_init(&q->dropped, 0);
+   return true;
+}
+
+void spsc_queue_destroy(SpscQueue* q) {
+   if (q->items) q->allocator->free(q->item_size * q->capacity, q->items, q->allocator->ctx);
+   *q = (SpscQueue){0};
+}
+
+// Indices only ever grow, the slot is the index masked by the capacity and tail - head is
+// how many items are in the queue.
+bool spsc_queue_push(SpscQueue* q, const void* item) {
+   Size tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+   Size head = atomic_load_explicit(&q->head, memory_order_acquire);
+   if (tail - head == q->capacity) {
+      atomic_fetch_add_explicit(&q->dropped, 1, memory_order_relaxed);
+      return false;
+   }
+
+   memcpy(q->items + (tail & (q->capacity - 1)) * q->item_size, item, (size_t)q->item_size);
+   atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+   return true;
+}
+
+bool spsc_queue_pop(SpscQueue* q, void* item) {
+   Size head = atomic_load_explicit(&q->head, memory_order_relaxed);
+   Size tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+   if (head == tail) return false;
+
+   memcpy(item, q->items + (head & (q->capacity - 1)) * q->item_size, (size_t)q->item_size);
+   atomic_store_explicit(&q->head, head + 1, memory_order_release);
+   return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#include "memory.h"
+
+// Bounded single producer, single consumer queue of fixed size items.
+//
+// One thread pushes and one thread pops, neither ever blocks or takes a lock. Each side owns
+// one index and only reads the other's, the two sit on separate cache lines so they don't
+// bounce between the cores. A full queue refuses the push, the producer decides what to drop.
+
+#define SPSC_CACHE_LINE 64
+
+typedef struct {
+   Allocator* allocator;
+   u8* items;
+   Size item_size;
+   Size capacity; // power of two
+
+   alignas(SPSC_CACHE_LINE) _Atomic(Size) head; // next to pop, consumer only writes it
+   alignas(SPSC_CACHE_LINE) _Atomic(Size) tail; // next to push, producer only writes it
+   alignas(SPSC_CACHE_LINE) _Atomic(Size) dropped;
+} SpscQueue;
+
+bool spsc_queue_init(SpscQueue* q, Allocator* allocator, Size item_size, Size capacity);
+void spsc_queue_destroy(SpscQueue* q);
+
+// Producer side.
+bool spsc_queue_push(SpscQueue* q, const void* item);
+
+// Consumer side.
+bool spsc_queue_pop(SpscQueue* q, void* item);
@@ -0,0 +1,2 @@
+#define STR_IMPLEMENTATION
+#include "str.h"
@@ -2,6 +2,7 @@
 #define STR_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #define str(cstr) str_from_cstr(cstr)
@@ -16,6 +17,10 @@ typedef String StringView;
 String str_make(char *str, size_t length);
 String str_from_cstr(char *cstr);
 
+// Index of the first/last occurance of c, or str.length if there is none.
+size_t str_find_char(String str, char c);
+size_t str_find_char_reverse(String str, char c);
+
 // Chop a string view up to but not including the delim.
 // Only finds the first occurance of delim.
 String str_chop_delim(String* in, char delim);
@@ -27,12 +32,23 @@ String str_chop_delim(String* in, char delim);
 // being returned and [in] would become " how are you?"
 String str_chop_consecutive_delim(String* in, char delim);
 
-// Same as str_chop_delim just starts from the end of the string
+// Same as str_chop_delim just starts from the end of the string, returns what comes after the
+// last delim and leaves [in] as everything before it.
 String str_chop_delim_reverse(String* in, char delim);
 
 bool str_eq_cstr(String *str, char* cstr);
 bool str_eq(String* str1, String* str2);
 
+// Number parsing straight from the view, no copies and no libc. Leading whitespace is skipped
+// like strtod does. Returns the number of characters consumed, 0 if there was no number.
+//
+// Floats are correctly rounded: the common case (at most 19 significant digits that fit the
+// mantissa and a small exponent) is a single exact multiply or divide, anything else goes
+// through an exact decimal to binary conversion.
+size_t str_parse_f64(String str, double* out);
+size_t str_parse_f32(String str, float* out);
+size_t str_parse_i64(String str, int64_t* out);
+
 double str_strtod(String* str);
 int str_strtoi(String str);
 
@@ -47,6 +63,11 @@ void str_debug(String str, char* name);
 
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STR_X86 1
+#endif
+
 String str_make(char *str, size_t length) {
    return (String){
        .length = length,
@@ -61,11 +82,143 @@ String str_from_cstr(char *cstr) {
    };
 }
 
+// searching and counting
+//
+// SSE2 is always there on x86_64, AVX2 is picked at runtime so the build doesn't need -march.
+
+#ifdef STR_X86
+
+static size_t str_find_char_sse2(const char* data, size_t length, char c) {
+   __m128i needle = _mm_set1_epi8(c);
+   size_t i = 0;
+   for (; i + 16 <= length; i += 16) {
+      __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+      if (mask) return i + (size_t)__builtin_ctz((unsigned)mask);
+   }
+   for (; i < length; i++) {
+      if (data[i] == c) return i;
+   }
+   return length;
+}
+
+__attribute__((target("avx2")))
+static size_t str_find_char_avx2(const char* data, size_t length, char c) {
+   __m256i needle = _mm256_set1_epi8(c);
+   size_t i = 0;
+   for (; i + 64 <= length; i += 64) {
+      __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), needle);
+      __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i + 32)), needle);
+      if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b))) {
+         uint64_t mask = (uint32_t)_mm256_movemask_epi8(a) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(b) << 32);
+         return i + (size_t)__builtin_ctzll(mask);
+      }
+   }
+   for (; i + 32 <= length; i += 32) {
+      uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), needle));
+      if (mask) return i + (size_t)__builtin_ctz(mask);
+   }
+   return i + str_find_char_sse2(data + i, length - i, c);
+}
+
+static size_t str_find_char_reverse_sse2(const char* data, size_t length, char c) {
+   __m128i needle = _mm_set1_epi8(c);
+   size_t i = length;
+   for (; i >= 16; i -= 16) {
+      __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i - 16));
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+      if (mask) return i - 16 + 31 - (size_t)__builtin_clz((unsigned)mask);
+   }
+   while (i > 0) {
+      if (data[--i] == c) return i;
+   }
+   return length;
+}
+
+// Each compare gives 0 or -1 per byte, subtracting them counts per byte lane. The lanes are
+// folded into 64 bit sums with sad before they can overflow at 255.
+static size_t str_count_char_sse2(const char* data, size_t length, char c) {
+   __m128i needle = _mm_set1_epi8(c);
+   __m128i zero = _mm_setzero_si128();
+   __m128i total = zero;
+   size_t i = 0;
+
+   while (i + 16 <= length) {
+      __m128i lanes = zero;
+      for (size_t n = 0; n < 255 && i + 16 <= length; n++, i += 16) {
+         __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+         lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(chunk, needle));
+      }
+      total = _mm_add_epi64(total, _mm_sad_epu8(lanes, zero));
+   }
+
+   size_t count = (size_t)_mm_cvtsi128_si64(total) + (size_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(total, total));
+   for (; i < length; i++) {
+      count += data[i] == c;
+   }
+   return count;
+}
+
+__attribute__((target("avx2")))
+static size_t str_count_char_avx2(const char* data, size_t length, char c) {
+   __m256i needle = _mm256_set1_epi8(c);
+   __m256i zero = _mm256_setzero_si256();
+   __m256i total = zero;
+   size_t i = 0;
+
+   while (i + 64 <= length) {
+      __m256i a = zero;
+      __m256i b = zero;
+      for (size_t n = 0; n < 255 && i + 64 <= length; n++, i += 64) {
+         a = _mm256_sub_epi8(a, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), needle));
+         b = _mm256_sub_epi8(b, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i + 32)), needle));
+      }
+      total = _mm256_add_epi64(total, _mm256_sad_epu8(a, zero));
+      total = _mm256_add_epi64(total, _mm256_sad_epu8(b, zero));
+   }
+
+   __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+   size_t count = (size_t)_mm_cvtsi128_si64(sum) + (size_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(sum, sum));
+   return count + str_count_char_sse2(data + i, length - i, c);
+}
+
+static bool str_has_avx2(void) {
+   static int has = -1;
+   if (has < 0) {
+      has = __builtin_cpu_supports("avx2") ? 1 : 0;
+   }
+   return has;
+}
+
+#endif
+
+size_t str_find_char(String str, char c) {
+#ifdef STR_X86
+   if (str.length >= 64 && str_has_avx2()) {
+      return str_find_char_avx2(str.data, str.length, c);
+   }
+   return str_find_char_sse2(str.data, str.length, c);
+#else
+   const char* found = memchr(str.data, c, str.length);
+   return found ? (size_t)(found - str.data) : str.length;
+#endif
+}
+
+size_t str_find_char_reverse(String str, char c) {
+#ifdef STR_X86
+   return str_find_char_reverse_sse2(str.data, str.length, c);
+#else
+   for (size_t i = str.length; i > 0; i--) {
+      if (str.data[i - 1] == c) return i - 1;
+   }
+   return str.length;
+#endif
+}
+
 // Chop a string view up to but not including the delim.
 // Only finds the first occurance of delim.
 String str_chop_delim(String* in, char delim) {
-   size_t i = 0;
-   for (i = 0; (i < in->length) && (in->data[i] != delim); i++) {}
+   size_t i = str_find_char(*in, delim);
 
    String result = str_make(in->data, i);
 
@@ -98,84 +251,534 @@ String str_chop_consecutive_delim(String* in, char delim) {
 }
 
 String str_chop_delim_reverse(String* in, char delim) {
-   size_t i = in->length;
-   for (i; (i > 0) && (in->data[i] != delim); i--) {}
-
-   String result = str_make(in->data + i + 1, in->length - i);
+   size_t i = str_find_char_reverse(*in, delim);
 
-   if (i > 0) {
-      // in->data += i + 1;
-      in->length -= in->length - i;
-   } else {
-      // in->data += i;
+   if (i == in->length) {
+      String result = *in;
       in->length = 0;
+      return result;
    }
 
-   str_debug(result, "Result");
+   String result = str_make(in->data + i + 1, in->length - i - 1);
+   in->length = i;
    return result;
 }
 
-bool str_eq_cstr(String *str, char* str) {
-   if (str->length != strlen(str)) return false;
-   for (int i = 0; i < str->length; i++) {
-      if (str->data[i] != str[i])
-         return false;
-   } 
-   return true;
+bool str_eq_cstr(String *str, char* cstr) {
+   size_t length = strlen(cstr);
+   return str->length == length && memcmp(str->data, cstr, length) == 0;
 }
 
 bool str_eq(String* str1, String* str2) {
-   if (str1->length != str2->length) { return false; }
-   for (int i = 0; i < str1->length; i++) {
-      if (str1->data[i] != str2->data[i])
-         return false;
-   } 
+   return str1->length == str2->length && memcmp(str1->data, str2->data, str1->length) == 0;
+}
+
+int str_count_char(String str, char c) {
+#ifdef STR_X86
+   if (str.length >= 64 && str_has_avx2()) {
+      return (int)str_count_char_avx2(str.data, str.length, c);
+   }
+   return (int)str_count_char_sse2(str.data, str.length, c);
+#else
+   int count = 0;
+   for (size_t i = 0; i < str.length; i++) {
+      count += str.data[i] == c;
+   }
+   return count;
+#endif
+}
+
+// number parsing
+
+static bool str_is_digit(char c) {
+   return (unsigned)(c - '0') < 10;
+}
+
+static bool str_is_space(char c) {
+   return c == ' ' || (unsigned)(c - '\t') < 5;
+}
+
+static char str_lower(char c) {
+   return (char)(c | 0x20);
+}
+
+static bool str_match_nocase(const char* p, const char* end, const char* word) {
+   for (; *word; p++, word++) {
+      if (p >= end || str_lower(*p) != *word) return false;
+   }
    return true;
 }
 
-double str_strtod(String* str) {
-   char buf[str->length + 1];
-   memcpy(buf, str->data, str->length);
-   buf[str->length] = 0;
-   return strtod(buf, NULL);;
+size_t str_parse_i64(String str, int64_t* out) {
+   const char* p = str.data;
+   const char* end = str.data + str.length;
+   while (p < end && str_is_space(*p)) p++;
+
+   bool neg = false;
+   if (p < end && (*p == '-' || *p == '+')) {
+      neg = *p == '-';
+      p++;
+   }
+
+   const char* digits = p;
+   uint64_t value = 0;
+   uint64_t limit = neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+   bool overflow = false;
+   for (; p < end && str_is_digit(*p); p++) {
+      uint64_t d = (uint64_t)(*p - '0');
+      if (value > (limit - d) / 10) {
+         overflow = true;
+      } else {
+         value = value * 10 + d;
+      }
+   }
+
+   if (p == digits) {
+      *out = 0;
+      return 0;
+   }
+
+   if (overflow) value = limit;
+   *out = neg ? (int64_t)(0 - value) : (int64_t)value;
+   return (size_t)(p - str.data);
 }
 
-int str_strtoi(String str) {
-   // there is some wacky shit going on here that I don't fully understand
-   char buf[str.length + 1];
-   memcpy(buf, str.data, str.length);
-   buf[str.length] = 0;
-   return strtol(buf, NULL, 10);
+// Exact decimal for the slow path, the simple decimal conversion from Go's strconv. Shifting a
+// decimal by powers of 2 is exact so it can be scaled into the mantissa range and rounded
+// without ever losing a bit, at the cost of a few hundred digit operations.
+
+#define STR_DECIMAL_DIGITS 800
+#define STR_DECIMAL_MAX_SHIFT 60
+
+typedef struct {
+   uint8_t d[STR_DECIMAL_DIGITS];
+   int nd;
+   int dp;
+   bool neg;
+   bool trunc;
+} StrDecimal;
+
+typedef struct {
+   int mantbits;
+   int expbits;
+   int bias;
+} StrFloatInfo;
+
+static const StrFloatInfo str_f64_info = {52, 11, -1023};
+static const StrFloatInfo str_f32_info = {23, 8, -127};
+
+static void str_decimal_trim(StrDecimal* a) {
+   while (a->nd > 0 && a->d[a->nd - 1] == 0) a->nd--;
+   if (a->nd == 0) a->dp = 0;
 }
 
-int str_count_char(String str, char c) {
-   if (str.length == 0) return 0;
-   int count = 0;
-   for (int i = 0; i < str.length; i++) {
-      if (str.data[i] == c) {
-         count++;
+static void str_decimal_right_shift(StrDecimal* a, unsigned k) {
+   int r = 0;
+   int w = 0;
+   uint64_t n = 0;
+
+   for (; n >> k == 0; r++) {
+      if (r >= a->nd) {
+         if (n == 0) {
+            a->nd = 0;
+            return;
+         }
+         while (n >> k == 0) {
+            n *= 10;
+            r++;
+         }
+         break;
       }
+      n = n * 10 + a->d[r];
    }
-   return count;
+   a->dp -= r - 1;
+
+   uint64_t mask = ((uint64_t)1 << k) - 1;
+   for (; r < a->nd; r++) {
+      uint64_t c = a->d[r];
+      a->d[w++] = (uint8_t)(n >> k);
+      n = (n & mask) * 10 + c;
+   }
+
+   while (n > 0) {
+      uint8_t dig = (uint8_t)(n >> k);
+      n &= mask;
+      if (w < STR_DECIMAL_DIGITS) {
+         a->d[w++] = dig;
+      } else if (dig > 0) {
+         a->trunc = true;
+      }
+      n *= 10;
+   }
+
+   a->nd = w;
+   str_decimal_trim(a);
+}
+
+static void str_decimal_left_shift(StrDecimal* a, unsigned k) {
+   // 2^60 has 19 digits so the result is at most 19 digits longer
+   uint8_t tmp[STR_DECIMAL_DIGITS + 19];
+   int w = a->nd + 19;
+   int top = w;
+   uint64_t n = 0;
+
+   for (int r = a->nd - 1; r >= 0; r--) {
+      n += (uint64_t)a->d[r] << k;
+      uint64_t quo = n / 10;
+      tmp[--w] = (uint8_t)(n - 10 * quo);
+      n = quo;
+   }
+   while (n > 0) {
+      uint64_t quo = n / 10;
+      tmp[--w] = (uint8_t)(n - 10 * quo);
+      n = quo;
+   }
+
+   int length = top - w;
+   a->dp += length - a->nd;
+   if (length > STR_DECIMAL_DIGITS) {
+      for (int i = STR_DECIMAL_DIGITS; i < length; i++) {
+         if (tmp[w + i] != 0) a->trunc = true;
+      }
+      length = STR_DECIMAL_DIGITS;
+   }
+   memcpy(a->d, tmp + w, (size_t)length);
+   a->nd = length;
+   str_decimal_trim(a);
 }
 
-static char* str_to_cstr(String str) {
-   return strndup(str.data, str.length);
+static void str_decimal_shift(StrDecimal* a, int k) {
+   if (a->nd == 0) return;
+   if (k > 0) {
+      for (; k > STR_DECIMAL_MAX_SHIFT; k -= STR_DECIMAL_MAX_SHIFT) {
+         str_decimal_left_shift(a, STR_DECIMAL_MAX_SHIFT);
+      }
+      str_decimal_left_shift(a, (unsigned)k);
+   } else if (k < 0) {
+      for (; k < -STR_DECIMAL_MAX_SHIFT; k += STR_DECIMAL_MAX_SHIFT) {
+         str_decimal_right_shift(a, STR_DECIMAL_MAX_SHIFT);
+      }
+      str_decimal_right_shift(a, (unsigned)-k);
+   }
 }
 
-void str_print(String str) {
-   for (int i = 0; i < str.length; i++) {
-      putc(str.data[i], stdout);
+static bool str_decimal_round_up(StrDecimal* a, int nd) {
+   if (nd < 0 || nd >= a->nd) return false;
+   // exactly halfway, round to even
+   if (a->d[nd] == 5 && nd + 1 == a->nd) {
+      if (a->trunc) return true;
+      return nd > 0 && a->d[nd - 1] % 2 != 0;
+   }
+   return a->d[nd] >= 5;
+}
+
+static uint64_t str_decimal_rounded_integer(StrDecimal* a) {
+   if (a->dp > 20) return UINT64_MAX;
+   int i = 0;
+   uint64_t n = 0;
+   for (; i < a->dp && i < a->nd; i++) n = n * 10 + a->d[i];
+   for (; i < a->dp; i++) n *= 10;
+   if (str_decimal_round_up(a, a->dp)) n++;
+   return n;
+}
+
+static uint64_t str_decimal_float_bits(StrDecimal* d, StrFloatInfo flt) {
+   static const int powtab[] = {1, 3, 6, 9, 13, 16, 19, 23, 26};
+   const int powtab_length = (int)(sizeof(powtab) / sizeof(powtab[0]));
+
+   int exp = 0;
+   uint64_t mant = 0;
+
+   if (d->nd == 0) {
+      exp = flt.bias;
+      goto out;
+   }
+   if (d->dp > 310) goto overflow;
+   if (d->dp < -330) {
+      exp = flt.bias;
+      goto out;
+   }
+
+   // scale to [0.5, 1) keeping track of the binary exponent
+   while (d->dp > 0) {
+      int n = d->dp >= powtab_length ? 27 : powtab[d->dp];
+      str_decimal_shift(d, -n);
+      exp += n;
+   }
+   while (d->dp < 0 || (d->dp == 0 && d->d[0] < 5)) {
+      int n = -d->dp >= powtab_length ? 27 : powtab[-d->dp];
+      str_decimal_shift(d, n);
+      exp -= n;
+   }
+
+   // the float range is [1, 2)
+   exp--;
+
+   // denormal
+   if (exp < flt.bias + 1) {
+      int n = flt.bias + 1 - exp;
+      str_decimal_shift(d, -n);
+      exp += n;
+   }
+
+   if (exp - flt.bias >= (1 << flt.expbits) - 1) goto overflow;
+
+   str_decimal_shift(d, 1 + flt.mantbits);
+   mant = str_decimal_rounded_integer(d);
+
+   // rounding carried into the next power of 2
+   if (mant == (uint64_t)2 << flt.mantbits) {
+      mant >>= 1;
+      exp++;
+      if (exp - flt.bias >= (1 << flt.expbits) - 1) goto overflow;
+   }
+
+   if ((mant & ((uint64_t)1 << flt.mantbits)) == 0) {
+      exp = flt.bias;
+   }
+   goto out;
+
+overflow:
+   mant = 0;
+   exp = (1 << flt.expbits) - 1 + flt.bias;
+
+out:;
+   uint64_t bits = mant & (((uint64_t)1 << flt.mantbits) - 1);
+   bits |= (uint64_t)((exp - flt.bias) & ((1 << flt.expbits) - 1)) << flt.mantbits;
+   if (d->neg) bits |= (uint64_t)1 << flt.mantbits << flt.expbits;
+   return bits;
+}
+
+typedef struct {
+   size_t consumed;
+   bool neg;
+   bool special;
+   double special_value;
+
+   // first 19 significant digits and the power of 10 that goes with them
+   uint64_t mantissa;
+   int64_t exp10;
+   bool many_digits;
+
+   const char* digits;
+   const char* digits_end;
+   const char* point;
+   int64_t exponent;
+} StrFloatScan;
+
+// One pass over the text that collects everything both paths need.
+static bool str_scan_float(String str, StrFloatScan* s) {
+   const char* p = str.data;
+   const char* end = str.data + str.length;
+   *s = (StrFloatScan){0};
+
+   while (p < end && str_is_space(*p)) p++;
+   if (p < end && (*p == '-' || *p == '+')) {
+      s->neg = *p == '-';
+      p++;
+   }
+
+   if (p < end && !str_is_digit(*p) && *p != '.') {
+      if (str_match_nocase(p, end, "infinity")) {
+         s->consumed = (size_t)(p + 8 - str.data);
+      } else if (str_match_nocase(p, end, "inf")) {
+         s->consumed = (size_t)(p + 3 - str.data);
+      } else if (str_match_nocase(p, end, "nan")) {
+         s->consumed = (size_t)(p + 3 - str.data);
+         s->special = true;
+         s->special_value = __builtin_nan("");
+         return true;
+      } else {
+         return false;
+      }
+      s->special = true;
+      s->special_value = __builtin_inf();
+      return true;
+   }
+
+   s->digits = p;
+   int significant = 0;
+   int64_t dropped = 0;
+   int64_t fraction = 0;
+   bool any = false;
+
+   for (; p < end; p++) {
+      char c = *p;
+      if (c == '.') {
+         if (s->point) break;
+         s->point = p;
+         continue;
+      }
+      if (!str_is_digit(c)) break;
+      any = true;
+
+      if (s->point) fraction++;
+      if (c == '0' && significant == 0) continue;
+
+      if (significant < 19) {
+         s->mantissa = s->mantissa * 10 + (uint64_t)(c - '0');
+         significant++;
+      } else {
+         if (c != '0') s->many_digits = true;
+         dropped++;
+      }
+   }
+   if (!any) return false;
+   s->digits_end = p;
+
+   if (p < end && (*p == 'e' || *p == 'E')) {
+      const char* e = p + 1;
+      bool exp_neg = false;
+      if (e < end && (*e == '-' || *e == '+')) {
+         exp_neg = *e == '-';
+         e++;
+      }
+      if (e < end && str_is_digit(*e)) {
+         int64_t exponent = 0;
+         for (; e < end && str_is_digit(*e); e++) {
+            if (exponent < 100000) exponent = exponent * 10 + (*e - '0');
+         }
+         s->exponent = exp_neg ? -exponent : exponent;
+         p = e;
+      }
+   }
+
+   s->exp10 = s->exponent - fraction + dropped;
+   s->consumed = (size_t)(p - str.data);
+   return true;
+}
+
+static void str_scan_to_decimal(const StrFloatScan* s, StrDecimal* d) {
+   d->nd = 0;
+   d->neg = s->neg;
+   d->trunc = false;
+
+   int64_t dp = 0;
+   bool seen_point = false;
+   bool started = false;
+   for (const char* p = s->digits; p < s->digits_end; p++) {
+      if (*p == '.') {
+         seen_point = true;
+         continue;
+      }
+      if (*p == '0' && !started) {
+         // leading zeros after the point only move it
+         if (seen_point) dp--;
+         continue;
+      }
+      started = true;
+      if (!seen_point) dp++;
+
+      if (d->nd < STR_DECIMAL_DIGITS) {
+         d->d[d->nd++] = (uint8_t)(*p - '0');
+      } else if (*p != '0') {
+         d->trunc = true;
+      }
+   }
+
+   dp += s->exponent;
+   if (dp > 100000) dp = 100000;
+   if (dp < -100000) dp = -100000;
+   d->dp = (int)dp;
+   str_decimal_trim(d);
+}
+
+static const double str_pow10_f64[] = {
+   1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static const float str_pow10_f32[] = {
+   1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+};
+
+size_t str_parse_f64(String str, double* out) {
+   StrFloatScan s;
+   if (!str_scan_float(str, &s)) {
+      *out = 0.0;
+      return 0;
    }
+
+   if (s.special) {
+      *out = s.neg ? -s.special_value : s.special_value;
+      return s.consumed;
+   }
+
+   // Clinger's fast path, both the mantissa and the power of 10 are exact doubles so a single
+   // IEEE multiply or divide is correctly rounded.
+   if (!s.many_digits && s.mantissa <= ((uint64_t)1 << 53) && s.exp10 >= -22 && s.exp10 <= 22) {
+      double value = (double)s.mantissa;
+      value = s.exp10 < 0 ? value / str_pow10_f64[-s.exp10] : value * str_pow10_f64[s.exp10];
+      *out = s.neg ? -value : value;
+      return s.consumed;
+   }
+   if (s.mantissa == 0 && !s.many_digits) {
+      *out = s.neg ? -0.0 : 0.0;
+      return s.consumed;
+   }
+
+   StrDecimal d;
+   str_scan_to_decimal(&s, &d);
+   uint64_t bits = str_decimal_float_bits(&d, str_f64_info);
+   memcpy(out, &bits, sizeof(*out));
+   return s.consumed;
+}
+
+size_t str_parse_f32(String str, float* out) {
+   StrFloatScan s;
+   if (!str_scan_float(str, &s)) {
+      *out = 0.0f;
+      return 0;
+   }
+
+   if (s.special) {
+      float value = (float)s.special_value;
+      *out = s.neg ? -value : value;
+      return s.consumed;
+   }
+
+   // parsing to double first would round twice, the fast path has to be done in float
+   if (!s.many_digits && s.mantissa <= ((uint64_t)1 << 24) && s.exp10 >= -10 && s.exp10 <= 10) {
+      float value = (float)s.mantissa;
+      value = s.exp10 < 0 ? value / str_pow10_f32[-s.exp10] : value * str_pow10_f32[s.exp10];
+      *out = s.neg ? -value : value;
+      return s.consumed;
+   }
+   if (s.mantissa == 0 && !s.many_digits) {
+      *out = s.neg ? -0.0f : 0.0f;
+      return s.consumed;
+   }
+
+   StrDecimal d;
+   str_scan_to_decimal(&s, &d);
+   uint32_t bits = (uint32_t)str_decimal_float_bits(&d, str_f32_info);
+   memcpy(out, &bits, sizeof(*out));
+   return s.consumed;
+}
+
+double str_strtod(String* str) {
+   double value = 0.0;
+   str_parse_f64(*str, &value);
+   return value;
+}
+
+int str_strtoi(String str) {
+   int64_t value = 0;
+   str_parse_i64(str, &value);
+   if (value > INT32_MAX) return INT32_MAX;
+   if (value < INT32_MIN) return INT32_MIN;
+   return (int)value;
+}
+
+void str_print(String str) {
+   fwrite(str.data, 1, str.length, stdout);
    putc('\n', stdout);
 }
 
 void str_debug(String str, char* name) {
-   char* buf;
    printf("String %s debug:\n", name);
-   printf("   \"%s\"\n", (buf = str_to_cstr(str)));
+   printf("   \"%.*s\"\n", (int)str.length, str.data);
    printf("   length: %lu\n", str.length);
-   free(buf);
 }
 
 #endif
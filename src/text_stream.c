@@ -0,0 +1,126 @@
+#include "text_stream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "async_io.h"
+#include "memory.h"
+#include "str.h"
+
+// Starts reading the next chunk into the buffer that isn't current.
+static void _text_stream_prefetch(TextStream* stream) {
+   if (stream->read_offset >= stream->file_size) return;
+
+   Size length = stream->file_size - stream->read_offset;
+   if (length > stream->chunk_size) length = stream->chunk_size;
+
+   u8* dst = stream->buffers[stream->current ^ 1] + stream->chunk_size;
+   if (!async_io_read(&stream->io, stream->fd, stream->read_offset, dst, length, 0)) return;
+   async_io_submit(&stream->io);
+   stream->read_offset += length;
+   stream->pending = true;
+}
+
+bool text_stream_open(TextStream* stream, const char* path, Size chunk_size, Allocator* allocator) {
+   *stream = (TextStream){.fd = -1, .chunk_size = chunk_size, .allocator = allocator};
+
+   stream->fd = open(path, O_RDONLY | O_CLOEXEC);
+   if (stream->fd < 0) return false;
+
+   struct stat st;
+   if (fstat(stream->fd, &st) != 0) {
+      close(stream->fd);
+      return false;
+   }
+   stream->file_size = (Size)st.st_size;
+   posix_fadvise(stream->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+   stream->buffer_size = chunk_size * 2;
+   stream->buffers[0] = allocator->alloc(stream->buffer_size, allocator->ctx);
+   stream->buffers[1] = allocator->alloc(stream->buffer_size, allocator->ctx);
+   if (!stream->buffers[0] || !stream->buffers[1] || !async_io_init(&stream->io, 1, false)) {
+      int error = stream->buffers[0] && stream->buffers[1] ? EAGAIN : ENOMEM;
+      for (int i = 0; i < 2; i++) {
+         if (stream->buffers[i]) allocator->free(stream->buffer_size, stream->buffers[i], allocator->ctx);
+      }
+      close(stream->fd);
+      *stream = (TextStream){.fd = -1};
+      errno = error;
+      return false;
+   }
+
+   // the first refill switches to buffer 0, so that is where the first chunk goes
+   stream->current = 1;
+   stream->window = str_make((char*)stream->buffers[0] + chunk_size, 0);
+   _text_stream_prefetch(stream);
+   return true;
+}
+
+void text_stream_close(TextStream* stream) {
+   // waits for a prefetch still in flight
+   async_io_destroy(&stream->io);
+   for (int i = 0; i < 2; i++) {
+      if (stream->buffers[i]) stream->allocator->free(stream->buffer_size, stream->buffers[i], stream->allocator->ctx);
+   }
+   if (stream->fd >= 0) close(stream->fd);
+   *stream = (TextStream){.fd = -1};
+}
+
+bool text_stream_refill(TextStream* stream) {
+   if (stream->error || !stream->pending) return false;
+
+   if (stream->window.length > (size_t)stream->chunk_size) {
+      stream->error = E2BIG;
+      return false;
+   }
+
+   AsyncIoCompletion done;
+   while (async_io_wait(&stream->io, &done, 1) == 0) {}
+   stream->pending = false;
+   if (done.error) {
+      stream->error = done.error;
+      return false;
+   }
+
+   // carry the unfinished record over to sit right in front of the new chunk
+   int next = stream->current ^ 1;
+   u8* chunk = stream->buffers[next] + stream->chunk_size;
+   u8* start = chunk - stream->window.length;
+   memcpy(start, stream->window.data, stream->window.length);
+
+   stream->window = str_make((char*)start, stream->window.length + (size_t)done.bytes);
+   stream->current = next;
+
+   // the old buffer is free now, start on the chunk after this one
+   _text_stream_prefetch(stream);
+   return done.bytes > 0 || stream->pending;
+}
+
+bool text_stream_next(TextStream* stream, char delim, String* record) {
+   size_t searched = 0;
+   for (;;) {
+      String rest = str_make(stream->window.data + searched, stream->window.length - searched);
+      if (str_find_char(rest, delim) < rest.length) {
+         *record = str_chop_delim(&stream->window, delim);
+         return true;
+      }
+      // no need to look through the carried part again
+      searched = stream->window.length;
+      if (!text_stream_refill(stream)) break;
+   }
+
+   if (stream->error || stream->window.length == 0) return false;
+   *record = stream->window;
+   stream->window.data += stream->window.length;
+   stream->window.length = 0;
+   return true;
+}
+
+bool text_stream_next_line(TextStream* stream, String* line) {
+   if (!text_stream_next(stream, '\n', line)) return false;
+   if (line->length && line->data[line->length - 1] == '\r') line->length--;
+   return true;
+}
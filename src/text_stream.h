@@ -0,0 +1,53 @@
+#pragma once
+
+#include "async_io.h"
+#include "memory.h"
+#include "str.h"
+
+// Streaming text reader
+//
+// Reads a file of any size through two fixed buffers, so parsing a multi GB OBJ needs the same
+// memory as a small one. window is a view of the data read so far that hasn't been consumed, it
+// can be chopped with the str_chop_* helpers directly. Once it holds no complete record call
+// text_stream_refill: what is left of the window is carried over in front of the next chunk so
+// records that straddle a chunk boundary come out whole. While one buffer is being parsed the
+// next chunk is already being read into the other.
+//
+//    String line;
+//    while (text_stream_next_line(&stream, &line)) { ... }
+//
+// Records have to fit in chunk_size bytes, a longer one stops the stream with error E2BIG.
+
+typedef struct {
+   String window;
+   int error; // errno value, 0 while things are fine
+
+   int fd;
+   Size file_size;
+   Size read_offset; // where the next chunk starts in the file
+   Size chunk_size;
+
+   // each buffer is chunk_size bytes of room for the carried over record followed by the chunk
+   u8* buffers[2];
+   Size buffer_size;
+   int current;
+   bool pending;
+
+   AsyncIo io;
+   Allocator* allocator;
+} TextStream;
+
+// Returns false with errno set if the file can't be opened.
+bool text_stream_open(TextStream* stream, const char* path, Size chunk_size, Allocator* allocator);
+void text_stream_close(TextStream* stream);
+
+// Appends the next chunk to what is left of the window. Returns false at the end of the file or
+// on error, the window is left as it was.
+bool text_stream_refill(TextStream* stream);
+
+// The next record up to but not including delim, refilling as needed. The last record doesn't
+// need a delim after it. The view is only valid until the next call.
+bool text_stream_next(TextStream* stream, char delim, String* record);
+
+// Same as next with '\n', also drops the '\r' of CRLF line endings.
+bool text_stream_next_line(TextStream* stream, String* line);
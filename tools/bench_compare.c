@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file.h"
+#include "str.h"
+
+// Compares a scene benchmark result against a baseline, see ./bench-scenes.
+//
+//    bench_compare [-t percent] baseline.json result.json
+//
+// Every timing and memory metric is lower is better. One that got worse by more than percent
+// (10 by default) is a regression and the exit status is 1.
+
+#define COMPARE_MAX_METRICS 128
+#define COMPARE_MAX_DEPTH 8
+#define COMPARE_MAX_NAME 96
+
+typedef struct {
+   char name[COMPARE_MAX_NAME];
+   double value;
+} Metric;
+
+typedef struct {
+   Metric metrics[COMPARE_MAX_METRICS];
+   Size count;
+   char scene[COMPARE_MAX_NAME];
+} Result;
+
+// compared, the rest are parameters or too noisy to judge on
+static const char* watched[] = {
+   "frame_ms.mean", "frame_ms.p50", "frame_ms.p90", "frame_ms.p99",
+   "cpu_ms.mean", "cpu_ms.p50", "cpu_ms.p90", "cpu_ms.p99",
+   "gpu_ms.mean", "gpu_ms.p50", "gpu_ms.p90", "gpu_ms.p99",
+   "memory.allocations", "memory.peak_bytes",
+   "memory.vulkan_host_allocations", "memory.vulkan_host_peak_bytes", "memory.peak_rss_kib",
+};
+
+static int usage(void) {
+   fprintf(stderr, "usage: bench_compare [-t percent] baseline.json result.json\n");
+   return 2;
+}
+
+static void skip_space(String* in) {
+   while (in->length > 0 && (*in->data == ' ' || *in->data == '\n' || *in->data == '\r' || *in->data == '\t')) {
+      in->data++;
+      in->length--;
+   }
+}
+
+// no escapes, the results never have any
+static bool read_string(String* in, String* out) {
+   if (in->length == 0 || *in->data != '"') return false;
+   String rest = str_make(in->data + 1, in->length - 1);
+   if (str_find_char(rest, '"') == rest.length) return false;
+   *out = str_chop_delim(&rest, '"');
+   *in = rest;
+   return true;
+}
+
+// Flattens nested objects into dotted names of their numbers, e.g. frame_ms.p99. Only what the
+// benchmark writes is understood, objects, strings and numbers.
+static bool parse_result(String in, Result* out) {
+   String path[COMPARE_MAX_DEPTH];
+   Size depth = 0;
+   String key = {0};
+   bool expectKey = false;
+
+   while (skip_space(&in), in.length > 0) {
+      char c = *in.data;
+      if (c == '{') {
+         if (depth == COMPARE_MAX_DEPTH) return false;
+         path[depth++] = key;
+         expectKey = true;
+         in.data++;
+         in.length--;
+      } else if (c == '}') {
+         if (depth == 0) return false;
+         depth--;
+         in.data++;
+         in.length--;
+      } else if (c == ',') {
+         expectKey = true;
+         in.data++;
+         in.length--;
+      } else if (c == ':') {
+         expectKey = false;
+         in.data++;
+         in.length--;
+      } else if (c == '"') {
+         String value;
+         if (!read_string(&in, &value)) return false;
+         if (expectKey) {
+            key = value;
+         } else if (depth == 1 && str_eq_cstr(&key, "scene")) {
+            snprintf(out->scene, sizeof(out->scene), "%.*s", (int)value.length, value.data);
+         }
+      } else {
+         double value = 0.0;
+         Size used = (Size)str_parse_f64(in, &value);
+         if (used == 0) return false;
+         in.data += used;
+         in.length -= used;
+         if (out->count == COMPARE_MAX_METRICS) continue;
+
+         // a dotted name that doesn't fit makes the whole result bad, not a cut off name
+         Metric* metric = &out->metrics[out->count++];
+         size_t length = 0;
+         for (Size i = 1; i < depth; i++) {
+            int written = snprintf(metric->name + length, sizeof(metric->name) - length, "%.*s.", (int)path[i].length, path[i].data);
+            if (written < 0 || (size_t)written >= sizeof(metric->name) - length) return false;
+            length += (size_t)written;
+         }
+         int written = snprintf(metric->name + length, sizeof(metric->name) - length, "%.*s", (int)key.length, key.data);
+         if (written < 0 || (size_t)written >= sizeof(metric->name) - length) return false;
+         metric->value = value;
+      }
+   }
+   return depth == 0;
+}
+
+static bool load_result(const char* path, Result* out) {
+   MappedFileResult mapped = map_file(path, FILE_ADVICE_SEQUENTIAL);
+   if (!mapped.ok) {
+      fprintf(stderr, "failed to open %s\n", path);
+      return false;
+   }
+   MappedFile file = mapped.value;
+   *out = (Result){0};
+   bool ok = parse_result(mapped_file_string(&file), out);
+   unmap_file(&file);
+   if (!ok) fprintf(stderr, "%s is not a benchmark result\n", path);
+   return ok;
+}
+
+static const Metric* find_metric(const Result* r, const char* name) {
+   for (Size i = 0; i < r->count; i++) {
+      if (strcmp(r->metrics[i].name, name) == 0) return &r->metrics[i];
+   }
+   return nullptr;
+}
+
+int main(int argc, char** argv) {
+   double threshold = 10.0;
+   int arg = 1;
+   if (arg + 1 < argc && strcmp(argv[arg], "-t") == 0) {
+      threshold = strtod(argv[arg + 1], nullptr);
+      arg += 2;
+   }
+   if (argc - arg != 2) return usage();
+
+   static Result baseline;
+   static Result result;
+   if (!load_result(argv[arg], &baseline) || !load_result(argv[arg + 1], &result)) return 2;
+
+   printf("%s, regressions beyond %.1f%%\n", result.scene[0] ? result.scene : argv[arg + 1], threshold);
+   int regressions = 0;
+   for (Size i = 0; i < lengthof(watched); i++) {
+      const Metric* before = find_metric(&baseline, watched[i]);
+      const Metric* after = find_metric(&result, watched[i]);
+      if (!before || !after) continue;
+
+      // nothing to scale against, e.g. no GPU timestamps on either run
+      if (before->value == 0.0) {
+         if (after->value != 0.0) printf("   %-32s %14.4f %14.4f        new\n", watched[i], before->value, after->value);
+         continue;
+      }
+
+      double change = (after->value - before->value) / before->value * 100.0;
+      const char* verdict = "";
+      if (change > threshold) {
+         verdict = "REGRESSION";
+         regressions++;
+      } else if (change < -threshold) {
+         verdict = "improved";
+      }
+      printf("   %-32s %14.4f %14.4f %+9.1f%% %s\n", watched[i], before->value, after->value, change, verdict);
+   }
+   return regressions > 0;
+}
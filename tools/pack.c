@@ -0,0 +1,93 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file.h"
+#include "memory.h"
+#include "pack.h"
+
+// Packs files into an asset pack (see src/pack.h), or lists one.
+//
+//    pack [-c] [-C root] out.pack files...   -c compresses, names are relative to root
+//    pack -l in.pack
+
+static int usage(void) {
+   fprintf(stderr, "usage: pack [-c] [-C root] out.pack files...\n       pack -l in.pack\n");
+   return EXIT_FAILURE;
+}
+
+static int list(const char* path) {
+   PackResult opened = pack_open(path);
+   if (!opened.ok) {
+      fprintf(stderr, "failed to open %s: %s\n", path, strerror(opened.error));
+      return EXIT_FAILURE;
+   }
+   Pack pack = opened.value;
+
+   u32 cursor = 0;
+   const PackEntry* entry;
+   while ((entry = pack_next(&pack, &cursor))) {
+      String name = pack_entry_name(&pack, entry);
+      printf("%10llu %10llu %s %.*s\n", (unsigned long long)entry->size, (unsigned long long)entry->stored_size,
+             entry->flags & PACK_ENTRY_COMPRESSED ? "lz" : "--", (int)name.length, name.data);
+   }
+   printf("%u entries, %llu bytes\n", pack.header->entry_count, (unsigned long long)pack.header->file_size);
+
+   pack_close(&pack);
+   return 0;
+}
+
+int main(int argc, char** argv) {
+   bool compress = false;
+   const char* root = nullptr;
+
+   int arg = 1;
+   for (; arg < argc && argv[arg][0] == '-'; arg++) {
+      if (strcmp(argv[arg], "-l") == 0) {
+         return arg + 1 < argc ? list(argv[arg + 1]) : usage();
+      } else if (strcmp(argv[arg], "-c") == 0) {
+         compress = true;
+      } else if (strcmp(argv[arg], "-C") == 0 && arg + 1 < argc) {
+         root = argv[++arg];
+      } else {
+         return usage();
+      }
+   }
+   if (argc - arg < 2) return usage();
+
+   const char* out = argv[arg++];
+   Size count = argc - arg;
+   PackInput* inputs = calloc((size_t)count, sizeof(PackInput));
+   MappedFile* files = calloc((size_t)count, sizeof(MappedFile));
+
+   Size root_length = root ? (Size)strlen(root) : 0;
+   for (Size i = 0; i < count; i++) {
+      const char* path = argv[arg + i];
+      MappedFileResult mapped = map_file(path, FILE_ADVICE_SEQUENTIAL);
+      if (!mapped.ok) {
+         fprintf(stderr, "failed to open %s: %s\n", path, strerror(mapped.error));
+         return EXIT_FAILURE;
+      }
+      files[i] = mapped.value;
+
+      const char* name = path;
+      if (root && strncmp(path, root, (size_t)root_length) == 0 && path[root_length] == '/') {
+         name = path + root_length + 1;
+      }
+      inputs[i] = (PackInput){name, files[i].data, files[i].length};
+   }
+
+   Allocator allocator = stdlib_allocator();
+   if (!pack_write(out, inputs, count, compress, &allocator)) {
+      fprintf(stderr, "failed to write %s: %s\n", out, strerror(errno));
+      return EXIT_FAILURE;
+   }
+
+   for (Size i = 0; i < count; i++) {
+      unmap_file(&files[i]);
+   }
+   free(files);
+   free(inputs);
+   return list(out);
+}